@@ -0,0 +1,162 @@
+// bin/decoder-hash-benchmark.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Benchmark the types of hash that LatticeFasterDecoder can use to look\n"
+        "up tokens (see the --hash-type option of the decoding programs).  All\n"
+        "the log-likelihoods are read into memory, and then decoded with each\n"
+        "hash type in turn; the time taken by the decoder is printed for each,\n"
+        "and we check that the best paths have the same cost.\n"
+        "Usage: decoder-hash-benchmark [options] <trans-model-in> <fst-in> "
+        "<loglikes-rspecifier>\n"
+        "e.g.: decoder-hash-benchmark --hash-types=chained,probing,direct \\\n"
+        "   final.mdl HCLG.fst ark:loglikes.ark\n";
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 0.1;
+    std::string hash_types_str = "chained,probing,direct";
+    int32 num_repeats = 1;
+    LatticeFasterDecoderConfig config;
+
+    config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("hash-types", &hash_types_str, "Comma-separated list of the "
+                "hash types to benchmark; the first is the baseline.");
+    po.Register("num-repeats", &num_repeats, "Number of times to decode the "
+                "data with each hash type (the fastest time is reported).");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        loglikes_rspecifier = po.GetArg(3);
+
+    std::vector<std::string> hash_types;
+    SplitStringToVector(hash_types_str, ",", true, &hash_types);
+    if (hash_types.empty() || num_repeats < 1)
+      KALDI_ERR << "Invalid options --hash-types=" << hash_types_str
+                << " --num-repeats=" << num_repeats;
+    for (size_t i = 0; i < hash_types.size(); i++) {
+      HashListIndexType type;
+      if (!HashListIndexTypeFromString(hash_types[i], &type))
+        KALDI_ERR << "Invalid hash type " << hash_types[i];
+    }
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+
+    std::vector<std::string> utts;
+    std::vector<Matrix<BaseFloat>* > loglikes;
+    int64 frame_count = 0;
+    SequentialBaseFloatMatrixReader loglike_reader(loglikes_rspecifier);
+    for (; !loglike_reader.Done(); loglike_reader.Next()) {
+      if (loglike_reader.Value().NumRows() == 0) {
+        KALDI_WARN << "Zero-length utterance: " << loglike_reader.Key();
+        continue;
+      }
+      utts.push_back(loglike_reader.Key());
+      loglikes.push_back(new Matrix<BaseFloat>(loglike_reader.Value()));
+      frame_count += loglikes.back()->NumRows();
+    }
+    if (utts.empty())
+      KALDI_ERR << "No utterances to decode.";
+    KALDI_LOG << "Read " << utts.size() << " utterances with " << frame_count
+              << " frames.";
+
+    // best_costs[i] is the cost of the best path of utterance i with the
+    // first hash type (or infinity if no best path was found).
+    std::vector<double> best_costs(utts.size());
+    std::vector<double> elapsed(hash_types.size());
+    for (size_t h = 0; h < hash_types.size(); h++) {
+      config.hash_type = hash_types[h];
+      // The decoder is shared between utterances, as in the decoding
+      // programs, so that its memory gets reused.
+      LatticeFasterDecoder decoder(*decode_fst, config);
+      int32 num_mismatch = 0;
+      for (int32 r = 0; r < num_repeats; r++) {
+        double this_elapsed = 0.0;
+        for (size_t i = 0; i < utts.size(); i++) {
+          DecodableMatrixScaledMapped decodable(trans_model, *(loglikes[i]),
+                                                acoustic_scale);
+          Timer timer;
+          decoder.Decode(&decodable);
+          this_elapsed += timer.Elapsed();
+          if (r != 0)
+            continue;
+          double cost = std::numeric_limits<double>::infinity();
+          Lattice decoded;
+          if (decoder.GetBestPath(&decoded) && decoded.NumStates() != 0) {
+            std::vector<int32> alignment, words;
+            LatticeWeight weight;
+            GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
+            cost = weight.Value1() + weight.Value2();
+          }
+          if (h == 0) {
+            best_costs[i] = cost;
+          } else if (!ApproxEqual(cost, best_costs[i])) {
+            KALDI_WARN << "For utterance " << utts[i] << ", best-path cost "
+                       << "with hash type " << hash_types[h] << " is "
+                       << cost << " vs. " << best_costs[i] << " with "
+                       << hash_types[0];
+            num_mismatch++;
+          }
+        }
+        if (r == 0 || this_elapsed < elapsed[h])
+          elapsed[h] = this_elapsed;
+      }
+      KALDI_LOG << "Hash type " << hash_types[h] << ": decoding took "
+                << elapsed[h] << "s, real-time factor assuming 100 frames/sec "
+                << "is " << (elapsed[h] * 100.0 / frame_count)
+                << "; speedup versus " << hash_types[0] << " is "
+                << (elapsed[0] / elapsed[h]);
+      if (num_mismatch != 0)
+        KALDI_WARN << "Best-path costs differed for " << num_mismatch
+                   << " utterances";
+    }
+
+    DeletePointers(&loglikes);
+    delete decode_fst;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
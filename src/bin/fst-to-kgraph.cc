@@ -0,0 +1,83 @@
+// bin/fst-to-kgraph.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert a decoding graph (e.g. HCLG.fst) to the compiled format that\n"
+        "is faster to decode with (see fstext/compiled-fst.h).  With\n"
+        "--use-pdf-labels=true (the default), the ilabels of the graph are\n"
+        "also mapped to pdf-ids, which the decoder uses to look up the\n"
+        "likelihoods; such a graph can only be used by programs that support it\n"
+        "(e.g. latgen-faster-mapped); other programs that use\n"
+        "LatticeFasterDecoder will report an error.  The lattices are the same\n"
+        "as when decoding with the original graph.\n"
+        "\n"
+        "Usage:  fst-to-kgraph [options] <model-in> <fst-in> <kgraph-out>\n"
+        "e.g.: fst-to-kgraph final.mdl HCLG.fst HCLG.kgraph\n";
+    ParseOptions po(usage);
+    bool use_pdf_labels = true;
+    po.Register("use-pdf-labels", &use_pdf_labels, "If true, store the pdf-id "
+                "(plus one) for each emitting arc, for looking up the "
+                "likelihoods.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        kgraph_out_filename = po.GetArg(3);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    fst::Fst<fst::StdArc> *fst = fst::ReadFstKaldiGeneric(fst_in_filename);
+
+    std::vector<int32> pdf_labels(trans_model.NumTransitionIds() + 1, 0);
+    for (int32 tid = 1; tid <= trans_model.NumTransitionIds(); tid++)
+      pdf_labels[tid] = trans_model.TransitionIdToPdf(tid) + 1;
+
+    fst::CompiledFst compiled_fst(*fst, (use_pdf_labels ? &pdf_labels : NULL),
+                                  trans_model.NumPdfs());
+    delete fst;
+
+    if (!compiled_fst.Write(kgraph_out_filename))
+      KALDI_ERR << "Error writing compiled FST to "
+                << PrintableWxfilename(kgraph_out_filename);
+
+    KALDI_LOG << "Wrote compiled FST with " << compiled_fst.NumStates()
+              << " states to " << PrintableWxfilename(kgraph_out_filename);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
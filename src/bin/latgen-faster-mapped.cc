@@ -49,12 +49,16 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wspecifier;
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("search-stats-wspecifier", &search_stats_wspecifier,
+                "If supplied, write per-frame statistics of the decoder's "
+                "search (see SearchStatsToMatrix() in "
+                "decoder/lattice-faster-decoder.h) to here, as matrices.");
 
     po.Read(argc, argv);
 
@@ -85,6 +89,8 @@ int main(int argc, char *argv[]) {
 
     Int32VectorWriter alignment_writer(alignment_wspecifier);
 
+    BaseFloatMatrixWriter search_stats_writer(search_stats_wspecifier);
+
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_filename != "")
       if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
@@ -99,10 +105,17 @@ int main(int argc, char *argv[]) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+      // If the graph was compiled by fst-to-kgraph with pdf labels, the decoder
+      // will look up the likelihoods by pdf-id (plus one).
+      const fst::CompiledFst *compiled_fst =
+          dynamic_cast<const fst::CompiledFst*>(decode_fst);
+      bool use_pdf_labels = (compiled_fst != NULL &&
+                             compiled_fst->HasPdfLabels());
       timer.Reset();
 
       {
         LatticeFasterDecoder decoder(*decode_fst, config);
+        decoder.SetRecordSearchStats(search_stats_writer.IsOpen());
 
         for (; !loglike_reader.Done(); loglike_reader.Next()) {
           std::string utt = loglike_reader.Key();
@@ -114,7 +127,12 @@ int main(int argc, char *argv[]) {
             continue;
           }
 
-          DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+          DecodableMatrixScaledMapped mapped_decodable(trans_model, loglikes,
+                                                       acoustic_scale);
+          DecodableMatrixScaled pdf_decodable(loglikes, acoustic_scale);
+          DecodableInterface &decodable = (use_pdf_labels ?
+              static_cast<DecodableInterface&>(pdf_decodable) :
+              static_cast<DecodableInterface&>(mapped_decodable));
 
           double like;
           if (DecodeUtteranceLatticeFaster(
@@ -126,6 +144,11 @@ int main(int argc, char *argv[]) {
             frame_count += loglikes.NumRows();
             num_success++;
           } else num_fail++;
+          if (search_stats_writer.IsOpen()) {
+            Matrix<BaseFloat> search_stats;
+            SearchStatsToMatrix(decoder.SearchStats(), &search_stats);
+            search_stats_writer.Write(utt, search_stats);
+          }
         }
       }
       delete decode_fst; // delete this only after decoder goes out of scope.
@@ -147,6 +170,7 @@ int main(int argc, char *argv[]) {
           continue;
         }
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
+        decoder.SetRecordSearchStats(search_stats_writer.IsOpen());
         DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
         double like;
         if (DecodeUtteranceLatticeFaster(
@@ -157,6 +181,11 @@ int main(int argc, char *argv[]) {
           frame_count += loglikes.NumRows();
           num_success++;
         } else num_fail++;
+        if (search_stats_writer.IsOpen()) {
+          Matrix<BaseFloat> search_stats;
+          SearchStatsToMatrix(decoder.SearchStats(), &search_stats);
+          search_stats_writer.Write(utt, search_stats);
+        }
       }
     }
 
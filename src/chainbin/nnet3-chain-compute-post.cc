@@ -111,6 +111,7 @@ int main(int argc, char *argv[]) {
         ivector_rspecifier, utt2spk_rspecifier);
 
     CachingOptimizingCompiler compiler(nnet, opts.optimize_config);
+    ReadComputationCache(opts, nnet, &compiler);
 
     chain::ChainTrainingOptions chain_opts;
     // the only option that actually gets used here is
@@ -37,7 +37,8 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
   DecodableMatrixScaledMapped(const TransitionModel &tm,
                               const Matrix<BaseFloat> &likes,
                               BaseFloat scale): trans_model_(tm), likes_(&likes),
-                                                scale_(scale), delete_likes_(false) {
+                                                scale_(scale), delete_likes_(false),
+                                                row_frame_(-1) {
     if (likes.NumCols() != tm.NumPdfs())
       KALDI_ERR << "DecodableMatrixScaledMapped: mismatch, matrix has "
                 << likes.NumCols() << " rows but transition-model has "
@@ -50,7 +51,7 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
                               BaseFloat scale,
                               const Matrix<BaseFloat> *likes):
       trans_model_(tm), likes_(likes),
-      scale_(scale), delete_likes_(true) {
+      scale_(scale), delete_likes_(true), row_frame_(-1) {
     if (likes->NumCols() != tm.NumPdfs())
       KALDI_ERR << "DecodableMatrixScaledMapped: mismatch, matrix has "
                 << likes->NumCols() << " rows but transition-model has "
@@ -69,6 +70,15 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
     return scale_ * (*likes_)(frame, trans_model_.TransitionIdToPdf(tid));
   }
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    if (frame != row_frame_) {
+      row_.Resize(trans_model_.NumTransitionIds(), kUndefined);
+      trans_model_.MapPdfsToTransitionIds(likes_->Row(frame), scale_, &row_);
+      row_frame_ = frame;
+    }
+    return row_.Data();
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
@@ -80,6 +90,10 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
   const Matrix<BaseFloat> *likes_;
   BaseFloat scale_;
   bool delete_likes_;
+  // row_ is the scaled log-likelihoods of frame row_frame_, indexed by
+  // transition-id minus one; it is used by LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixScaledMapped);
 };
 
@@ -95,7 +109,8 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
 class DecodableMatrixMappedOffset: public DecodableInterface {
  public:
   DecodableMatrixMappedOffset(const TransitionModel &tm):
-      trans_model_(tm), frame_offset_(0), input_is_finished_(false) { }  
+      trans_model_(tm), frame_offset_(0), input_is_finished_(false),
+      row_frame_(-1) { }
 
 
 
@@ -151,6 +166,17 @@ class DecodableMatrixMappedOffset: public DecodableInterface {
     return loglikes_(index, trans_model_.TransitionIdToPdf(tid));
   }
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    if (frame != row_frame_) {
+      int32 index = frame - frame_offset_;
+      KALDI_ASSERT(index >= 0 && index < loglikes_.NumRows());
+      row_.Resize(trans_model_.NumTransitionIds(), kUndefined);
+      trans_model_.MapPdfsToTransitionIds(loglikes_.Row(index), 1.0, &row_);
+      row_frame_ = frame;
+    }
+    return row_.Data();
+  }
+
                  
                  
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
@@ -162,6 +188,10 @@ class DecodableMatrixMappedOffset: public DecodableInterface {
   Matrix<BaseFloat> loglikes_;
   int32 frame_offset_;
   bool input_is_finished_;
+  // row_ is the log-likelihoods of frame row_frame_, indexed by
+  // transition-id minus one; it is used by LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixMappedOffset);
 };
 
@@ -170,7 +200,7 @@ class DecodableMatrixScaled: public DecodableInterface {
  public:
   DecodableMatrixScaled(const Matrix<BaseFloat> &likes,
                         BaseFloat scale):
-    likes_(likes), scale_(scale) { }
+    likes_(likes), scale_(scale), row_frame_(-1) { }
   
   virtual int32 NumFramesReady() const { return likes_.NumRows(); }
   
@@ -189,12 +219,29 @@ class DecodableMatrixScaled: public DecodableInterface {
     return scale_ * likes_(frame, index - 1);
   }
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    KALDI_ASSERT(frame >= 0 && frame < likes_.NumRows());
+    if (scale_ == 1.0)
+      return likes_.RowData(frame);
+    if (frame != row_frame_) {
+      row_.Resize(likes_.NumCols(), kUndefined);
+      row_.CopyFromVec(likes_.Row(frame));
+      row_.Scale(scale_);
+      row_frame_ = frame;
+    }
+    return row_.Data();
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return likes_.NumCols(); }
 
  private:
   const Matrix<BaseFloat> &likes_;
   BaseFloat scale_;
+  // row_ is the scaled log-likelihoods of frame row_frame_; it is used by
+  // LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixScaled);
 };
 
@@ -23,8 +23,91 @@
 
 namespace kaldi {
 
+// Appends 'b' to 'a', which may be empty.
+template<class Arc>
+static void AppendLattice(const fst::VectorFst<Arc> &b,
+                          fst::VectorFst<Arc> *a) {
+  if (a->Start() == fst::kNoStateId)
+    *a = b;
+  else
+    fst::Concat(a, b);
+}
 
-
+// This is called by the decoding wrappers below when the --flush-interval
+// option is set.  It decodes 'decodable' with 'decoder', every
+// config.flush_interval frames outputting the part of the lattice that all the
+// surviving paths share (see LatticeFasterDecoder::FlushRawLattice()), so that
+// the memory used does not grow with the length of the utterance.  It outputs
+// the lattice for the whole utterance to 'clat' if determinize == true (the
+// parts are determinized separately), else to 'lat'; and its best path to
+// 'best_path'.  The lattices are not acoustically rescaled.  Returns false if
+// the decoding failed.
+static bool DecodeWithLatticeFlushing(const TransitionModel &trans_model,
+                                      const std::string &utt,
+                                      bool determinize,
+                                      LatticeFasterDecoder *decoder,
+                                      DecodableInterface *decodable,
+                                      Lattice *lat,
+                                      CompactLattice *clat,
+                                      Lattice *best_path) {
+  const LatticeFasterDecoderConfig &config = decoder->GetOptions();
+  KALDI_ASSERT(config.flush_interval > 0);
+  lat->DeleteStates();
+  clat->DeleteStates();
+  int32 num_flushed = 0;
+  // 'part' is the part of the lattice we are currently dealing with.
+  Lattice part;
+  decoder->InitDecoding();
+  while (true) {
+    int32 num_frames_decoded = decoder->NumFramesDecoded();
+    decoder->AdvanceDecoding(decodable, config.flush_interval);
+    if (decoder->NumFramesDecoded() == num_frames_decoded ||
+        decodable->IsLastFrame(decoder->NumFramesDecoded() - 1))
+      break;
+    bool force = (config.flush_max_frames > 0 &&
+                  decoder->NumFramesDecoded() - decoder->NumFramesFlushed() >
+                  config.flush_max_frames);
+    if (decoder->FlushRawLattice(config.flush_delay, force, &part)) {
+      fst::Connect(&part);
+      if (determinize) {
+        CompactLattice cpart;
+        if (!DeterminizeLatticePhonePrunedWrapper(
+                trans_model, &part, config.lattice_beam, &cpart,
+                config.det_opts))
+          KALDI_WARN << "Determinization finished earlier than the beam for "
+                     << "utterance " << utt;
+        AppendLattice(cpart, clat);
+      } else {
+        AppendLattice(part, lat);
+      }
+      num_flushed++;
+    }
+  }
+  decoder->FinalizeDecoding();
+  if (!decoder->GetRawLattice(&part) || part.NumStates() == 0) {
+    KALDI_WARN << "Failed to decode file " << utt;
+    return false;
+  }
+  fst::Connect(&part);
+  if (determinize) {
+    CompactLattice cpart;
+    if (!DeterminizeLatticePhonePrunedWrapper(
+            trans_model, &part, config.lattice_beam, &cpart,
+            config.det_opts))
+      KALDI_WARN << "Determinization finished earlier than the beam for "
+                 << "utterance " << utt;
+    AppendLattice(cpart, clat);
+    CompactLattice cbest_path;
+    CompactLatticeShortestPath(*clat, &cbest_path);
+    ConvertLattice(cbest_path, best_path);
+  } else {
+    AppendLattice(part, lat);
+    fst::ShortestPath(*lat, best_path);
+  }
+  KALDI_VLOG(1) << "For utterance " << utt << ", flushed the lattice "
+                << num_flushed << " times.";
+  return (best_path->NumStates() != 0);
+}
 
 
 DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
@@ -56,7 +139,7 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     num_done_(num_done), num_err_(num_err),
     num_partial_(num_partial),
     computed_(false), success_(false), partial_(false),
-    clat_(NULL), lat_(NULL) { }
+    clat_(NULL), lat_(NULL), best_path_(NULL) { }
 
 
 void DecodeUtteranceLatticeFasterClass::operator () () {
@@ -65,7 +148,22 @@ void DecodeUtteranceLatticeFasterClass::operator () () {
   // calling code.
   success_ = true;
   using fst::VectorFst;
-  if (!decoder_->Decode(decodable_)) {
+  if (decoder_->GetOptions().flush_interval > 0) {
+    lat_ = new Lattice;
+    clat_ = new CompactLattice;
+    best_path_ = new Lattice;
+    if (!DecodeWithLatticeFlushing(*trans_model_, utt_, determinize_,
+                                   decoder_, decodable_, lat_, clat_,
+                                   best_path_))
+      success_ = false;
+    if (determinize_) {
+      delete lat_;
+      lat_ = NULL;
+    } else {
+      delete clat_;
+      clat_ = NULL;
+    }
+  } else if (!decoder_->Decode(decodable_)) {
     KALDI_WARN << "Failed to decode file " << utt_;
     success_ = false;
   }
@@ -83,6 +181,19 @@ void DecodeUtteranceLatticeFasterClass::operator () () {
   }
   if (!success_) return;
 
+  if (best_path_ != NULL) {  // we already have the lattice.
+    // We'll write the lattice without acoustic scaling.
+    if (acoustic_scale_ != 0.0) {
+      if (determinize_)
+        fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                          clat_);
+      else
+        fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                          lat_);
+    }
+    return;
+  }
+
   // Get lattice, and do determinization if requested.
   lat_ = new Lattice;
   decoder_->GetRawLattice(lat_);
@@ -127,7 +238,10 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
     { // First do some stuff with word-level traceback...
       // This is basically for diagnostics.
       fst::VectorFst<LatticeArc> decoded;
-      decoder_->GetBestPath(&decoded);
+      if (best_path_ != NULL)
+        decoded = *best_path_;
+      else
+        decoder_->GetBestPath(&decoded);
       if (decoded.NumStates() == 0) {
         // Shouldn't really reach this point as already checked success.
         KALDI_ERR << "Failed to get traceback for utterance " << utt_;
@@ -187,6 +301,9 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
     if (num_done_ != NULL) (*num_done_)++;
     if (partial_ && num_partial_ != NULL) (*num_partial_)++;
   }
+  delete best_path_;
+  delete clat_;  // these two are only non-NULL here if we failed.
+  delete lat_;
   // We were given ownership of these two objects that were passed in in
   // the initializer.
   delete decoder_;
@@ -194,6 +311,92 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
 }
 
 
+// Writes the words and alignment of 'best_path' if the writers are open, and
+// prints the words if word_syms != NULL.  Outputs its weight and number of
+// frames.
+static void OutputBestPath(const Lattice &best_path,
+                           const std::string &utt,
+                           const fst::SymbolTable *word_syms,
+                           Int32VectorWriter *alignment_writer,
+                           Int32VectorWriter *words_writer,
+                           LatticeWeight *weight,
+                           int32 *num_frames) {
+  std::vector<int32> alignment;
+  std::vector<int32> words;
+  GetLinearSymbolSequence(best_path, &alignment, &words, weight);
+  *num_frames = alignment.size();
+  if (words_writer->IsOpen())
+    words_writer->Write(utt, words);
+  if (alignment_writer->IsOpen())
+    alignment_writer->Write(utt, alignment);
+  if (word_syms != NULL) {
+    std::cerr << utt << ' ';
+    for (size_t i = 0; i < words.size(); i++) {
+      std::string s = word_syms->Find(words[i]);
+      if (s == "")
+        KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+      std::cerr << s << ' ';
+    }
+    std::cerr << '\n';
+  }
+}
+
+// This is the version of DecodeUtteranceLatticeFaster() that we use if the
+// --flush-interval option is set.
+static bool DecodeUtteranceLatticeFasterFlushing(
+    LatticeFasterDecoder &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr) {
+  Lattice lat, best_path;
+  CompactLattice clat;
+  if (!DecodeWithLatticeFlushing(trans_model, utt, determinize, &decoder,
+                                 &decodable, &lat, &clat, &best_path))
+    return false;
+  if (!decoder.ReachedFinal()) {
+    if (allow_partial) {
+      KALDI_WARN << "Outputting partial output for utterance " << utt
+                 << " since no final-state reached\n";
+    } else {
+      KALDI_WARN << "Not producing output for utterance " << utt
+                 << " since no final-state reached and "
+                 << "--allow-partial=false.\n";
+      return false;
+    }
+  }
+  LatticeWeight weight;
+  int32 num_frames;
+  OutputBestPath(best_path, utt, word_syms, alignment_writer, words_writer,
+                 &weight, &num_frames);
+  double likelihood = -(weight.Value1() + weight.Value2());
+  // We'll write the lattice without acoustic scaling.
+  if (determinize) {
+    if (acoustic_scale != 0.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale), &clat);
+    compact_lattice_writer->Write(utt, clat);
+  } else {
+    if (acoustic_scale != 0.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale), &lat);
+    lattice_writer->Write(utt, lat);
+  }
+  KALDI_LOG << "Log-like per frame for utterance " << utt << " is "
+            << (likelihood / num_frames) << " over "
+            << num_frames << " frames.";
+  KALDI_VLOG(2) << "Cost for utterance " << utt << " is "
+                << weight.Value1() << " + " << weight.Value2();
+  *like_ptr = likelihood;
+  return true;
+}
+
 // Takes care of output.  Returns true on success.
 bool DecodeUtteranceLatticeFaster(
     LatticeFasterDecoder &decoder, // not const but is really an input.
@@ -209,12 +412,37 @@ bool DecodeUtteranceLatticeFaster(
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
     double *like_ptr) { // puts utterance's like in like_ptr on success.
-  using fst::VectorFst;
-
+  if (decoder.GetOptions().flush_interval > 0)
+    return DecodeUtteranceLatticeFasterFlushing(
+        decoder, decodable, trans_model, word_syms, utt, acoustic_scale,
+        determinize, allow_partial, alignment_writer, words_writer,
+        compact_lattice_writer, lattice_writer, like_ptr);
   if (!decoder.Decode(&decodable)) {
     KALDI_WARN << "Failed to decode file " << utt;
     return false;
   }
+  return OutputDecodedUtteranceLatticeFaster(
+      decoder, trans_model, word_syms, utt, acoustic_scale, determinize,
+      allow_partial, alignment_writer, words_writer, compact_lattice_writer,
+      lattice_writer, like_ptr);
+}
+
+// Takes care of output.  Returns true on success.
+bool OutputDecodedUtteranceLatticeFaster(
+    const LatticeFasterDecoder &decoder,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr) { // puts utterance's like in like_ptr on success.
+  using fst::VectorFst;
+
   if (!decoder.ReachedFinal()) {
     if (allow_partial) {
       KALDI_WARN << "Outputting partial output for utterance " << utt
@@ -236,24 +464,8 @@ bool DecodeUtteranceLatticeFaster(
       // Shouldn't really reach this point as already checked success.
       KALDI_ERR << "Failed to get traceback for utterance " << utt;
 
-    std::vector<int32> alignment;
-    std::vector<int32> words;
-    GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
-    num_frames = alignment.size();
-    if (words_writer->IsOpen())
-      words_writer->Write(utt, words);
-    if (alignment_writer->IsOpen())
-      alignment_writer->Write(utt, alignment);
-    if (word_syms != NULL) {
-      std::cerr << utt << ' ';
-      for (size_t i = 0; i < words.size(); i++) {
-        std::string s = word_syms->Find(words[i]);
-        if (s == "")
-          KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
-        std::cerr << s << ' ';
-      }
-      std::cerr << '\n';
-    }
+    OutputBestPath(decoded, utt, word_syms, alignment_writer, words_writer,
+                   &weight, &num_frames);
     likelihood = -(weight.Value1() + weight.Value2());
   }
 
@@ -110,6 +110,25 @@ bool DecodeUtteranceLatticeFaster(
     LatticeWriter *lattice_writer,
     double *like_ptr);  // puts utterance's likelihood in like_ptr on success.
 
+/// This function does the output part of DecodeUtteranceLatticeFaster(), for
+/// an utterance that the caller has already decoded, e.g. by calling
+/// InitDecoding(), AdvanceDecoding() and FinalizeDecoding() on "decoder".  This
+/// is useful when the decoding is interleaved with other work, e.g. in batched
+/// decoding.  Returns true on success.
+bool OutputDecodedUtteranceLatticeFaster(
+    const LatticeFasterDecoder &decoder,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignments_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr);  // puts utterance's likelihood in like_ptr on success.
+
 /// This class basically does the same job as the function
 /// DecodeUtteranceLatticeFaster, but in a way that allows us
 /// to build a multi-threaded command line program more easily.
@@ -166,6 +185,8 @@ class DecodeUtteranceLatticeFasterClass {
   bool partial_; // decoding was partial.
   CompactLattice *clat_; // Stored output, if determinize_ == true.
   Lattice *lat_; // Stored output, if determinize_ == false.
+  Lattice *best_path_; // Stored best path, if the lattice was flushed during
+                       // decoding (see the --flush-interval option).
 };
 
 // This function DecodeUtteranceLatticeSimple is used in several decoders, and
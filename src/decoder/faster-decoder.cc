@@ -36,6 +36,7 @@ FasterDecoder::FasterDecoder(const fst::Fst<fst::StdArc> &fst,
 void FasterDecoder::InitDecoding() {
   // clean up from last time:
   ClearToks(toks_.Clear());
+  SetHashType();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   Arc dummy_arc(0, 0, Weight::One(), start_state);
@@ -212,6 +213,14 @@ double FasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
   }
 }
 
+void FasterDecoder::SetHashType() {
+  HashListIndexType type;
+  if (!HashListIndexTypeFromString(config_.hash_type, &type))
+    KALDI_ERR << "Invalid option --hash-type=" << config_.hash_type;
+  if (type != toks_.IndexType())
+    toks_.SetIndexType(type);
+}
+
 void FasterDecoder::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
@@ -223,6 +232,9 @@ void FasterDecoder::PossiblyResizeHash(size_t num_toks) {
 // ProcessEmitting returns the likelihood cutoff used.
 double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   int32 frame = num_frames_decoded_;
+  // If the decodable object can give us the whole row of log-likelihoods, we
+  // index it directly rather than calling LogLikelihood() for each arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
   Elem *last_toks = toks_.Clear();
   size_t tok_cnt;
   BaseFloat adaptive_beam;
@@ -247,7 +259,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // we'd propagate..
-        BaseFloat ac_cost = - decodable->LogLikelihood(frame, arc.ilabel);
+        BaseFloat ac_cost = - (loglikes != NULL ? loglikes[arc.ilabel - 1] :
+                               decodable->LogLikelihood(frame, arc.ilabel));
         double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
         if (new_weight + adaptive_beam < next_weight_cutoff)
           next_weight_cutoff = new_weight + adaptive_beam;
@@ -273,7 +286,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
            aiter.Next()) {
         Arc arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost =  - decodable->LogLikelihood(frame, arc.ilabel);
+          BaseFloat ac_cost =  - (loglikes != NULL ? loglikes[arc.ilabel - 1] :
+                                  decodable->LogLikelihood(frame, arc.ilabel));
           double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
           if (new_weight < next_weight_cutoff) {  // not pruned..
             Token *new_tok = new Token(arc, ac_cost, tok);
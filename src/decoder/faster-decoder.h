@@ -36,12 +36,15 @@ struct FasterDecoderOptions {
   int32 min_active;
   BaseFloat beam_delta;
   BaseFloat hash_ratio;
+  std::string hash_type;  // "chained", "direct" or "probing"; see
+                          // HashListIndexType in ../util/hash-list.h.
   FasterDecoderOptions(): beam(16.0),
                           max_active(std::numeric_limits<int32>::max()),
                           min_active(20), // This decoder mostly used for
                                           // alignment, use small default.
                           beam_delta(0.5),
-                          hash_ratio(2.0) { }
+                          hash_ratio(2.0),
+                          hash_type("chained") { }
   void Register(OptionsItf *opts, bool full) {  /// if "full", use obscure
     /// options too.
     /// Depends on program.
@@ -55,6 +58,11 @@ struct FasterDecoderOptions {
                      "Increment used in decoder [obscure setting]");
       opts->Register("hash-ratio", &hash_ratio,
                      "Setting used in decoder to control hash behavior");
+      opts->Register("hash-type", &hash_type, "Type of hash used by the "
+                     "decoder to look up tokens by state: \"chained\" (least "
+                     "memory), \"probing\" (open addressing), or \"direct\" "
+                     "(an array indexed by state; fastest, but uses 16 bytes "
+                     "per state of the graph).");
     }
   }
 };
@@ -154,6 +162,10 @@ class FasterDecoder {
   double GetCutoff(Elem *list_head, size_t *tok_count,
                    BaseFloat *adaptive_beam, Elem **best_elem);
 
+  // Sets the type of toks_ from config_.hash_type; must be called while
+  // toks_ is empty.
+  void SetHashType();
+
   void PossiblyResizeHash(size_t num_toks);
 
   // ProcessEmitting returns the likelihood cutoff used.
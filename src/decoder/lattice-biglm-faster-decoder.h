@@ -24,6 +24,7 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/free-list-allocator.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -84,7 +85,7 @@ class LatticeBiglmFasterDecoder {
     num_toks_ = 0;
     PairId start_pair = ConstructPair(fst_.Start(), lm_diff_fst_->Start());
     active_toks_.resize(1);
-    Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+    Token *start_tok = new (token_allocator_.New()) Token(0.0, 0.0, NULL, NULL);
     active_toks_[0].toks = start_tok;
     toks_.Insert(start_pair, start_tok);
     num_toks_++;
@@ -276,11 +277,12 @@ class LatticeBiglmFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next): tot_cost(tot_cost), extra_cost(extra_cost),
                  links(links), next(next) { }
-    inline void DeleteForwardLinks() {
+    inline void DeleteForwardLinks(
+        FreeListAllocator<ForwardLink> *link_allocator) {
       ForwardLink *l = links, *m; 
       while (l != NULL) {
         m = l->next;
-        delete l;
+        link_allocator->Delete(l);
         l = m;
       }
       links = NULL;
@@ -324,7 +326,8 @@ class LatticeBiglmFasterDecoder {
       // tokens on the currently final frame have zero extra_cost
       // as any of them could end up
       // on the winning path.
-      Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
+      Token *new_tok = new (token_allocator_.New()) Token(tot_cost, extra_cost,
+                                                          NULL, toks);
       // NULL: no forward links yet
       toks = new_tok;
       num_toks_++;
@@ -396,7 +399,7 @@ class LatticeBiglmFasterDecoder {
             ForwardLink *next_link = link->next;
             if (prev_link != NULL) prev_link->next = next_link;
             else tok->links = next_link;
-            delete link;
+            link_allocator_.Delete(link);
             link = next_link; // advance link but leave prev_link the same.
             *links_pruned = true;
           } else { // keep the link and update the tok_extra_cost if needed.
@@ -487,7 +490,7 @@ class LatticeBiglmFasterDecoder {
             ForwardLink *next_link = link->next;
             if (prev_link != NULL) prev_link->next = next_link;
             else tok->links = next_link;
-            delete link;
+            link_allocator_.Delete(link);
             link = next_link; // advance link but leave prev_link the same.
           } else { // keep the link and update the tok_extra_cost if needed.
             if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -548,7 +551,7 @@ class LatticeBiglmFasterDecoder {
         // excise tok from list and delete tok.
         if (prev_tok != NULL) prev_tok->next = tok->next;
         else toks = tok->next;
-        delete tok;
+        token_allocator_.Delete(tok);
         num_toks_--;
       } else { // fetch next Token
         prev_tok = tok;
@@ -748,8 +751,9 @@ class LatticeBiglmFasterDecoder {
             // true: emitting, NULL: no change indicator needed
           
             // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-            tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel, 
-                                         graph_cost, ac_cost, tok->links);
+            tok->links = new (link_allocator_.New()) ForwardLink(
+                next_tok, arc.ilabel, arc.olabel, graph_cost, ac_cost,
+                tok->links);
           }
         } // for all arcs
       }
@@ -798,7 +802,7 @@ class LatticeBiglmFasterDecoder {
       // because we're about to regenerate them.  This is a kind
       // of non-optimality (remember, this is the simple decoder),
       // but since most states are emitting it's not a huge issue.
-      tok->DeleteForwardLinks(); // necessary when re-visiting
+      tok->DeleteForwardLinks(&link_allocator_); // necessary when re-visiting
       tok->links = NULL;
       for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
           !aiter.Done();
@@ -815,8 +819,8 @@ class LatticeBiglmFasterDecoder {
             Token *new_tok = FindOrAddToken(next_pair, frame, tot_cost,
                                             false, &changed); // false: non-emit
             
-            tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                         graph_cost, 0, tok->links);
+            tok->links = new (link_allocator_.New()) ForwardLink(
+                new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
             
             // "changed" tells us whether the new token has a different
             // cost from before, or is new [if so, add into queue].
@@ -832,6 +836,12 @@ class LatticeBiglmFasterDecoder {
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.
   HashList<PairId, Token*> toks_;
+
+  // Tokens and ForwardLinks are allocated from these free lists rather than
+  // with new/delete; the memory is kept across utterances, and is only returned
+  // to the system when this object is destroyed.
+  FreeListAllocator<Token> token_allocator_;
+  FreeListAllocator<ForwardLink> link_allocator_;
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
@@ -868,9 +878,9 @@ class LatticeBiglmFasterDecoder {
       // Delete all tokens alive on this frame, and any forward
       // links they may have.
       for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-        tok->DeleteForwardLinks();
+        tok->DeleteForwardLinks(&link_allocator_);
         Token *next_tok = tok->next;
-        delete tok;
+        token_allocator_.Delete(tok);
         num_toks_--;
         tok = next_tok;
       }
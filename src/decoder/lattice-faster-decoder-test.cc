@@ -0,0 +1,161 @@
+// decoder/lattice-faster-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "fstext/fstext-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+
+
+namespace kaldi {
+using namespace fst;
+
+// Returns a random decoding graph whose input labels are in the range
+// [1, num_pdfs].  The epsilon arcs only go to higher-numbered states, so the
+// graph has no epsilon cycles.
+VectorFst<StdArc> *RandDecodingGraph(int32 num_pdfs) {
+  VectorFst<StdArc> *fst = new VectorFst<StdArc>();
+  int32 num_states = 50 + Rand() % 200;
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = 1 + Rand() % 6;
+    for (int32 a = 0; a < num_arcs; a++) {
+      int32 ilabel = 1 + Rand() % num_pdfs,
+          olabel = (Rand() % 3 == 0 ? 1 + Rand() % 20 : 0),
+          nextstate = Rand() % num_states;
+      fst->AddArc(s, StdArc(ilabel, olabel, 2.0 * RandUniform(), nextstate));
+    }
+    if (s + 1 < num_states && Rand() % 4 == 0) {
+      int32 nextstate = s + 1 + Rand() % (num_states - s - 1);
+      fst->AddArc(s, StdArc(0, 1 + Rand() % 20, RandUniform(), nextstate));
+    }
+    if (Rand() % 2 == 0)
+      fst->SetFinal(s, 5.0 * RandUniform());
+  }
+  return fst;
+}
+
+// Decodes the whole utterance at once and outputs the raw lattice.
+void DecodeWhole(const VectorFst<StdArc> &fst,
+                 const Matrix<BaseFloat> &loglikes,
+                 const LatticeFasterDecoderConfig &config,
+                 Lattice *raw_lat) {
+  LatticeFasterDecoder decoder(fst, config);
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  decoder.Decode(&decodable);
+  KALDI_ASSERT(decoder.NumFramesDecoded() == loglikes.NumRows());
+  KALDI_ASSERT(decoder.GetRawLattice(raw_lat));
+}
+
+// Decodes the utterance calling FlushRawLattice() (without forcing a cut
+// point) every 'interval' frames, and outputs the concatenation of the flushed
+// parts and the final part of the raw lattice.  Returns the number of times the
+// lattice was flushed.
+int32 DecodeFlushing(const VectorFst<StdArc> &fst,
+                     const Matrix<BaseFloat> &loglikes,
+                     const LatticeFasterDecoderConfig &config,
+                     int32 interval, int32 min_delay,
+                     Lattice *raw_lat) {
+  LatticeFasterDecoder decoder(fst, config);
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  int32 num_flushed = 0;
+  Lattice part;
+  raw_lat->DeleteStates();
+  decoder.InitDecoding();
+  while (decoder.NumFramesDecoded() < loglikes.NumRows()) {
+    decoder.AdvanceDecoding(&decodable, interval);
+    if (decoder.FlushRawLattice(min_delay, false, &part)) {
+      KALDI_ASSERT(decoder.NumFramesFlushed() > 0);
+      if (raw_lat->Start() == kNoStateId)
+        *raw_lat = part;
+      else
+        Concat(raw_lat, part);
+      num_flushed++;
+    }
+  }
+  decoder.FinalizeDecoding();
+  KALDI_ASSERT(decoder.GetRawLattice(&part));
+  if (raw_lat->Start() == kNoStateId)
+    *raw_lat = part;
+  else
+    Concat(raw_lat, part);
+  return num_flushed;
+}
+
+// Checks that decoding with lattice flushing gives the same lattice and best
+// path as decoding the whole utterance.  The flushed parts are pruned less
+// (they are output before the end of the utterance is known), so we compare
+// the lattices after pruning them with the lattice beam.  Returns the number
+// of times the lattice was flushed.
+int32 TestLatticeFasterDecoderFlushing() {
+  int32 num_pdfs = 5 + Rand() % 20,
+      num_frames = 50 + Rand() % 150;
+  VectorFst<StdArc> *fst = RandDecodingGraph(num_pdfs);
+  Matrix<BaseFloat> loglikes(num_frames, num_pdfs);
+  loglikes.SetRandn();
+  loglikes.Scale(2.0);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 4.0 + 4.0 * RandUniform();
+  config.lattice_beam = 0.5 + 2.0 * RandUniform();
+  config.max_active = 20 + Rand() % 100;
+  config.min_active = 5;
+  // We prune on every frame so that the pruning done by FlushRawLattice() is
+  // the same as the pruning done without flushing.
+  config.prune_interval = 1;
+
+  Lattice raw_lat1, raw_lat2;
+  DecodeWhole(*fst, loglikes, config, &raw_lat1);
+  int32 interval = 1 + Rand() % 20,
+      min_delay = 1 + Rand() % 5;
+  int32 num_flushed = DecodeFlushing(*fst, loglikes, config, interval,
+                                     min_delay, &raw_lat2);
+
+  KALDI_ASSERT(PruneLattice(config.lattice_beam, &raw_lat1) &&
+               PruneLattice(config.lattice_beam, &raw_lat2));
+  KALDI_ASSERT(RandEquivalent(raw_lat1, raw_lat2, 5, 0.01, Rand(),
+                              2 * num_frames + 10));
+
+  Lattice best_path1, best_path2;
+  ShortestPath(raw_lat1, &best_path1);
+  ShortestPath(raw_lat2, &best_path2);
+  KALDI_ASSERT(best_path1.NumStates() > 0 && best_path2.NumStates() > 0);
+  std::vector<int32> alignment1, alignment2, words1, words2;
+  LatticeWeight weight1, weight2;
+  GetLinearSymbolSequence(best_path1, &alignment1, &words1, &weight1);
+  GetLinearSymbolSequence(best_path2, &alignment2, &words2, &weight2);
+  KALDI_ASSERT(alignment1 == alignment2 && words1 == words2 &&
+               ApproxEqual(weight1, weight2));
+  delete fst;
+  return num_flushed;
+}
+
+}  // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  int32 num_flushed = 0;
+  for (int32 i = 0; i < 20; i++)
+    num_flushed += TestLatticeFasterDecoderFlushing();
+  // Make sure that we actually tested the flushing.
+  KALDI_ASSERT(num_flushed > 0);
+  KALDI_LOG << "Success; flushed the lattice " << num_flushed << " times.";
+}
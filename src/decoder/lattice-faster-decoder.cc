@@ -26,6 +26,7 @@
 // svn merge ^/sandbox/online/src/decoder/lattice-faster-decoder.cc lattice-faster-online-decoder.cc
 
 #include "decoder/lattice-faster-decoder.h"
+#include "base/timer.h"
 #include "lat/lattice-functions.h"
 
 namespace kaldi {
@@ -33,7 +34,8 @@ namespace kaldi {
 // instantiate this class once for each thing you have to decode.
 LatticeFasterDecoder::LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
                                            const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(fst), delete_fst_(false), config_(config), num_toks_(0),
+    num_frames_flushed_(0), record_search_stats_(false) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -41,7 +43,8 @@ LatticeFasterDecoder::LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
 
 LatticeFasterDecoder::LatticeFasterDecoder(const LatticeFasterDecoderConfig &config,
                                            fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0),
+    num_frames_flushed_(0), record_search_stats_(false) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -56,16 +59,19 @@ LatticeFasterDecoder::~LatticeFasterDecoder() {
 void LatticeFasterDecoder::InitDecoding() {
   // clean up from last time:
   DeleteElems(toks_.Clear());
+  SetHashType();
   cost_offsets_.clear();
   ClearActiveTokens();
   warned_ = false;
   num_toks_ = 0;
+  num_frames_flushed_ = 0;
+  search_stats_.clear();
   decoding_finalized_ = false;
   final_costs_.clear();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+  Token *start_tok = new (token_allocator_.New()) Token(0.0, 0.0, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -135,9 +141,11 @@ bool LatticeFasterDecoder::GetRawLattice(Lattice *ofst,
   KALDI_ASSERT(num_frames > 0);
   const int32 bucket_count = num_toks_/2 + 3;
   unordered_map<Token*, StateId> tok_map(bucket_count);
-  // First create all states.
+  // First create all states.  If FlushRawLattice() was called, we start from
+  // the token it cut the lattice at, which is the only one on its frame that
+  // has no epsilon links into it.
   std::vector<Token*> token_list;
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = num_frames_flushed_; f <= num_frames; f++) {
     if (active_toks_[f].toks == NULL) {
       KALDI_WARN << "GetRawLattice: no tokens active on frame " << f
                  << ": not producing lattice.\n";
@@ -156,7 +164,7 @@ bool LatticeFasterDecoder::GetRawLattice(Lattice *ofst,
                 << tok_map.bucket_count() << " load:" << tok_map.load_factor()
                 << " max:" << tok_map.max_load_factor();
   // Now create all arcs.
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = num_frames_flushed_; f <= num_frames; f++) {
     for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
       StateId cur_state = tok_map[tok];
       for (ForwardLink *l = tok->links;
@@ -217,6 +225,14 @@ bool LatticeFasterDecoder::GetLattice(CompactLattice *ofst,
   return (ofst->NumStates() != 0);
 }
 
+void LatticeFasterDecoder::SetHashType() {
+  HashListIndexType type;
+  if (!HashListIndexTypeFromString(config_.hash_type, &type))
+    KALDI_ERR << "Invalid option --hash-type=" << config_.hash_type;
+  if (type != toks_.IndexType())
+    toks_.SetIndexType(type);
+}
+
 void LatticeFasterDecoder::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
@@ -268,7 +284,8 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
+    Token *new_tok = new (token_allocator_.New()) Token(tot_cost, extra_cost,
+                                                        NULL, toks);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -341,7 +358,7 @@ void LatticeFasterDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_allocator_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -428,7 +445,7 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_allocator_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -480,6 +497,7 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
   if (toks == NULL)
     KALDI_WARN << "No tokens alive [doing pruning]";
   Token *tok, *next_tok, *prev_tok = NULL;
+  int32 num_pruned = 0;
   for (tok = toks; tok != NULL; tok = next_tok) {
     next_tok = tok->next;
     if (tok->extra_cost == std::numeric_limits<BaseFloat>::infinity()) {
@@ -487,12 +505,19 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_allocator_.Delete(tok);
       num_toks_--;
+      num_pruned++;
     } else {  // fetch next Token
       prev_tok = tok;
     }
   }
+  // The tokens on active_toks_[t+1] were created while decoding frame t, which
+  // is search_stats_[t]; the tokens created before the first frame are counted
+  // on frame 0.
+  int32 t = std::max<int32>(frame_plus_one - 1, 0);
+  if (record_search_stats_ && t < static_cast<int32>(search_stats_.size()))
+    search_stats_[t].num_tokens_pruned += num_pruned;
 }
 
 // Go backwards through still-alive tokens, pruning them, starting not from
@@ -501,11 +526,12 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
 // where the delta-costs are not changing (and the delta controls when we consider
 // a cost to have "not changed").
 void LatticeFasterDecoder::PruneActiveTokens(BaseFloat delta) {
+  Timer timer(record_search_stats_);
   int32 cur_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
   // one to get the corresponding index for the decodable object.
-  for (int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = cur_frame_plus_one - 1; f >= num_frames_flushed_; f--) {
     // Reason why we need to prune forward links in this situation:
     // (1) we have never pruned them (new TokenList)
     // (2) we have not yet pruned the forward links to the next f,
@@ -513,7 +539,8 @@ void LatticeFasterDecoder::PruneActiveTokens(BaseFloat delta) {
     if (active_toks_[f].must_prune_forward_links) {
       bool extra_costs_changed = false, links_pruned = false;
       PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
-      if (extra_costs_changed && f > 0) // any token has changed extra_cost
+      // if any token has changed extra_cost:
+      if (extra_costs_changed && f > num_frames_flushed_)
         active_toks_[f-1].must_prune_forward_links = true;
       if (links_pruned) // any link was pruned
         active_toks_[f].must_prune_tokens = true;
@@ -527,6 +554,181 @@ void LatticeFasterDecoder::PruneActiveTokens(BaseFloat delta) {
   }
   KALDI_VLOG(4) << "PruneActiveTokens: pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  if (record_search_stats_ && !search_stats_.empty()) {
+    search_stats_.back().prune_time += timer.Elapsed();
+  }
+}
+
+bool LatticeFasterDecoder::FlushRawLattice(int32 min_delay, bool force,
+                                           Lattice *prefix) {
+  typedef LatticeArc::StateId LatStateId;
+  KALDI_ASSERT(!active_toks_.empty() && !decoding_finalized_ &&
+               min_delay > 0);
+  int32 last_cut = NumFramesDecoded() - min_delay;
+  if (last_cut <= num_frames_flushed_)
+    return false;
+  // Make sure the pruning is up to date, since it decides where we can cut.
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+
+  int32 cut;
+  Token *cut_tok = NULL;
+  for (cut = last_cut; cut > num_frames_flushed_; cut--)
+    if ((cut_tok = FindCutToken(cut, false)) != NULL)
+      break;
+  if (cut_tok == NULL) {
+    if (!force)
+      return false;
+    cut = last_cut;
+    if ((cut_tok = FindCutToken(cut, true)) == NULL) {
+      KALDI_WARN << "FlushRawLattice: no tokens active on frame " << cut;
+      return false;
+    }
+    KALDI_VLOG(2) << "Forcing the lattice to be cut on frame " << cut;
+  }
+  PruneToCutToken(cut, cut_tok);
+
+  // Output the lattice up to cut_tok; this is like GetRawLattice(), except
+  // that cut_tok is the final state.
+  prefix->DeleteStates();
+  unordered_map<Token*, LatStateId> tok_map;
+  std::vector<Token*> token_list;
+  for (int32 f = num_frames_flushed_; f < cut; f++) {
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++)
+      if (token_list[i] != NULL)
+        tok_map[token_list[i]] = prefix->AddState();
+  }
+  LatStateId final_state = prefix->AddState();
+  tok_map[cut_tok] = final_state;
+  prefix->SetStart(0);
+  prefix->SetFinal(final_state, LatticeWeight::One());
+  for (int32 f = num_frames_flushed_; f < cut; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      LatStateId cur_state = tok_map[tok];
+      for (ForwardLink *l = tok->links; l != NULL; l = l->next) {
+        unordered_map<Token*, LatStateId>::const_iterator iter =
+            tok_map.find(l->next_tok);
+        KALDI_ASSERT(iter != tok_map.end());
+        BaseFloat cost_offset = (l->ilabel != 0 ? cost_offsets_[f] : 0.0);
+        prefix->AddArc(cur_state,
+                       LatticeArc(l->ilabel, l->olabel,
+                                  LatticeWeight(l->graph_cost,
+                                                l->acoustic_cost - cost_offset),
+                                  iter->second));
+      }
+    }
+  }
+
+  // Free the tokens before the cut point.
+  for (int32 f = num_frames_flushed_; f < cut; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; ) {
+      tok->DeleteForwardLinks(&link_allocator_);
+      Token *next_tok = tok->next;
+      token_allocator_.Delete(tok);
+      num_toks_--;
+      tok = next_tok;
+    }
+    active_toks_[f].toks = NULL;
+  }
+  KALDI_VLOG(3) << "Flushed the lattice for frames " << num_frames_flushed_
+                << " to " << (cut - 1);
+  num_frames_flushed_ = cut;
+  return true;
+}
+
+LatticeFasterDecoder::Token* LatticeFasterDecoder::FindCutToken(
+    int32 frame_plus_one, bool force) const {
+  Token *ans = NULL;
+  for (Token *tok = active_toks_[frame_plus_one - 1].toks; tok != NULL;
+       tok = tok->next) {
+    for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
+      if (link->ilabel == 0)  // epsilon links stay on the same frame.
+        continue;
+      Token *next_tok = link->next_tok;
+      if (ans == NULL || (force && next_tok->extra_cost < ans->extra_cost))
+        ans = next_tok;
+      else if (!force && next_tok != ans)
+        return NULL;
+    }
+  }
+  return ans;
+}
+
+void LatticeFasterDecoder::PruneToCutToken(int32 frame_plus_one,
+                                           Token *cut_tok) {
+  int32 cur_frame_plus_one = NumFramesDecoded();
+  BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+  for (Token *tok = active_toks_[frame_plus_one - 1].toks; tok != NULL;
+       tok = tok->next) {
+    ForwardLink *link = tok->links, *prev_link = NULL;
+    while (link != NULL) {
+      if (link->ilabel != 0 && link->next_tok != cut_tok) {  // excise link
+        ForwardLink *next_link = link->next;
+        if (prev_link != NULL) prev_link->next = next_link;
+        else tok->links = next_link;
+        link_allocator_.Delete(link);
+        link = next_link;
+      } else {
+        prev_link = link;
+        link = link->next;
+      }
+    }
+  }
+
+  // Go forward from cut_tok, in topological order; 'reachable' maps the
+  // tokens that we have reached on this frame and 'next_reachable' those on
+  // the next frame to the best cost with which we reached them.
+  unordered_map<Token*, BaseFloat> reachable, next_reachable;
+  reachable[cut_tok] = cut_tok->tot_cost;
+  std::vector<Token*> token_list;
+  for (int32 f = frame_plus_one; f <= cur_frame_plus_one; f++) {
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++) {
+      Token *tok = token_list[i];
+      if (tok == NULL)
+        continue;
+      unordered_map<Token*, BaseFloat>::iterator iter = reachable.find(tok);
+      if (iter == reachable.end()) {
+        // Nothing that survives links to this token, so it is safe to delete
+        // it (below) once it has no links itself.
+        tok->DeleteForwardLinks(&link_allocator_);
+        tok->tot_cost = infinity;
+        tok->extra_cost = infinity;
+        continue;
+      }
+      tok->tot_cost = iter->second;
+      for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
+        BaseFloat cost = tok->tot_cost + link->acoustic_cost +
+            link->graph_cost;
+        // epsilon links lead to tokens later in token_list.
+        unordered_map<Token*, BaseFloat> &next_map =
+            (link->ilabel == 0 ? reachable : next_reachable);
+        std::pair<unordered_map<Token*, BaseFloat>::iterator, bool> ret =
+            next_map.insert(std::make_pair(link->next_tok, cost));
+        if (!ret.second && cost < ret.first->second)
+          ret.first->second = cost;
+      }
+    }
+    if (f < cur_frame_plus_one) {
+      Token *&toks = active_toks_[f].toks;
+      for (Token *tok = toks, *prev_tok = NULL, *next_tok; tok != NULL;
+           tok = next_tok) {
+        next_tok = tok->next;
+        if (reachable.count(tok) == 0) {
+          if (prev_tok != NULL) prev_tok->next = next_tok;
+          else toks = next_tok;
+          token_allocator_.Delete(tok);
+          num_toks_--;
+        } else {
+          prev_tok = tok;
+        }
+      }
+      // The extra_costs may change now that the tot_costs have.
+      active_toks_[f].must_prune_forward_links = true;
+    }
+    reachable.swap(next_reachable);
+    next_reachable.clear();
+  }
 }
 
 void LatticeFasterDecoder::ComputeFinalCosts(
@@ -598,20 +800,25 @@ void LatticeFasterDecoder::AdvanceDecoding(DecodableInterface *decodable,
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
 void LatticeFasterDecoder::FinalizeDecoding() {
+  Timer timer(record_search_stats_);
   int32 final_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
   // sets decoding_finalized_.
   PruneForwardLinksFinal();
-  for (int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = final_frame_plus_one - 1; f >= num_frames_flushed_; f--) {
     bool b1, b2; // values not used.
     BaseFloat dontcare = 0.0; // delta of zero means we must always update
     PruneForwardLinks(f, &b1, &b2, dontcare);
     PruneTokensForFrame(f + 1);
   }
-  PruneTokensForFrame(0);
+  // The tokens before num_frames_flushed_ were freed by FlushRawLattice().
+  PruneTokensForFrame(num_frames_flushed_);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  if (record_search_stats_ && !search_stats_.empty()) {
+    search_stats_.back().prune_time += timer.Elapsed();
+  }
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
@@ -691,6 +898,9 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
                                          // (zero-based) used to get likelihoods
                                          // from the decodable object.
   active_toks_.resize(active_toks_.size() + 1);
+  // If the decodable object can give us the whole row of log-likelihoods, we
+  // index it directly rather than calling LogLikelihood() for each arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
 
   Elem *final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
                                    // in simple-decoder.h.   Removes the Elems from
@@ -703,6 +913,13 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
                 << adaptive_beam;
 
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
+  if (record_search_stats_) {
+    DecoderFrameStats &stats = search_stats_.back();
+    stats.num_active_tokens = tok_cnt;
+    stats.adaptive_beam = adaptive_beam;
+    if (best_elem != NULL)
+      stats.cutoff = cur_cutoff - best_elem->val->tot_cost;
+  }
 
   BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
   // pruning "online" before having seen all tokens
@@ -724,7 +941,8 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
         BaseFloat new_weight = arc.weight.Value() + cost_offset - 
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+            (loglikes != NULL ? loglikes[arc.ilabel - 1] :
+             decodable->LogLikelihood(frame, arc.ilabel)) + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -736,6 +954,7 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   // do it this way as it's more robust to future code changes.
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
+  int32 num_arcs = 0;  // the number of arcs we expand, for search_stats_.
 
   // the tokens are now owned here, in final_toks, and the hash is empty.
   // 'owned' is a complex thing here; the point is we need to call DeleteElem
@@ -750,8 +969,10 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
            aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
+          num_arcs++;
           BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
+              (loglikes != NULL ? loglikes[arc.ilabel - 1] :
+               decodable->LogLikelihood(frame, arc.ilabel)),
               graph_cost = arc.weight.Value(),
               cur_cost = tok->tot_cost,
               tot_cost = cur_cost + ac_cost + graph_cost;
@@ -765,14 +986,123 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
+          tok->links = new (link_allocator_.New()) ForwardLink(
+              next_tok, arc.ilabel, arc.olabel, graph_cost, ac_cost,
+              tok->links);
         }
       } // for all arcs
     }
     e_tail = e->tail;
     toks_.Delete(e); // delete Elem
   }
+  if (record_search_stats_)
+    search_stats_.back().num_emitting_arcs = num_arcs;
+  return next_cutoff;
+}
+
+// This specialization of ProcessEmitting for CompiledFst is the same as the
+// generic version above, except that it only visits the emitting arcs, it
+// reads the arcs from the struct-of-arrays layout of CompiledFst, and it uses
+// the pdf labels of the arcs to look up the likelihoods.  It visits the
+// emitting arcs in the same order as the generic version does.
+template <>
+BaseFloat LatticeFasterDecoder::ProcessEmitting<fst::CompiledFst>(
+    DecodableInterface *decodable) {
+  KALDI_ASSERT(active_toks_.size() > 0);
+  int32 frame = active_toks_.size() - 1; // frame is the frame-index
+                                         // (zero-based) used to get likelihoods
+                                         // from the decodable object.
+  active_toks_.resize(active_toks_.size() + 1);
+  // If the decodable object can give us the whole row of log-likelihoods, we
+  // index it directly rather than calling LogLikelihood() for each arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
+
+  const fst::CompiledFst &fst = dynamic_cast<const fst::CompiledFst&>(fst_);
+  if (fst.HasPdfLabels() && decodable->NumIndices() != fst.NumPdfs())
+    KALDI_ERR << "The decoding graph has pdf labels for " << fst.NumPdfs()
+              << " pdfs, but the decodable object has " << decodable->NumIndices()
+              << " indices: you need a decodable object that is indexed by "
+              << "pdf-id plus one.";
+  const Label *ilabels = fst.EmittingIlabels(),
+      *pdf_labels = fst.EmittingPdfLabels(),
+      *olabels = fst.EmittingOlabels();
+  const float *weights = fst.EmittingWeights();
+  const StateId *nextstates = fst.EmittingNextstates();
+
+  Elem *final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
+                                   // in simple-decoder.h.   Removes the Elems from
+                                   // being indexed in the hash in toks_.
+  Elem *best_elem = NULL;
+  BaseFloat adaptive_beam;
+  size_t tok_cnt;
+  BaseFloat cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
+  KALDI_VLOG(6) << "Adaptive beam on frame " << NumFramesDecoded() << " is "
+                << adaptive_beam;
+
+  PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
+  if (record_search_stats_) {
+    DecoderFrameStats &stats = search_stats_.back();
+    stats.num_active_tokens = tok_cnt;
+    stats.adaptive_beam = adaptive_beam;
+    if (best_elem != NULL)
+      stats.cutoff = cur_cutoff - best_elem->val->tot_cost;
+  }
+
+  BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  // pruning "online" before having seen all tokens
+
+  BaseFloat cost_offset = 0.0; // Used to keep probabilities in a good
+  // dynamic range.
+
+  // First process the best token to get a hopefully
+  // reasonably tight bound on the next cutoff.  The only
+  // products of the next block are "next_cutoff" and "cost_offset".
+  if (best_elem) {
+    StateId state = best_elem->key;
+    Token *tok = best_elem->val;
+    cost_offset = - tok->tot_cost;
+    for (int64 i = fst.EmittingArcsBegin(state),
+             end = fst.EmittingArcsEnd(state); i < end; i++) {
+      BaseFloat new_weight = weights[i] + cost_offset -
+          (loglikes != NULL ? loglikes[pdf_labels[i] - 1] :
+           decodable->LogLikelihood(frame, pdf_labels[i])) + tok->tot_cost;
+      if (new_weight + adaptive_beam < next_cutoff)
+        next_cutoff = new_weight + adaptive_beam;
+    }
+  }
+
+  cost_offsets_.resize(frame + 1, 0.0);
+  cost_offsets_[frame] = cost_offset;
+  int32 num_arcs = 0;  // the number of arcs we expand, for search_stats_.
+
+  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
+    // loop this way because we delete "e" as we go.
+    StateId state = e->key;
+    Token *tok = e->val;
+    if (tok->tot_cost <= cur_cutoff) {
+      num_arcs += fst.NumEmittingArcs(state);
+      for (int64 i = fst.EmittingArcsBegin(state),
+               end = fst.EmittingArcsEnd(state); i < end; i++) {
+        BaseFloat ac_cost = cost_offset -
+            (loglikes != NULL ? loglikes[pdf_labels[i] - 1] :
+             decodable->LogLikelihood(frame, pdf_labels[i])),
+            graph_cost = weights[i],
+            cur_cost = tok->tot_cost,
+            tot_cost = cur_cost + ac_cost + graph_cost;
+        if (tot_cost > next_cutoff) continue;
+        else if (tot_cost + adaptive_beam < next_cutoff)
+          next_cutoff = tot_cost + adaptive_beam; // prune by best current token
+        Token *next_tok = FindOrAddToken(nextstates[i],
+                                         frame + 1, tot_cost, NULL);
+        tok->links = new (link_allocator_.New()) ForwardLink(
+            next_tok, ilabels[i], olabels[i], graph_cost, ac_cost, tok->links);
+      } // for all arcs
+    }
+    e_tail = e->tail;
+    toks_.Delete(e); // delete Elem
+  }
+  if (record_search_stats_)
+    search_stats_.back().num_emitting_arcs = num_arcs;
   return next_cutoff;
 }
 
@@ -784,13 +1114,22 @@ template BaseFloat LatticeFasterDecoder::ProcessEmitting<fst::Fst<fst::StdArc>>(
         DecodableInterface *decodable);
 
 BaseFloat LatticeFasterDecoder::ProcessEmittingWrapper(DecodableInterface *decodable) {
+  Timer timer(record_search_stats_);
+  if (record_search_stats_)
+    search_stats_.push_back(DecoderFrameStats());
+  BaseFloat cutoff;
   if (fst_.Type() == "const") {
-    return LatticeFasterDecoder::ProcessEmitting<fst::ConstFst<Arc>>(decodable);
+    cutoff = LatticeFasterDecoder::ProcessEmitting<fst::ConstFst<Arc>>(decodable);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterDecoder::ProcessEmitting<fst::VectorFst<Arc>>(decodable);
+    cutoff = LatticeFasterDecoder::ProcessEmitting<fst::VectorFst<Arc>>(decodable);
+  } else if (fst_.Type() == "compiled") {
+    cutoff = LatticeFasterDecoder::ProcessEmitting<fst::CompiledFst>(decodable);
   } else {
-    return LatticeFasterDecoder::ProcessEmitting<fst::Fst<Arc>>(decodable);
+    cutoff = LatticeFasterDecoder::ProcessEmitting<fst::Fst<Arc>>(decodable);
   }
+  if (record_search_stats_)
+    search_stats_.back().emitting_time = timer.Elapsed();
+  return cutoff;
 }
 
 template <typename FstType> 
@@ -818,6 +1157,7 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
     }
   }
 
+  int32 num_arcs = 0;  // the number of arcs we expand, for search_stats_.
   while (!queue_.empty()) {
     StateId state = queue_.back();
     queue_.pop_back();
@@ -830,13 +1170,14 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    tok->DeleteForwardLinks(&link_allocator_); // necessary when re-visiting
     tok->links = NULL;
     for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel == 0) {  // propagate nonemitting only...
+        num_arcs++;
         BaseFloat graph_cost = arc.weight.Value(),
             tot_cost = cur_cost + graph_cost;
         if (tot_cost < cutoff) {
@@ -845,8 +1186,8 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = new (link_allocator_.New()) ForwardLink(
+              new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -855,6 +1196,60 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
       }
     } // for all arcs
   } // while queue not empty
+  if (record_search_stats_ && !search_stats_.empty())
+    search_stats_.back().num_nonemitting_arcs = num_arcs;
+}
+
+// Specialization of ProcessNonemitting for CompiledFst, which only visits the
+// epsilon arcs; see the comment for ProcessEmitting<fst::CompiledFst>.
+template <>
+void LatticeFasterDecoder::ProcessNonemitting<fst::CompiledFst>(
+    BaseFloat cutoff) {
+  KALDI_ASSERT(!active_toks_.empty());
+  int32 frame = static_cast<int32>(active_toks_.size()) - 2;
+  const fst::CompiledFst &fst = dynamic_cast<const fst::CompiledFst&>(fst_);
+  const Label *olabels = fst.EpsilonOlabels();
+  const float *weights = fst.EpsilonWeights();
+  const StateId *nextstates = fst.EpsilonNextstates();
+
+  KALDI_ASSERT(queue_.empty());
+  for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
+    queue_.push_back(e->key);
+  if (queue_.empty()) {
+    if (!warned_) {
+      KALDI_WARN << "Error, no surviving tokens: frame is " << frame;
+      warned_ = true;
+    }
+  }
+
+  int32 num_arcs = 0;  // the number of arcs we expand, for search_stats_.
+  while (!queue_.empty()) {
+    StateId state = queue_.back();
+    queue_.pop_back();
+
+    Token *tok = toks_.Find(state)->val;  // would segfault if state not in toks_ but this can't happen.
+    BaseFloat cur_cost = tok->tot_cost;
+    if (cur_cost > cutoff) // Don't bother processing successors.
+      continue;
+    tok->DeleteForwardLinks(&link_allocator_); // necessary when re-visiting
+    tok->links = NULL;
+    num_arcs += fst.NumEpsilonArcs(state);
+    for (int64 i = fst.EpsilonArcsBegin(state),
+             end = fst.EpsilonArcsEnd(state); i < end; i++) {
+      BaseFloat graph_cost = weights[i],
+          tot_cost = cur_cost + graph_cost;
+      if (tot_cost < cutoff) {
+        bool changed;
+        Token *new_tok = FindOrAddToken(nextstates[i], frame + 1, tot_cost,
+                                        &changed);
+        tok->links = new (link_allocator_.New()) ForwardLink(
+            new_tok, 0, olabels[i], graph_cost, 0, tok->links);
+        if (changed) queue_.push_back(nextstates[i]);
+      }
+    } // for all arcs
+  } // while queue not empty
+  if (record_search_stats_ && !search_stats_.empty())
+    search_stats_.back().num_nonemitting_arcs = num_arcs;
 }
 
 template void LatticeFasterDecoder::ProcessNonemitting<fst::ConstFst<fst::StdArc>>(
@@ -865,13 +1260,19 @@ template void LatticeFasterDecoder::ProcessNonemitting<fst::Fst<fst::StdArc>>(
         BaseFloat cutoff);
 
 void LatticeFasterDecoder::ProcessNonemittingWrapper(BaseFloat cost_cutoff) {
+  Timer timer(record_search_stats_);
   if (fst_.Type() == "const") {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
+    LatticeFasterDecoder::ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
+    LatticeFasterDecoder::ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
+  } else if (fst_.Type() == "compiled") {
+    LatticeFasterDecoder::ProcessNonemitting<fst::CompiledFst>(cost_cutoff);
   } else {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
+    LatticeFasterDecoder::ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
   }
+  // Note: there are no statistics for the call from InitDecoding().
+  if (record_search_stats_ && !search_stats_.empty())
+    search_stats_.back().nonemitting_time = timer.Elapsed();
 }
 
 void LatticeFasterDecoder::DeleteElems(Elem *list) {
@@ -886,9 +1287,9 @@ void LatticeFasterDecoder::ClearActiveTokens() { // a cleanup routine, at utt en
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      tok->DeleteForwardLinks(&link_allocator_);
       Token *next_tok = tok->next;
-      delete tok;
+      token_allocator_.Delete(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -975,4 +1376,22 @@ void LatticeFasterDecoder::TopSortTokens(Token *tok_list,
     (*topsorted_list)[iter->second] = iter->first;
 }
 
+void SearchStatsToMatrix(const std::vector<DecoderFrameStats> &stats,
+                         Matrix<BaseFloat> *mat) {
+  mat->Resize(stats.size(), 9);
+  for (size_t t = 0; t < stats.size(); t++) {
+    const DecoderFrameStats &s = stats[t];
+    SubVector<BaseFloat> row(mat->Row(t));
+    row(0) = s.num_active_tokens;
+    row(1) = s.adaptive_beam;
+    row(2) = s.cutoff;
+    row(3) = s.num_emitting_arcs;
+    row(4) = s.num_nonemitting_arcs;
+    row(5) = s.num_tokens_pruned;
+    row(6) = s.emitting_time;
+    row(7) = s.nonemitting_time;
+    row(8) = s.prune_time;
+  }
+}
+
 } // end namespace kaldi.
@@ -28,8 +28,10 @@
 #define KALDI_DECODER_LATTICE_FASTER_DECODER_H_
 
 
+#include "matrix/kaldi-matrix.h"
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/free-list-allocator.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -48,6 +50,18 @@ struct LatticeFasterDecoderConfig {
                             // command-line program.
   BaseFloat beam_delta; // has nothing to do with beam_ratio
   BaseFloat hash_ratio;
+  std::string hash_type;  // "chained", "direct" or "probing"; see
+                          // HashListIndexType in ../util/hash-list.h.
+  // The next three options are not inspected by this class, but by
+  // DecodeUtteranceLatticeFaster(); see FlushRawLattice().
+  int32 flush_interval;
+  int32 flush_delay;
+  int32 flush_max_frames;
+  // Not inspected by this class, only by LatticeFasterOnlineDecoder.  It is
+  // not registered by Register(), since it only takes effect with a decodable
+  // object that supports LogLikelihoodRow(); programs that support it
+  // register it themselves (see online2-wav-nnet3-latgen-faster.cc).
+  int32 num_decoder_threads;
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
@@ -64,6 +78,11 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
+                                hash_type("chained"),
+                                flush_interval(0),
+                                flush_delay(100),
+                                flush_max_frames(0),
+                                num_decoder_threads(1),
                                 prune_scale(0.1) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
@@ -83,15 +102,76 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("hash-type", &hash_type, "Type of hash used by the decoder "
+                   "to look up tokens by state: \"chained\" (least memory), "
+                   "\"probing\" (open addressing), or \"direct\" (an array "
+                   "indexed by state; fastest, but uses 16 bytes per state of "
+                   "the graph).");
+    opts->Register("flush-interval", &flush_interval, "If >0, the interval "
+                   "(in frames) at which we try to output the part of the "
+                   "lattice that all the surviving paths share, and free the "
+                   "memory for those frames.  This bounds the memory used "
+                   "for long recordings.  If 0, the lattice is output at the "
+                   "end of the utterance.");
+    opts->Register("flush-delay", &flush_delay, "When flushing the lattice "
+                   "(see --flush-interval), the minimum number of frames "
+                   "between the point where we cut it and the most recently "
+                   "decoded frame.");
+    opts->Register("flush-max-frames", &flush_max_frames, "When flushing the "
+                   "lattice (see --flush-interval), if the lattice has not "
+                   "been cut for this many frames, cut it anyway on the best "
+                   "path (this is an approximation, and only applies if "
+                   "there is no point where all the paths meet).  If 0, "
+                   "never cut it on the best path.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
-                 && prune_scale > 0.0 && prune_scale < 1.0);
+                 && prune_scale > 0.0 && prune_scale < 1.0
+                 && flush_interval >= 0 && flush_delay > 0
+                 && flush_max_frames >= 0 && num_decoder_threads >= 1);
+    HashListIndexType type;
+    if (!HashListIndexTypeFromString(hash_type, &type))
+      KALDI_ERR << "Invalid option --hash-type=" << hash_type;
   }
 };
 
 
+/// Statistics about the search on one frame, which LatticeFasterDecoder and
+/// LatticeFasterOnlineDecoder record if you call SetRecordSearchStats(true).
+/// They are intended for tuning the beam and max-active from data, and for
+/// finding the frames on which the decoder spends the most time.
+struct DecoderFrameStats {
+  int32 num_active_tokens;  // The number of tokens active before this frame,
+                            // i.e. before applying the cutoff.
+  BaseFloat adaptive_beam;  // The beam after applying max-active and
+                            // min-active; see GetCutoff().
+  BaseFloat cutoff;  // The cutoff applied to the tokens active before this
+                     // frame, relative to the cost of the best token.
+  int32 num_emitting_arcs;  // The number of emitting arcs expanded.
+  int32 num_nonemitting_arcs;  // The number of nonemitting arcs expanded.
+  int32 num_tokens_pruned;  // The number of tokens of this frame that were
+                            // later deleted by pruning; those created before
+                            // the first frame are counted on frame 0.
+  BaseFloat emitting_time;  // Time in seconds taken by ProcessEmitting().
+  BaseFloat nonemitting_time;  // Time in seconds taken by
+                               // ProcessNonemitting().
+  BaseFloat prune_time;  // Time in seconds taken by the pruning done after
+                         // this frame (if any).
+  DecoderFrameStats(): num_active_tokens(0), adaptive_beam(0.0), cutoff(0.0),
+                       num_emitting_arcs(0), num_nonemitting_arcs(0),
+                       num_tokens_pruned(0), emitting_time(0.0),
+                       nonemitting_time(0.0), prune_time(0.0) { }
+};
+
+/// Converts the per-frame statistics of the search to a matrix with a row for
+/// each frame, and a column for each member of DecoderFrameStats, in the
+/// order in which they are declared.  This is the format written by the
+/// --search-stats-wspecifier option of the decoding programs.
+void SearchStatsToMatrix(const std::vector<DecoderFrameStats> &stats,
+                         Matrix<BaseFloat> *mat);
+
+
 /** A bit more optimized version of the lattice decoder.
    See \ref lattices_generation \ref decoders_faster and \ref decoders_simple
     for more information.
@@ -207,6 +287,43 @@ class LatticeFasterDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// This function is for decoding long recordings (e.g. hours of audio) in
+  /// bounded memory; you may call it between calls to AdvanceDecoding().  It
+  /// looks for the most recent frame, at least 'min_delay' frames before the
+  /// last frame decoded, where all the paths that survive the lattice pruning
+  /// go through a single token (a "cut point").  If it finds one, it outputs
+  /// to 'prefix' the raw lattice up to that token (which becomes the only
+  /// final state of 'prefix', with unit final-prob), frees the tokens on the
+  /// frames before it, and returns true.  The lattices that GetRawLattice()
+  /// and related functions output afterwards start from that token, so
+  /// concatenating the prefixes and the final lattice gives the lattice for
+  /// the whole utterance.  [It may have a few more paths than if we had not
+  /// flushed, since the part before the cut point gets pruned less, but the
+  /// best path is the same].
+  /// If there is no cut point and 'force' is true, it makes one 'min_delay'
+  /// frames back by discarding the paths that do not go through the best
+  /// token there; this is an approximation, but a good one if min_delay is
+  /// large enough for the best path to have settled.
+  /// Returns false if it did not output anything.  Note: we still use a few
+  /// bytes of memory per frame for frames that were flushed.
+  bool FlushRawLattice(int32 min_delay, bool force, Lattice *prefix);
+
+  /// Returns the number of frames whose lattice was output by
+  /// FlushRawLattice() in this utterance.
+  inline int32 NumFramesFlushed() const { return num_frames_flushed_; }
+
+  /// If 'record' is true, the decoder records statistics about the search on
+  /// each frame, which you can get from SearchStats().  Call this before
+  /// InitDecoding() or Decode().
+  void SetRecordSearchStats(bool record) { record_search_stats_ = record; }
+
+  /// Returns the statistics about the search (see DecoderFrameStats), indexed
+  /// by frame, for the frames decoded so far in this utterance; empty unless
+  /// SetRecordSearchStats(true) was called.
+  const std::vector<DecoderFrameStats> &SearchStats() const {
+    return search_stats_;
+  }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -244,11 +361,12 @@ class LatticeFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next) { }
-    inline void DeleteForwardLinks() {
+    inline void DeleteForwardLinks(
+        FreeListAllocator<ForwardLink> *link_allocator) {
       ForwardLink *l = links, *m;
       while (l != NULL) {
         m = l->next;
-        delete l;
+        link_allocator->Delete(l);
         l = m;
       }
       links = NULL;
@@ -267,6 +385,10 @@ class LatticeFasterDecoder {
 
   typedef HashList<StateId, Token*>::Elem Elem;
 
+  // Sets the type of toks_ from config_.hash_type; must be called while
+  // toks_ is empty.
+  void SetHashType();
+
   void PossiblyResizeHash(size_t num_toks);
 
   // FindOrAddToken either locates a token in hash of toks_, or if necessary
@@ -334,6 +456,20 @@ class LatticeFasterDecoder {
   // less far.
   void PruneActiveTokens(BaseFloat delta);
 
+  // Used by FlushRawLattice().  If all the emitting links from the tokens on
+  // frame frame_plus_one - 1 lead to the same token, returns that token;
+  // otherwise, returns NULL, or if 'force' is true, the token with the
+  // lowest extra_cost out of the ones they lead to.
+  Token *FindCutToken(int32 frame_plus_one, bool force) const;
+
+  // Used by FlushRawLattice().  Removes the emitting links from frame
+  // frame_plus_one - 1 that don't lead to 'cut_tok' (which is on frame
+  // frame_plus_one), and the tokens on frame_plus_one and later frames that
+  // can't be reached from it; and recomputes the tot_cost of the tokens that
+  // remain.  Tokens on the current frame can't be deleted as they are in
+  // toks_, so we give them infinite cost instead.
+  void PruneToCutToken(int32 frame_plus_one, Token *cut_tok);
+
   /// Gets the weight cutoff.  Also counts the active tokens.
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
@@ -362,6 +498,12 @@ class LatticeFasterDecoder {
   // the graph.
   HashList<StateId, Token*> toks_;
 
+  // Tokens and ForwardLinks are allocated from these free lists rather than
+  // with new/delete; the memory is kept across utterances, and is only returned
+  // to the system when this object is destroyed.
+  FreeListAllocator<Token> token_allocator_;
+  FreeListAllocator<ForwardLink> link_allocator_;
+
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
@@ -376,8 +518,14 @@ class LatticeFasterDecoder {
   // zero, to reduce roundoff errors.
   LatticeFasterDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
+  int32 num_frames_flushed_;  // The tokens on frames before this (i.e. in
+                              // active_toks_[0 .. num_frames_flushed_ - 1])
+                              // were freed by FlushRawLattice().
   bool warned_;
 
+  bool record_search_stats_;  // see SetRecordSearchStats().
+  std::vector<DecoderFrameStats> search_stats_;  // indexed by frame.
+
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
   /// calling this is optional].  If true, it's forbidden to decode more.  Also,
   /// if this is set, then the output of ComputeFinalCosts() is in the next
@@ -0,0 +1,120 @@
+// decoder/lattice-faster-online-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "decoder/lattice-faster-online-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "fstext/fstext-utils.h"
+#include "lat/kaldi-lattice.h"
+
+
+namespace kaldi {
+using namespace fst;
+
+// Returns a random decoding graph whose input labels are in the range
+// [1, num_pdfs].  The epsilon arcs only go to higher-numbered states, so the
+// graph has no epsilon cycles.
+VectorFst<StdArc> *RandDecodingGraph(int32 num_pdfs) {
+  VectorFst<StdArc> *fst = new VectorFst<StdArc>();
+  int32 num_states = 50 + Rand() % 200;
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = 1 + Rand() % 6;
+    for (int32 a = 0; a < num_arcs; a++) {
+      int32 ilabel = 1 + Rand() % num_pdfs,
+          olabel = (Rand() % 3 == 0 ? 1 + Rand() % 20 : 0),
+          nextstate = Rand() % num_states;
+      fst->AddArc(s, StdArc(ilabel, olabel, 2.0 * RandUniform(), nextstate));
+    }
+    if (s + 1 < num_states && Rand() % 4 == 0) {
+      int32 nextstate = s + 1 + Rand() % (num_states - s - 1);
+      fst->AddArc(s, StdArc(0, 1 + Rand() % 20, RandUniform(), nextstate));
+    }
+    if (Rand() % 2 == 0)
+      fst->SetFinal(s, 5.0 * RandUniform());
+  }
+  return fst;
+}
+
+// Decodes with the given number of threads and outputs the raw lattice and
+// the best path.
+void DecodeWithThreads(const VectorFst<StdArc> &fst,
+                       const Matrix<BaseFloat> &loglikes,
+                       LatticeFasterDecoderConfig config,
+                       int32 num_threads,
+                       Lattice *raw_lat,
+                       Lattice *best_path) {
+  config.num_decoder_threads = num_threads;
+  LatticeFasterOnlineDecoder decoder(fst, config);
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  decoder.Decode(&decodable);
+  KALDI_ASSERT(decoder.NumFramesDecoded() == loglikes.NumRows());
+  decoder.GetRawLattice(raw_lat);
+  decoder.GetBestPath(best_path);
+}
+
+// Checks that decoding with several threads (which goes through
+// ProcessEmittingParallel(), since the graph is a VectorFst and the decodable
+// object supports LogLikelihoodRow()) gives the same lattice as decoding with
+// one thread.
+void TestLatticeFasterOnlineDecoderThreads() {
+  int32 num_pdfs = 5 + Rand() % 20,
+      num_frames = 10 + Rand() % 50;
+  VectorFst<StdArc> *fst = RandDecodingGraph(num_pdfs);
+  Matrix<BaseFloat> loglikes(num_frames, num_pdfs);
+  loglikes.SetRandn();
+  loglikes.Scale(2.0);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 4.0 + 8.0 * RandUniform();
+  config.lattice_beam = 2.0 + 4.0 * RandUniform();
+  config.max_active = (Rand() % 2 == 0 ? 20 + Rand() % 100 :
+                       std::numeric_limits<int32>::max());
+  config.min_active = 5;
+  config.prune_interval = 1 + Rand() % 10;
+
+  Lattice raw_lat1, best_path1;
+  DecodeWithThreads(*fst, loglikes, config, 1, &raw_lat1, &best_path1);
+  int32 num_threads = 2 + Rand() % 3;
+  Lattice raw_lat2, best_path2;
+  DecodeWithThreads(*fst, loglikes, config, num_threads,
+                    &raw_lat2, &best_path2);
+
+  KALDI_ASSERT(raw_lat1.NumStates() == raw_lat2.NumStates());
+  KALDI_ASSERT(RandEquivalent(raw_lat1, raw_lat2, 5, 0.01, Rand(),
+                              2 * num_frames + 10));
+
+  KALDI_ASSERT(best_path1.NumStates() > 0 && best_path2.NumStates() > 0);
+  std::vector<int32> alignment1, alignment2, words1, words2;
+  LatticeWeight weight1, weight2;
+  GetLinearSymbolSequence(best_path1, &alignment1, &words1, &weight1);
+  GetLinearSymbolSequence(best_path2, &alignment2, &words2, &weight2);
+  KALDI_ASSERT(alignment1 == alignment2 && words1 == words2 &&
+               ApproxEqual(weight1, weight2));
+  delete fst;
+}
+
+}  // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestLatticeFasterOnlineDecoderThreads();
+  KALDI_LOG << "Success.";
+}
@@ -25,6 +25,7 @@
 // file in sync with lattice-faster-decoder.cc
 
 #include "decoder/lattice-faster-online-decoder.h"
+#include "base/timer.h"
 #include "lat/lattice-functions.h"
 
 namespace kaldi {
@@ -33,7 +34,8 @@ namespace kaldi {
 LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
     const fst::Fst<fst::StdArc> &fst,
     const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    thread_team_(NULL), fst_(fst), delete_fst_(false), config_(config),
+    num_toks_(0), record_search_stats_(false) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -41,7 +43,8 @@ LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
 
 LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(const LatticeFasterDecoderConfig &config,
                                                        fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+    thread_team_(NULL), fst_(*fst), delete_fst_(true), config_(config),
+    num_toks_(0), record_search_stats_(false) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -50,22 +53,28 @@ LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(const LatticeFasterDecode
 LatticeFasterOnlineDecoder::~LatticeFasterOnlineDecoder() {
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
+  delete thread_team_;
+  DeletePointers(&shard_index_);
   if (delete_fst_) delete &(fst_);
 }
 
 void LatticeFasterOnlineDecoder::InitDecoding() {
   // clean up from last time:
   DeleteElems(toks_.Clear());
+  SetHashType();
+  SetNumThreads();
   cost_offsets_.clear();
   ClearActiveTokens();
   warned_ = false;
   num_toks_ = 0;
+  search_stats_.clear();
   decoding_finalized_ = false;
   final_costs_.clear();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = new (token_allocator_.New()) Token(0.0, 0.0, NULL, NULL,
+                                                        NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -326,6 +335,14 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
 }
 
 
+void LatticeFasterOnlineDecoder::SetHashType() {
+  HashListIndexType type;
+  if (!HashListIndexTypeFromString(config_.hash_type, &type))
+    KALDI_ERR << "Invalid option --hash-type=" << config_.hash_type;
+  if (type != toks_.IndexType())
+    toks_.SetIndexType(type);
+}
+
 void LatticeFasterOnlineDecoder::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
@@ -334,6 +351,35 @@ void LatticeFasterOnlineDecoder::PossiblyResizeHash(size_t num_toks) {
   }
 }
 
+void LatticeFasterOnlineDecoder::SetNumThreads() {
+  int32 num_threads = config_.num_decoder_threads;
+  if (thread_team_ != NULL && thread_team_->NumThreads() == num_threads)
+    return;
+  delete thread_team_;
+  thread_team_ = NULL;
+  DeletePointers(&shard_index_);
+  shard_index_.clear();
+  if (num_threads <= 1) {
+    candidates_.clear();
+    new_toks_.clear();
+    thread_results_.clear();
+    shard_positions_.clear();
+    return;
+  }
+  thread_team_ = new ThreadTeam(num_threads);
+  candidates_.clear();
+  candidates_.resize(num_threads * num_threads);
+  new_toks_.clear();
+  new_toks_.resize(num_threads);
+  for (int32 s = 0; s < num_threads; s++) {
+    shard_index_.push_back(new HashList<StateId, int32>());
+    shard_index_.back()->SetSize(1000);
+  }
+  thread_results_.resize(num_threads);
+  shard_positions_.resize(num_threads);
+  histogram_.resize(kNumCostBins + 1);
+}
+
 // FindOrAddToken either locates a token in hash of toks_,
 // or if necessary inserts a new, empty token (i.e. with no forward links)
 // for the current frame.  [note: it's inserted if necessary into hash toks_
@@ -352,7 +398,9 @@ inline LatticeFasterOnlineDecoder::Token *LatticeFasterOnlineDecoder::FindOrAddT
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = new (token_allocator_.New()) Token(tot_cost, extra_cost,
+                                                        NULL, toks,
+                                                        backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -426,7 +474,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_allocator_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -513,7 +561,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_allocator_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -566,6 +614,7 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
   if (toks == NULL)
     KALDI_WARN << "No tokens alive [doing pruning]\n";
   Token *tok, *next_tok, *prev_tok = NULL;
+  int32 num_pruned = 0;
   for (tok = toks; tok != NULL; tok = next_tok) {
     next_tok = tok->next;
     if (tok->extra_cost == std::numeric_limits<BaseFloat>::infinity()) {
@@ -573,12 +622,19 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_allocator_.Delete(tok);
       num_toks_--;
+      num_pruned++;
     } else {  // fetch next Token
       prev_tok = tok;
     }
   }
+  // The tokens on active_toks_[t+1] were created while decoding frame t, which
+  // is search_stats_[t]; the tokens created before the first frame are counted
+  // on frame 0.
+  int32 t = std::max<int32>(frame_plus_one - 1, 0);
+  if (record_search_stats_ && t < static_cast<int32>(search_stats_.size()))
+    search_stats_[t].num_tokens_pruned += num_pruned;
 }
 
 // Go backwards through still-alive tokens, pruning them, starting not from
@@ -587,6 +643,7 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
 // where the delta-costs are not changing (and the delta controls when we consider
 // a cost to have "not changed").
 void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
+  Timer timer(record_search_stats_);
   int32 cur_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
@@ -613,6 +670,9 @@ void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
   }
   KALDI_VLOG(4) << "PruneActiveTokens: pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  if (record_search_stats_ && !search_stats_.empty()) {
+    search_stats_.back().prune_time += timer.Elapsed();
+  }
 }
 
 void LatticeFasterOnlineDecoder::ComputeFinalCosts(
@@ -774,6 +834,7 @@ void LatticeFasterOnlineDecoder::AdvanceDecoding(DecodableInterface *decodable,
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
 void LatticeFasterOnlineDecoder::FinalizeDecoding() {
+  Timer timer(record_search_stats_);
   int32 final_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
@@ -788,6 +849,9 @@ void LatticeFasterOnlineDecoder::FinalizeDecoding() {
   PruneTokensForFrame(0);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  if (record_search_stats_ && !search_stats_.empty()) {
+    search_stats_.back().prune_time += timer.Elapsed();
+  }
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
@@ -862,6 +926,141 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
 }
 
 
+BaseFloat LatticeFasterOnlineDecoder::GetCutoffParallel(
+    BaseFloat *adaptive_beam, size_t *best_index) {
+  const int32 num_threads = thread_team_->NumThreads();
+  const size_t num_toks = prev_toks_.size();
+  thread_team_->Run([&](int32 t) {
+      const BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+      BaseFloat best_cost = infinity, max_cost = -infinity;
+      size_t best = num_toks;
+      for (size_t i = num_toks * t / num_threads,
+               end = num_toks * (t + 1) / num_threads; i < end; i++) {
+        BaseFloat w = prev_toks_[i].second->tot_cost;
+        if (w < best_cost) {
+          best_cost = w;
+          best = i;
+        }
+        if (w > max_cost && w != infinity)
+          max_cost = w;
+      }
+      ThreadResults &results = thread_results_[t];
+      results.best_cost = best_cost;
+      results.best_index = best;
+      results.max_cost = max_cost;
+    });
+  // As in GetCutoff(), in case of ties the best token is the one that comes
+  // first.
+  BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity(),
+      max_weight = -std::numeric_limits<BaseFloat>::infinity();
+  *best_index = num_toks;
+  for (int32 t = 0; t < num_threads; t++) {
+    if (thread_results_[t].best_cost < best_weight) {
+      best_weight = thread_results_[t].best_cost;
+      *best_index = thread_results_[t].best_index;
+    }
+    max_weight = std::max(max_weight, thread_results_[t].max_cost);
+  }
+
+  BaseFloat beam_cutoff = best_weight + config_.beam;
+  *adaptive_beam = config_.beam;
+  if (config_.max_active == std::numeric_limits<int32>::max() &&
+      config_.min_active == 0)
+    return beam_cutoff;
+
+  KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
+                << " is " << num_toks;
+
+  // The rest of this function computes the same thing as the corresponding
+  // part of GetCutoff(), with SelectCost() instead of std::nth_element.
+  bool have_histogram = false;
+  BaseFloat min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
+      max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  if (num_toks > static_cast<size_t>(config_.max_active)) {
+    ComputeCostHistogram(best_weight, max_weight);
+    have_histogram = true;
+    max_active_cutoff = SelectCost(config_.max_active);
+  }
+  if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+    *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
+    return max_active_cutoff;
+  }
+  if (num_toks > static_cast<size_t>(config_.min_active)) {
+    if (config_.min_active == 0) {
+      min_active_cutoff = best_weight;
+    } else {
+      if (!have_histogram)
+        ComputeCostHistogram(best_weight, max_weight);
+      min_active_cutoff = SelectCost(config_.min_active);
+    }
+  }
+  if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
+    *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
+    return min_active_cutoff;
+  } else {
+    return beam_cutoff;
+  }
+}
+
+void LatticeFasterOnlineDecoder::ComputeCostHistogram(BaseFloat min_cost,
+                                                      BaseFloat max_cost) {
+  histogram_min_cost_ = min_cost;
+  histogram_max_cost_ = max_cost;
+  histogram_scale_ = (max_cost > min_cost ?
+                      kNumCostBins / (max_cost - min_cost) : 0.0);
+  if (!(histogram_scale_ < 1.0e+30))  // guard against overflow; with a scale
+    histogram_scale_ = 0.0;           // of zero, everything goes in bin 0.
+  const int32 num_threads = thread_team_->NumThreads();
+  const size_t num_toks = prev_toks_.size();
+  thread_team_->Run([&](int32 t) {
+      std::vector<int32> &histogram = thread_results_[t].histogram;
+      histogram.assign(kNumCostBins + 1, 0);
+      for (size_t i = num_toks * t / num_threads,
+               end = num_toks * (t + 1) / num_threads; i < end; i++)
+        histogram[CostBin(prev_toks_[i].second->tot_cost)]++;
+    });
+  histogram_.assign(kNumCostBins + 1, 0);
+  for (int32 t = 0; t < num_threads; t++)
+    for (int32 b = 0; b <= kNumCostBins; b++)
+      histogram_[b] += thread_results_[t].histogram[b];
+}
+
+BaseFloat LatticeFasterOnlineDecoder::SelectCost(size_t rank) {
+  KALDI_ASSERT(rank < prev_toks_.size());
+  // Find the bin that the cost we want is in.
+  int32 bin = 0;
+  size_t count_below = 0;
+  while (count_below + histogram_[bin] <= rank) {
+    count_below += histogram_[bin];
+    bin++;
+  }
+  if (bin == kNumCostBins)
+    return std::numeric_limits<BaseFloat>::infinity();
+  const int32 num_threads = thread_team_->NumThreads();
+  const size_t num_toks = prev_toks_.size();
+  thread_team_->Run([&](int32 t) {
+      std::vector<BaseFloat> &selected = thread_results_[t].selected_costs;
+      selected.clear();
+      for (size_t i = num_toks * t / num_threads,
+               end = num_toks * (t + 1) / num_threads; i < end; i++) {
+        BaseFloat w = prev_toks_[i].second->tot_cost;
+        if (CostBin(w) == bin)
+          selected.push_back(w);
+      }
+    });
+  tmp_array_.clear();
+  for (int32 t = 0; t < num_threads; t++)
+    tmp_array_.insert(tmp_array_.end(),
+                      thread_results_[t].selected_costs.begin(),
+                      thread_results_[t].selected_costs.end());
+  KALDI_ASSERT(tmp_array_.size() == static_cast<size_t>(histogram_[bin]));
+  std::nth_element(tmp_array_.begin(),
+                   tmp_array_.begin() + (rank - count_below),
+                   tmp_array_.end());
+  return tmp_array_[rank - count_below];
+}
+
+
 template <typename FstType>
 BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
     DecodableInterface *decodable) {
@@ -870,6 +1069,9 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
   // (zero-based) used to get likelihoods
   // from the decodable object.
   active_toks_.resize(active_toks_.size() + 1);
+  // If the decodable object can give us the whole row of log-likelihoods, we
+  // index it directly rather than calling LogLikelihood() for each arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
 
   Elem *final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
   // in simple-decoder.h.   Removes the Elems from
@@ -879,6 +1081,13 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
   size_t tok_cnt;
   BaseFloat cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
+  if (record_search_stats_) {
+    DecoderFrameStats &stats = search_stats_.back();
+    stats.num_active_tokens = tok_cnt;
+    stats.adaptive_beam = adaptive_beam;
+    if (best_elem != NULL)
+      stats.cutoff = cur_cutoff - best_elem->val->tot_cost;
+  }
 
   BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
   // pruning "online" before having seen all tokens
@@ -900,7 +1109,8 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
         BaseFloat new_weight = arc.weight.Value() + cost_offset - 
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+            (loglikes != NULL ? loglikes[arc.ilabel - 1] :
+             decodable->LogLikelihood(frame, arc.ilabel)) + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -912,6 +1122,7 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
   // do it this way as it's more robust to future code changes.
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
+  int32 num_arcs = 0;  // the number of arcs we expand, for search_stats_.
 
   // the tokens are now owned here, in final_toks, and the hash is empty.
   // 'owned' is a complex thing here; the point is we need to call DeleteElem
@@ -926,8 +1137,10 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
            aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
+          num_arcs++;
           BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
+              (loglikes != NULL ? loglikes[arc.ilabel - 1] :
+               decodable->LogLikelihood(frame, arc.ilabel)),
               graph_cost = arc.weight.Value(),
               cur_cost = tok->tot_cost,
               tot_cost = cur_cost + ac_cost + graph_cost;
@@ -941,14 +1154,17 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
+          tok->links = new (link_allocator_.New()) ForwardLink(
+              next_tok, arc.ilabel, arc.olabel, graph_cost, ac_cost,
+              tok->links);
         }
       } // for all arcs
     }
     e_tail = e->tail;
     toks_.Delete(e); // delete Elem
   }
+  if (record_search_stats_)
+    search_stats_.back().num_emitting_arcs = num_arcs;
   return next_cutoff;
 }
 
@@ -959,18 +1175,222 @@ template BaseFloat LatticeFasterOnlineDecoder::
 template BaseFloat LatticeFasterOnlineDecoder::
     ProcessEmitting<fst::Fst<fst::StdArc>>(DecodableInterface *decodable);
 
+template <typename FstType>
+BaseFloat LatticeFasterOnlineDecoder::ProcessEmittingParallel(
+    const BaseFloat *loglikes) {
+  KALDI_ASSERT(active_toks_.size() > 0);
+  int32 frame = active_toks_.size() - 1; // frame is the frame-index
+  // (zero-based) used to get likelihoods
+  // from the decodable object.
+  active_toks_.resize(active_toks_.size() + 1);
+  const FstType &fst = dynamic_cast<const FstType&>(fst_);
+  const int32 num_threads = thread_team_->NumThreads();
+
+  // Take the tokens out of toks_ and put them in an array, so we can split
+  // them between the threads.
+  prev_toks_.clear();
+  for (Elem *e = toks_.Clear(), *e_tail; e != NULL; e = e_tail) {
+    prev_toks_.push_back(std::make_pair(e->key, e->val));
+    e_tail = e->tail;
+    toks_.Delete(e);
+  }
+  const size_t num_toks = prev_toks_.size();
+
+  size_t best_index;
+  BaseFloat adaptive_beam;
+  BaseFloat cur_cutoff = GetCutoffParallel(&adaptive_beam, &best_index);
+  PossiblyResizeHash(num_toks);
+  if (record_search_stats_) {
+    DecoderFrameStats &stats = search_stats_.back();
+    stats.num_active_tokens = num_toks;
+    stats.adaptive_beam = adaptive_beam;
+    if (best_index < num_toks)
+      stats.cutoff = cur_cutoff - prev_toks_[best_index].second->tot_cost;
+  }
+
+  BaseFloat next_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  BaseFloat cost_offset = 0.0;
+  // As in ProcessEmitting(), first process the best token to get a reasonably
+  // tight bound on the next cutoff.
+  if (best_index < num_toks) {
+    StateId state = prev_toks_[best_index].first;
+    Token *tok = prev_toks_[best_index].second;
+    cost_offset = - tok->tot_cost;
+    for (fst::ArcIterator<FstType> aiter(fst, state);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {  // propagate..
+        BaseFloat new_weight = arc.weight.Value() + cost_offset -
+            loglikes[arc.ilabel - 1] + tok->tot_cost;
+        if (new_weight + adaptive_beam < next_cutoff)
+          next_cutoff = new_weight + adaptive_beam;
+      }
+    }
+  }
+  cost_offsets_.resize(frame + 1, 0.0);
+  cost_offsets_[frame] = cost_offset;
+
+  // Stage 1: thread t expands the tokens in its range of prev_toks_.
+  thread_team_->Run([&](int32 t) {
+      std::vector<ArcCandidate> *candidates = &(candidates_[t * num_threads]);
+      for (int32 s = 0; s < num_threads; s++)
+        candidates[s].clear();
+      std::vector<int32> &candidate_shards =
+          thread_results_[t].candidate_shards;
+      candidate_shards.clear();
+      BaseFloat cutoff = next_cutoff;
+      int32 num_arcs = 0;
+      for (size_t i = num_toks * t / num_threads,
+               end = num_toks * (t + 1) / num_threads; i < end; i++) {
+        Token *tok = prev_toks_[i].second;
+        if (tok->tot_cost > cur_cutoff)
+          continue;
+        for (fst::ArcIterator<FstType> aiter(fst, prev_toks_[i].first);
+             !aiter.Done();
+             aiter.Next()) {
+          const Arc &arc = aiter.Value();
+          if (arc.ilabel != 0) {  // propagate..
+            num_arcs++;
+            BaseFloat ac_cost = cost_offset - loglikes[arc.ilabel - 1],
+                graph_cost = arc.weight.Value(),
+                tot_cost = tok->tot_cost + ac_cost + graph_cost;
+            if (tot_cost > cutoff) continue;
+            else if (tot_cost + adaptive_beam < cutoff)
+              cutoff = tot_cost + adaptive_beam;
+            int32 shard = static_cast<uint32>(arc.nextstate) % num_threads;
+            candidates[shard].push_back(ArcCandidate(
+                tok, arc.nextstate, arc.ilabel, arc.olabel, graph_cost,
+                ac_cost, tot_cost));
+            candidate_shards.push_back(shard);
+          }
+        }
+      }
+      thread_results_[t].next_cutoff = cutoff;
+      thread_results_[t].num_arcs = num_arcs;
+    });
+  // ProcessEmitting() tightens the cutoff as it goes, so an arc is kept if
+  // its cost is within the cutoff given by all the arcs before it.  The arcs
+  // of thread t were only checked against the arcs of thread t, so we work
+  // out the cutoff that the arcs of the previous threads give.
+  int32 num_arcs = 0;
+  for (int32 t = 0; t < num_threads; t++) {
+    thread_results_[t].prefix_cutoff = next_cutoff;
+    next_cutoff = std::min(next_cutoff, thread_results_[t].next_cutoff);
+    num_arcs += thread_results_[t].num_arcs;
+  }
+  if (record_search_stats_)
+    search_stats_.back().num_emitting_arcs = num_arcs;
+
+  // Stage 2: thread s finds the best incoming arc for each next-state in shard
+  // s.  Arcs are visited in order of thread and then arc, and on ties the
+  // first one wins, as in ProcessEmitting().
+  thread_team_->Run([&](int32 s) {
+      HashList<StateId, int32> &index = *(shard_index_[s]);
+      std::vector<NewToken> &new_toks = new_toks_[s];
+      new_toks.clear();
+      size_t num_candidates = 0;
+      for (int32 t = 0; t < num_threads; t++)
+        num_candidates += candidates_[t * num_threads + s].size();
+      size_t new_sz = static_cast<size_t>(
+          static_cast<BaseFloat>(num_candidates) * config_.hash_ratio);
+      if (new_sz > index.Size())
+        index.SetSize(new_sz);
+      for (int32 t = 0; t < num_threads; t++) {
+        std::vector<ArcCandidate> &candidates =
+            candidates_[t * num_threads + s];
+        BaseFloat cutoff = thread_results_[t].prefix_cutoff;
+        for (size_t j = 0; j < candidates.size(); j++) {
+          ArcCandidate &cand = candidates[j];
+          if (cand.tot_cost > cutoff) {
+            cand.nextstate = -1;
+            continue;
+          }
+          HashList<StateId, int32>::Elem *e = index.Find(cand.nextstate);
+          if (e == NULL) {
+            index.Insert(cand.nextstate, new_toks.size());
+            new_toks.push_back(NewToken(cand.nextstate, cand.tot_cost,
+                                        cand.source));
+            cand.nextstate = new_toks.size() - 1;
+          } else {
+            NewToken &new_tok = new_toks[e->val];
+            if (cand.tot_cost < new_tok.tot_cost) {
+              new_tok.tot_cost = cand.tot_cost;
+              new_tok.backpointer = cand.source;
+            }
+            cand.nextstate = e->val;
+          }
+        }
+      }
+      for (HashList<StateId, int32>::Elem *e = index.Clear(), *e_tail;
+           e != NULL; e = e_tail) {
+        e_tail = e->tail;
+        index.Delete(e);
+      }
+    });
+
+  // Stage 3: create the tokens and forward links.  We go through the arcs in
+  // the order in which ProcessEmitting() would, so that the tokens are
+  // created, and inserted in toks_, in the same order; this matters because
+  // the order of toks_ affects the pruning on the next frame.
+  Token *&toks = active_toks_[frame + 1].toks;
+  for (int32 t = 0; t < num_threads; t++) {
+    const std::vector<int32> &candidate_shards =
+        thread_results_[t].candidate_shards;
+    std::fill(shard_positions_.begin(), shard_positions_.end(), 0);
+    for (size_t i = 0; i < candidate_shards.size(); i++) {
+      int32 s = candidate_shards[i];
+      const ArcCandidate &cand =
+          candidates_[t * num_threads + s][shard_positions_[s]++];
+      if (cand.nextstate < 0)
+        continue;
+      NewToken &new_tok = new_toks_[s][cand.nextstate];
+      if (new_tok.tok == NULL) {
+        new_tok.tok = new (token_allocator_.New()) Token(
+            new_tok.tot_cost, 0.0, NULL, toks, new_tok.backpointer);
+        toks = new_tok.tok;
+        num_toks_++;
+        toks_.Insert(new_tok.state, new_tok.tok);
+      }
+      Token *tok = cand.source;
+      tok->links = new (link_allocator_.New()) ForwardLink(
+          new_tok.tok, cand.ilabel, cand.olabel, cand.graph_cost,
+          cand.acoustic_cost, tok->links);
+    }
+  }
+  return next_cutoff;
+}
+
 BaseFloat LatticeFasterOnlineDecoder::ProcessEmittingWrapper(
         DecodableInterface *decodable) {
-  if (fst_.Type() == "const") {
-    return LatticeFasterOnlineDecoder::
+  Timer timer(record_search_stats_);
+  if (record_search_stats_)
+    search_stats_.push_back(DecoderFrameStats());
+  BaseFloat cutoff;
+  // The parallel version needs the whole row of log-likelihoods, since the
+  // decodable object is not required to be thread-safe; and it needs an FST
+  // whose arc iterators are thread-safe.
+  const BaseFloat *loglikes = (thread_team_ == NULL ? NULL :
+                               decodable->LogLikelihoodRow(NumFramesDecoded()));
+  if (loglikes != NULL && fst_.Type() == "const") {
+    cutoff = LatticeFasterOnlineDecoder::
+        ProcessEmittingParallel<fst::ConstFst<Arc>>(loglikes);
+  } else if (loglikes != NULL && fst_.Type() == "vector") {
+    cutoff = LatticeFasterOnlineDecoder::
+        ProcessEmittingParallel<fst::VectorFst<Arc>>(loglikes);
+  } else if (fst_.Type() == "const") {
+    cutoff = LatticeFasterOnlineDecoder::
         ProcessEmitting<fst::ConstFst<Arc>>(decodable);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterOnlineDecoder::
+    cutoff = LatticeFasterOnlineDecoder::
         ProcessEmitting<fst::VectorFst<Arc>>(decodable);
   } else {
-    return LatticeFasterOnlineDecoder::
+    cutoff = LatticeFasterOnlineDecoder::
         ProcessEmitting<fst::Fst<Arc>>(decodable);
   }
+  if (record_search_stats_)
+    search_stats_.back().emitting_time = timer.Elapsed();
+  return cutoff;
 }
 
 template <typename FstType> 
@@ -998,6 +1418,7 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
     }
   }
 
+  int32 num_arcs = 0;  // the number of arcs we expand, for search_stats_.
   while (!queue_.empty()) {
     StateId state = queue_.back();
     queue_.pop_back();
@@ -1010,13 +1431,14 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    tok->DeleteForwardLinks(&link_allocator_); // necessary when re-visiting
     tok->links = NULL;
     for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel == 0) {  // propagate nonemitting only...
+        num_arcs++;
         BaseFloat graph_cost = arc.weight.Value(),
             tot_cost = cur_cost + graph_cost;
         if (tot_cost < cutoff) {
@@ -1025,8 +1447,8 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = new (link_allocator_.New()) ForwardLink(
+              new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -1035,6 +1457,8 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
       }
     } // for all arcs
   } // while queue not empty
+  if (record_search_stats_ && !search_stats_.empty())
+    search_stats_.back().num_nonemitting_arcs = num_arcs;
 }
 
 template void LatticeFasterOnlineDecoder::
@@ -1046,16 +1470,20 @@ template void LatticeFasterOnlineDecoder::
 
 void LatticeFasterOnlineDecoder::ProcessNonemittingWrapper(
         BaseFloat cost_cutoff) {
+  Timer timer(record_search_stats_);
   if (fst_.Type() == "const") {
-    return LatticeFasterOnlineDecoder::
+    LatticeFasterOnlineDecoder::
         ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterOnlineDecoder::
+    LatticeFasterOnlineDecoder::
         ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
   } else {
-    return LatticeFasterOnlineDecoder::
+    LatticeFasterOnlineDecoder::
         ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
   }
+  // Note: there are no statistics for the call from InitDecoding().
+  if (record_search_stats_ && !search_stats_.empty())
+    search_stats_.back().nonemitting_time = timer.Elapsed();
 }
 
 void LatticeFasterOnlineDecoder::DeleteElems(Elem *list) {
@@ -1071,9 +1499,9 @@ void LatticeFasterOnlineDecoder::ClearActiveTokens() { // a cleanup routine, at
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      tok->DeleteForwardLinks(&link_allocator_);
       Token *next_tok = tok->next;
-      delete tok;
+      token_allocator_.Delete(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -29,6 +29,8 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/free-list-allocator.h"
+#include "util/kaldi-thread.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -194,6 +196,18 @@ class LatticeFasterOnlineDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// If 'record' is true, the decoder records statistics about the search on
+  /// each frame, which you can get from SearchStats().  Call this before
+  /// InitDecoding() or Decode().
+  void SetRecordSearchStats(bool record) { record_search_stats_ = record; }
+
+  /// Returns the statistics about the search (see DecoderFrameStats), indexed
+  /// by frame, for the frames decoded so far in this utterance; empty unless
+  /// SetRecordSearchStats(true) was called.
+  const std::vector<DecoderFrameStats> &SearchStats() const {
+    return search_stats_;
+  }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -241,11 +255,12 @@ class LatticeFasterOnlineDecoder {
                  Token *next, Token *backpointer):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
         backpointer(backpointer) { }
-    inline void DeleteForwardLinks() {
+    inline void DeleteForwardLinks(
+        FreeListAllocator<ForwardLink> *link_allocator) {
       ForwardLink *l = links, *m;
       while (l != NULL) {
         m = l->next;
-        delete l;
+        link_allocator->Delete(l);
         l = m;
       }
       links = NULL;
@@ -264,6 +279,10 @@ class LatticeFasterOnlineDecoder {
 
   typedef HashList<StateId, Token*>::Elem Elem;
 
+  // Sets the type of toks_ from config_.hash_type; must be called while
+  // toks_ is empty.
+  void SetHashType();
+
   void PossiblyResizeHash(size_t num_toks);
 
   // FindOrAddToken either locates a token in hash of toks_, or if necessary
@@ -351,6 +370,58 @@ class LatticeFasterOnlineDecoder {
 
   void ProcessNonemittingWrapper(BaseFloat cost_cutoff);
 
+  // The following functions are used instead of GetCutoff() and
+  // ProcessEmitting() if config_.num_decoder_threads > 1, the FST is a
+  // ConstFst or VectorFst, and the decodable object supports
+  // LogLikelihoodRow().  They split the work between the threads of
+  // thread_team_.
+
+  /// Creates or deletes thread_team_ and the buffers that go with it, as
+  /// required by config_.num_decoder_threads.
+  void SetNumThreads();
+
+  /// Parallel version of GetCutoff(), which works on the tokens in prev_toks_
+  /// and gives exactly the same cutoff.  Instead of sorting the costs to
+  /// apply max_active and min_active, it makes a histogram of the costs and
+  /// only sorts the ones in the bin that contains the cutoff.  Outputs the
+  /// index of the best token in prev_toks_ to 'best_index' (or
+  /// prev_toks_.size() if there are no tokens).
+  BaseFloat GetCutoffParallel(BaseFloat *adaptive_beam, size_t *best_index);
+
+  /// Used in GetCutoffParallel(): makes the histogram of the costs of the
+  /// tokens in prev_toks_, with bins of equal width between min_cost and
+  /// max_cost (max_cost must be finite).
+  void ComputeCostHistogram(BaseFloat min_cost, BaseFloat max_cost);
+
+  /// Used in GetCutoffParallel(): returns the cost that would be at position
+  /// 'rank' if the costs of the tokens in prev_toks_ were sorted.  Requires
+  /// ComputeCostHistogram() to have been called.
+  BaseFloat SelectCost(size_t rank);
+
+  /// Returns the bin of the histogram of costs that 'cost' falls into;
+  /// infinite costs go in the extra bin at the end.
+  inline int32 CostBin(BaseFloat cost) const {
+    if (!(cost <= histogram_max_cost_))
+      return kNumCostBins;
+    int32 bin = static_cast<int32>((cost - histogram_min_cost_) *
+                                   histogram_scale_);
+    return std::min(bin, kNumCostBins - 1);
+  }
+
+  /// Parallel version of ProcessEmitting().  'loglikes' is the output of
+  /// LogLikelihoodRow() for the frame we are processing.  The work is done in
+  /// three stages: first each thread expands the arcs leaving its part of the
+  /// tokens, pruning them with its own cutoff, and puts the arcs it keeps
+  /// into buffers that are sharded by next-state.  Then each thread takes one
+  /// shard, prunes its arcs with the cutoff that ProcessEmitting() would have
+  /// used for them, and finds the best incoming arc for each of its
+  /// next-states.  Lastly the tokens and forward links are created, in the
+  /// calling thread since this uses the allocators and toks_, in the same
+  /// order as in ProcessEmitting().  So the output is the same as that of
+  /// ProcessEmitting().
+  template <typename FstType>
+  BaseFloat ProcessEmittingParallel(const BaseFloat *loglikes);
+
   // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
@@ -360,12 +431,95 @@ class LatticeFasterOnlineDecoder {
   // the graph.
   HashList<StateId, Token*> toks_;
 
+  // Tokens and ForwardLinks are allocated from these free lists rather than
+  // with new/delete; the memory is kept across utterances, and is only returned
+  // to the system when this object is destroyed.
+  FreeListAllocator<Token> token_allocator_;
+  FreeListAllocator<ForwardLink> link_allocator_;
+
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
   // make it class member to avoid internal new/delete.
+
+  // The remaining variables up to config_ are only used if
+  // config_.num_decoder_threads > 1; see ProcessEmittingParallel().
+  ThreadTeam *thread_team_;  // NULL if config_.num_decoder_threads == 1.
+
+  // The tokens of the previous frame, with their states, in the order in which
+  // they were in toks_; each thread works on a contiguous range of them.
+  std::vector<std::pair<StateId, Token*> > prev_toks_;
+
+  // An emitting arc that was not pruned in the first stage of
+  // ProcessEmittingParallel().
+  struct ArcCandidate {
+    Token *source;
+    StateId nextstate;  // In the second stage, this is changed to the index
+                        // into new_toks_[shard], or -1 if the arc is pruned.
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+    BaseFloat acoustic_cost;
+    BaseFloat tot_cost;
+    ArcCandidate(Token *source, StateId nextstate, Label ilabel, Label olabel,
+                 BaseFloat graph_cost, BaseFloat acoustic_cost,
+                 BaseFloat tot_cost):
+        source(source), nextstate(nextstate), ilabel(ilabel), olabel(olabel),
+        graph_cost(graph_cost), acoustic_cost(acoustic_cost),
+        tot_cost(tot_cost) { }
+  };
+  // candidates_[t * num_threads + s] is the arcs kept by thread t whose
+  // next-states are in shard s (i.e. nextstate % num_threads == s).
+  std::vector<std::vector<ArcCandidate> > candidates_;
+
+  // A token to be created on the next frame, with the best of its incoming
+  // arcs.
+  struct NewToken {
+    StateId state;
+    BaseFloat tot_cost;
+    Token *backpointer;
+    Token *tok;  // set when the Token is created.
+    NewToken(StateId state, BaseFloat tot_cost, Token *backpointer):
+        state(state), tot_cost(tot_cost), backpointer(backpointer),
+        tok(NULL) { }
+  };
+  std::vector<std::vector<NewToken> > new_toks_;  // indexed by shard.
+  // shard_index_[s] maps from state to index into new_toks_[s]; it is empty
+  // between frames.
+  std::vector<HashList<StateId, int32>* > shard_index_;
+
+  // Per-thread results; they are padded to avoid false sharing.
+  struct ThreadResults {
+    BaseFloat best_cost;
+    size_t best_index;
+    BaseFloat max_cost;
+    BaseFloat next_cutoff;
+    // The cutoff given by the arcs of the threads before this one (and by the
+    // best token), which ProcessEmitting() would have when it reached the
+    // first arc of this thread.
+    BaseFloat prefix_cutoff;
+    int32 num_arcs;
+    // The shards of the arcs that this thread kept, in the order in which it
+    // kept them; used to go through the arcs in their original order.
+    std::vector<int32> candidate_shards;
+    std::vector<int32> histogram;
+    std::vector<BaseFloat> selected_costs;
+    char padding[64];
+  };
+  std::vector<ThreadResults> thread_results_;
+  // Used in the last stage of ProcessEmittingParallel(): the number of arcs of
+  // candidates_[t * num_threads + s] that we have processed, indexed by s.
+  std::vector<size_t> shard_positions_;
+
+  // The histogram of costs made by ComputeCostHistogram().
+  static const int32 kNumCostBins = 1024;
+  std::vector<int32> histogram_;  // dimension kNumCostBins + 1
+  BaseFloat histogram_min_cost_;
+  BaseFloat histogram_max_cost_;
+  BaseFloat histogram_scale_;
+
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
@@ -376,6 +530,9 @@ class LatticeFasterOnlineDecoder {
   int32 num_toks_; // current total #toks allocated...
   bool warned_;
 
+  bool record_search_stats_;  // see SetRecordSearchStats().
+  std::vector<DecoderFrameStats> search_stats_;  // indexed by frame.
+
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
   /// calling this is optional].  If true, it's forbidden to decode more.  Also,
   /// if this is set, then the output of ComputeFinalCosts() is in the next
@@ -0,0 +1,133 @@
+// fstext/compiled-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/rand-fst.h"
+#include "fstext/compiled-fst.h"
+#include "fstext/kaldi-fst-io.h"
+
+
+namespace fst {
+
+// Checks that 'cfst' has the same states and arcs as 'fst', with the
+// emitting and epsilon arcs each in their original order.
+void CheckCompiledFst(const VectorFst<StdArc> &fst, const CompiledFst &cfst,
+                      const std::vector<int32> *pdf_labels) {
+  typedef StdArc::StateId StateId;
+  KALDI_ASSERT(cfst.Start() == fst.Start() &&
+               cfst.NumStates() == fst.NumStates());
+  for (StateId s = 0; s < fst.NumStates(); s++) {
+    KALDI_ASSERT(cfst.Final(s) == fst.Final(s));
+    KALDI_ASSERT(cfst.NumArcs(s) == fst.NumArcs(s) &&
+                 cfst.NumInputEpsilons(s) == fst.NumInputEpsilons(s) &&
+                 cfst.NumOutputEpsilons(s) == fst.NumOutputEpsilons(s));
+    int64 e = cfst.EmittingArcsBegin(s), p = cfst.EpsilonArcsBegin(s);
+    for (ArcIterator<VectorFst<StdArc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      if (arc.ilabel != 0) {
+        KALDI_ASSERT(e < cfst.EmittingArcsEnd(s));
+        KALDI_ASSERT(cfst.EmittingIlabels()[e] == arc.ilabel &&
+                     cfst.EmittingOlabels()[e] == arc.olabel &&
+                     cfst.EmittingWeights()[e] == arc.weight.Value() &&
+                     cfst.EmittingNextstates()[e] == arc.nextstate);
+        int32 pdf_label = (pdf_labels == NULL ? arc.ilabel :
+                           (*pdf_labels)[arc.ilabel]);
+        KALDI_ASSERT(cfst.EmittingPdfLabels()[e] == pdf_label);
+        e++;
+      } else {
+        KALDI_ASSERT(p < cfst.EpsilonArcsEnd(s));
+        KALDI_ASSERT(cfst.EpsilonOlabels()[p] == arc.olabel &&
+                     cfst.EpsilonWeights()[p] == arc.weight.Value() &&
+                     cfst.EpsilonNextstates()[p] == arc.nextstate);
+        p++;
+      }
+    }
+    KALDI_ASSERT(e == cfst.EmittingArcsEnd(s) && p == cfst.EpsilonArcsEnd(s));
+    // Check that the data is aligned as advertised.
+    KALDI_ASSERT(reinterpret_cast<size_t>(cfst.EmittingIlabels()) % 64 == 0 &&
+                 reinterpret_cast<size_t>(cfst.EmittingWeights()) % 64 == 0 &&
+                 reinterpret_cast<size_t>(cfst.EpsilonNextstates()) % 64 == 0);
+  }
+  // Check the generic Fst interface.  Generic code (e.g. CountStates())
+  // relies on kExpanded meaning that the FST is an ExpandedFst.
+  const Fst<StdArc> &generic_fst = cfst;
+  KALDI_ASSERT(cfst.Properties(kExpanded, false) &&
+               CountStates(generic_fst) == fst.NumStates());
+  VectorFst<StdArc> fst2(cfst);
+  KALDI_ASSERT(RandEquivalent(fst, fst2, 5, 0.01, kaldi::Rand(), 10));
+}
+
+void TestCompiledFst() {
+  for (int32 i = 0; i < 10; i++) {
+    RandFstOptions opts;
+    VectorFst<StdArc> *fst = RandFst<StdArc>(opts);
+
+    std::vector<int32> pdf_labels;
+    int32 num_pdfs = kaldi::RandInt(1, 5);
+    for (int32 j = 0; j <= static_cast<int32>(opts.n_syms); j++)
+      pdf_labels.push_back(kaldi::RandInt(1, num_pdfs));
+    bool use_pdf_labels = (kaldi::Rand() % 2 == 0);
+
+    CompiledFst cfst(*fst, (use_pdf_labels ? &pdf_labels : NULL), num_pdfs);
+    KALDI_ASSERT(cfst.HasPdfLabels() == use_pdf_labels);
+    CheckCompiledFst(*fst, cfst, (use_pdf_labels ? &pdf_labels : NULL));
+
+    // Test I/O.
+    std::ostringstream os;
+    KALDI_ASSERT(cfst.Write(os, FstWriteOptions("<unknown>")));
+    std::istringstream is(os.str());
+    CompiledFst *cfst2 = CompiledFst::Read(is, FstReadOptions("<unknown>"));
+    KALDI_ASSERT(cfst2 != NULL && cfst2->NumPdfs() == cfst.NumPdfs());
+    CheckCompiledFst(*fst, *cfst2, (use_pdf_labels ? &pdf_labels : NULL));
+
+    // Copies share the data.
+    CompiledFst *cfst3 = cfst2->Copy();
+    delete cfst2;
+    CheckCompiledFst(*fst, *cfst3, (use_pdf_labels ? &pdf_labels : NULL));
+    delete cfst3;
+    delete fst;
+  }
+}
+
+// Checks that CastOrConvertToVectorFst() converts a CompiledFst to an
+// equivalent VectorFst.
+void TestConvertCompiledFst() {
+  RandFstOptions opts;
+  VectorFst<StdArc> *fst = RandFst<StdArc>(opts);
+  VectorFst<StdArc> *converted_fst =
+      CastOrConvertToVectorFst(new CompiledFst(*fst));
+  KALDI_ASSERT(converted_fst->Start() == fst->Start() &&
+               converted_fst->NumStates() == fst->NumStates());
+  for (StdArc::StateId s = 0; s < fst->NumStates(); s++)
+    KALDI_ASSERT(converted_fst->NumArcs(s) == fst->NumArcs(s) &&
+                 converted_fst->Final(s) == fst->Final(s));
+  KALDI_ASSERT(RandEquivalent(*fst, *converted_fst, 5, 0.01, kaldi::Rand(),
+                              10));
+  delete converted_fst;
+  delete fst;
+}
+
+} // end namespace fst
+
+int main() {
+  using namespace fst;
+  for (int i = 0; i < 2; i++) {
+    TestCompiledFst();
+    TestConvertCompiledFst();
+  }
+  std::cout << "Test OK\n";
+}
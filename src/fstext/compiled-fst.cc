@@ -0,0 +1,327 @@
+// fstext/compiled-fst.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/compiled-fst.h"
+#include "base/kaldi-utils.h"
+#include "util/kaldi-io.h"
+
+namespace fst {
+
+namespace {
+
+// Arrays in CompiledFst start on multiples of this many bytes.
+const size_t kCompiledFstAlignment = 64;
+
+inline size_t RoundUpToAlignment(size_t size) {
+  return (size + kCompiledFstAlignment - 1) / kCompiledFstAlignment *
+      kCompiledFstAlignment;
+}
+
+// Arc iterator for the generic Fst interface; the emitting arcs come first,
+// then the epsilon arcs.
+class CompiledFstArcIterator: public ArcIteratorBase<StdArc> {
+ public:
+  typedef StdArc Arc;
+  CompiledFstArcIterator(const CompiledFst &fst, CompiledFst::StateId s):
+      fst_(fst), emitting_begin_(fst.EmittingArcsBegin(s)),
+      num_emitting_(fst.NumEmittingArcs(s)),
+      epsilon_begin_(fst.EpsilonArcsBegin(s)),
+      num_arcs_(num_emitting_ + fst.NumEpsilonArcs(s)), pos_(0) { }
+
+ private:
+  virtual bool Done_() const { return pos_ >= num_arcs_; }
+  virtual const Arc& Value_() const {
+    if (pos_ < num_emitting_) {
+      int64 i = emitting_begin_ + pos_;
+      arc_.ilabel = fst_.EmittingIlabels()[i];
+      arc_.olabel = fst_.EmittingOlabels()[i];
+      arc_.weight = Arc::Weight(fst_.EmittingWeights()[i]);
+      arc_.nextstate = fst_.EmittingNextstates()[i];
+    } else {
+      int64 i = epsilon_begin_ + pos_ - num_emitting_;
+      arc_.ilabel = 0;
+      arc_.olabel = fst_.EpsilonOlabels()[i];
+      arc_.weight = Arc::Weight(fst_.EpsilonWeights()[i]);
+      arc_.nextstate = fst_.EpsilonNextstates()[i];
+    }
+    return arc_;
+  }
+  virtual void Next_() { pos_++; }
+  virtual size_t Position_() const { return pos_; }
+  virtual void Reset_() { pos_ = 0; }
+  virtual void Seek_(size_t a) { pos_ = a; }
+  virtual uint32 Flags_() const { return kArcValueFlags; }
+  virtual void SetFlags_(uint32 flags, uint32 mask) { }
+
+  const CompiledFst &fst_;
+  int64 emitting_begin_;
+  size_t num_emitting_;
+  int64 epsilon_begin_;
+  size_t num_arcs_;
+  size_t pos_;
+  mutable Arc arc_;
+};
+
+}  // namespace
+
+
+CompiledFst::Storage::Storage(size_t size): region_(NULL) {
+  void *temp;
+  if ((data_ = static_cast<char*>(
+          KALDI_MEMALIGN(kCompiledFstAlignment, std::max<size_t>(size, 1),
+                         &temp))) == NULL)
+    throw std::bad_alloc();
+  memset(data_, 0, size);
+}
+
+CompiledFst::Storage::Storage(MappedFile *region):
+    data_(static_cast<char*>(region->mutable_data())), region_(region) {
+  KALDI_ASSERT(reinterpret_cast<size_t>(data_) % kCompiledFstAlignment == 0);
+}
+
+CompiledFst::Storage::~Storage() {
+  if (region_ != NULL)
+    delete region_;
+  else
+    KALDI_MEMALIGN_FREE(data_);
+}
+
+CompiledFst::CompiledFst():
+    start_(kNoStateId), num_states_(0), num_emitting_arcs_(0),
+    num_epsilon_arcs_(0), num_pdfs_(0), properties_(0) { }
+
+size_t CompiledFst::BlockSize() const {
+  size_t states_size = RoundUpToAlignment(sizeof(float) * num_states_),
+      offsets_size = RoundUpToAlignment(sizeof(int64) * (num_states_ + 1)),
+      emitting_size = RoundUpToAlignment(sizeof(int32) * num_emitting_arcs_),
+      epsilon_size = RoundUpToAlignment(sizeof(int32) * num_epsilon_arcs_);
+  int32 num_emitting_arrays = (num_pdfs_ > 0 ? 5 : 4);
+  return states_size + 2 * offsets_size +
+      num_emitting_arrays * emitting_size + 3 * epsilon_size;
+}
+
+void CompiledFst::SetPointers(char *data) {
+  size_t states_size = RoundUpToAlignment(sizeof(float) * num_states_),
+      offsets_size = RoundUpToAlignment(sizeof(int64) * (num_states_ + 1)),
+      emitting_size = RoundUpToAlignment(sizeof(int32) * num_emitting_arcs_),
+      epsilon_size = RoundUpToAlignment(sizeof(int32) * num_epsilon_arcs_);
+  final_costs_ = reinterpret_cast<float*>(data);
+  data += states_size;
+  emitting_offsets_ = reinterpret_cast<int64*>(data);
+  data += offsets_size;
+  epsilon_offsets_ = reinterpret_cast<int64*>(data);
+  data += offsets_size;
+  emitting_ilabels_ = reinterpret_cast<Label*>(data);
+  data += emitting_size;
+  if (num_pdfs_ > 0) {
+    emitting_pdf_labels_ = reinterpret_cast<Label*>(data);
+    data += emitting_size;
+  } else {
+    emitting_pdf_labels_ = emitting_ilabels_;
+  }
+  emitting_olabels_ = reinterpret_cast<Label*>(data);
+  data += emitting_size;
+  emitting_weights_ = reinterpret_cast<float*>(data);
+  data += emitting_size;
+  emitting_nextstates_ = reinterpret_cast<StateId*>(data);
+  data += emitting_size;
+  epsilon_olabels_ = reinterpret_cast<Label*>(data);
+  data += epsilon_size;
+  epsilon_weights_ = reinterpret_cast<float*>(data);
+  data += epsilon_size;
+  epsilon_nextstates_ = reinterpret_cast<StateId*>(data);
+}
+
+CompiledFst::CompiledFst(const Fst<Arc> &fst,
+                         const std::vector<int32> *pdf_labels,
+                         int32 num_pdfs):
+    start_(fst.Start()), num_states_(0), num_emitting_arcs_(0),
+    num_epsilon_arcs_(0), num_pdfs_(pdf_labels != NULL ? num_pdfs : 0) {
+  if (!fst.Properties(kExpanded, false))
+    KALDI_ERR << "CompiledFst can only be created from an expanded FST.";
+  if (pdf_labels != NULL && num_pdfs <= 0)
+    KALDI_ERR << "Invalid number of pdfs " << num_pdfs;
+  num_states_ = CountStates(fst);
+  for (StateIterator<Fst<Arc> > siter(fst); !siter.Done(); siter.Next()) {
+    StateId s = siter.Value();
+    size_t num_eps = fst.NumInputEpsilons(s);
+    num_epsilon_arcs_ += num_eps;
+    num_emitting_arcs_ += fst.NumArcs(s) - num_eps;
+  }
+  // The arc order changes, so the properties that depend on it are not kept.
+  properties_ = (fst.Properties(kCopyProperties, false) &
+                 ~(kILabelSorted | kNotILabelSorted |
+                   kOLabelSorted | kNotOLabelSorted)) | kExpanded;
+  storage_ = std::make_shared<Storage>(BlockSize());
+  SetPointers(storage_->Data());
+
+  int64 emitting_index = 0, epsilon_index = 0;
+  for (StateId s = 0; s < num_states_; s++) {
+    final_costs_[s] = fst.Final(s).Value();
+    emitting_offsets_[s] = emitting_index;
+    epsilon_offsets_[s] = epsilon_index;
+    for (ArcIterator<Fst<Arc> > aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {
+        emitting_ilabels_[emitting_index] = arc.ilabel;
+        if (pdf_labels != NULL) {
+          if (arc.ilabel < 0 ||
+              static_cast<size_t>(arc.ilabel) >= pdf_labels->size() ||
+              (*pdf_labels)[arc.ilabel] <= 0 ||
+              (*pdf_labels)[arc.ilabel] > num_pdfs)
+            KALDI_ERR << "No valid pdf label for ilabel " << arc.ilabel;
+          emitting_pdf_labels_[emitting_index] = (*pdf_labels)[arc.ilabel];
+        }
+        emitting_olabels_[emitting_index] = arc.olabel;
+        emitting_weights_[emitting_index] = arc.weight.Value();
+        emitting_nextstates_[emitting_index] = arc.nextstate;
+        emitting_index++;
+      } else {
+        epsilon_olabels_[epsilon_index] = arc.olabel;
+        epsilon_weights_[epsilon_index] = arc.weight.Value();
+        epsilon_nextstates_[epsilon_index] = arc.nextstate;
+        epsilon_index++;
+      }
+    }
+  }
+  KALDI_ASSERT(emitting_index == num_emitting_arcs_ &&
+               epsilon_index == num_epsilon_arcs_);
+  emitting_offsets_[num_states_] = emitting_index;
+  epsilon_offsets_[num_states_] = epsilon_index;
+}
+
+size_t CompiledFst::NumOutputEpsilons(StateId s) const {
+  size_t ans = 0;
+  for (int64 i = EmittingArcsBegin(s); i < EmittingArcsEnd(s); i++)
+    if (emitting_olabels_[i] == 0) ans++;
+  for (int64 i = EpsilonArcsBegin(s); i < EpsilonArcsEnd(s); i++)
+    if (epsilon_olabels_[i] == 0) ans++;
+  return ans;
+}
+
+void CompiledFst::InitArcIterator(StateId s,
+                                  ArcIteratorData<Arc> *data) const {
+  data->base = new CompiledFstArcIterator(*this, s);
+}
+
+bool CompiledFst::Write(std::ostream &strm,
+                        const FstWriteOptions &opts) const {
+  FstHeader hdr;
+  hdr.SetFstType(Type());
+  hdr.SetArcType(Arc::Type());
+  hdr.SetVersion(kFileVersion);
+  hdr.SetFlags(0);
+  hdr.SetProperties(properties_);
+  hdr.SetStart(start_);
+  hdr.SetNumStates(num_states_);
+  hdr.SetNumArcs(num_emitting_arcs_ + num_epsilon_arcs_);
+  if (!hdr.Write(strm, opts.source))
+    return false;
+  kaldi::WriteBasicType(strm, true, num_emitting_arcs_);
+  kaldi::WriteBasicType(strm, true, num_epsilon_arcs_);
+  kaldi::WriteBasicType(strm, true, num_pdfs_);
+  // If we know the stream position, we pad so that the block starts at a
+  // multiple of 64 bytes in the file; this is what allows Read() to memory-map
+  // it with the arrays aligned.  The amount of padding is written first.
+  int32 padding = 0;
+  std::streamoff pos = strm.tellp();
+  if (pos >= 0) {
+    pos += 1 + sizeof(int32);  // the size of the next WriteBasicType().
+    padding = (kCompiledFstAlignment - pos % kCompiledFstAlignment) %
+        kCompiledFstAlignment;
+  }
+  kaldi::WriteBasicType(strm, true, padding);
+  for (int32 i = 0; i < padding; i++)
+    strm.put(0);
+  strm.write(reinterpret_cast<const char*>(final_costs_), BlockSize());
+  strm.flush();
+  if (!strm) {
+    KALDI_WARN << "CompiledFst::Write: write failed: " << opts.source;
+    return false;
+  }
+  return true;
+}
+
+bool CompiledFst::Write(const std::string &filename) const {
+  kaldi::Output ko(filename, true, false);
+  FstWriteOptions wopts(kaldi::PrintableWxfilename(filename));
+  return Write(ko.Stream(), wopts) && ko.Close();
+}
+
+CompiledFst *CompiledFst::Read(std::istream &strm,
+                               const FstReadOptions &opts) {
+  FstHeader hdr;
+  if (opts.header != NULL) {
+    hdr = *opts.header;
+  } else if (!hdr.Read(strm, opts.source)) {
+    return NULL;
+  }
+  if (hdr.FstType() != "compiled" || hdr.ArcType() != Arc::Type()) {
+    KALDI_WARN << "CompiledFst::Read: FST of type " << hdr.FstType()
+               << " with arc type " << hdr.ArcType() << " is not a "
+               << "CompiledFst: " << opts.source;
+    return NULL;
+  }
+  if (hdr.Version() != kFileVersion) {
+    KALDI_WARN << "CompiledFst::Read: unsupported version " << hdr.Version()
+               << " (you may need to re-create the file with fst-to-kgraph): "
+               << opts.source;
+    return NULL;
+  }
+  std::unique_ptr<CompiledFst> fst(new CompiledFst());
+  fst->start_ = hdr.Start();
+  fst->num_states_ = hdr.NumStates();
+  fst->properties_ = hdr.Properties();
+  int32 padding;
+  kaldi::ReadBasicType(strm, true, &(fst->num_emitting_arcs_));
+  kaldi::ReadBasicType(strm, true, &(fst->num_epsilon_arcs_));
+  kaldi::ReadBasicType(strm, true, &(fst->num_pdfs_));
+  kaldi::ReadBasicType(strm, true, &padding);
+  strm.ignore(padding);
+  size_t block_size = fst->BlockSize();
+  if (opts.mode == FstReadOptions::MAP) {
+    // MappedFile::Map() memory-maps the region if it can (in which case the
+    // alignment in memory is the same as in the file, modulo the page size),
+    // and otherwise reads it into memory.
+    MappedFile *region = MappedFile::Map(&strm, true, opts.source,
+                                         block_size);
+    if (region == NULL) {
+      KALDI_WARN << "CompiledFst::Read: read failed: " << opts.source;
+      return NULL;
+    }
+    if (reinterpret_cast<size_t>(region->data()) % kCompiledFstAlignment
+        == 0) {
+      fst->storage_ = std::make_shared<Storage>(region);
+    } else {
+      fst->storage_ = std::make_shared<Storage>(block_size);
+      memcpy(fst->storage_->Data(), region->data(), block_size);
+      delete region;
+    }
+  } else {
+    fst->storage_ = std::make_shared<Storage>(block_size);
+    strm.read(fst->storage_->Data(), block_size);
+  }
+  fst->SetPointers(fst->storage_->Data());
+  if (!strm) {
+    KALDI_WARN << "CompiledFst::Read: read failed: " << opts.source;
+    return NULL;
+  }
+  return fst.release();
+}
+
+
+}  // namespace fst
@@ -0,0 +1,218 @@
+// fstext/compiled-fst.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_COMPILED_FST_H_
+#define KALDI_FSTEXT_COMPILED_FST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <fst/fstlib.h>
+#include "base/kaldi-common.h"
+
+namespace fst {
+
+/**
+   CompiledFst is a read-only FST type (type "compiled") whose memory layout is
+   designed for the decoders, and which is written to disk by the program
+   fst-to-kgraph (conventionally as HCLG.kgraph).  Compared with ConstFst:
+
+    - The emitting arcs (ilabel != 0) and the epsilon arcs (ilabel == 0) of
+      each state are stored separately, so that ProcessEmitting() and
+      ProcessNonemitting() in the decoders only visit the arcs they need.
+      Within each of the two groups the arcs keep their original order, so
+      the decoders visit arcs in the same order as with the original FST and
+      produce the same lattices.
+    - The arcs are stored as a struct of arrays (one array each for the
+      ilabels, olabels, weights and next-states), each aligned to 64 bytes,
+      rather than as an array of 16-byte structs.
+    - Optionally, each emitting arc has a "pdf label", which is what the
+      decoder passes to DecodableInterface::LogLikelihood() instead of the
+      ilabel.  fst-to-kgraph sets this to the pdf-id plus one, so the decodable
+      object does not need to map transition-ids to pdf-ids; this requires a
+      decodable object that is indexed by pdf-id plus one, such as
+      DecodableMatrixScaled.  The ilabels (transition-ids) are still used
+      in the lattices.
+
+   It implements the ExpandedFst interface (so it can be returned by
+   ReadFstKaldiGeneric() and used with generic code, e.g. GetRawLattice(), or
+   converted to a VectorFst), but the arc iterator is slow; the decoders access
+   the arrays directly.
+*/
+class CompiledFst: public ExpandedFst<StdArc> {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+  typedef Arc::Weight Weight;
+
+  /// Creates a CompiledFst from 'fst', which must be expanded (e.g. a
+  /// ConstFst or VectorFst).  If 'pdf_labels' is non-NULL, the pdf label of
+  /// an emitting arc with ilabel i will be (*pdf_labels)[i]; it must be
+  /// positive, and 'num_pdfs' must be the number of distinct pdf labels that
+  /// the decodable object supports (its NumIndices()).
+  explicit CompiledFst(const Fst<Arc> &fst,
+                       const std::vector<int32> *pdf_labels = NULL,
+                       int32 num_pdfs = 0);
+
+  CompiledFst(const CompiledFst &other) = default;
+
+  StateId Start() const override { return start_; }
+
+  Weight Final(StateId s) const override { return Weight(final_costs_[s]); }
+
+  size_t NumArcs(StateId s) const override {
+    return NumEmittingArcs(s) + NumEpsilonArcs(s);
+  }
+
+  size_t NumInputEpsilons(StateId s) const override {
+    return NumEpsilonArcs(s);
+  }
+
+  size_t NumOutputEpsilons(StateId s) const override;
+
+  uint64 Properties(uint64 mask, bool test) const override {
+    return properties_ & mask;
+  }
+
+  const std::string &Type() const override {
+    static const std::string type = "compiled";
+    return type;
+  }
+
+  CompiledFst *Copy(bool safe = false) const override {
+    return new CompiledFst(*this);
+  }
+
+  const SymbolTable *InputSymbols() const override { return NULL; }
+
+  const SymbolTable *OutputSymbols() const override { return NULL; }
+
+  void InitStateIterator(StateIteratorData<Arc> *data) const override {
+    data->base = NULL;
+    data->nstates = num_states_;
+  }
+
+  void InitArcIterator(StateId s, ArcIteratorData<Arc> *data) const override;
+
+  bool Write(std::ostream &strm, const FstWriteOptions &opts) const override;
+
+  bool Write(const std::string &filename) const override;
+
+  /// Reads a CompiledFst.  If opts.header is non-NULL, the FstHeader is
+  /// assumed to have already been read.  If opts.mode is FstReadOptions::MAP
+  /// and opts.source is the name of the file that 'strm' reads from, the
+  /// arrays are memory-mapped read-only rather than read into memory, so
+  /// processes that read the same graph share its memory (this needs the
+  /// file to have been written with a known stream position, i.e. not to a
+  /// pipe).  Returns NULL on error.
+  static CompiledFst *Read(std::istream &strm, const FstReadOptions &opts);
+
+  StateId NumStates() const override { return num_states_; }
+
+  /// The emitting arcs of state s are those with indexes from
+  /// EmittingArcsBegin(s) to EmittingArcsEnd(s) - 1 in the arrays returned by
+  /// EmittingIlabels(), EmittingPdfLabels() and so on.
+  int64 EmittingArcsBegin(StateId s) const { return emitting_offsets_[s]; }
+  int64 EmittingArcsEnd(StateId s) const { return emitting_offsets_[s + 1]; }
+  size_t NumEmittingArcs(StateId s) const {
+    return emitting_offsets_[s + 1] - emitting_offsets_[s];
+  }
+  const Label *EmittingIlabels() const { return emitting_ilabels_; }
+  /// Returns the labels that the decoder should use to look up the
+  /// likelihoods; this is the same array as EmittingIlabels() unless
+  /// HasPdfLabels().
+  const Label *EmittingPdfLabels() const { return emitting_pdf_labels_; }
+  const Label *EmittingOlabels() const { return emitting_olabels_; }
+  const float *EmittingWeights() const { return emitting_weights_; }
+  const StateId *EmittingNextstates() const { return emitting_nextstates_; }
+
+  /// The same as the Emitting* functions, for the epsilon arcs (the ilabels
+  /// of these are all zero).
+  int64 EpsilonArcsBegin(StateId s) const { return epsilon_offsets_[s]; }
+  int64 EpsilonArcsEnd(StateId s) const { return epsilon_offsets_[s + 1]; }
+  size_t NumEpsilonArcs(StateId s) const {
+    return epsilon_offsets_[s + 1] - epsilon_offsets_[s];
+  }
+  const Label *EpsilonOlabels() const { return epsilon_olabels_; }
+  const float *EpsilonWeights() const { return epsilon_weights_; }
+  const StateId *EpsilonNextstates() const { return epsilon_nextstates_; }
+
+  /// True if the emitting arcs have pdf labels distinct from their ilabels
+  /// (see the class comment).
+  bool HasPdfLabels() const { return num_pdfs_ > 0; }
+  /// If HasPdfLabels(), the number of pdfs (the pdf labels are in the range
+  /// 1 ... NumPdfs()); otherwise zero.
+  int32 NumPdfs() const { return num_pdfs_; }
+
+ private:
+  CompiledFst();
+
+  // Returns the size in bytes of the block of memory that holds all the
+  // arrays, given num_states_, num_emitting_arcs_, num_epsilon_arcs_ and
+  // num_pdfs_.  This block is also what we write to disk.
+  size_t BlockSize() const;
+
+  // Sets up the array pointers to point into 'block', which must be 64-byte
+  // aligned and of size BlockSize().
+  void SetPointers(char *block);
+
+  // This holds the memory for all the arrays, which is either allocated by us
+  // or memory-mapped from a file; it is shared between copies.
+  class Storage {
+   public:
+    // Allocates 'size' bytes of zeroed, 64-byte aligned memory.
+    explicit Storage(size_t size);
+    // Takes ownership of 'region', which must be 64-byte aligned.
+    explicit Storage(MappedFile *region);
+    char *Data() { return data_; }
+    ~Storage();
+   private:
+    char *data_;
+    MappedFile *region_;
+  };
+
+  StateId start_;
+  StateId num_states_;
+  int64 num_emitting_arcs_;
+  int64 num_epsilon_arcs_;
+  int32 num_pdfs_;
+  uint64 properties_;
+
+  std::shared_ptr<Storage> storage_;
+  // The following point into the block in storage_, and are each 64-byte
+  // aligned.
+  float *final_costs_;          // dimension num_states_
+  int64 *emitting_offsets_;     // dimension num_states_ + 1
+  int64 *epsilon_offsets_;      // dimension num_states_ + 1
+  Label *emitting_ilabels_;     // dimension num_emitting_arcs_
+  Label *emitting_pdf_labels_;  // num_emitting_arcs_; == emitting_ilabels_
+                                // if !HasPdfLabels().
+  Label *emitting_olabels_;     // dimension num_emitting_arcs_
+  float *emitting_weights_;     // dimension num_emitting_arcs_
+  StateId *emitting_nextstates_;  // dimension num_emitting_arcs_
+  Label *epsilon_olabels_;      // dimension num_epsilon_arcs_
+  float *epsilon_weights_;      // dimension num_epsilon_arcs_
+  StateId *epsilon_nextstates_;  // dimension num_epsilon_arcs_
+
+  static const int32 kFileVersion = 2;
+};
+
+
+}  // namespace fst
+
+#endif  // KALDI_FSTEXT_COMPILED_FST_H_
@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include "fstext/kaldi-fst-io.h"
+#include "fstext/compiled-fst.h"
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
 #include "util/kaldi-io.h"
@@ -69,13 +70,21 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
       return NULL;
     }
   }
-  // Read the FST
+  // Read the FST.  If it's an ordinary file, we ask for ConstFst and
+  // CompiledFst to be memory-mapped rather than read into memory (they will
+  // fall back to reading it if it can't be mapped).
   FstReadOptions ropts("<unspecified>", &hdr);
+  if (kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput) {
+    ropts.mode = FstReadOptions::MAP;
+    ropts.source = rxfilename;
+  }
   Fst<StdArc> *fst = NULL;
   if (hdr.FstType() == "const") {
     fst = ConstFst<StdArc>::Read(ki.Stream(), ropts);
   } else if (hdr.FstType() == "vector") {
     fst = VectorFst<StdArc>::Read(ki.Stream(), ropts);
+  } else if (hdr.FstType() == "compiled") {
+    fst = CompiledFst::Read(ki.Stream(), ropts);
   }
   if (!fst) {
     if(throw_on_err) {
@@ -92,9 +101,12 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
 }
 
 VectorFst<StdArc> *CastOrConvertToVectorFst(Fst<StdArc> *fst) {
-  // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
+  // This version currently supports ConstFst<StdArc>, VectorFst<StdArc> or
+  // CompiledFst (all of which are ExpandedFsts, as the VectorFst constructor
+  // needs for FSTs with the kExpanded property).
   std::string real_type = fst->Type();
-  KALDI_ASSERT(real_type == "vector" || real_type == "const");
+  KALDI_ASSERT(real_type == "vector" || real_type == "const" ||
+               real_type == "compiled");
   if (real_type == "vector") {
     return dynamic_cast<VectorFst<StdArc> *>(fst);
   } else {
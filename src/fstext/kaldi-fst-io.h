@@ -45,8 +45,16 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 // If it can't read the FST, if throw_on_err == true it throws using KALDI_ERR;
 // otherwise it prints a warning and returns. Note:this
 // doesn't support the text-mode option that we generally like to support.
-// This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
-// (const-fst can give better performance for decoding).
+// This version currently supports ConstFst<StdArc>, VectorFst<StdArc> or
+// CompiledFst (const-fst can give better performance for decoding than
+// vector-fst, and CompiledFst better still; see compiled-fst.h).
+// If 'rxfilename' is an ordinary file (not a pipe, stdin or an offset into a
+// file), ConstFst and CompiledFst are memory-mapped read-only instead of
+// being read into memory, so that all the processes on a machine that read
+// the same graph share the same physical memory, and reading it is almost
+// instant.  For ConstFst this requires the file to have been written
+// aligned, e.g. with "fstconvert --fst_type=const --fst_align=true"; if it
+// wasn't, it is read into memory as before.
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
                                  bool throw_on_err = true);
 
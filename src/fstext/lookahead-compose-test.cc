@@ -0,0 +1,57 @@
+// fstext/lookahead-compose-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/rand-fst.h"
+#include "fstext/lookahead-compose.h"
+
+
+namespace fst {
+
+// Checks that the on-the-fly composition of random FSTs is equivalent to the
+// static composition.
+void TestLookaheadCompose() {
+  for (int32 i = 0; i < 10; i++) {
+    RandFstOptions opts;
+    opts.acyclic = (kaldi::Rand() % 2 == 0);
+    VectorFst<StdArc> *hcl = RandFst<StdArc>(opts);
+    VectorFst<StdArc> *g = RandFst<StdArc>(opts);
+
+    VectorFst<StdArc> hcl_sorted(*hcl), g_sorted(*g), composed;
+    ArcSort(&hcl_sorted, OLabelCompare<StdArc>());
+    ArcSort(&g_sorted, ILabelCompare<StdArc>());
+    Compose(hcl_sorted, g_sorted, &composed);
+
+    size_t cache_size = (kaldi::Rand() % 2 == 0 ? 0 : 1 << 20);
+    LookaheadComposeFst lookahead_fst(*hcl, g, cache_size);  // takes g.
+    VectorFst<StdArc> lookahead_composed(lookahead_fst.GetFst());
+    // The weights are pushed differently, so the FSTs are not identical, but
+    // the weights of the paths are the same.
+    KALDI_ASSERT(RandEquivalent(composed, lookahead_composed, 5, 0.01,
+                                kaldi::Rand(), 10));
+    delete hcl;
+  }
+}
+
+} // end namespace fst
+
+int main() {
+  using namespace fst;
+  for (int i = 0; i < 2; i++) {
+    TestLookaheadCompose();
+  }
+  std::cout << "Test OK\n";
+}
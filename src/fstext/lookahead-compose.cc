@@ -0,0 +1,61 @@
+// fstext/lookahead-compose.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fst/matcher-fst.h>
+#include <fst/lookahead-matcher.h>
+#include "fstext/lookahead-compose.h"
+
+namespace fst {
+
+// This is the same type as OpenFst's StdOLabelLookAheadFst, but we can't use
+// that directly because the string olabel_lookahead_fst_type is only compiled
+// into the OpenFst libraries if it was configured with --enable-lookahead-fsts,
+// which our tools/Makefile does not do.
+extern const char kaldi_olabel_lookahead_fst_type[];
+const char kaldi_olabel_lookahead_fst_type[] = "olabel_lookahead";
+
+typedef MatcherFst<ConstFst<StdArc>,
+                   LabelLookAheadMatcher<SortedMatcher<ConstFst<StdArc> >,
+                                         olabel_lookahead_flags,
+                                         FastLogAccumulator<StdArc> >,
+                   kaldi_olabel_lookahead_fst_type,
+                   LabelLookAheadRelabeler<StdArc> > OLabelLookAheadFst;
+
+
+LookaheadComposeFst::LookaheadComposeFst(const Fst<StdArc> &hcl,
+                                         VectorFst<StdArc> *g,
+                                         size_t cache_size): g_(g) {
+  // The constructor relabels the output side of HCL so that the words that
+  // can be reached from each state form a small number of intervals.
+  OLabelLookAheadFst *hcl_lookahead = new OLabelLookAheadFst(hcl);
+  hcl_ = hcl_lookahead;
+  LabelLookAheadRelabeler<StdArc>::Relabel(g_, *hcl_lookahead, true);
+  ArcSort(g_, ILabelCompare<StdArc>());
+  // Because hcl_ has a lookahead matcher, ComposeFst uses the lookahead
+  // composition filter with label and weight pushing (see DefaultLookAhead in
+  // OpenFst's lookahead-filter.h).
+  CacheOptions cache_opts(true, cache_size);
+  compose_fst_ = new ComposeFst<StdArc>(*hcl_, *g_, cache_opts);
+}
+
+LookaheadComposeFst::~LookaheadComposeFst() {
+  delete compose_fst_;
+  delete hcl_;
+  delete g_;
+}
+
+}  // namespace fst
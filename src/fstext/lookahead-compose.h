@@ -0,0 +1,79 @@
+// fstext/lookahead-compose.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_LOOKAHEAD_COMPOSE_H_
+#define KALDI_FSTEXT_LOOKAHEAD_COMPOSE_H_
+
+#include <fst/fstlib.h>
+#include "base/kaldi-common.h"
+
+namespace fst {
+
+/**
+   LookaheadComposeFst computes the composition HCL o G on demand, as the
+   decoder visits its states, so that we can decode without building the
+   (possibly very large) static graph HCLG; the memory used is about the size
+   of HCL plus the size of G plus the size of the cache of composed states,
+   rather than the size of their product.
+
+   We use OpenFst's label-lookahead composition: HCL is converted to an
+   "olabel_lookahead" FST, which knows, for each state, the set of words that
+   can be reached from it, and the input labels of G are relabeled to match.
+   The composition filter then uses this to (a) avoid creating composed
+   states from which no word of G can be reached, (b) push the labels of G
+   towards the start of HCL, and (c) push the weights of G (computed over all
+   the words that can be reached) towards the start of HCL, which gives the
+   decoder's pruning much the same information it would get from a static
+   HCLG.  Lattices from decoding with this FST have the same form as
+   lattices from decoding with HCLG (transition-ids on the input side, words
+   on the output side), and should have a similar word error rate at the
+   same beam.
+
+   The composed states are cached (up to 'cache_size' bytes, after which
+   states that are not in use are garbage-collected) for as long as this
+   object exists, so you should keep it for all the utterances you decode.
+   Like ComposeFst, it is not thread-safe: you cannot decode with it in
+   more than one thread at a time.
+
+   HCL should have transition-ids on its input side (with the self-loops
+   added) and words on its output side, and no disambiguation symbols; the
+   input labels of G should not contain disambiguation symbols either (see
+   RemoveSomeInputSymbols() in fstext-utils.h).
+*/
+class LookaheadComposeFst {
+ public:
+  /// Note: this changes the labels on the input side of 'g' (it is not
+  /// usable with the original HCL after that), and takes ownership of it.
+  LookaheadComposeFst(const Fst<StdArc> &hcl, VectorFst<StdArc> *g,
+                      size_t cache_size);
+
+  /// Returns the composed FST, for use by the decoders.
+  const Fst<StdArc> &GetFst() const { return *compose_fst_; }
+
+  ~LookaheadComposeFst();
+
+ private:
+  Fst<StdArc> *hcl_;  // HCL, converted to an olabel-lookahead FST.
+  VectorFst<StdArc> *g_;  // G, relabeled to match hcl_.
+  ComposeFst<StdArc> *compose_fst_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LookaheadComposeFst);
+};
+
+}  // namespace fst
+
+#endif  // KALDI_FSTEXT_LOOKAHEAD_COMPOSE_H_
@@ -25,6 +25,8 @@
 #include "fstext/fstext-lib.h"
 #include "decoder/biglm-faster-decoder.h"
 #include "gmm/decodable-am-diag-gmm.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/hash-arpa-lm.h"
 #include "base/timer.h"
 
 namespace kaldi {
@@ -79,13 +81,15 @@ int main(int argc, char *argv[])
     const char *usage =
         "Decode features using GMM-based model.\n"
         "User supplies LM used to generate decoding graph, and desired LM;\n"
-        "this decoder applies the difference during decoding\n"
+        "this decoder applies the difference during decoding.  With\n"
+        "--new-lm-format=arpa, the desired LM is in ConstArpaLm or HashArpaLm\n"
+        "format (see arpa-to-const-arpa and arpa-to-hash-arpa).\n"
         "Usage:  gmm-decode-biglm-faster [options] model-in fst-in oldlm-fst-in newlm-fst-in features-rspecifier words-wspecifier [alignments-wspecifier [lattice-wspecifier]]\n";
     ParseOptions po(usage);
     bool allow_partial = true;    
     BaseFloat acoustic_scale = 0.1;
     
-    std::string word_syms_filename;
+    std::string word_syms_filename, new_lm_format = "fst";
     BiglmFasterDecoderOptions decoder_opts;
     decoder_opts.Register(&po, true);  // true == include obscure settings.
     po.Register("acoustic-scale", &acoustic_scale,
@@ -94,6 +98,9 @@ int main(int argc, char *argv[])
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "Produce output even when final state was not reached");
+    po.Register("new-lm-format", &new_lm_format, "Format of newlm-fst-in: "
+                "\"fst\", or \"arpa\" for a language model in ConstArpaLm or "
+                "HashArpaLm format.");
 
     po.Read(argc, argv);
 
@@ -146,7 +153,17 @@ int main(int argc, char *argv[])
     VectorFst<StdArc> *old_lm_fst = ReadFstKaldi(old_lm_fst_rxfilename);
     ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
     
-    VectorFst<StdArc> *new_lm_fst = ReadFstKaldi(new_lm_fst_rxfilename);
+    VectorFst<StdArc> *new_lm_fst = NULL;
+    ConstArpaLm *new_const_arpa = NULL;
+    HashArpaLm *new_hash_arpa = NULL;
+    if (new_lm_format == "fst") {
+      new_lm_fst = ReadFstKaldi(new_lm_fst_rxfilename);
+    } else if (new_lm_format == "arpa") {
+      ReadConstOrHashArpaLm(new_lm_fst_rxfilename, &new_const_arpa,
+                            &new_hash_arpa);
+    } else {
+      KALDI_ERR << "Invalid --new-lm-format: " << new_lm_format;
+    }
 
 
     BaseFloat tot_like = 0.0;
@@ -165,9 +182,16 @@ int main(int argc, char *argv[])
         continue;
       }
       fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
-      fst::BackoffDeterministicOnDemandFst<StdArc> new_lm_dfst(*new_lm_fst);
+      fst::DeterministicOnDemandFst<StdArc> *new_lm_dfst;
+      if (new_lm_fst != NULL)
+        new_lm_dfst = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+            *new_lm_fst);
+      else if (new_const_arpa != NULL)
+        new_lm_dfst = new ConstArpaLmDeterministicFst(*new_const_arpa);
+      else
+        new_lm_dfst = new HashArpaLmDeterministicFst(*new_hash_arpa);
       fst::ComposeDeterministicOnDemandFst<StdArc> compose_dfst(&old_lm_dfst,
-                                                                &new_lm_dfst);
+                                                                new_lm_dfst);
       fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(&compose_dfst);
       
       BiglmFasterDecoder decoder(*decode_fst, decoder_opts, &cache_dfst);
@@ -229,6 +253,7 @@ int main(int argc, char *argv[])
         KALDI_WARN << "Did not successfully decode utterance " << key
                    << ", len = " << features.NumRows();
       }
+      delete new_lm_dfst;
     }
 
     double elapsed = timer.Elapsed();
@@ -244,6 +269,8 @@ int main(int argc, char *argv[])
     delete decode_fst;
     delete old_lm_fst;
     delete new_lm_fst;
+    delete new_const_arpa;
+    delete new_hash_arpa;
     return (num_success != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
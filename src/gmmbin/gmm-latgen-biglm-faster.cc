@@ -28,6 +28,8 @@
 #include "fstext/fstext-lib.h"
 #include "decoder/lattice-biglm-faster-decoder.h"
 #include "gmm/decodable-am-diag-gmm.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/hash-arpa-lm.h"
 #include "base/timer.h"
 
 
@@ -136,6 +138,22 @@ bool DecodeUtterance(LatticeBiglmFasterDecoder &decoder, // not const but is rea
   return true;
 }
 
+// Returns a newly allocated DeterministicOnDemandFst for the desired LM; exactly
+// one of "new_lm_fst", "const_arpa" and "hash_arpa" is expected to be non-NULL.
+// These FSTs remember every LM state they have visited, so the caller should
+// create one for each utterance rather than sharing one across utterances.
+fst::DeterministicOnDemandFst<fst::StdArc> *NewLmDeterministicFst(
+    const fst::VectorFst<fst::StdArc> *new_lm_fst,
+    const ConstArpaLm *const_arpa,
+    const HashArpaLm *hash_arpa) {
+  if (new_lm_fst != NULL)
+    return new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(*new_lm_fst);
+  else if (const_arpa != NULL)
+    return new ConstArpaLmDeterministicFst(*const_arpa);
+  KALDI_ASSERT(hash_arpa != NULL);
+  return new HashArpaLmDeterministicFst(*hash_arpa);
+}
+
 }
 
 
@@ -153,7 +171,9 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Generate lattices using GMM-based model.\n"
         "User supplies LM used to generate decoding graph, and desired LM;\n"
-        "this decoder applies the difference during decoding\n"
+        "this decoder applies the difference during decoding.  With\n"
+        "--new-lm-format=arpa, the desired LM is in ConstArpaLm or HashArpaLm\n"
+        "format (see arpa-to-const-arpa and arpa-to-hash-arpa).\n"
         "Usage: gmm-latgen-biglm-faster [options] model-in (fst-in|fsts-rspecifier) "
         "oldlm-fst-in newlm-fst-in features-rspecifier"
         " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
@@ -163,12 +183,15 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 0.1;
     LatticeBiglmFasterDecoderConfig config;
     
-    std::string word_syms_filename;
+    std::string word_syms_filename, new_lm_format = "fst";
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("new-lm-format", &new_lm_format, "Format of newlm-fst-in: "
+                "\"fst\", or \"arpa\" for a language model in ConstArpaLm or "
+                "HashArpaLm format.");
     
     po.Read(argc, argv);
 
@@ -199,14 +222,18 @@ int main(int argc, char *argv[]) {
         fst::ReadFstKaldiGeneric(old_lm_fst_rxfilename));
     ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
     
-    VectorFst<StdArc> *new_lm_fst = fst::CastOrConvertToVectorFst(
-        fst::ReadFstKaldiGeneric(new_lm_fst_rxfilename));
-
-    fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
-    fst::BackoffDeterministicOnDemandFst<StdArc> new_lm_dfst(*new_lm_fst);
-    fst::ComposeDeterministicOnDemandFst<StdArc> compose_dfst(&old_lm_dfst,
-                                                              &new_lm_dfst);
-    fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(&compose_dfst);
+    VectorFst<StdArc> *new_lm_fst = NULL;
+    ConstArpaLm *new_const_arpa = NULL;
+    HashArpaLm *new_hash_arpa = NULL;
+    if (new_lm_format == "fst") {
+      new_lm_fst = fst::CastOrConvertToVectorFst(
+          fst::ReadFstKaldiGeneric(new_lm_fst_rxfilename));
+    } else if (new_lm_format == "arpa") {
+      ReadConstOrHashArpaLm(new_lm_fst_rxfilename, &new_const_arpa,
+                            &new_hash_arpa);
+    } else {
+      KALDI_ERR << "Invalid --new-lm-format: " << new_lm_format;
+    }
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -236,36 +263,42 @@ int main(int argc, char *argv[]) {
       // Input FST is just one FST, not a table of FSTs.
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
 
-      {
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        Matrix<BaseFloat> features (feature_reader.Value());
+        feature_reader.FreeCurrent();
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+
+        // The on-demand FSTs cache the states they visit, so we create them
+        // (and hence the decoder) for each utterance to bound their size.
+        fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
+        fst::DeterministicOnDemandFst<StdArc> *new_lm_dfst =
+            NewLmDeterministicFst(new_lm_fst, new_const_arpa, new_hash_arpa);
+        fst::ComposeDeterministicOnDemandFst<StdArc> compose_dfst(&old_lm_dfst,
+                                                                  new_lm_dfst);
+        fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(&compose_dfst);
         LatticeBiglmFasterDecoder decoder(*decode_fst, config, &cache_dfst);
-    
-        for (; !feature_reader.Done(); feature_reader.Next()) {
-          std::string utt = feature_reader.Key();
-          Matrix<BaseFloat> features (feature_reader.Value());
-          feature_reader.FreeCurrent();
-          if (features.NumRows() == 0) {
-            KALDI_WARN << "Zero-length utterance: " << utt;
-            num_fail++;
-            continue;
-          }
-      
-          DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                                 acoustic_scale);
 
+        DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
+                                               acoustic_scale);
 
-          double like;
-          if (DecodeUtterance(decoder, gmm_decodable, trans_model, word_syms,
-                              utt, acoustic_scale, determinize, allow_partial,
-                              &alignment_writer, &words_writer,
-                              &compact_lattice_writer, &lattice_writer,
-                              &like)) {
-            tot_like += like;
-            frame_count += features.NumRows();
-            num_success++;
-          } else num_fail++;
-        }
+        double like;
+        if (DecodeUtterance(decoder, gmm_decodable, trans_model, word_syms,
+                            utt, acoustic_scale, determinize, allow_partial,
+                            &alignment_writer, &words_writer,
+                            &compact_lattice_writer, &lattice_writer,
+                            &like)) {
+          tot_like += like;
+          frame_count += features.NumRows();
+          num_success++;
+        } else num_fail++;
+        delete new_lm_dfst;
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
+      delete decode_fst;
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
       RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);          
@@ -283,6 +316,12 @@ int main(int argc, char *argv[]) {
           num_fail++;
           continue;
         }
+        fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
+        fst::DeterministicOnDemandFst<StdArc> *new_lm_dfst =
+            NewLmDeterministicFst(new_lm_fst, new_const_arpa, new_hash_arpa);
+        fst::ComposeDeterministicOnDemandFst<StdArc> compose_dfst(&old_lm_dfst,
+                                                                  new_lm_dfst);
+        fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(&compose_dfst);
         LatticeBiglmFasterDecoder decoder(fst_reader.Value(), config,
                                           &cache_dfst);
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
@@ -297,6 +336,7 @@ int main(int argc, char *argv[]) {
           frame_count += features.NumRows();
           num_success++;
         } else num_fail++;
+        delete new_lm_dfst;
       }
     }
       
@@ -310,6 +350,9 @@ int main(int argc, char *argv[]) {
               << frame_count<<" frames.";
 
     delete word_syms;
+    delete new_lm_fst;
+    delete new_const_arpa;
+    delete new_hash_arpa;
     if (num_success != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
@@ -46,11 +46,26 @@ void TestTransitionModel() {
   delete trans_model;
 }
 
+void TestMapPdfsToTransitionIds() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  Vector<BaseFloat> pdf_values(trans_model->NumPdfs()),
+      tid_values(trans_model->NumTransitionIds());
+  pdf_values.SetRandn();
+  BaseFloat scale = RandUniform();
+  trans_model->MapPdfsToTransitionIds(pdf_values, scale, &tid_values);
+  for (int32 tid = 1; tid <= trans_model->NumTransitionIds(); tid++)
+    KALDI_ASSERT(tid_values(tid - 1) ==
+                 scale * pdf_values(trans_model->TransitionIdToPdf(tid)));
+  delete trans_model;
+}
+
 }
 
 int main() {
-  for (int i = 0; i < 2; i++)
+  for (int i = 0; i < 2; i++) {
     kaldi::TestTransitionModel();
+    kaldi::TestMapPdfsToTransitionIds();
+  }
   KALDI_LOG << "Test OK.\n";
 }
 
@@ -261,6 +261,18 @@ int32 TransitionModel::NumTransitionIndices(int32 trans_state) const {
   return static_cast<int32>(state2id_[trans_state+1]-state2id_[trans_state]);
 }
 
+void TransitionModel::MapPdfsToTransitionIds(
+    const VectorBase<BaseFloat> &pdf_values, BaseFloat scale,
+    VectorBase<BaseFloat> *tid_values) const {
+  int32 num_tids = NumTransitionIds();
+  KALDI_ASSERT(pdf_values.Dim() == NumPdfs() &&
+               tid_values->Dim() == num_tids);
+  const BaseFloat *pdf_data = pdf_values.Data();
+  BaseFloat *tid_data = tid_values->Data();
+  for (int32 trans_id = 1; trans_id <= num_tids; trans_id++)
+    tid_data[trans_id - 1] = scale * pdf_data[id2pdf_id_[trans_id]];
+}
+
 int32 TransitionModel::TransitionIdToTransitionState(int32 trans_id) const {
   KALDI_ASSERT(trans_id != 0 &&  static_cast<size_t>(trans_id) < id2state_.size());
   return id2state_[trans_id];
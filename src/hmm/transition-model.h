@@ -162,6 +162,16 @@ class TransitionModel {
 
   /// @}
 
+  /// Sets (*tid_values)(trans_id - 1) to
+  /// scale * pdf_values(TransitionIdToPdf(trans_id)) for each transition-id.
+  /// 'pdf_values' must have dimension NumPdfs() and 'tid_values' dimension
+  /// NumTransitionIds().  This is used by decodable objects to expand a frame
+  /// of log-likelihoods from pdf-ids to transition-ids, for
+  /// DecodableInterface::LogLikelihoodRow().
+  void MapPdfsToTransitionIds(const VectorBase<BaseFloat> &pdf_values,
+                              BaseFloat scale,
+                              VectorBase<BaseFloat> *tid_values) const;
+
   bool IsFinal(int32 trans_id) const;  // returns true if this trans_id goes to the final state
   // (which is bound to be nonemitting).
   bool IsSelfLoop(int32 trans_id) const;  // return true if this trans_id corresponds to a self-loop.
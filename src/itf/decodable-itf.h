@@ -115,6 +115,16 @@ class DecodableInterface {
   /// this is for compatibility with OpenFst).
   virtual int32 NumIndices() const = 0;
 
+  /// This optional function is for decoders that look up many
+  /// log-likelihoods on each frame, to save a virtual function call per
+  /// lookup.  If the decodable object can supply all the log-likelihoods for
+  /// this frame as an array, it returns a pointer 'p' to an array of
+  /// dimension NumIndices(), with p[index - 1] == LogLikelihood(frame, index)
+  /// (note the one-based indexes); the pointer is valid until the next call
+  /// to a non-const function of this object.  Otherwise it returns NULL
+  /// (the default), and the caller should call LogLikelihood() instead.
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) { return NULL; }
+
   virtual ~DecodableInterface() {}
 };
 /// @}
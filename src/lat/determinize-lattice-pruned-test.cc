@@ -23,6 +23,7 @@
 #include "fstext/fst-test-utils.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "hmm/hmm-test-utils.h"
 
 namespace fst {
 // Caution: these tests are not as generic as you might think from all the
@@ -137,11 +138,76 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
 }
 
 
+// Creates a random state-level lattice with 'num_frames' frames and 1 to 3
+// states on each frame.
+kaldi::Lattice *RandStateLevelLattice(const kaldi::TransitionModel &trans_model,
+                                      int32 num_frames) {
+  typedef kaldi::LatticeArc Arc;
+  typedef kaldi::LatticeWeight Weight;
+  kaldi::Lattice *lat = new kaldi::Lattice();
+  std::vector<Arc::StateId> prev_states(1, lat->AddState());
+  lat->SetStart(prev_states[0]);
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<Arc::StateId> cur_states(kaldi::RandInt(1, 3));
+    for (size_t i = 0; i < cur_states.size(); i++)
+      cur_states[i] = lat->AddState();
+    for (size_t i = 0; i < prev_states.size(); i++) {
+      for (size_t j = 0; j < cur_states.size(); j++) {
+        // Make sure each state has arcs into and out of it.
+        if (i != j % prev_states.size() && j != i % cur_states.size() &&
+            kaldi::Rand() % 2 == 0)
+          continue;
+        Arc::Label tid = kaldi::RandInt(1, trans_model.NumTransitionIds()),
+            word = (kaldi::Rand() % 10 == 0 ? kaldi::RandInt(1, 2) : 0);
+        Weight weight(kaldi::RandUniform(), kaldi::RandUniform());
+        lat->AddArc(prev_states[i], Arc(tid, word, weight, cur_states[j]));
+      }
+    }
+    prev_states.swap(cur_states);
+  }
+  for (size_t i = 0; i < prev_states.size(); i++)
+    lat->SetFinal(prev_states[i], Weight::One());
+  return lat;
+}
+
+// Tests that determinizing a lattice in chunks in parallel gives the same
+// result as determinizing it all at once.
+void TestDeterminizeLatticeInChunks() {
+  kaldi::ContextDependency *ctx_dep;
+  kaldi::TransitionModel *trans_model = kaldi::GenRandTransitionModel(&ctx_dep);
+  for (int32 i = 0; i < 10; i++) {
+    kaldi::Lattice *lat = RandStateLevelLattice(*trans_model, 30);
+    kaldi::Lattice lat_copy(*lat);
+    DeterminizeLatticePhonePrunedOptions opts;
+    kaldi::CompactLattice clat, chunked_clat;
+    bool ans = DeterminizeLatticePhonePrunedWrapper(*trans_model, &lat_copy,
+                                                    100.0, &clat, opts);
+    // The lattice has at most 3 states on each frame, so with these options
+    // it can always be split into 3 chunks.
+    opts.num_threads = 3;
+    opts.chunk_frames = 5;
+    opts.max_cut_states = 3;
+    bool chunked_ans = false;
+    int32 num_chunks = DeterminizeLatticeInChunks(
+        *trans_model, lat, 100.0, &chunked_clat, opts, &chunked_ans);
+    KALDI_ASSERT(num_chunks >= 2);
+    KALDI_ASSERT(ans && chunked_ans);
+    KALDI_ASSERT(chunked_clat.Properties(kIDeterministic, true) &
+                 kIDeterministic);
+    KALDI_ASSERT(RandEquivalent(clat, chunked_clat, 5/*paths*/, 0.01/*delta*/,
+                                kaldi::Rand()/*seed*/, 100/*path length*/));
+    delete lat;
+  }
+  delete trans_model;
+  delete ctx_dep;
+}
+
 } // end namespace fst
 
 int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticeInChunks();
   std::cout << "Tests succeeded\n";
 }
@@ -21,12 +21,16 @@
 
 #include <vector>
 #include <climits>
+#include <cstdlib>
+#include <limits>
+#include <unordered_map>
 #include "fstext/determinize-lattice.h" // for LatticeStringRepository
 #include "fstext/fstext-utils.h"
 #include "lat/lattice-functions.h"  // for PruneLattice
 #include "lat/minimize-lattice.h"   // for minimization
 #include "lat/push-lattice.h"       // for minimization
 #include "lat/determinize-lattice-pruned.h"
+#include "util/kaldi-thread.h"
 
 namespace fst {
 
@@ -1482,6 +1486,327 @@ bool DeterminizeLatticePhonePruned(
                                        beam, ofst, opts);
 }
 
+// The class and function below are used by
+// DeterminizeLatticePhonePrunedWrapper() when opts.num_threads > 1.
+
+// Determinizes the chunks that DeterminizeLatticeInChunks() splits a lattice
+// into; thread i of n does chunks i, i + n, i + 2n and so on.
+class LatticeChunkDeterminizer: public kaldi::MultiThreadable {
+ public:
+  LatticeChunkDeterminizer(const kaldi::TransitionModel &trans_model,
+                           double beam,
+                           const DeterminizeLatticePhonePrunedOptions &opts,
+                           std::vector<kaldi::Lattice*> *chunks,
+                           std::vector<kaldi::CompactLattice> *det_chunks,
+                           std::vector<char> *success):
+      trans_model_(&trans_model), beam_(beam), opts_(opts), chunks_(chunks),
+      det_chunks_(det_chunks), success_(success) { }
+
+  void operator () () {
+    for (size_t c = thread_id_; c < chunks_->size(); c += num_threads_) {
+      kaldi::Lattice *chunk = (*chunks_)[c];
+      ILabelCompare<kaldi::LatticeArc> ilabel_comp;
+      ArcSort(chunk, ilabel_comp);
+      (*success_)[c] =
+          DeterminizeLatticePhonePruned<kaldi::LatticeWeight, kaldi::int32>(
+              *trans_model_, chunk, beam_, &((*det_chunks_)[c]), opts_);
+      delete chunk;
+      (*chunks_)[c] = NULL;
+    }
+  }
+
+ private:
+  const kaldi::TransitionModel *trans_model_;
+  double beam_;
+  DeterminizeLatticePhonePrunedOptions opts_;
+  std::vector<kaldi::Lattice*> *chunks_;  // owned by the caller; the chunks
+                                          // themselves are deleted here.
+  std::vector<kaldi::CompactLattice> *det_chunks_;
+  std::vector<char> *success_;
+};
+
+/*
+  Chunk c covers the states on frames cuts[c-1] <= t < cuts[c].  The paths
+  leave chunk c through the "entry states" of chunk c + 1, which are the states
+  on frame cuts[c] with an emitting arc into them.  In chunk c, each arc into an
+  entry state d goes to a copy of d, which has an arc with the special word
+  label first_boundary_label + d to a final state; and chunk c + 1 has a new
+  start state with arcs with the same label to the entry states.  So after
+  determinizing the chunks, we can join them by matching up these labels.
+*/
+int32 DeterminizeLatticeInChunks(
+    const kaldi::TransitionModel &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double beam,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticePhonePrunedOptions &opts,
+    bool *ans) {
+  typedef kaldi::LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+  typedef kaldi::LatticeWeight Weight;
+  typedef kaldi::CompactLatticeArc CompactArc;
+  typedef kaldi::CompactLatticeWeight CompactWeight;
+
+  // With --word-determinize=false the output would not be deterministic at
+  // the word level, and we rely on that when joining the chunks.
+  if (!opts.word_determinize || ifst->Start() == kNoStateId)
+    return 0;
+  if (ifst->Properties(kTopSorted, true) == 0 && !TopSort(ifst))
+    return 0;  // The caller will report the error.
+
+  // Work out the frame of each state, the costs of the best paths to and from
+  // it, and the largest word label.
+  const double inf = std::numeric_limits<double>::infinity();
+  StateId num_states = ifst->NumStates(), start = ifst->Start();
+  std::vector<int32> times(num_states, -1);
+  std::vector<double> alpha(num_states, inf), beta(num_states, inf);
+  times[start] = 0;
+  alpha[start] = 0.0;
+  Label max_label = 0;
+  int32 num_frames = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    if (times[s] < 0)
+      continue;  // Not reachable.
+    num_frames = std::max(num_frames, times[s]);
+    for (ArcIterator<MutableFst<Arc> > aiter(*ifst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      int32 t = times[s] + (arc.ilabel != 0 ? 1 : 0);
+      if (times[arc.nextstate] < 0)
+        times[arc.nextstate] = t;
+      else if (times[arc.nextstate] != t)
+        return 0;  // Not a state-level lattice; we can't split it.
+      alpha[arc.nextstate] = std::min(alpha[arc.nextstate],
+                                      alpha[s] + ConvertToCost(arc.weight));
+      max_label = std::max(max_label, arc.olabel);
+    }
+  }
+  for (StateId s = num_states - 1; s >= 0; s--) {
+    beta[s] = ConvertToCost(ifst->Final(s));
+    for (ArcIterator<MutableFst<Arc> > aiter(*ifst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      beta[s] = std::min(beta[s],
+                         ConvertToCost(arc.weight) + beta[arc.nextstate]);
+    }
+  }
+
+  int32 chunk_frames = std::max(opts.chunk_frames, 1),
+      num_chunks = std::min(opts.num_threads, num_frames / chunk_frames);
+  if (num_chunks < 2)
+    return 0;
+
+  // is_entry[s] is true if s has an emitting arc into it.
+  std::vector<char> is_entry(num_states, 0);
+  std::vector<int32> num_entry_states(num_frames + 1, 0),
+      num_states_on_frame(num_frames + 1, 0);
+  int64 num_reachable = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    if (times[s] < 0)
+      continue;
+    num_states_on_frame[times[s]]++;
+    num_reachable++;
+    for (ArcIterator<MutableFst<Arc> > aiter(*ifst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0 && !is_entry[arc.nextstate]) {
+        is_entry[arc.nextstate] = 1;
+        num_entry_states[times[arc.nextstate]]++;
+      }
+    }
+  }
+
+  // Choose the frames to cut at: near the frames that divide the states
+  // evenly, we choose the one with the fewest entry states.
+  std::vector<int32> cuts;
+  int32 search_frames = std::max(chunk_frames / 4, 1), t = 0;
+  int64 cur_states = 0;
+  for (int32 c = 1; c < num_chunks; c++) {
+    int64 target_states = num_reachable * c / num_chunks;
+    while (t < num_frames && cur_states + num_states_on_frame[t] <= target_states)
+      cur_states += num_states_on_frame[t++];
+    int32 begin = std::max(t - search_frames,
+                           (cuts.empty() ? 0 : cuts.back()) + chunk_frames),
+        end = std::min(t + search_frames, num_frames - chunk_frames),
+        best = -1;
+    for (int32 f = begin; f <= end; f++) {
+      int32 n = num_entry_states[f];
+      if (n > 0 && n <= opts.max_cut_states &&
+          (best < 0 || n < num_entry_states[best] ||
+           (n == num_entry_states[best] && std::abs(f - t) < std::abs(best - t))))
+        best = f;
+    }
+    if (best >= 0)
+      cuts.push_back(best);
+  }
+  if (cuts.empty())
+    return 0;
+  num_chunks = cuts.size() + 1;
+  KALDI_VLOG(2) << "Determinizing lattice with " << num_frames
+                << " frames in " << num_chunks << " chunks.";
+
+  std::vector<int32> chunk_of_state(num_states, -1);
+  for (StateId s = 0; s < num_states; s++) {
+    if (times[s] >= 0)
+      chunk_of_state[s] = std::upper_bound(cuts.begin(), cuts.end(), times[s]) -
+          cuts.begin();
+  }
+  // We subtract these from the costs we add to the arcs that enter and leave
+  // the chunks, to keep them small.
+  std::vector<double> alpha_offset(num_chunks, inf), beta_offset(num_chunks, inf);
+  for (StateId s = 0; s < num_states; s++) {
+    int32 c = chunk_of_state[s];
+    if (c > 0 && is_entry[s] && times[s] == cuts[c - 1]) {
+      alpha_offset[c] = std::min(alpha_offset[c], alpha[s]);
+      beta_offset[c] = std::min(beta_offset[c], beta[s]);
+    }
+  }
+
+  // Create the chunks; they have the words on the input side, and are
+  // topologically sorted.
+  Label first_boundary_label = max_label + 1;
+  std::vector<kaldi::Lattice*> chunks(num_chunks);
+  for (int32 c = 0; c < num_chunks; c++) {
+    chunks[c] = new kaldi::Lattice();
+    if (c > 0)
+      chunks[c]->SetStart(chunks[c]->AddState());
+  }
+  // state_map[s] is the state for s in its chunk; exit_map[s], for entry states
+  // of chunks c > 0, is its copy in chunk c - 1.
+  std::vector<StateId> state_map(num_states, kNoStateId),
+      exit_map(num_states, kNoStateId);
+  for (StateId s = 0; s < num_states; s++) {
+    int32 c = chunk_of_state[s];
+    if (c < 0)
+      continue;
+    state_map[s] = chunks[c]->AddState();
+    chunks[c]->SetFinal(state_map[s], ifst->Final(s));
+  }
+  chunks[0]->SetStart(state_map[start]);
+  std::vector<StateId> superfinal(num_chunks, kNoStateId);
+  for (StateId s = 0; s < num_states; s++) {
+    int32 c = chunk_of_state[s];
+    if (c > 0 && is_entry[s] && times[s] == cuts[c - 1] &&
+        alpha[s] != inf && beta[s] != inf)
+      exit_map[s] = chunks[c - 1]->AddState();
+  }
+  for (int32 c = 0; c + 1 < num_chunks; c++) {
+    superfinal[c] = chunks[c]->AddState();
+    chunks[c]->SetFinal(superfinal[c], Weight::One());
+  }
+  for (StateId s = 0; s < num_states; s++) {
+    if (exit_map[s] == kNoStateId)
+      continue;
+    int32 c = chunk_of_state[s];
+    Label label = first_boundary_label + s;
+    chunks[c - 1]->AddArc(exit_map[s],
+                          Arc(label, 0, Weight(beta[s] - beta_offset[c], 0.0),
+                              superfinal[c - 1]));
+    chunks[c]->AddArc(chunks[c]->Start(),
+                      Arc(label, 0, Weight(alpha[s] - alpha_offset[c], 0.0),
+                          state_map[s]));
+  }
+  for (StateId s = 0; s < num_states; s++) {
+    int32 c = chunk_of_state[s];
+    if (c < 0)
+      continue;
+    for (ArcIterator<MutableFst<Arc> > aiter(*ifst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      StateId nextstate = (chunk_of_state[arc.nextstate] == c ?
+                           state_map[arc.nextstate] : exit_map[arc.nextstate]);
+      if (nextstate != kNoStateId)
+        chunks[c]->AddArc(state_map[s], Arc(arc.olabel, arc.ilabel,
+                                            arc.weight, nextstate));
+    }
+  }
+
+  std::vector<kaldi::CompactLattice> det_chunks(num_chunks);
+  std::vector<char> success(num_chunks, 0);
+  {
+    DeterminizeLatticePhonePrunedOptions chunk_opts(opts);
+    chunk_opts.minimize = false;
+    LatticeChunkDeterminizer determinizer(trans_model, beam, chunk_opts,
+                                          &chunks, &det_chunks, &success);
+    // The destructor waits for the threads to finish.
+    kaldi::MultiThreader<LatticeChunkDeterminizer> threader(
+        std::min(opts.num_threads, num_chunks), determinizer);
+  }
+
+  // Join the determinized chunks: each arc with a boundary label, and the arc
+  // with the same label from the start state of the next chunk, become an
+  // epsilon arc.
+  kaldi::CompactLattice joined;
+  std::vector<StateId> offset(num_chunks);
+  for (int32 c = 0; c < num_chunks; c++) {
+    offset[c] = joined.NumStates();
+    for (StateId s = 0; s < det_chunks[c].NumStates(); s++)
+      joined.AddState();
+  }
+  for (int32 c = 0; c < num_chunks; c++) {
+    const kaldi::CompactLattice &det = det_chunks[c];
+    if (det.Start() == kNoStateId)
+      continue;  // The output will be empty.
+    if (c == 0)
+      joined.SetStart(offset[0] + det.Start());
+    // entry_arcs[label] is the arc with the boundary label 'label' out of the
+    // start state of the next chunk.
+    std::unordered_map<Label, CompactArc> entry_arcs;
+    if (c + 1 < num_chunks && det_chunks[c + 1].Start() != kNoStateId) {
+      const kaldi::CompactLattice &next = det_chunks[c + 1];
+      for (ArcIterator<kaldi::CompactLattice> aiter(next, next.Start());
+           !aiter.Done(); aiter.Next())
+        entry_arcs[aiter.Value().ilabel] = aiter.Value();
+    }
+    std::vector<char> is_boundary_target(det.NumStates(), 0);
+    for (StateId s = 0; s < det.NumStates(); s++) {
+      for (ArcIterator<kaldi::CompactLattice> aiter(det, s); !aiter.Done();
+           aiter.Next()) {
+        CompactArc arc = aiter.Value();
+        if (arc.ilabel < first_boundary_label) {
+          arc.nextstate += offset[c];
+          joined.AddArc(offset[c] + s, arc);
+          continue;
+        }
+        is_boundary_target[arc.nextstate] = 1;
+        std::unordered_map<Label, CompactArc>::const_iterator iter =
+            entry_arcs.find(arc.ilabel);
+        if (iter == entry_arcs.end())
+          continue;  // Pruned away in the next chunk.
+        StateId d = arc.ilabel - first_boundary_label;
+        CompactWeight weight = Times(Times(arc.weight, det.Final(arc.nextstate)),
+                                     iter->second.weight);
+        Weight w = weight.Weight();
+        w.SetValue1(w.Value1() - (beta[d] - beta_offset[c + 1]) -
+                    (alpha[d] - alpha_offset[c + 1]));
+        weight.SetWeight(w);
+        joined.AddArc(offset[c] + s,
+                      CompactArc(0, 0, weight,
+                                 offset[c + 1] + iter->second.nextstate));
+      }
+    }
+    for (StateId s = 0; s < det.NumStates(); s++)
+      if (!is_boundary_target[s])
+        joined.SetFinal(offset[c] + s, det.Final(s));
+  }
+  Connect(&joined);
+
+  // The joined lattice has epsilons, and may not be deterministic, where the
+  // chunks join.  Determinizing it again at the word level is fast, since it
+  // is much smaller than ifst and almost deterministic.
+  kaldi::Lattice joined_lat;
+  ConvertLattice(joined, &joined_lat);
+  DeterminizeLatticePhonePrunedOptions final_opts(opts);
+  final_opts.num_threads = 1;
+  final_opts.phone_determinize = false;
+  *ans = DeterminizeLatticePhonePrunedWrapper(trans_model, &joined_lat, beam,
+                                              ofst, final_opts);
+  for (int32 c = 0; c < num_chunks; c++)
+    *ans = *ans && success[c];
+  return num_chunks;
+}
+
 bool DeterminizeLatticePhonePrunedWrapper(
     const kaldi::TransitionModel &trans_model,
     MutableFst<kaldi::LatticeArc> *ifst,
@@ -1489,6 +1814,10 @@ bool DeterminizeLatticePhonePrunedWrapper(
     MutableFst<kaldi::CompactLatticeArc> *ofst,
     DeterminizeLatticePhonePrunedOptions opts) {
   bool ans = true;
+  if (opts.num_threads > 1 &&
+      DeterminizeLatticeInChunks(trans_model, ifst, beam, ofst, opts,
+                                 &ans) > 0)
+    return ans;
   Invert(ifst);
   if (ifst->Properties(fst::kTopSorted, true) == 0) {
     if (!TopSort(ifst)) {
@@ -155,11 +155,22 @@ struct DeterminizeLatticePhonePrunedOptions {
   bool word_determinize;
   // minimize: if true, push and minimize after determinization.
   bool minimize;
+  // num_threads: if > 1, DeterminizeLatticePhonePrunedWrapper() splits long
+  // lattices into chunks and determinizes them in parallel.
+  int num_threads;
+  // chunk_frames: the minimum number of frames in each chunk.
+  int chunk_frames;
+  // max_cut_states: the maximum number of states on the frame where we split
+  // the lattice.
+  int max_cut_states;
   DeterminizeLatticePhonePrunedOptions(): delta(kDelta),
                                           max_mem(50000000),
                                           phone_determinize(true),
                                           word_determinize(true),
-                                          minimize(false) {}
+                                          minimize(false),
+                                          num_threads(1),
+                                          chunk_frames(500),
+                                          max_cut_states(10) {}
   void Register (kaldi::OptionsItf *opts) {
     opts->Register("delta", &delta, "Tolerance used in determinization");
     opts->Register("max-mem", &max_mem, "Maximum approximate memory usage in "
@@ -172,6 +183,17 @@ struct DeterminizeLatticePhonePrunedOptions {
                    "--phone-determinize)");
     opts->Register("minimize", &minimize, "If true, push and minimize after "
                    "determinization.");
+    opts->Register("determinize-num-threads", &num_threads, "If >1, split "
+                   "long lattices into chunks at frames where the lattice "
+                   "narrows to a few states, and determinize the chunks in "
+                   "parallel using this many threads.");
+    opts->Register("determinize-chunk-frames", &chunk_frames, "With "
+                   "--determinize-num-threads > 1, the minimum number of frames "
+                   "in each chunk.");
+    opts->Register("determinize-max-cut-states", &max_cut_states, "With "
+                   "--determinize-num-threads > 1, we only split the lattice at "
+                   "frames with at most this many states that paths can enter "
+                   "the frame through.");
   }
 };
 
@@ -280,6 +302,18 @@ bool DeterminizeLatticePhonePruned(
     output side.
     This function can be used as the top-level interface to all the determinization
     code.
+
+    If opts.num_threads > 1 and the lattice is longer than 2 * opts.chunk_frames
+    frames, it splits it into up to opts.num_threads chunks, at frames where
+    the paths enter through at most opts.max_cut_states states, and
+    determinizes the chunks in parallel.  Each chunk is pruned relative to the
+    best path through the whole lattice (the costs of the best paths before and
+    after the chunk are added to the arcs that enter and leave it), as it
+    would be without chunking.  The determinized chunks are then
+    joined, and the result (which is much smaller than 'ifst') is determinized
+    again at the word level to make it deterministic and remove the epsilons
+    where the chunks join.  The output is equivalent to the output without
+    chunking, within the beam.
 */
 bool DeterminizeLatticePhonePrunedWrapper(
     const kaldi::TransitionModel &trans_model,
@@ -289,6 +323,23 @@ bool DeterminizeLatticePhonePrunedWrapper(
     DeterminizeLatticePhonePrunedOptions opts
       = DeterminizeLatticePhonePrunedOptions());
 
+/** This does the work of DeterminizeLatticePhonePrunedWrapper() when
+    opts.num_threads > 1 (see its documentation above); you won't normally
+    need to call it directly.  'ifst' has the transition-ids on the input side.
+    If it decides not to split the lattice (because it is too short, or has no
+    suitable frames to split it at), it returns 0, having at most
+    topologically sorted 'ifst'.  Otherwise it outputs the determinized
+    lattice to 'ofst', sets *ans to what DeterminizeLatticePhonePruned() would
+    have returned, and returns the number of chunks (at least 2).
+*/
+kaldi::int32 DeterminizeLatticeInChunks(
+    const kaldi::TransitionModel &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticePhonePrunedOptions &opts,
+    bool *ans);
+
 /// @} end "addtogroup fst_extensions"
 
 } // end namespace fst
@@ -20,6 +20,7 @@
 
 
 #include "lat/kaldi-lattice.h"
+#include "lat/packed-lattice.h"
 #include "fst/script/print-impl.h"
 
 namespace kaldi {
@@ -304,7 +305,9 @@ Lattice *ReadLatticeText(std::istream &is) {
 bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat) {
   KALDI_ASSERT(*clat == NULL);
-  if (binary) {
+  if (binary && IsPackedCompactLattice(is)) {
+    return ReadPackedCompactLattice(is, clat);
+  } else if (binary) {
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading compact lattice: error reading FST header.";
@@ -374,8 +377,10 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && !IsPackedCompactLattice(is)) {
+    // 214 is first char of FST magic number, on little-endian machines which
+    // is all we support (\326 octal); see packed-lattice.h for the other
+    // binary format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -417,7 +422,15 @@ bool WriteLattice(std::ostream &os, bool binary, const Lattice &t) {
 bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat) {
   KALDI_ASSERT(*lat == NULL);
-  if (binary) {
+  if (binary && IsPackedCompactLattice(is)) {
+    CompactLattice *clat = NULL;
+    if (!ReadPackedCompactLattice(is, &clat))
+      return false;
+    *lat = new Lattice();
+    ConvertLattice(*clat, *lat);
+    delete clat;
+    return true;
+  } else if (binary) {
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading lattice: error reading FST header.";
@@ -490,8 +503,10 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && !IsPackedCompactLattice(is)) {
+    // 214 is first char of FST magic number, on little-endian machines which
+    // is all we support (\326 octal); see packed-lattice.h for the other
+    // binary format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -0,0 +1,127 @@
+// lat/packed-lattice-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/packed-lattice.h"
+#include "fstext/rand-fst.h"
+
+
+namespace kaldi {
+
+
+CompactLattice *RandCompactLattice() {
+  Lattice *fst = fst::RandPairFst<LatticeArc>();
+  CompactLattice *cfst = new CompactLattice;
+  ConvertLattice(*fst, cfst);
+  delete fst;
+  return cfst;
+}
+
+void TestPackedLatticeIo() {
+  CompactLattice *clat = RandCompactLattice();
+  BaseFloat weight_quantum = (Rand() % 2 == 0 ? 0.0 : 0.01);
+  std::ostringstream os;
+  KALDI_ASSERT(WritePackedCompactLattice(os, *clat, weight_quantum));
+
+  std::istringstream is(os.str());
+  KALDI_ASSERT(IsPackedCompactLattice(is));
+  CompactLattice *clat2 = NULL;
+  KALDI_ASSERT(ReadCompactLattice(is, true, &clat2));
+  if (weight_quantum == 0.0)
+    KALDI_ASSERT(fst::Equal(*clat, *clat2));
+  else
+    KALDI_ASSERT(fst::Equal(*clat, *clat2, weight_quantum));
+
+  // ReadLattice() should read it too.
+  std::istringstream is2(os.str());
+  Lattice *lat = NULL;
+  KALDI_ASSERT(ReadLattice(is2, true, &lat));
+  CompactLattice clat3;
+  ConvertLattice(*lat, &clat3);
+  KALDI_ASSERT(fst::Equal(*clat2, clat3));
+
+  // A truncated lattice should be rejected.
+  std::string truncated = os.str().substr(0, os.str().size() - 1);
+  std::istringstream is3(truncated);
+  CompactLattice *clat4 = NULL;
+  KALDI_ASSERT(!ReadPackedCompactLattice(is3, &clat4) && clat4 == NULL);
+
+  // So should a lattice whose size is corrupted.
+  std::string corrupted = os.str();
+  corrupted[4 + sizeof(uint64) - 1] = '\x7f';
+  std::istringstream is4(corrupted);
+  KALDI_ASSERT(!ReadPackedCompactLattice(is4, &clat4) && clat4 == NULL);
+
+  // And one whose size is plausible but more than the data that follows.
+  std::string too_long = os.str();
+  too_long[4 + 3] = '\x01';  // adds 16M to the size.
+  std::istringstream is5(too_long);
+  KALDI_ASSERT(!ReadPackedCompactLattice(is5, &clat4) && clat4 == NULL);
+
+  delete clat;
+  delete clat2;
+  delete lat;
+}
+
+// Write packed lattices to an archive, and read them back as CompactLattice
+// and as Lattice.
+void TestPackedLatticeTable(bool binary) {
+  PackedCompactLatticeWriter writer(binary ? "ark:tmpf" : "ark,t:tmpf");
+  int N = 10;
+  std::vector<CompactLattice*> lat_vec(N);
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    CompactLattice *fst = RandCompactLattice();
+    lat_vec[i] = fst;
+    writer.Write(key, *fst);
+  }
+  writer.Close();
+
+  RandomAccessCompactLatticeReader reader("ark:tmpf");
+  RandomAccessLatticeReader lattice_reader("ark:tmpf");
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    const CompactLattice &fst = reader.Value(key);
+    KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i])));
+    CompactLattice fst2;
+    ConvertLattice(lattice_reader.Value(key), &fst2);
+    KALDI_ASSERT(fst::Equal(fst2, *(lat_vec[i])));
+    delete lat_vec[i];
+  }
+}
+
+
+} // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int i = 0; i < 20; i++)
+    TestPackedLatticeIo();
+  for (int i = 0; i < 2; i++) {
+    bool binary = (i%2 == 0);
+    TestPackedLatticeTable(binary);
+  }
+  std::cout << "Test OK\n";
+
+  unlink("tmpf");
+}
@@ -0,0 +1,338 @@
+// lat/packed-lattice.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include "lat/packed-lattice.h"
+
+namespace kaldi {
+
+BaseFloat PackedCompactLatticeHolder::weight_quantum_ = 0.0;
+
+namespace {
+
+const char kPackedLatticeMagic[] = "KPL1";
+const size_t kPackedLatticeMagicSize = 4;
+// Upper bound on the size of a packed lattice, used to detect corrupted
+// data; 2G is far more than any real lattice needs.
+const uint64 kPackedLatticeMaxSize = static_cast<uint64>(1) << 31;
+
+// Encodes values into a buffer; see the comment in packed-lattice.h for the
+// format.
+class PackedLatticeEncoder {
+ public:
+  explicit PackedLatticeEncoder(std::string *buf): buf_(buf) { }
+
+  void PutVarint(uint64 value) {
+    while (value >= 128) {
+      buf_->push_back(static_cast<char>((value & 127) | 128));
+      value >>= 7;
+    }
+    buf_->push_back(static_cast<char>(value));
+  }
+
+  void PutSignedVarint(int64 value) {
+    // zigzag encoding: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...
+    PutVarint((static_cast<uint64>(value) << 1) ^
+              static_cast<uint64>(value >> 63));
+  }
+
+  void PutFloat(float value) {
+    buf_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  // Returns false if the value cannot be encoded.
+  bool PutCost(float value, float weight_quantum) {
+    if (weight_quantum == 0.0) {
+      PutFloat(value);
+      return true;
+    }
+    if (value == std::numeric_limits<float>::infinity()) {
+      PutVarint(0);
+      return true;
+    }
+    double scaled = value / static_cast<double>(weight_quantum);
+    if (!(std::abs(scaled) < 1.0e+18))  // NaN, -infinity or too large.
+      return false;
+    int64 code = static_cast<int64>(std::floor(scaled + 0.5));
+    PutVarint(((static_cast<uint64>(code) << 1) ^
+               static_cast<uint64>(code >> 63)) + 1);
+    return true;
+  }
+
+  bool PutWeight(const CompactLatticeWeight &weight, float weight_quantum) {
+    if (!PutCost(weight.Weight().Value1(), weight_quantum) ||
+        !PutCost(weight.Weight().Value2(), weight_quantum))
+      return false;
+    const std::vector<int32> &str = weight.String();
+    size_t num_runs = 0;
+    for (size_t i = 0; i < str.size(); i++)
+      if (i == 0 || str[i] != str[i - 1])
+        num_runs++;
+    PutVarint(num_runs);
+    int32 prev_tid = 0;
+    for (size_t i = 0; i < str.size(); ) {
+      size_t j = i + 1;
+      while (j < str.size() && str[j] == str[i])
+        j++;
+      PutSignedVarint(static_cast<int64>(str[i]) - prev_tid);
+      PutVarint(j - i);
+      prev_tid = str[i];
+      i = j;
+    }
+    return true;
+  }
+
+ private:
+  std::string *buf_;
+};
+
+// Decodes values from a buffer; all the functions return false if they would
+// read past the end.
+class PackedLatticeDecoder {
+ public:
+  PackedLatticeDecoder(const char *data, size_t size):
+      data_(reinterpret_cast<const unsigned char*>(data)),
+      end_(data_ + size) { }
+
+  bool GetVarint(uint64 *value) {
+    uint64 ans = 0;
+    for (int32 shift = 0; shift < 64; shift += 7) {
+      if (data_ == end_)
+        return false;
+      unsigned char c = *(data_++);
+      ans |= static_cast<uint64>(c & 127) << shift;
+      if (c < 128) {
+        *value = ans;
+        return true;
+      }
+    }
+    return false;  // Too many bytes.
+  }
+
+  bool GetSignedVarint(int64 *value) {
+    uint64 zigzag;
+    if (!GetVarint(&zigzag))
+      return false;
+    *value = static_cast<int64>(zigzag >> 1) ^ -static_cast<int64>(zigzag & 1);
+    return true;
+  }
+
+  bool GetFloat(float *value) {
+    if (end_ - data_ < static_cast<ptrdiff_t>(sizeof(float)))
+      return false;
+    std::memcpy(value, data_, sizeof(float));
+    data_ += sizeof(float);
+    return true;
+  }
+
+  bool GetCost(float weight_quantum, float *value) {
+    if (weight_quantum == 0.0)
+      return GetFloat(value);
+    uint64 code;
+    if (!GetVarint(&code))
+      return false;
+    if (code == 0) {
+      *value = std::numeric_limits<float>::infinity();
+    } else {
+      code--;
+      int64 i = static_cast<int64>(code >> 1) ^ -static_cast<int64>(code & 1);
+      *value = i * weight_quantum;
+    }
+    return true;
+  }
+
+  bool GetWeight(float weight_quantum, CompactLatticeWeight *weight) {
+    float value1, value2;
+    uint64 num_runs;
+    if (!GetCost(weight_quantum, &value1) ||
+        !GetCost(weight_quantum, &value2) ||
+        !GetVarint(&num_runs) || num_runs > static_cast<uint64>(end_ - data_))
+      return false;
+    std::vector<int32> str;
+    int64 tid = 0;
+    for (uint64 r = 0; r < num_runs; r++) {
+      int64 delta;
+      uint64 length;
+      if (!GetSignedVarint(&delta) || !GetVarint(&length) || length == 0 ||
+          length > std::numeric_limits<int32>::max())
+        return false;
+      tid += delta;
+      str.insert(str.end(), length, static_cast<int32>(tid));
+    }
+    *weight = CompactLatticeWeight(LatticeWeight(value1, value2), str);
+    return true;
+  }
+
+  bool Done() const { return data_ == end_; }
+
+ private:
+  const unsigned char *data_;
+  const unsigned char *end_;
+};
+
+}  // namespace
+
+
+bool WritePackedCompactLattice(std::ostream &os, const CompactLattice &clat,
+                               BaseFloat weight_quantum) {
+  typedef CompactLatticeArc::StateId StateId;
+  KALDI_ASSERT(weight_quantum >= 0.0);
+  std::string buf;
+  PackedLatticeEncoder encoder(&buf);
+  float quantum = weight_quantum;
+  encoder.PutFloat(quantum);
+  StateId num_states = clat.NumStates();
+  encoder.PutVarint(num_states);
+  encoder.PutVarint(clat.Start() == fst::kNoStateId ? 0 : clat.Start() + 1);
+  for (StateId s = 0; s < num_states; s++) {
+    CompactLatticeWeight final_weight = clat.Final(s);
+    if (final_weight == CompactLatticeWeight::Zero()) {
+      encoder.PutVarint(0);
+    } else {
+      encoder.PutVarint(1);
+      if (!encoder.PutWeight(final_weight, quantum)) {
+        KALDI_WARN << "Cannot write lattice weight " << final_weight
+                   << " in packed format.";
+        return false;
+      }
+    }
+    encoder.PutVarint(clat.NumArcs(s));
+    int32 prev_ilabel = 0;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      encoder.PutSignedVarint(static_cast<int64>(arc.ilabel) - prev_ilabel);
+      encoder.PutSignedVarint(static_cast<int64>(arc.olabel) - arc.ilabel);
+      encoder.PutSignedVarint(static_cast<int64>(arc.nextstate) - s);
+      if (!encoder.PutWeight(arc.weight, quantum)) {
+        KALDI_WARN << "Cannot write lattice weight " << arc.weight
+                   << " in packed format.";
+        return false;
+      }
+      prev_ilabel = arc.ilabel;
+    }
+  }
+  uint64 size = buf.size();
+  os.write(kPackedLatticeMagic, kPackedLatticeMagicSize);
+  os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  os.write(buf.data(), buf.size());
+  return os.good();
+}
+
+
+bool DecodePackedCompactLattice(const char *data, size_t size,
+                                CompactLattice *clat) {
+  typedef CompactLatticeArc::StateId StateId;
+  PackedLatticeDecoder decoder(data, size);
+  clat->DeleteStates();
+  float quantum;
+  uint64 num_states, start;
+  if (!decoder.GetFloat(&quantum) || !(quantum >= 0.0) ||
+      !decoder.GetVarint(&num_states) || !decoder.GetVarint(&start) ||
+      num_states > size || start > num_states)
+    return false;
+  clat->ReserveStates(num_states);
+  for (uint64 s = 0; s < num_states; s++)
+    clat->AddState();
+  if (start != 0)
+    clat->SetStart(start - 1);
+  for (StateId s = 0; s < static_cast<StateId>(num_states); s++) {
+    uint64 is_final, num_arcs;
+    if (!decoder.GetVarint(&is_final) || is_final > 1)
+      return false;
+    if (is_final) {
+      CompactLatticeWeight final_weight;
+      if (!decoder.GetWeight(quantum, &final_weight))
+        return false;
+      clat->SetFinal(s, final_weight);
+    }
+    if (!decoder.GetVarint(&num_arcs) || num_arcs > size)
+      return false;
+    clat->ReserveArcs(s, num_arcs);
+    int64 ilabel = 0;
+    for (uint64 a = 0; a < num_arcs; a++) {
+      int64 ilabel_delta, olabel_delta, nextstate_delta;
+      CompactLatticeArc arc;
+      if (!decoder.GetSignedVarint(&ilabel_delta) ||
+          !decoder.GetSignedVarint(&olabel_delta) ||
+          !decoder.GetSignedVarint(&nextstate_delta) ||
+          !decoder.GetWeight(quantum, &arc.weight))
+        return false;
+      ilabel += ilabel_delta;
+      int64 nextstate = s + nextstate_delta;
+      if (nextstate < 0 || nextstate >= static_cast<int64>(num_states))
+        return false;
+      arc.ilabel = ilabel;
+      arc.olabel = ilabel + olabel_delta;
+      arc.nextstate = nextstate;
+      clat->AddArc(s, arc);
+    }
+  }
+  return decoder.Done();
+}
+
+
+bool ReadPackedCompactLattice(std::istream &is, CompactLattice **clat) {
+  KALDI_ASSERT(*clat == NULL);
+  char magic[kPackedLatticeMagicSize];
+  uint64 size;
+  is.read(magic, kPackedLatticeMagicSize);
+  if (is.fail() ||
+      std::memcmp(magic, kPackedLatticeMagic, kPackedLatticeMagicSize) != 0) {
+    KALDI_WARN << "Reading packed lattice: wrong magic string.";
+    return false;
+  }
+  is.read(reinterpret_cast<char*>(&size), sizeof(size));
+  if (is.fail()) {
+    KALDI_WARN << "Reading packed lattice: error reading size.";
+    return false;
+  }
+  // A corrupted size should give an error rather than a huge allocation, so
+  // we check it against a fixed bound and read the data in blocks, checking
+  // that each one was read in full before we allocate more.
+  if (size > kPackedLatticeMaxSize) {
+    KALDI_WARN << "Reading packed lattice: implausible size " << size;
+    return false;
+  }
+  const uint64 block_size = static_cast<uint64>(1) << 20;
+  std::string buf;
+  while (buf.size() < size) {
+    size_t offset = buf.size(),
+        this_size = std::min<uint64>(size - offset, block_size);
+    buf.resize(offset + this_size);
+    is.read(&(buf[offset]), this_size);
+    if (static_cast<size_t>(is.gcount()) != this_size) {
+      KALDI_WARN << "Reading packed lattice: unexpected end of stream.";
+      return false;
+    }
+  }
+  CompactLattice *ans = new CompactLattice();
+  if (!DecodePackedCompactLattice(buf.data(), buf.size(), ans)) {
+    KALDI_WARN << "Reading packed lattice: the data is corrupted.";
+    delete ans;
+    return false;
+  }
+  *clat = ans;
+  return true;
+}
+
+
+} // namespace kaldi
@@ -0,0 +1,117 @@
+// lat/packed-lattice.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_PACKED_LATTICE_H_
+#define KALDI_LAT_PACKED_LATTICE_H_
+
+#include <string>
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   This header provides a compact binary format for CompactLattice ("packed
+   lattices"), which is typically several times smaller than the OpenFst
+   format that WriteCompactLattice() writes, and faster to read.
+
+   ReadCompactLattice() and ReadLattice() in binary mode, and therefore
+   CompactLatticeHolder and LatticeHolder, recognize this format
+   automatically, so any program can read archives and scp files of packed
+   lattices; to write them, use PackedCompactLatticeWriter (see
+   lattice-copy --write-packed).
+
+   The format of a packed lattice is: the four bytes "KPL1"; the number of
+   bytes that follow, as an 8-byte integer; and then the encoded lattice:
+
+     weight_quantum  (4-byte float)
+     num_states      (varint)
+     start_state+1   (varint; 0 means no start state)
+     for each state s:
+       final weight  (varint 0 if Zero(), else 1 followed by the weight and
+                     string as for an arc)
+       num_arcs      (varint)
+       for each arc:
+         ilabel - previous ilabel of this state   (signed varint)
+         olabel - ilabel                          (signed varint)
+         nextstate - s                            (signed varint)
+         the two components of the weight: if weight_quantum is zero, as
+           4-byte floats; otherwise each is round(value / weight_quantum),
+           as a signed varint, plus one (zero encodes +infinity).
+         the string: the number of runs of identical transition-ids
+           (varint), then for each run, the transition-id minus the previous
+           run's transition-id (signed varint) and the run length (varint).
+
+   Varints are little-endian base-128 (7 bits per byte, with the top bit set
+   on all but the last byte); signed varints are zigzag-encoded first.  With
+   weight_quantum == 0 the format is lossless.
+*/
+
+/// Writes 'clat' to 'os' in the packed format.  If weight_quantum > 0, the
+/// weights are rounded to multiples of it (an absolute error of up to half
+/// weight_quantum on each of the two costs), which makes them smaller to
+/// store; 0.001 is normally more than precise enough.  Returns false on
+/// error (e.g. stream failure or a weight that is NaN or -infinity).
+bool WritePackedCompactLattice(std::ostream &os, const CompactLattice &clat,
+                               BaseFloat weight_quantum = 0.0);
+
+/// Reads a lattice written by WritePackedCompactLattice().  Requires *clat to
+/// be NULL.  Returns false (with a warning) on error, including if the size in
+/// the header is implausible or the stream ends before that many bytes.
+bool ReadPackedCompactLattice(std::istream &is, CompactLattice **clat);
+
+/// Decodes the part of a packed lattice that follows the magic string and the
+/// size, from memory (e.g. from a memory-mapped file); 'data' points to
+/// 'size' bytes.  Returns false on error.
+bool DecodePackedCompactLattice(const char *data, size_t size,
+                                CompactLattice *clat);
+
+/// Returns true if the next character in 'is' is the first character of a
+/// packed lattice (this does not check the rest of the magic string).
+inline bool IsPackedCompactLattice(std::istream &is) {
+  return is.peek() == 'K';
+}
+
+/// Holder for writing packed lattices (for reading, it behaves the same as
+/// CompactLatticeHolder, which reads both formats).  In text mode it writes
+/// the usual text format.
+class PackedCompactLatticeHolder: public CompactLatticeHolder {
+ public:
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    if (binary)
+      return WritePackedCompactLattice(os, t, weight_quantum_);
+    else
+      return WriteCompactLattice(os, binary, t);
+  }
+
+  /// Sets the weight_quantum argument that Write() passes to
+  /// WritePackedCompactLattice(), for all writers in the program; the
+  /// default is 0.0 (lossless).
+  static void SetWeightQuantum(BaseFloat weight_quantum) {
+    KALDI_ASSERT(weight_quantum >= 0.0);
+    weight_quantum_ = weight_quantum;
+  }
+
+ private:
+  static BaseFloat weight_quantum_;
+};
+
+typedef TableWriter<PackedCompactLatticeHolder> PackedCompactLatticeWriter;
+
+
+} // namespace kaldi
+
+#endif  // KALDI_LAT_PACKED_LATTICE_H_
@@ -92,39 +92,48 @@ void MinimumBayesRisk::NormalizeEps(std::vector<int32> *vec) {
 }
 
 double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
-                                      Vector<double> &alpha,
                                       Matrix<double> &alpha_dash,
-                                      Vector<double> &alpha_dash_arc) {
-  alpha(1) = 0.0; // = log(1).  Line 5.
+                                      Vector<double> &alpha_dash_arc,
+                                      std::vector<char> &b_arc) {
   alpha_dash(1, 0) = 0.0; // Line 5.
   for (int32 q = 1; q <= Q; q++)
     alpha_dash(1, q) = alpha_dash(1, q-1) + l(0, r(q)); // Line 7.
+  // ins_cost[q] is l(0, r(q)), which does not depend on the arc.
+  std::vector<double> ins_cost(Q+1, 0.0);
+  for (int32 q = 1; q <= Q; q++)
+    ins_cost[q] = l(0, r(q));
+  b_arc.resize(arcs_.size() * (Q+1));
+  double *arc_dash = alpha_dash_arc.Data();
   for (int32 n = 2; n <= N; n++) {
-    double alpha_n = kLogZeroDouble;
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
-      alpha_n = LogAdd(alpha_n, alpha(arc.start_node) + arc.loglike);
-    }
-    alpha(n) = alpha_n; // Line 10.
+    // Line 10 was done in PrepareLatticeAndInitStats().
     // Line 11 omitted: matrix was initialized to zero.
+    double *this_alpha_dash = alpha_dash.RowData(n);
     for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
-      int32 s_a = arc.start_node, w_a = arc.word;
-      BaseFloat p_a = arc.loglike;
-      for (int32 q = 0; q <= Q; q++) {
-        if (q == 0) {
-          alpha_dash_arc(q) = // line 15.
-              alpha_dash(s_a, q) + l(w_a, 0, true);
-        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
-          int32 r_q = r(q);
-          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-              a2 = alpha_dash(s_a, q) + l(w_a, 0, true),
-              a3 = alpha_dash_arc(q-1) + l(0, r_q);
-          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
+      int32 arc_index = pre_[n][i];
+      const Arc &arc = arcs_[arc_index];
+      const double *prev_alpha_dash = alpha_dash.RowData(arc.start_node);
+      char *this_b_arc = &(b_arc[static_cast<size_t>(arc_index) * (Q+1)]);
+      int32 w_a = arc.word;
+      double del_cost = l(w_a, 0, true);
+      arc_dash[0] = prev_alpha_dash[0] + del_cost; // line 15.
+      for (int32 q = 1; q <= Q; q++) {
+        // a1,a2,a3 are the 3 parts of min expression of line 17.
+        double a1 = prev_alpha_dash[q-1] + l(w_a, r(q)),
+            a2 = prev_alpha_dash[q] + del_cost,
+            a3 = arc_dash[q-1] + ins_cost[q];
+        if (a1 <= a2) {
+          if (a1 <= a3) { this_b_arc[q] = 1; arc_dash[q] = a1; }
+          else { this_b_arc[q] = 3; arc_dash[q] = a3; }
+        } else {
+          if (a2 <= a3) { this_b_arc[q] = 2; arc_dash[q] = a2; }
+          else { this_b_arc[q] = 3; arc_dash[q] = a3; }
         }
-        // line 19:
-        alpha_dash(n, q) += Exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
       }
+      // line 19 (there is no dependency between the q's here, so the compiler
+      // can vectorize this loop).
+      double post = arc.post;
+      for (int32 q = 0; q <= Q; q++)
+        this_alpha_dash[q] += post * arc_dash[q];
     }
   }
   return alpha_dash(N, Q); // line 23.
@@ -137,12 +146,12 @@ void MinimumBayesRisk::AccStats() {
   int32 N = static_cast<int32>(pre_.size()) - 1,
       Q = static_cast<int32>(R_.size());
 
-  Vector<double> alpha(N+1); // index (1...N)
   Matrix<double> alpha_dash(N+1, Q+1); // index (1...N, 0...Q)
   Vector<double> alpha_dash_arc(Q+1); // index 0...Q
   Matrix<double> beta_dash(N+1, Q+1); // index (1...N, 0...Q)
   Vector<double> beta_dash_arc(Q+1); // index 0...Q
-  std::vector<char> b_arc(Q+1); // integer in {1,2,3}; index 1...Q
+  std::vector<char> b_arc; // integer in {1,2,3}; index (arc, 1...Q), see
+                           // EditDistance().
   std::vector<map<int32, double> > gamma(Q+1); // temp. form of gamma.
   // index 1...Q [word] -> occ.
 
@@ -152,7 +161,7 @@ void MinimumBayesRisk::AccStats() {
   // the sausage bins, not specifically for the 1-best output.
   Vector<double> tau_b(Q+1), tau_e(Q+1);
 
-  double Ltmp = EditDistance(N, Q, alpha, alpha_dash, alpha_dash_arc);
+  double Ltmp = EditDistance(N, Q, alpha_dash, alpha_dash_arc, b_arc);
   if (L_ != 0 && Ltmp > L_) { // L_ != 0 is to rule out 1st iter.
     KALDI_WARN << "Edit distance increased: " << Ltmp << " > "
                << L_;
@@ -163,28 +172,18 @@ void MinimumBayesRisk::AccStats() {
   beta_dash(N, Q) = 1.0; // Line 11.
   for (int32 n = N; n >= 2; n--) {
     for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
+      int32 arc_index = pre_[n][i];
+      const Arc &arc = arcs_[arc_index];
       int32 s_a = arc.start_node, w_a = arc.word;
-      BaseFloat p_a = arc.loglike;
-      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0, true); // line 14.
-      for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
-        int32 r_q = r(q);
-        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-            a2 = alpha_dash(s_a, q) + l(w_a, 0, true),
-            a3 = alpha_dash_arc(q-1) + l(0, r_q);
-        if (a1 <= a2) {
-          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
-        } else {
-          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
-        }
-      }
+      double post = arc.post;
+      // Lines 14-18 were done in EditDistance(), which stored the choices in
+      // b_arc.
+      const char *this_b_arc = &(b_arc[static_cast<size_t>(arc_index) * (Q+1)]);
       beta_dash_arc.SetZero(); // line 19.
       for (int32 q = Q; q >= 1; q--) {
         // line 21:
-        beta_dash_arc(q) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
-        switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
+        beta_dash_arc(q) += post * beta_dash(n, q);
+        switch (static_cast<int>(this_b_arc[q])) { // lines 22 and 23:
           case 1:
             beta_dash(s_a, q-1) += beta_dash_arc(q);
             // next: gamma(q, w(a)) += beta_dash_arc(q)
@@ -211,7 +210,7 @@ void MinimumBayesRisk::AccStats() {
             KALDI_ERR << "Invalid b_arc value"; // error in code.
         }
       }
-      beta_dash_arc(0) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
+      beta_dash_arc(0) += post * beta_dash(n, 0);
       beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
     }
   }
@@ -313,6 +312,26 @@ void MinimumBayesRisk::PrepareLatticeAndInitStats(CompactLattice *clat) {
       arcs_.push_back(arc);
     }
   }
+
+  // The forward probabilities alpha (line 10 of Fig. 4 of the paper) don't
+  // depend on R_, so we compute them, and the arcs' share of them, just once
+  // here instead of on every iteration.
+  std::vector<double> alpha(N+1, kLogZeroDouble); // index (1...N)
+  alpha[1] = 0.0;
+  for (int32 n = 2; n <= N; n++) {
+    double alpha_n = kLogZeroDouble;
+    for (size_t i = 0; i < pre_[n].size(); i++) {
+      const Arc &arc = arcs_[pre_[n][i]];
+      alpha_n = LogAdd(alpha_n, alpha[arc.start_node] + arc.loglike);
+    }
+    alpha[n] = alpha_n;
+  }
+  for (int32 n = 2; n <= N; n++) {
+    for (size_t i = 0; i < pre_[n].size(); i++) {
+      Arc &arc = arcs_[pre_[n][i]];
+      arc.post = Exp(alpha[arc.start_node] + arc.loglike - alpha[n]);
+    }
+  }
 }
 
 MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
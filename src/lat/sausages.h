@@ -153,11 +153,15 @@ class MinimumBayesRisk {
   inline int32 r(int32 q) { return R_[q-1]; }
 
 
-  /// Figure 4 of the paper; called from AccStats (Fig. 5)
+  /// Figure 4 of the paper; called from AccStats (Fig. 5).  Line 10 (alpha)
+  /// is done in PrepareLatticeAndInitStats(), as it does not depend on R_; see
+  /// Arc::post.  Also outputs to b_arc, indexed [arc-index * (Q+1) + q], which
+  /// of the three terms of line 17 was the minimum (1, 2 or 3), so that
+  /// AccStats() does not need to work out the alignments again.
   double EditDistance(int32 N, int32 Q,
-                      Vector<double> &alpha,
                       Matrix<double> &alpha_dash,
-                      Vector<double> &alpha_dash_arc);
+                      Vector<double> &alpha_dash_arc,
+                      std::vector<char> &b_arc);
 
   /// Figure 5 of the paper.  Outputs to gamma_ and L_.
   void AccStats();
@@ -192,6 +196,8 @@ class MinimumBayesRisk {
     int32 start_node;
     int32 end_node;
     BaseFloat loglike;
+    double post;  // Exp(alpha(start_node) + loglike - alpha(end_node)), the
+                  // term of lines 19 (Fig. 4) and 21 (Fig. 5) of the paper.
   };
 
   MinimumBayesRiskOptions opts_;
@@ -23,6 +23,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/packed-lattice.h"
 
 namespace kaldi {
   int32 CopySubsetLattices(std::string filename,
@@ -76,9 +77,11 @@ namespace kaldi {
     return (num_success != 0 ? 0 : 1);
   }
 
+  // WriterType is CompactLatticeWriter or PackedCompactLatticeWriter.
+  template<class WriterType>
   int32 CopySubsetLattices(std::string filename,
       SequentialCompactLatticeReader *lattice_reader,
-      CompactLatticeWriter *lattice_writer,
+      WriterType *lattice_writer,
       bool include = true, bool ignore_missing = false,
       bool sorted = false) {
     unordered_set<std::string, StringHasher> subset;
@@ -126,6 +129,40 @@ namespace kaldi {
 
     return (num_success != 0 ? 0 : 1);
   }
+
+  // Copies compact lattices; WriterType is CompactLatticeWriter or
+  // PackedCompactLatticeWriter.  Returns the exit status of the program.
+  template<class WriterType>
+  int32 CopyCompactLattices(const std::string &lats_rspecifier,
+                            const std::string &lats_wspecifier,
+                            const std::string &include_rxfilename,
+                            const std::string &exclude_rxfilename,
+                            bool ignore_missing, bool sorted) {
+    SequentialCompactLatticeReader lattice_reader(lats_rspecifier);
+    WriterType lattice_writer(lats_wspecifier);
+
+    if (include_rxfilename != "") {
+      if (exclude_rxfilename != "") {
+        KALDI_ERR << "should not have both --exclude and --include option!";
+      }
+      return CopySubsetLattices(include_rxfilename,
+          &lattice_reader, &lattice_writer,
+          true, ignore_missing, sorted);
+    } else if (exclude_rxfilename != "") {
+      return CopySubsetLattices(exclude_rxfilename,
+          &lattice_reader, &lattice_writer,
+          false, ignore_missing);
+    }
+
+    int32 n_done = 0;
+    for (; !lattice_reader.Done(); lattice_reader.Next(), n_done++)
+      lattice_writer.Write(lattice_reader.Key(), lattice_reader.Value());
+    KALDI_LOG << "Done copying " << n_done << " lattices.";
+
+    if (ignore_missing) return 0;
+
+    return (n_done != 0 ? 0 : 1);
+  }
 }
 
 int main(int argc, char *argv[]) {
@@ -147,15 +184,24 @@ int main(int argc, char *argv[]) {
         "Only one of --include and --exclude can be supplied.\n"
         "Usage: lattice-copy [options] lattice-rspecifier lattice-wspecifier\n"
         " e.g.: lattice-copy --write-compact=false ark:1.lats ark,t:text.lats\n"
+        "   or: lattice-copy --write-packed=true ark:1.lats ark:1.packed.lats\n"
         "See also: lattice-scale, lattice-to-fst, and\n"
         "   the script egs/wsj/s5/utils/convert_slf.pl\n";
 
     ParseOptions po(usage);
-    bool write_compact = true, ignore_missing = false;
+    bool write_compact = true, write_packed = false, ignore_missing = false;
+    BaseFloat packed_weight_quantum = 0.0;
     std::string include_rxfilename;
     std::string exclude_rxfilename;
 
     po.Register("write-compact", &write_compact, "If true, write in normal (compact) form.");
+    po.Register("write-packed", &write_packed, "If true, write compact lattices "
+                "in the packed binary format (see lat/packed-lattice.h), which "
+                "is smaller and faster to read; all programs can read it.");
+    po.Register("packed-weight-quantum", &packed_weight_quantum, "With "
+                "--write-packed=true, if nonzero, round the costs to multiples "
+                "of this value (e.g. 0.001), which makes them smaller to store; "
+                "if zero, the packed format is lossless.");
     po.Register("include", &include_rxfilename,
                 "Text file, the first field of each "
                 "line being interpreted as the "
@@ -181,28 +227,24 @@ int main(int argc, char *argv[]) {
     ClassifyRspecifier(lats_rspecifier, NULL, &opts);
     bool sorted = opts.sorted;
 
-    int32 n_done = 0;
-
-    if (write_compact) {
-      SequentialCompactLatticeReader lattice_reader(lats_rspecifier);
-      CompactLatticeWriter lattice_writer(lats_wspecifier);
-
-      if (include_rxfilename != "") {
-        if (exclude_rxfilename != "") {
-          KALDI_ERR << "should not have both --exclude and --include option!";
-        }
-        return CopySubsetLattices(include_rxfilename,
-            &lattice_reader, &lattice_writer,
-            true, ignore_missing, sorted);
-      } else if (exclude_rxfilename != "") {
-        return CopySubsetLattices(exclude_rxfilename,
-            &lattice_reader, &lattice_writer,
-            false, ignore_missing);
-      }
+    if (write_packed && !write_compact)
+      KALDI_ERR << "--write-packed=true requires --write-compact=true";
+    if (packed_weight_quantum < 0.0)
+      KALDI_ERR << "Invalid --packed-weight-quantum=" << packed_weight_quantum;
+
+    if (write_packed) {
+      PackedCompactLatticeHolder::SetWeightQuantum(packed_weight_quantum);
+      return CopyCompactLattices<PackedCompactLatticeWriter>(
+          lats_rspecifier, lats_wspecifier, include_rxfilename,
+          exclude_rxfilename, ignore_missing, sorted);
+    } else if (write_compact) {
+      return CopyCompactLattices<CompactLatticeWriter>(
+          lats_rspecifier, lats_wspecifier, include_rxfilename,
+          exclude_rxfilename, ignore_missing, sorted);
+    }
 
-      for (; !lattice_reader.Done(); lattice_reader.Next(), n_done++)
-        lattice_writer.Write(lattice_reader.Key(), lattice_reader.Value());
-    } else {
+    int32 n_done = 0;
+    {
       SequentialLatticeReader lattice_reader(lats_rspecifier);
       LatticeWriter lattice_writer(lats_wspecifier);
 
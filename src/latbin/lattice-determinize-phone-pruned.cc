@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 #include "base/kaldi-common.h"
+#include "base/timer.h"
 #include "hmm/transition-model.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/determinize-lattice-pruned.h"
@@ -36,7 +37,8 @@ int main(int argc, char *argv[]) {
         "phone inertion when doing a first pass determinization, it then\n"
         "removes the inserted symbols and does a second pass determinization.\n"
         "It also does pruning as part of the determinization algorithm, which\n"
-        "is more efficient and prevents blowup.\n"
+        "is more efficient and prevents blowup.  For long lattices, see the\n"
+        "--determinize-num-threads option.\n"
         "\n"
         "Usage: lattice-determinize-phone-pruned [options] <model> \\\n"
         "                  <lattice-rspecifier> <lattice-wspecifier>\n"
@@ -91,6 +93,7 @@ int main(int argc, char *argv[]) {
     // depth stats (for diagnostics).
     double sum_depth_in = 0.0,
           sum_depth_out = 0.0, sum_t = 0.0;
+    double det_time = 0.0;
 
     if (acoustic_scale == 0.0)
       KALDI_ERR << "Do not use a zero acoustic scale (cannot be inverted)";
@@ -111,12 +114,14 @@ int main(int argc, char *argv[]) {
       fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &lat);
 
       CompactLattice det_clat;
+      Timer timer;
       if (!DeterminizeLatticePhonePrunedWrapper(
               trans_model, &lat, beam, &det_clat, opts)) {
         KALDI_WARN << "For key " << key << ", determinization did not succeed"
             "(partial output will be pruned tighter than the specified beam.)";
         n_warn++;
       }
+      det_time += timer.Elapsed();
 
       int32 t;
       TopSortCompactLatticeIfNeeded(&det_clat);
@@ -147,6 +152,7 @@ int main(int argc, char *argv[]) {
                 << (sum_depth_out / sum_t) << ", over " << sum_t << " frames "
                 << " (average num-frames = " << (sum_t / n_done) << ").";
     }
+    KALDI_LOG << "Determinization took " << det_time << " seconds.";
     KALDI_LOG << "Done " << n_done << " lattices, determinization finished "
               << "earlier than specified by the beam on " << n_warn << " of "
               << "these.";
@@ -0,0 +1,130 @@
+// latbin/lattice-io-benchmark.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/packed-lattice.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Benchmark the packed lattice format (see lat/packed-lattice.h) against\n"
+        "the standard (OpenFst) binary format of compact lattices.  All the\n"
+        "lattices are read into memory; then they are written to memory in\n"
+        "each format and read back, and the sizes and times are printed.  We\n"
+        "also check that the lattices read back are the same as the originals\n"
+        "(up to --packed-weight-quantum, if it is nonzero).\n"
+        "\n"
+        "Usage: lattice-io-benchmark [options] <lattice-rspecifier>\n"
+        " e.g.: lattice-io-benchmark --num-repeats=3 ark:1.lats\n";
+
+    ParseOptions po(usage);
+    BaseFloat packed_weight_quantum = 0.0;
+    int32 num_repeats = 1;
+    po.Register("packed-weight-quantum", &packed_weight_quantum, "If nonzero, "
+                "round the costs to multiples of this value in the packed "
+                "format.");
+    po.Register("num-repeats", &num_repeats, "Number of times to write and "
+                "read the lattices in each format (the fastest time is "
+                "reported).");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 1 || num_repeats < 1 || packed_weight_quantum < 0.0) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string lats_rspecifier = po.GetArg(1);
+
+    std::vector<CompactLattice*> lats;
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    for (; !clat_reader.Done(); clat_reader.Next())
+      lats.push_back(new CompactLattice(clat_reader.Value()));
+    if (lats.empty())
+      KALDI_ERR << "No lattices read.";
+
+    const char *format_names[] = { "standard", "packed" };
+    double write_time[2], read_time[2];
+    size_t size[2];
+    int32 num_mismatch = 0;
+    for (int32 format = 0; format < 2; format++) {
+      for (int32 r = 0; r < num_repeats; r++) {
+        std::ostringstream os;
+        Timer timer;
+        for (size_t i = 0; i < lats.size(); i++) {
+          bool ans = (format == 0 ?
+                      WriteCompactLattice(os, true, *(lats[i])) :
+                      WritePackedCompactLattice(os, *(lats[i]),
+                                                packed_weight_quantum));
+          if (!ans)
+            KALDI_ERR << "Error writing lattice in " << format_names[format]
+                      << " format.";
+        }
+        double this_write_time = timer.Elapsed();
+        size[format] = os.str().size();
+
+        std::istringstream is(os.str());
+        timer.Reset();
+        std::vector<CompactLattice*> lats_read(lats.size(), NULL);
+        for (size_t i = 0; i < lats.size(); i++) {
+          if (!ReadCompactLattice(is, true, &(lats_read[i])))
+            KALDI_ERR << "Error reading lattice in " << format_names[format]
+                      << " format.";
+        }
+        double this_read_time = timer.Elapsed();
+        if (r == 0) {
+          float delta = (format == 1 && packed_weight_quantum != 0.0 ?
+                         packed_weight_quantum : fst::kDelta);
+          for (size_t i = 0; i < lats.size(); i++)
+            if (!fst::Equal(*(lats[i]), *(lats_read[i]), delta))
+              num_mismatch++;
+        }
+        DeletePointers(&lats_read);
+        if (r == 0 || this_write_time < write_time[format])
+          write_time[format] = this_write_time;
+        if (r == 0 || this_read_time < read_time[format])
+          read_time[format] = this_read_time;
+      }
+      KALDI_LOG << "Format " << format_names[format] << ": size is "
+                << size[format] << " bytes, writing took "
+                << write_time[format] << "s, reading took "
+                << read_time[format] << "s";
+    }
+    KALDI_LOG << "Packed format is " << (size[0] * 1.0 / size[1])
+              << " times smaller; writing is "
+              << (write_time[0] / write_time[1]) << " times faster; reading is "
+              << (read_time[0] / read_time[1]) << " times faster.";
+    if (num_mismatch != 0)
+      KALDI_WARN << num_mismatch << " lattices were not the same after being "
+                 << "written and read.";
+
+    DeletePointers(&lats);
+    return (num_mismatch == 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -23,7 +23,127 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
+#include "lm/hash-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; this is run by TaskSequencer, possibly in parallel
+// with other lattices.  The language model, which is either "const_arpa" or
+// "hash_arpa" (the other is NULL), is shared between the tasks, and is only
+// read; so is "cache", if non-NULL, which is thread-safe.  If
+// "interpolated_lms" has more than one language model, we instead use them
+// interpolated with "lm_weights" (which may be specific to this lattice), and
+// "const_arpa" and "hash_arpa" are NULL.
+class ConstArpaRescoreTask {
+ public:
+  // Takes ownership of "clat".
+  ConstArpaRescoreTask(const ConstArpaLm *const_arpa,
+                       const HashArpaLm *hash_arpa, ConstArpaLmCache *cache,
+                       const std::vector<const ConstArpaLm*> &interpolated_lms,
+                       const std::vector<BaseFloat> &lm_weights,
+                       bool log_linear, BaseFloat lm_scale,
+                       const std::string &key, CompactLattice *clat,
+                       CompactLatticeWriter *clat_writer,
+                       int32 *num_done, int32 *num_fail):
+      const_arpa_(const_arpa), hash_arpa_(hash_arpa), cache_(cache),
+      interpolated_lms_(interpolated_lms), lm_weights_(lm_weights),
+      log_linear_(log_linear), lm_scale_(lm_scale), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_fail_(num_fail) { }
+
+  void operator () () {
+    if (lm_scale_ == 0.0) {
+      // Zero scale so nothing to do.
+      determinized_clat_ = *clat_;
+    } else {
+      // Before composing with the LM FST, we scale the lattice weights
+      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+      // We do it this way so we can determinize and it will give the
+      // right effect (taking the "best path" through the LM) regardless
+      // of the sign of lm_scale.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale_), clat_);
+      ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+      // Wraps the language model into FST. We re-create it for each lattice
+      // to prevent memory usage increasing with time (the cache, if used, has
+      // a bounded size).
+      fst::DeterministicOnDemandFst<fst::StdArc> *lm_fst;
+      if (interpolated_lms_.size() > 1)
+        lm_fst = new InterpolatedConstArpaLmDeterministicFst(
+            interpolated_lms_, lm_weights_, log_linear_);
+      else if (hash_arpa_ != NULL)
+        lm_fst = new HashArpaLmDeterministicFst(*hash_arpa_);
+      else if (cache_ != NULL)
+        lm_fst = new ConstArpaLmDeterministicFst(cache_);
+      else
+        lm_fst = new ConstArpaLmDeterministicFst(*const_arpa_);
+
+      // Composes lattice with language model.
+      CompactLattice composed_clat;
+      ComposeCompactLatticeDeterministic(*clat_, lm_fst, &composed_clat);
+      delete lm_fst;
+
+      // Determinizes the composed lattice.
+      Lattice composed_lat;
+      ConvertLattice(composed_clat, &composed_lat);
+      Invert(&composed_lat);
+      DeterminizeLattice(composed_lat, &determinized_clat_);
+      fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_),
+                        &determinized_clat_);
+    }
+    delete clat_;
+    clat_ = NULL;
+  }
+
+  ~ConstArpaRescoreTask() {
+    // The destructors are called in the same order as the lattices were read,
+    // and not in parallel.
+    if (lm_scale_ != 0.0 && determinized_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, determinized_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ConstArpaLm *const_arpa_;
+  const HashArpaLm *hash_arpa_;
+  ConstArpaLmCache *cache_;
+  const std::vector<const ConstArpaLm*> &interpolated_lms_;
+  std::vector<BaseFloat> lm_weights_;
+  bool log_linear_;
+  BaseFloat lm_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice, owned locally.
+  CompactLattice determinized_clat_;  // The output; written to clat_writer_
+                                      // in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+// Checks the interpolation weights "weights" (described by "what", for the
+// error message) before they are given to a task, since an error in
+// InterpolatedConstArpaLmDeterministicFst would happen in a worker thread.
+void CheckLmWeights(const std::vector<BaseFloat> &weights, bool log_linear,
+                    const std::string &what) {
+  BaseFloat sum = 0.0;
+  for (size_t i = 0; i < weights.size(); i++) {
+    if (!KALDI_ISFINITE(weights[i]) || (!log_linear && weights[i] < 0.0))
+      KALDI_ERR << "Invalid interpolation weight " << weights[i] << " in "
+                << what;
+    sum += weights[i];
+  }
+  if (!log_linear && sum <= 0.0)
+    KALDI_ERR << "The linear interpolation weights in " << what
+              << " must not all be zero.";
+}
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -36,83 +156,161 @@ int main(int argc, char *argv[]) {
         "will be wrapped into the DeterministicOnDemandFst interface and the\n"
         "rescoring is done by composing with the wrapped LM using a special\n"
         "type of composition algorithm. Determinization will be applied on\n"
-        "the composed lattice.\n"
+        "the composed lattice.  The language model may also be in the\n"
+        "HashArpaLm format (see arpa-to-hash-arpa).\n"
+        "\n"
+        "This program accepts the --num-threads option; the lattices are\n"
+        "written in the same order as they are read.  With --lm-cache-size,\n"
+        "the n-gram lookups are cached across lattices (and threads).\n"
+        "\n"
+        "If several language models (in the ConstArpaLm format) are given,\n"
+        "they are interpolated on the fly, linearly or log-linearly, with the\n"
+        "weights from --lm-weights or, per utterance or speaker, from\n"
+        "--lm-weights-rspecifier; no merged language model is built.\n"
         "\n"
         "Usage: lattice-lmrescore-const-arpa [options] lattice-rspecifier \\\n"
-        "                                   const-arpa-in lattice-wspecifier\n"
+        "                 const-arpa-in [const-arpa-in2 ...] lattice-wspecifier\n"
         " e.g.: lattice-lmrescore-const-arpa --lm-scale=-1.0 ark:in.lats \\\n"
-        "                                   const_arpa ark:out.lats\n";
+        "                                   const_arpa ark:out.lats\n"
+        " or:   lattice-lmrescore-const-arpa --lm-weights=0.7,0.3 \\\n"
+        "          ark:in.lats general.carpa domain.carpa ark:out.lats\n";
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    int32 lm_cache_size = 0;
+    std::string lm_weights_str, lm_weights_rspecifier, utt2spk_rspecifier,
+        interpolation = "linear";
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    po.Register("lm-cache-size", &lm_cache_size, "If >0, the maximum number "
+                "of n-gram lookups to cache across lattices; e.g. 10000000 "
+                "uses a few hundred megabytes.  Only used with a single "
+                "language model in the ConstArpaLm format.");
+    po.Register("lm-weights", &lm_weights_str, "With several language "
+                "models, comma-separated list of their interpolation "
+                "weights, e.g. 0.7,0.3 (by default, equal weights that sum "
+                "to one).");
+    po.Register("interpolation", &interpolation, "With several language "
+                "models, the type of interpolation: \"linear\" (of the "
+                "probabilities) or \"log-linear\" (of the logprobs, which "
+                "is not normalized).");
+    po.Register("lm-weights-rspecifier", &lm_weights_rspecifier, "With "
+                "several language models, rspecifier for vectors of "
+                "interpolation weights indexed by utterance (or by speaker, "
+                "with --utt2spk); utterances that are not in it use "
+                "--lm-weights.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "rspecifier for utterance "
+                "to speaker map, for --lm-weights-rspecifier.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
-    if (po.NumArgs() != 3) {
+    if (po.NumArgs() < 3) {
       po.PrintUsage();
       exit(1);
     }
 
     std::string lats_rspecifier = po.GetArg(1),
-        lm_rxfilename = po.GetArg(2),
-        lats_wspecifier = po.GetArg(3);
+        lats_wspecifier = po.GetArg(po.NumArgs());
+    int32 num_lms = po.NumArgs() - 2;
+
+    if (interpolation != "linear" && interpolation != "log-linear")
+      KALDI_ERR << "Invalid value for --interpolation: " << interpolation;
+    bool log_linear = (interpolation == "log-linear");
+    std::vector<BaseFloat> lm_weights(num_lms, 1.0 / num_lms);
+    if (!lm_weights_str.empty() &&
+        (!SplitStringToFloats(lm_weights_str, ",", false, &lm_weights) ||
+         static_cast<int32>(lm_weights.size()) != num_lms)) {
+      KALDI_ERR << "Invalid --lm-weights option '" << lm_weights_str
+                << "' for " << num_lms << " language models.";
+    }
+    if (num_lms == 1 && (!lm_weights_str.empty() ||
+                         !lm_weights_rspecifier.empty()))
+      KALDI_WARN << "Ignoring the interpolation weights, as there is only "
+                 << "one language model.";
+    if (num_lms > 1)
+      CheckLmWeights(lm_weights, log_linear, "--lm-weights");
+
+    // Reads the language model in ConstArpaLm or HashArpaLm format or, with
+    // several language models, reads them in ConstArpaLm format.
+    ConstArpaLm *const_arpa = NULL;
+    HashArpaLm *hash_arpa = NULL;
+    std::vector<const ConstArpaLm*> interpolated_lms;
+    if (num_lms == 1) {
+      ReadConstOrHashArpaLm(po.GetArg(2), &const_arpa, &hash_arpa);
+    } else {
+      for (int32 i = 0; i < num_lms; i++) {
+        ConstArpaLm *lm = new ConstArpaLm();
+        ReadConstArpaLm(po.GetArg(i + 2), lm);
+        interpolated_lms.push_back(lm);
+        if (lm->BosSymbol() != interpolated_lms[0]->BosSymbol() ||
+            lm->EosSymbol() != interpolated_lms[0]->EosSymbol())
+          KALDI_ERR << "The language models to interpolate have different "
+                    << "<s> or </s> symbols.";
+      }
+    }
+    ConstArpaLmCache *cache = NULL;
+    if (lm_cache_size > 0) {
+      if (const_arpa != NULL)
+        cache = new ConstArpaLmCache(*const_arpa, lm_cache_size);
+      else
+        KALDI_WARN << "Ignoring --lm-cache-size, as it is only used with a "
+                   << "single language model in the ConstArpaLm format.";
+    }
 
-    // Reads the language model in ConstArpaLm format.
-    ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    RandomAccessBaseFloatVectorReaderMapped lm_weights_reader(
+        num_lms > 1 ? lm_weights_rspecifier : "", utt2spk_rspecifier);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
-    int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
-          n_done++;
+    int32 n_done = 0, n_fail = 0, n_default_weights = 0;
+    {
+      TaskSequencer<ConstArpaRescoreTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        // The task takes ownership of the lattice.
+        CompactLattice *clat = new CompactLattice(compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+        std::string key = compact_lattice_reader.Key();
+        // The weights reader is only accessed from this thread.
+        std::vector<BaseFloat> utt_lm_weights(lm_weights);
+        if (num_lms > 1 && !lm_weights_rspecifier.empty()) {
+          if (lm_weights_reader.HasKey(key)) {
+            const Vector<BaseFloat> &weights = lm_weights_reader.Value(key);
+            if (weights.Dim() != num_lms)
+              KALDI_ERR << "Expected " << num_lms << " interpolation weights "
+                        << "for utterance " << key << ", got "
+                        << weights.Dim();
+            for (int32 i = 0; i < num_lms; i++)
+              utt_lm_weights[i] = weights(i);
+            CheckLmWeights(utt_lm_weights, log_linear,
+                           "the weights for utterance " + key);
+          } else {
+            n_default_weights++;
+          }
         }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
+        sequencer.Run(new ConstArpaRescoreTask(
+            const_arpa, hash_arpa, cache, interpolated_lms, utt_lm_weights,
+            log_linear, lm_scale, key, clat,
+            &compact_lattice_writer, &n_done, &n_fail));
       }
+      sequencer.Wait();
+    }
+    if (cache != NULL) {
+      cache->PrintStats();
+      delete cache;
     }
+    delete const_arpa;
+    delete hash_arpa;
+    for (size_t i = 0; i < interpolated_lms.size(); i++)
+      delete interpolated_lms[i];
+    if (n_default_weights != 0)
+      KALDI_WARN << "Used the --lm-weights for " << n_default_weights
+                 << " utterances that had no weights in "
+                 << lm_weights_rspecifier;
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
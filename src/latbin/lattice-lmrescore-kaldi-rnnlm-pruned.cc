@@ -28,6 +28,106 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; this is run by TaskSequencer, possibly in parallel
+// with other lattices.  The RNNLM (in "info") and the old LM are shared
+// between the tasks and only read; the objects that cache LM states
+// (KaldiRnnlmDeterministicFst and ConstArpaLmDeterministicFst) are created
+// for each lattice.
+class RnnlmRescorePrunedTask {
+ public:
+  // Takes ownership of "clat".  If "const_arpa" is non-NULL it is the LM to
+  // subtract; otherwise "lm_to_subtract" is.
+  RnnlmRescorePrunedTask(const ComposeLatticePrunedOptions &compose_opts,
+                         const rnnlm::RnnlmComputeStateInfo &info,
+                         int32 max_ngram_order,
+                         BaseFloat lm_scale, BaseFloat acoustic_scale,
+                         fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+                         const ConstArpaLm *const_arpa,
+                         const std::string &key, CompactLattice *clat,
+                         CompactLatticeWriter *clat_writer,
+                         int32 *num_done, int32 *num_err):
+      compose_opts_(compose_opts), info_(info),
+      max_ngram_order_(max_ngram_order), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), lm_to_subtract_(lm_to_subtract),
+      const_arpa_(const_arpa), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    ConstArpaLmDeterministicFst *const_arpa_fst = NULL;
+    fst::ScaleDeterministicOnDemandFst *const_arpa_scale = NULL;
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract =
+        lm_to_subtract_;
+    if (const_arpa_ != NULL) {
+      const_arpa_fst = new ConstArpaLmDeterministicFst(*const_arpa_);
+      const_arpa_scale = new fst::ScaleDeterministicOnDemandFst(
+          -lm_scale_, const_arpa_fst);
+      lm_to_subtract = const_arpa_scale;
+    }
+
+    rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order_, info_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, &lm_to_add_orig);
+
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        lm_to_subtract, &lm_to_add);
+
+    // Composes lattice with language model.
+    ComposeCompactLatticePruned(compose_opts_, *clat_,
+                                &combined_lms, &composed_clat_);
+    delete const_arpa_scale;
+    delete const_arpa_fst;
+    delete clat_;
+    clat_ = NULL;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~RnnlmRescorePrunedTask() {
+    // The destructors are called in the same order as the lattices were read,
+    // and not in parallel.
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  int32 max_ngram_order_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_;
+  const ConstArpaLm *const_arpa_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice, owned locally.
+  CompactLattice composed_clat_;  // The output; written to clat_writer_ in
+                                  // the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -43,6 +143,8 @@ int main(int argc, char *argv[]) {
         "Rescores lattice with kaldi-rnnlm. This script is called from \n"
         "scripts/rnnlm/lmrescore_pruned.sh. An example for rescoring \n"
         "lattices is at egs/swbd/s5c/local/rnnlm/run_lstm.sh \n"
+        "This program accepts the --num-threads option; the lattices are\n"
+        "written in the same order as they are read.\n"
         "\n"
         "Usage: lattice-lmrescore-kaldi-rnnlm-pruned [options] \\\n"
         "             <old-lm-rxfilename> <embedding-file> \\\n"
@@ -65,6 +167,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -80,6 +183,7 @@ int main(int argc, char *argv[]) {
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -106,18 +210,13 @@ int main(int argc, char *argv[]) {
     fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
 
-    // for G.carpa
+    // for G.carpa; the tasks create their own ConstArpaLmDeterministicFst.
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
-      ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
+      ReadConstArpaLm(lm_to_subtract_rxfilename, const_arpa);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
@@ -138,66 +237,35 @@ int main(int argc, char *argv[]) {
 
     const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
 
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
     int32 num_done = 0, num_err = 0;
-
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    {
+      TaskSequencer<RnnlmRescorePrunedTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        // The task takes ownership of the lattice.
+        CompactLattice *clat =
+            new CompactLattice(compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+        sequencer.Run(new RnnlmRescorePrunedTask(
+            compose_opts, info, max_ngram_order, lm_scale, acoustic_scale,
+            lm_to_subtract_det_scale, const_arpa,
+            compact_lattice_reader.Key(), clat, &compact_lattice_writer,
+            &num_done, &num_err));
       }
-      delete lm_to_add;
+      sequencer.Wait();
     }
 
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
     delete lm_to_subtract_det_backoff;
     delete lm_to_subtract_det_scale;
 
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -23,9 +23,115 @@
 #include "fstext/fstext-lib.h"
 #include "fstext/kaldi-fst-io.h"
 #include "lm/const-arpa-lm.h"
+#include "lm/hash-arpa-lm.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; this is run by TaskSequencer, possibly in parallel
+// with other lattices.  The language models are shared between the tasks;
+// the FST-format ones are wrapped in BackoffDeterministicOnDemandFst, which
+// has no state and so can be shared, but ConstArpaLmDeterministicFst and
+// HashArpaLmDeterministicFst cache the LM states they have seen, so we create
+// one for each lattice (ConstArpaLmDeterministicFsts may share a thread-safe
+// ConstArpaLmCache).
+class LmRescorePrunedTask {
+ public:
+  // Takes ownership of "clat".  If "const_arpa" is non-NULL it is the LM to
+  // add, looked up through "cache" if that is non-NULL; if "hash_arpa" is
+  // non-NULL it is; otherwise "lm_to_add" is.
+  LmRescorePrunedTask(const ComposeLatticePrunedOptions &compose_opts,
+                      BaseFloat lm_scale, BaseFloat acoustic_scale,
+                      fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+                      fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add,
+                      const ConstArpaLm *const_arpa,
+                      const HashArpaLm *hash_arpa, ConstArpaLmCache *cache,
+                      const std::string &key, CompactLattice *clat,
+                      CompactLatticeWriter *clat_writer,
+                      int32 *num_done, int32 *num_err):
+      compose_opts_(compose_opts), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), lm_to_subtract_(lm_to_subtract),
+      lm_to_add_(lm_to_add), const_arpa_(const_arpa), hash_arpa_(hash_arpa),
+      cache_(cache), key_(key), clat_(clat), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    fst::DeterministicOnDemandFst<fst::StdArc> *arpa_fst = NULL;
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add = lm_to_add_;
+    if (const_arpa_ != NULL) {
+      arpa_fst = (cache_ != NULL ?
+                  new ConstArpaLmDeterministicFst(cache_) :
+                  new ConstArpaLmDeterministicFst(*const_arpa_));
+      lm_to_add = arpa_fst;
+    } else if (hash_arpa_ != NULL) {
+      arpa_fst = new HashArpaLmDeterministicFst(*hash_arpa_);
+      lm_to_add = arpa_fst;
+    }
+    fst::ScaleDeterministicOnDemandFst lm_to_add_scale(lm_scale_, lm_to_add);
+    if (lm_scale_ != 1.0)
+      lm_to_add = &lm_to_add_scale;
+
+    // To avoid memory gradually increasing with time, we reconstruct the
+    // composed-LM FST for each lattice we process.
+    //   It shouldn't make a difference in which order we provide the
+    // arguments to the composition; either way should work.  They are both
+    // acceptors so the result is the same either way.
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        lm_to_subtract_, lm_to_add);
+
+    ComposeCompactLatticePruned(compose_opts_,
+                                *clat_,
+                                &combined_lms,
+                                &composed_clat_);
+    delete arpa_fst;
+    delete clat_;
+    clat_ = NULL;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~LmRescorePrunedTask() {
+    // The destructors are called in the same order as the lattices were read,
+    // and not in parallel.
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add_;
+  const ConstArpaLm *const_arpa_;
+  const HashArpaLm *hash_arpa_;
+  ConstArpaLmCache *cache_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice, owned locally.
+  CompactLattice composed_clat_;  // The output; written to clat_writer_ in
+                                  // the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -42,9 +148,12 @@ int main(int argc, char *argv[]) {
         "add scores from another one.  It uses an efficient rescoring algorithm that\n"
         "avoids exploring the entire composed lattice.  The first (negative-weight)\n"
         "language model is expected to be an FST, e.g. G.fst; the second one can\n"
-        "either be in FST or const-arpa format.  Any FST-format language models will\n"
+        "either be in FST or const-arpa format (or the HashArpaLm format; see\n"
+        "arpa-to-hash-arpa).  Any FST-format language models will\n"
         "be projected on their output by this program, making it unnecessary for the\n"
-        "caller to remove disambiguation symbols.\n"
+        "caller to remove disambiguation symbols.  This program accepts the\n"
+        "--num-threads option; the lattices are written in the same order as\n"
+        "they are read.\n"
         "\n"
         "Usage: lattice-lmrescore-pruned [options] <lm-to-subtract> <lm-to-add> <lattice-rspecifier> <lattice-wspecifier>\n"
         " e.g.: lattice-lmrescore-pruned --acoustic-scale=0.1 \\\n"
@@ -60,16 +169,21 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    int32 lm_cache_size = 0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic "
                 "probabilities (e.g. 0.1 for non-chain systems); important because "
                 "of its effect on pruning.");
-    po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
-                "to be in const-arpa format; if false it's expected to be in FST"
-                "format.");
-
+    po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected "
+                "to be in const-arpa (or HashArpaLm) format; if false it's "
+                "expected to be in FST format.");
+    po.Register("lm-cache-size", &lm_cache_size, "If >0 and --add-const-arpa "
+                "is true, the maximum number of n-gram lookups of <lm-to-add> "
+                "to cache across lattices (and threads).");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -87,9 +201,13 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
         lm_to_subtract_rxfilename);
     VectorFst<StdArc> *lm_to_add_fst = NULL;
-    ConstArpaLm const_arpa;
+    ConstArpaLm *const_arpa = NULL;
+    HashArpaLm *hash_arpa = NULL;
+    ConstArpaLmCache *cache = NULL;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      ReadConstOrHashArpaLm(lm_to_add_rxfilename, &const_arpa, &hash_arpa);
+      if (lm_cache_size > 0 && const_arpa != NULL)
+        cache = new ConstArpaLmCache(*const_arpa, lm_cache_size);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
@@ -99,22 +217,18 @@ int main(int argc, char *argv[]) {
         -lm_scale, &lm_to_subtract_det_backoff);
 
 
-    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
-        *lm_to_add = NULL;
-    if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
-    } else {
+    // If add_const_arpa, the tasks create their own
+    // ConstArpaLmDeterministicFst or HashArpaLmDeterministicFst.
+    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_add = NULL;
+    if (!add_const_arpa)
       lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
           *lm_to_add_fst);
-    }
-    if (lm_scale != 1.0) {
-      lm_to_add_orig = lm_to_add;
-      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
-                                                         lm_to_add_orig);
-    }
 
     KALDI_LOG << "Done.";
 
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
     // We read and write as CompactLattice.
     SequentialCompactLatticeReader clat_reader(lats_rspecifier);
 
@@ -122,48 +236,29 @@ int main(int argc, char *argv[]) {
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
     int32 num_done = 0, num_err = 0;
-
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice &clat = clat_reader.Value();
-
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      // To avoid memory gradually increasing with time, we reconstruct the
-      // composed-LM FST for each lattice we process.
-      //   It shouldn't make a difference in which order we provide the
-      // arguments to the composition; either way should work.  They are both
-      // acceptors so the result is the same either way.
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          &lm_to_subtract_det_scale, lm_to_add);
-
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts,
-                                  clat,
-                                  &combined_lms,
-                                  &composed_clat);
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    {
+      TaskSequencer<LmRescorePrunedTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        // The task takes ownership of the lattice.
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new LmRescorePrunedTask(
+            compose_opts, lm_scale, acoustic_scale, &lm_to_subtract_det_scale,
+            lm_to_add, const_arpa, hash_arpa, cache,
+            clat_reader.Key(), clat, &compact_lattice_writer,
+            &num_done, &num_err));
       }
+      sequencer.Wait();
+    }
+    if (cache != NULL) {
+      cache->PrintStats();
+      delete cache;
     }
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
-    delete lm_to_add_orig;
     delete lm_to_add;
+    delete const_arpa;
+    delete hash_arpa;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -21,8 +21,84 @@
 #include "util/common-utils.h"
 #include "util/kaldi-table.h"
 #include "lat/sausages.h"
+#include "util/kaldi-thread.h"
 #include <numeric>
 
+namespace kaldi {
+
+// Does the MBR computation for one lattice; this is run by TaskSequencer,
+// possibly in parallel with other lattices.  The destructor writes the ctm
+// lines.
+class LatticeToCtmTask {
+ public:
+  // Takes ownership of "clat".  If "one_best" is NULL the initial hypothesis
+  // is the lattice's best path; "times" may be NULL.
+  LatticeToCtmTask(const MinimumBayesRiskOptions &mbr_opts,
+                   BaseFloat frame_shift, const std::string &key,
+                   CompactLattice *clat, const std::vector<int32> *one_best,
+                   const std::vector<std::pair<BaseFloat,BaseFloat> > *times,
+                   std::ostream *os, int32 *n_done, int32 *n_words,
+                   BaseFloat *tot_bayes_risk):
+      mbr_opts_(mbr_opts), frame_shift_(frame_shift), key_(key), clat_(clat),
+      has_one_best_(one_best != NULL), has_times_(times != NULL), mbr_(NULL),
+      os_(os), n_done_(n_done), n_words_(n_words),
+      tot_bayes_risk_(tot_bayes_risk) {
+    if (one_best != NULL) one_best_ = *one_best;
+    if (times != NULL) times_ = *times;
+  }
+
+  void operator () () {
+    if (!has_one_best_)
+      mbr_ = new MinimumBayesRisk(*clat_, mbr_opts_);
+    else if (!has_times_)
+      mbr_ = new MinimumBayesRisk(*clat_, one_best_, mbr_opts_); // no 'times',
+    else // with initial 'times' of the bins,
+      mbr_ = new MinimumBayesRisk(*clat_, one_best_, times_, mbr_opts_);
+    delete clat_;
+    clat_ = NULL;
+  }
+
+  ~LatticeToCtmTask() {
+    // The destructors are called in the same order as the lattices were read,
+    // and not in parallel.
+    const std::vector<BaseFloat> &conf = mbr_->GetOneBestConfidences();
+    const std::vector<int32> &words = mbr_->GetOneBest();
+    const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+        mbr_->GetOneBestTimes();
+    KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      KALDI_ASSERT(words[i] != 0 || mbr_opts_.print_silence); // Should not have epsilons.
+      *os_ << key_ << " 1 " << (frame_shift_ * times[i].first) << ' '
+           << (frame_shift_ * (times[i].second-times[i].first)) << ' '
+           << words[i] << ' ' << conf[i] << '\n';
+    }
+    KALDI_LOG << "For utterance " << key_ << ", Bayes Risk "
+              << mbr_->GetBayesRisk() << ", avg. confidence per-word "
+              << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
+    (*n_done_)++;
+    *n_words_ += mbr_->GetOneBest().size();
+    *tot_bayes_risk_ += mbr_->GetBayesRisk();
+    delete mbr_;
+  }
+
+ private:
+  MinimumBayesRiskOptions mbr_opts_;
+  BaseFloat frame_shift_;
+  std::string key_;
+  CompactLattice *clat_;  // owned here.
+  bool has_one_best_;
+  bool has_times_;
+  std::vector<int32> one_best_;
+  std::vector<std::pair<BaseFloat,BaseFloat> > times_;
+  MinimumBayesRisk *mbr_;  // owned here.
+  std::ostream *os_;
+  int32 *n_done_;
+  int32 *n_words_;
+  BaseFloat *tot_bayes_risk_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -75,6 +151,8 @@ int main(int argc, char *argv[]) {
 
     MinimumBayesRiskOptions mbr_opts;
     mbr_opts.Register(&po);
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -129,56 +207,39 @@ int main(int argc, char *argv[]) {
     int32 n_done = 0, n_words = 0;
     BaseFloat tot_bayes_risk = 0.0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-
-      MinimumBayesRisk *mbr = NULL;
-
-      if (one_best_rspecifier == "") {
-        mbr = new MinimumBayesRisk(clat, mbr_opts);
-      } else {
-        // check,
-        if (!one_best_reader.HasKey(key)) {
-          KALDI_WARN << "No 1-best present for utterance " << key;
-          continue;
-        }
-        if (times_rspecifier != "" && !times_reader.HasKey(key)) {
-          KALDI_WARN << "No 'times' present for utterance " << key;
-          continue;
+    {
+      TaskSequencer<LatticeToCtmTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), clat);
+
+        const std::vector<int32> *one_best = NULL;
+        const std::vector<std::pair<BaseFloat,BaseFloat> > *times = NULL;
+        if (one_best_rspecifier != "") {
+          // check,
+          if (!one_best_reader.HasKey(key)) {
+            KALDI_WARN << "No 1-best present for utterance " << key;
+            delete clat;
+            continue;
+          }
+          if (times_rspecifier != "" && !times_reader.HasKey(key)) {
+            KALDI_WARN << "No 'times' present for utterance " << key;
+            delete clat;
+            continue;
+          }
+          one_best = &one_best_reader.Value(key);
+          if (times_rspecifier != "")
+            times = &times_reader.Value(key);
         }
-        // get the 'mbr' decoding object,
-        if (times_rspecifier == "") {
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, mbr_opts); // no 'times',
-        } else {
-          // with initial 'times' of the bins,
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          const std::vector<std::pair<BaseFloat,BaseFloat> > &times = times_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, times, mbr_opts);
-        }
-      }
-
-      const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
-      const std::vector<int32> &words = mbr->GetOneBest();
-      const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
-          mbr->GetOneBestTimes();
-      KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
-      for (size_t i = 0; i < words.size(); i++) {
-        KALDI_ASSERT(words[i] != 0 || mbr_opts.print_silence); // Should not have epsilons.
-        ko.Stream() << key << " 1 " << (frame_shift * times[i].first) << ' '
-                    << (frame_shift * (times[i].second-times[i].first)) << ' '
-                    << words[i] << ' ' << conf[i] << '\n';
+        // The task copies one_best and times, as the readers may invalidate
+        // them before it runs.
+        sequencer.Run(new LatticeToCtmTask(
+            mbr_opts, frame_shift, key, clat, one_best, times, &(ko.Stream()),
+            &n_done, &n_words, &tot_bayes_risk));
       }
-      KALDI_LOG << "For utterance " << key << ", Bayes Risk "
-                << mbr->GetBayesRisk() << ", avg. confidence per-word "
-                << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
-      n_done++;
-      n_words += mbr->GetOneBest().size();
-      tot_bayes_risk += mbr->GetBayesRisk();
-      delete mbr;
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices.";
@@ -79,6 +79,7 @@ class TestableArpaFileParser : public ArpaFileParser {
         read_complete_(false),
         last_order_(0) { }
   void Validate(CountedArray<int32> counts, CountedArray<NGramTestData> ngrams);
+  const std::vector<NGramTestData> &NGrams() const { return ngrams_; }
 
  private:
   // ArpaFileParser overrides.
@@ -204,6 +205,48 @@ ngram 3=2\n\
                   MakeCountedArray(expect_ngrams));
 }
 
+// Read an integer LM that is large enough to be parsed by several threads, and
+// check that the result does not depend on the number of threads.
+void ReadLargeLmWithThreads() {
+  KALDI_LOG << "ReadLargeLmWithThreads()";
+
+  const int32 num_words = 5000;
+  std::ostringstream lm;
+  lm << "\\data\\\nngram 1=" << num_words << "\nngram 2=" << num_words
+     << "\n\n\\1-grams:\n";
+  for (int32 w = 1; w <= num_words; ++w)
+    lm << -0.001 * w << '\t' << w << '\t' << -0.5 << '\n';
+  lm << "\n\\2-grams:\n";
+  for (int32 w = 1; w <= num_words; ++w)
+    lm << -0.002 * w << '\t' << w << ' ' << (w % num_words) + 1 << '\n';
+  lm << "\n\\end\\\n";
+
+  ArpaParseOptions options;
+  options.bos_symbol = 1;
+  options.eos_symbol = 2;
+  TestableArpaFileParser parser1(options, NULL);
+  std::istringstream stm1(lm.str(), std::ios_base::in);
+  parser1.Read(stm1);
+
+  options.num_threads = 4;
+  TestableArpaFileParser parser4(options, NULL);
+  std::istringstream stm4(lm.str(), std::ios_base::in);
+  parser4.Read(stm4);
+
+  const std::vector<NGramTestData> &ngrams1 = parser1.NGrams(),
+      &ngrams4 = parser4.NGrams();
+  KALDI_ASSERT(ngrams1.size() == 2 * num_words &&
+               ngrams4.size() == ngrams1.size());
+  for (size_t i = 0; i < ngrams1.size(); ++i) {
+    KALDI_ASSERT(ngrams1[i].line_number == ngrams4[i].line_number &&
+                 ngrams1[i].logprob == ngrams4[i].logprob &&
+                 ngrams1[i].backoff == ngrams4[i].backoff &&
+                 std::equal(ngrams1[i].words, ngrams1[i].words + kMaxOrder,
+                            ngrams4[i].words));
+  }
+  KALDI_ASSERT(ngrams1.back().line_number == 2 * num_words + 7);
+}
+
 // \xCE\xB2 = UTF-8 for Greek beta, to churn some UTF-8 cranks.
 static std::string symbolic_lm = "\
 We also allow random text coming before the \\data\\\n\
@@ -367,6 +410,7 @@ void ReadSymbolicLmWithOovTests() {
 
 int main(int argc, char *argv[]) {
   kaldi::ReadIntegerLmLogconvExpectSuccess();
+  kaldi::ReadLargeLmWithThreads();
   kaldi::ReadSymbolicLmNoOovTests();
   kaldi::ReadSymbolicLmWithOovTests();
 }
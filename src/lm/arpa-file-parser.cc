@@ -24,15 +24,136 @@
 
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
+#include "base/timer.h"
 #include "lm/arpa-file-parser.h"
+#include "util/kaldi-thread.h"
 #include "util/text-utils.h"
 
 namespace kaldi {
 
+struct ArpaNGramLine {
+  int32 line_number;
+  std::string line;
+  NGram ngram;
+  // If non-empty, the line is invalid and this is the error message.
+  std::string error;
+  // Words that were not in the symbol table, as (index, word) pairs. With
+  // kSkipNGram this has only the first one, and with kAddToSymbols they are
+  // added to the symbol table when the n-gram is consumed.
+  std::vector<std::pair<int32, std::string> > oov_words;
+};
+
+// Number of n-gram lines that ArpaFileParser reads before parsing them.
+static const size_t kArpaBatchSize = 100000;
+
+// Parses line->line, an n-gram line of order <cur_order>, into line->ngram,
+// setting line->error if it is invalid. This only reads the symbol table, so
+// it can be called from several threads at once.
+static void ParseArpaNGramLine(const ArpaParseOptions &options,
+                               const fst::SymbolTable *symbols,
+                               int32 cur_order, int32 max_order,
+                               ArpaNGramLine *line) {
+  std::vector<std::string> col;
+  SplitStringToVector(line->line, " \t", true, &col);
+
+  if (col.size() < 1 + cur_order ||
+      col.size() > 2 + cur_order ||
+      (cur_order == max_order && col.size() != 1 + cur_order)) {
+    line->error = "Invalid n-gram data line";
+    return;
+  }
+
+  // Parse out n-gram logprob and, if present, backoff weight.
+  NGram &ngram = line->ngram;
+  if (!ConvertStringToReal(col[0], &ngram.logprob)) {
+    line->error = "invalid n-gram logprob '" + col[0] + "'";
+    return;
+  }
+  ngram.backoff = 0.0;
+  if (col.size() > cur_order + 1) {
+    if (!ConvertStringToReal(col[cur_order + 1], &ngram.backoff)) {
+      line->error = "invalid backoff weight '" + col[cur_order + 1] + "'";
+      return;
+    }
+  }
+  // Convert to natural log.
+  ngram.logprob *= M_LN10;
+  ngram.backoff *= M_LN10;
+
+  ngram.words.resize(cur_order);
+  for (int32 index = 0; index < cur_order; ++index) {
+    int32 word;
+    if (symbols) {
+      // Symbol table provided, so symbol labels are expected.
+      word = symbols->Find(col[1 + index]);
+      if (word == -1) {  // fst::kNoSymbol
+        switch (options.oov_handling) {
+          case ArpaParseOptions::kAddToSymbols:
+            // The word is added to the symbol table later, in file order.
+            line->oov_words.push_back(std::make_pair(index, col[1 + index]));
+            ngram.words[index] = -1;
+            continue;
+          case ArpaParseOptions::kReplaceWithUnk:
+            word = options.unk_symbol;
+            break;
+          case ArpaParseOptions::kSkipNGram:
+            line->oov_words.push_back(std::make_pair(index, col[1 + index]));
+            return;
+          default:
+            line->error = "word '" + col[1 + index] + "' not in symbol table";
+            return;
+        }
+      }
+    } else {
+      // Symbols not provided, LM file should contain integers.
+      if (!ConvertStringToInteger(col[1 + index], &word) || word < 0) {
+        line->error = "invalid symbol '" + col[1 + index] + "'";
+        return;
+      }
+    }
+    // Whichever way we got it, an epsilon is invalid.
+    if (word == 0) {
+      line->error = "epsilon symbol '" + col[1 + index] +
+          "' is illegal in ARPA LM";
+      return;
+    }
+    ngram.words[index] = word;
+  }
+}
+
+// Parses a subset of a batch of n-gram lines; this is run by MultiThreader.
+class ArpaNGramLineParser: public MultiThreadable {
+ public:
+  ArpaNGramLineParser(const ArpaParseOptions &options,
+                      const fst::SymbolTable *symbols,
+                      int32 cur_order, int32 max_order,
+                      std::vector<ArpaNGramLine> *lines):
+      options_(options), symbols_(symbols), cur_order_(cur_order),
+      max_order_(max_order), lines_(lines) { }
+
+  void operator () () {
+    // Each thread parses a contiguous range of lines.
+    size_t num_lines = lines_->size(),
+        begin = num_lines * thread_id_ / num_threads_,
+        end = num_lines * (thread_id_ + 1) / num_threads_;
+    for (size_t i = begin; i < end; ++i)
+      ParseArpaNGramLine(options_, symbols_, cur_order_, max_order_,
+                         &((*lines_)[i]));
+  }
+
+ private:
+  ArpaParseOptions options_;
+  const fst::SymbolTable *symbols_;
+  int32 cur_order_;
+  int32 max_order_;
+  std::vector<ArpaNGramLine> *lines_;
+};
+
 ArpaFileParser::ArpaFileParser(ArpaParseOptions options,
                                fst::SymbolTable* symbols)
     : options_(options), symbols_(symbols),
-      line_number_(0), warning_count_(0) {
+      line_number_(0), warning_count_(0), parse_time_(0.0),
+      consume_time_(0.0) {
 }
 
 ArpaFileParser::~ArpaFileParser() {
@@ -42,6 +163,65 @@ void TrimTrailingWhitespace(std::string *str) {
   str->erase(str->find_last_not_of(" \n\r\t") + 1);
 }
 
+void ArpaFileParser::ProcessNGramLines(int32 cur_order,
+                                       std::vector<ArpaNGramLine> *lines,
+                                       int32 *ngram_count) {
+  if (lines->empty()) return;
+  // The caller may still need the current line.
+  int32 saved_line_number = line_number_;
+  std::string saved_line;
+  saved_line.swap(current_line_);
+
+  Timer timer;
+  int32 num_threads = std::min<int32>(options_.num_threads,
+                                      lines->size() / 1000 + 1);
+  if (num_threads > 1) {
+    ArpaNGramLineParser parser(options_, symbols_, cur_order,
+                               ngram_counts_.size(), lines);
+    // The destructor of MultiThreader waits for the threads.
+    MultiThreader<ArpaNGramLineParser> threader(num_threads, parser);
+  } else {
+    for (size_t i = 0; i < lines->size(); ++i)
+      ParseArpaNGramLine(options_, symbols_, cur_order, ngram_counts_.size(),
+                         &((*lines)[i]));
+  }
+  parse_time_ += timer.Elapsed();
+
+  timer.Reset();
+  for (size_t i = 0; i < lines->size(); ++i) {
+    ArpaNGramLine &line = (*lines)[i];
+    line_number_ = line.line_number;
+    current_line_.swap(line.line);
+    if (!line.error.empty()) {
+      KALDI_ERR << LineReference() << ": " << line.error;
+    }
+    ++(*ngram_count);
+    if (!line.oov_words.empty()) {
+      if (options_.oov_handling == ArpaParseOptions::kSkipNGram) {
+        if (ShouldWarn())
+          KALDI_WARN << LineReference() << " skipped: word '"
+                     << line.oov_words[0].second << "' not in symbol table";
+        continue;
+      }
+      KALDI_ASSERT(options_.oov_handling == ArpaParseOptions::kAddToSymbols);
+      for (size_t j = 0; j < line.oov_words.size(); ++j) {
+        int32 word = symbols_->AddSymbol(line.oov_words[j].second);
+        if (word == 0) {
+          KALDI_ERR << LineReference() << ": epsilon symbol '"
+                    << line.oov_words[j].second << "' is illegal in ARPA LM";
+        }
+        line.ngram.words[line.oov_words[j].first] = word;
+      }
+    }
+    ConsumeNGram(line.ngram);
+  }
+  consume_time_ += timer.Elapsed();
+  lines->clear();
+
+  line_number_ = saved_line_number;
+  current_line_.swap(saved_line);
+}
+
 void ArpaFileParser::Read(std::istream &is) {
   // Argument sanity checks.
   if (options_.bos_symbol <= 0 || options_.eos_symbol <= 0 ||
@@ -129,8 +309,10 @@ void ArpaFileParser::Read(std::istream &is) {
   // Signal that grammar order and n-gram counts are known.
   HeaderAvailable();
 
-  NGram ngram;
-  ngram.words.reserve(ngram_counts_.size());
+  Timer timer;
+  parse_time_ = 0.0;
+  consume_time_ = 0.0;
+  std::vector<ArpaNGramLine> lines;
 
   // Processes "\N-grams:" section.
   for (int32 cur_order = 1; cur_order <= ngram_counts_.size(); ++cur_order) {
@@ -159,6 +341,9 @@ void ArpaFileParser::Read(std::istream &is) {
         next_keyword << "\\" << cur_order + 1 << "-grams:";
         if ((current_line_ != next_keyword.str()) &&
             (current_line_ != "\\end\\")) {
+          // The lines before this one are processed first, so that the
+          // warnings come out in order.
+          ProcessNGramLines(cur_order, &lines, &ngram_count);
           if (ShouldWarn()) {
             KALDI_WARN << "ignoring possible directive '" << current_line_
                        << "' expecting '" << next_keyword.str() << "'";
@@ -176,73 +361,13 @@ void ArpaFileParser::Read(std::istream &is) {
         }
       }
 
-      std::vector<std::string> col;
-      SplitStringToVector(current_line_, " \t", true, &col);
-
-      if (col.size() < 1 + cur_order ||
-          col.size() > 2 + cur_order ||
-          (cur_order == ngram_counts_.size() && col.size() != 1 + cur_order)) {
-        PARSE_ERR << "Invalid n-gram data line";
-      }
-      ++ngram_count;
-
-      // Parse out n-gram logprob and, if present, backoff weight.
-      if (!ConvertStringToReal(col[0], &ngram.logprob)) {
-        PARSE_ERR << "invalid n-gram logprob '" << col[0] << "'";
-      }
-      ngram.backoff = 0.0;
-      if (col.size() > cur_order + 1) {
-        if (!ConvertStringToReal(col[cur_order + 1], &ngram.backoff))
-          PARSE_ERR << "invalid backoff weight '" << col[cur_order + 1] << "'";
-      }
-      // Convert to natural log.
-      ngram.logprob *= M_LN10;
-      ngram.backoff *= M_LN10;
-
-      ngram.words.resize(cur_order);
-      bool skip_ngram = false;
-      for (int32 index = 0; !skip_ngram && index < cur_order; ++index) {
-        int32 word;
-        if (symbols_) {
-          // Symbol table provided, so symbol labels are expected.
-          if (options_.oov_handling == ArpaParseOptions::kAddToSymbols) {
-            word = symbols_->AddSymbol(col[1 + index]);
-          } else {
-            word = symbols_->Find(col[1 + index]);
-            if (word == -1) { // fst::kNoSymbol
-              switch (options_.oov_handling) {
-                case ArpaParseOptions::kReplaceWithUnk:
-                  word = options_.unk_symbol;
-                  break;
-                case ArpaParseOptions::kSkipNGram:
-                  if (ShouldWarn())
-                    KALDI_WARN << LineReference() << " skipped: word '"
-                               << col[1 + index] << "' not in symbol table";
-                  skip_ngram = true;
-                  break;
-                default:
-                  PARSE_ERR << "word '"  << col[1 + index]
-                            << "' not in symbol table";
-              }
-            }
-          }
-        } else {
-          // Symbols not provided, LM file should contain integers.
-          if (!ConvertStringToInteger(col[1 + index], &word) || word < 0) {
-            PARSE_ERR << "invalid symbol '" << col[1 + index] << "'";
-          }
-        }
-        // Whichever way we got it, an epsilon is invalid.
-        if (word == 0) {
-          PARSE_ERR << "epsilon symbol '" << col[1 + index]
-                    << "' is illegal in ARPA LM";
-        }
-        ngram.words[index] = word;
-      }
-      if (!skip_ngram) {
-        ConsumeNGram(ngram);
-      }
+      lines.resize(lines.size() + 1);
+      lines.back().line_number = line_number_;
+      lines.back().line.swap(current_line_);
+      if (lines.size() == kArpaBatchSize)
+        ProcessNGramLines(cur_order, &lines, &ngram_count);
     }
+    ProcessNGramLines(cur_order, &lines, &ngram_count);
     if (ngram_count > ngram_counts_[cur_order - 1]) {
       PARSE_ERR << "header said there would be " << ngram_counts_[cur_order - 1]
                 << " n-grams of order " << cur_order
@@ -262,7 +387,12 @@ void ArpaFileParser::Read(std::istream &is) {
   }
 
   current_line_.empty();
+  double read_time = timer.Elapsed() - parse_time_ - consume_time_;
+  timer.Reset();
   ReadComplete();
+  KALDI_LOG << "Time taken: reading lines " << read_time << "s, parsing "
+            << parse_time_ << "s, processing n-grams " << consume_time_
+            << "s, finishing " << timer.Elapsed() << "s.";
 
 #undef PARSE_ERR
 }
@@ -44,15 +44,18 @@ struct ArpaParseOptions {
 
   ArpaParseOptions():
       bos_symbol(-1), eos_symbol(-1), unk_symbol(-1),
-      oov_handling(kRaiseError), max_warnings(30) { }
+      oov_handling(kRaiseError), max_warnings(30), num_threads(1) { }
 
   void Register(OptionsItf *opts) {
-    // Registering only the max_warnings count, since other options are
-    // treated differently by client programs: some want integer symbols,
-    // while other are passed words in their command line.
+    // Registering only the max_warnings count and the number of threads, since
+    // other options are treated differently by client programs: some want
+    // integer symbols, while other are passed words in their command line.
     opts->Register("max-arpa-warnings", &max_warnings,
                    "Maximum warnings to report on ARPA parsing, "
                    "0 to disable, -1 to show all");
+    opts->Register("num-threads", &num_threads,
+                   "Number of threads used to parse the n-gram lines of the "
+                   "ARPA file (the output does not depend on it)");
   }
 
   int32 bos_symbol;  ///< Symbol for <s>, Required non-epsilon.
@@ -60,8 +63,13 @@ struct ArpaParseOptions {
   int32 unk_symbol;  ///< Symbol for <unk>, Required for kReplaceWithUnk.
   OovHandling oov_handling;  ///< How to handle OOV words in the file.
   int32 max_warnings;  ///< Maximum warnings to report, <0 unlimited.
+  int32 num_threads;  ///< Number of threads for parsing n-gram lines.
 };
 
+/// An n-gram line of an ARPA file, while it is being parsed; this is internal
+/// to ArpaFileParser, and defined in arpa-file-parser.cc.
+struct ArpaNGramLine;
+
 /**
    A parsed n-gram from ARPA LM file.
 */
@@ -77,6 +85,13 @@ struct NGram {
     ArpaFileParser is an abstract base class for ARPA LM file conversion.
 
     See ConstArpaLmBuilder and ArpaLmCompiler for usage examples.
+
+    The n-gram lines are read in batches; the lines of a batch are split,
+    converted to numbers and looked up in the symbol table in parallel if
+    options.num_threads > 1, and then passed to ConsumeNGram() one by one in
+    file order (symbols are added to the table, and warnings and errors are
+    reported, at that point), so the result does not depend on the number of
+    threads.
 */
 class ArpaFileParser {
  public:
@@ -133,12 +148,20 @@ class ArpaFileParser {
   const std::vector<int32>& NgramCounts() const { return ngram_counts_; }
 
  private:
+  /// Parses the n-gram lines in <lines>, of order <cur_order>, and passes the
+  /// n-grams to ConsumeNGram(); increments <ngram_count> for each line.
+  void ProcessNGramLines(int32 cur_order, std::vector<ArpaNGramLine> *lines,
+                         int32 *ngram_count);
+
   ArpaParseOptions options_;
   fst::SymbolTable* symbols_;  // the pointer is not owned here.
   int32 line_number_;
   uint32 warning_count_;
   std::string current_line_;
   std::vector<int32> ngram_counts_;
+  // Time spent in ProcessNGramLines(), parsing and in ConsumeNGram().
+  double parse_time_;
+  double consume_time_;
 };
 
 }  // namespace kaldi
@@ -0,0 +1,330 @@
+// lm/const-arpa-lm-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "base/kaldi-math.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/hash-arpa-lm.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+static const int32 kBos = 1, kEos = 2, kNumWords = 20;
+
+// Writes a random trigram ARPA language model over the words 1 ...
+// kNumWords - 1, with integer words.
+static void WriteRandomArpa(const std::string &filename) {
+  std::vector<std::vector<int32> > bigrams, trigrams;
+  std::set<std::vector<int32> > seen;
+  for (int32 i = 0; i < 300; ++i) {
+    std::vector<int32> bigram(2);
+    bigram[0] = RandInt(1, kNumWords - 1);
+    bigram[1] = RandInt(1, kNumWords - 1);
+    if (bigram[0] != kEos && bigram[1] != kBos && seen.insert(bigram).second)
+      bigrams.push_back(bigram);
+  }
+  for (int32 i = 0; i < 600; ++i) {
+    std::vector<int32> trigram(bigrams[RandInt(0, bigrams.size() - 1)]);
+    trigram.push_back(RandInt(1, kNumWords - 1));
+    if (trigram[1] != kEos && trigram[2] != kBos &&
+        seen.insert(trigram).second)
+      trigrams.push_back(trigram);
+  }
+  std::sort(bigrams.begin(), bigrams.end());
+  std::sort(trigrams.begin(), trigrams.end());
+
+  Output ko(filename, false);
+  std::ostream &os = ko.Stream();
+  os << "\n\\data\\\n"
+     << "ngram 1=" << (kNumWords - 1) << "\n"
+     << "ngram 2=" << bigrams.size() << "\n"
+     << "ngram 3=" << trigrams.size() << "\n";
+  os << "\n\\1-grams:\n";
+  for (int32 w = 1; w < kNumWords; ++w)
+    os << (w == kBos ? -99.0 : -5.0 * RandUniform()) << '\t' << w << '\t'
+       << (w == kEos ? 0.0 : -RandUniform()) << "\n";
+  os << "\n\\2-grams:\n";
+  for (size_t i = 0; i < bigrams.size(); ++i)
+    os << -3.0 * RandUniform() << '\t' << bigrams[i][0] << ' '
+       << bigrams[i][1] << '\t' << -RandUniform() << "\n";
+  os << "\n\\3-grams:\n";
+  for (size_t i = 0; i < trigrams.size(); ++i)
+    os << -2.0 * RandUniform() << '\t' << trigrams[i][0] << ' '
+       << trigrams[i][1] << ' ' << trigrams[i][2] << "\n";
+  os << "\n\\end\\\n";
+}
+
+// Checks that the quantized ConstArpaLm gives (approximately) the same n-gram
+// logprobs as the unquantized one, both when read from a stream and when
+// memory-mapped.
+void UnitTestConstArpaLmQuantized() {
+  std::string arpa_filename = "tmp.arpa",
+      carpa_filename = "tmp.carpa",
+      quantized_filename = "tmp.quantized.carpa";
+  WriteRandomArpa(arpa_filename);
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  BuildConstArpaLm(options, arpa_filename, carpa_filename);
+  ConstArpaLm lm;
+  ReadKaldiObject(carpa_filename, &lm);
+  KALDI_ASSERT(lm.QuantizeBits() == 0);
+
+  for (int32 bits = 8; bits <= 16; bits += 8) {
+    BuildConstArpaLm(options, arpa_filename, quantized_filename, bits);
+    ConstArpaLm quantized_lm, mapped_lm;
+    ReadKaldiObject(quantized_filename, &quantized_lm);
+    ReadConstArpaLm(quantized_filename, &mapped_lm);
+    KALDI_ASSERT(quantized_lm.QuantizeBits() == bits &&
+                 mapped_lm.QuantizeBits() == bits);
+
+    // With 16 bits there are more codes than distinct values, so the only
+    // difference is from the unquantized format dropping the last bit of the
+    // leaf logprobs.
+    float tolerance = (bits == 16 ? 1.0e-05 : 0.1);
+    for (int32 i = 0; i < 2000; ++i) {
+      std::vector<int32> hist;
+      int32 hist_size = RandInt(0, 2);
+      for (int32 j = 0; j < hist_size; ++j)
+        hist.push_back(RandInt(1, kNumWords - 1));
+      int32 word = RandInt(1, kNumWords - 1);
+      float logprob = lm.GetNgramLogprob(word, hist),
+          quantized_logprob = quantized_lm.GetNgramLogprob(word, hist),
+          mapped_logprob = mapped_lm.GetNgramLogprob(word, hist);
+      KALDI_ASSERT(quantized_logprob == mapped_logprob);
+      KALDI_ASSERT(std::abs(logprob - quantized_logprob) < tolerance);
+      KALDI_ASSERT(lm.HistoryStateExists(hist) ==
+                   quantized_lm.HistoryStateExists(hist));
+    }
+
+    // Writing the quantized model and reading it back gives the same model.
+    std::ostringstream os1, os2;
+    quantized_lm.Write(os1, true);
+    std::istringstream is(os1.str());
+    ConstArpaLm quantized_lm2;
+    quantized_lm2.Read(is, true);
+    quantized_lm2.Write(os2, true);
+    KALDI_ASSERT(os1.str() == os2.str());
+  }
+  std::remove(arpa_filename.c_str());
+  std::remove(carpa_filename.c_str());
+  std::remove(quantized_filename.c_str());
+}
+
+// Follows random word sequences through <cached_fst> and a
+// ConstArpaLmDeterministicFst without a cache, and checks they agree.
+static void CheckCachedFst(const ConstArpaLm &lm,
+                           ConstArpaLmDeterministicFst *cached_fst) {
+  typedef fst::StdArc::StateId StateId;
+  ConstArpaLmDeterministicFst fst(lm);
+  for (int32 i = 0; i < 100; ++i) {
+    StateId s = fst.Start(), cached_s = cached_fst->Start();
+    for (int32 j = 0; j < 10; ++j) {
+      KALDI_ASSERT(fst.Final(s) == cached_fst->Final(cached_s));
+      int32 word = RandInt(1, kNumWords - 1);
+      fst::StdArc arc, cached_arc;
+      KALDI_ASSERT(fst.GetArc(s, word, &arc) &&
+                   cached_fst->GetArc(cached_s, word, &cached_arc));
+      KALDI_ASSERT(arc.weight == cached_arc.weight);
+      s = arc.nextstate;
+      cached_s = cached_arc.nextstate;
+    }
+  }
+}
+
+// Checks that ConstArpaLmDeterministicFst gives the same results with a
+// ConstArpaLmCache, which is small enough to be cleared often, and shared
+// between threads.
+void UnitTestConstArpaLmCache() {
+  std::string arpa_filename = "tmp.arpa", carpa_filename = "tmp.carpa";
+  WriteRandomArpa(arpa_filename);
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  BuildConstArpaLm(options, arpa_filename, carpa_filename);
+  ConstArpaLm lm;
+  ReadKaldiObject(carpa_filename, &lm);
+
+  ConstArpaLmCache cache(lm, 200, 4);
+  std::vector<std::thread> threads;
+  std::vector<ConstArpaLmDeterministicFst*> fsts;
+  for (int32 t = 0; t < 4; ++t) {
+    fsts.push_back(new ConstArpaLmDeterministicFst(&cache));
+    threads.push_back(std::thread(CheckCachedFst, std::cref(lm), fsts.back()));
+  }
+  for (int32 t = 0; t < 4; ++t) {
+    threads[t].join();
+    delete fsts[t];
+  }
+  cache.PrintStats();
+  std::remove(arpa_filename.c_str());
+  std::remove(carpa_filename.c_str());
+}
+
+// Checks that HashArpaLm gives the same results as ConstArpaLm, directly and
+// through the DeterministicOnDemandFst interface, and after being written and
+// read back.
+void UnitTestHashArpaLm() {
+  std::string arpa_filename = "tmp.arpa", carpa_filename = "tmp.carpa",
+      hash_filename = "tmp.hash";
+  WriteRandomArpa(arpa_filename);
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  BuildConstArpaLm(options, arpa_filename, carpa_filename);
+  ConstArpaLm lm;
+  ReadKaldiObject(carpa_filename, &lm);
+  {
+    HashArpaLm hash_lm;
+    BuildHashArpaLm(options, arpa_filename, &hash_lm);
+    WriteKaldiObject(hash_lm, hash_filename, true);
+  }
+  ConstArpaLm *const_lm;
+  HashArpaLm *hash_lm;
+  ReadConstOrHashArpaLm(hash_filename, &const_lm, &hash_lm);
+  KALDI_ASSERT(const_lm == NULL && hash_lm != NULL);
+  KALDI_ASSERT(hash_lm->NgramOrder() == 3 && hash_lm->BosSymbol() == kBos);
+
+  for (int32 i = 0; i < 2000; ++i) {
+    std::vector<int32> hist;
+    int32 hist_size = RandInt(0, 3);
+    for (int32 j = 0; j < hist_size; ++j)
+      hist.push_back(RandInt(1, kNumWords - 1));
+    int32 word = RandInt(1, kNumWords - 1);
+    // The only difference is from ConstArpaLm dropping the last bit of the
+    // leaf logprobs.
+    KALDI_ASSERT(std::abs(lm.GetNgramLogprob(word, hist) -
+                          hash_lm->GetNgramLogprob(word, hist)) < 1.0e-05);
+    KALDI_ASSERT(lm.HistoryStateExists(hist) ==
+                 hash_lm->HistoryStateExists(hist));
+  }
+  // Words that are not in the language model, with no <unk>.
+  std::vector<int32> hist(1, kBos);
+  KALDI_ASSERT(hash_lm->GetNgramLogprob(kNumWords + 10, hist) ==
+               std::numeric_limits<float>::min());
+
+  ConstArpaLmDeterministicFst fst(lm);
+  HashArpaLmDeterministicFst hash_fst(*hash_lm);
+  for (int32 i = 0; i < 100; ++i) {
+    fst::StdArc::StateId s = fst.Start(), hash_s = hash_fst.Start();
+    for (int32 j = 0; j < 10; ++j) {
+      KALDI_ASSERT(fst::ApproxEqual(fst.Final(s), hash_fst.Final(hash_s),
+                                    1.0e-05));
+      int32 word = RandInt(1, kNumWords - 1);
+      fst::StdArc arc, hash_arc;
+      KALDI_ASSERT(fst.GetArc(s, word, &arc) &&
+                   hash_fst.GetArc(hash_s, word, &hash_arc));
+      KALDI_ASSERT(fst::ApproxEqual(arc.weight, hash_arc.weight, 1.0e-05));
+      s = arc.nextstate;
+      hash_s = hash_arc.nextstate;
+    }
+  }
+  delete hash_lm;
+  std::remove(arpa_filename.c_str());
+  std::remove(carpa_filename.c_str());
+  std::remove(hash_filename.c_str());
+}
+
+// Checks that <weight> is the interpolation of <weight1> and <weight2>.
+static void CheckInterpolatedWeight(fst::StdArc::Weight weight,
+                                    fst::StdArc::Weight weight1,
+                                    fst::StdArc::Weight weight2,
+                                    const std::vector<BaseFloat> &weights,
+                                    bool log_linear) {
+  double expected;
+  if (weights[1] == 0.0)
+    expected = weight1.Value();
+  else if (log_linear)
+    expected = weights[0] * weight1.Value() + weights[1] * weight2.Value();
+  else
+    expected = -LogAdd(Log(weights[0]) - weight1.Value(),
+                       Log(weights[1]) - weight2.Value());
+  KALDI_ASSERT(ApproxEqual(weight.Value(), expected, 1.0e-04));
+}
+
+// Checks that InterpolatedConstArpaLmDeterministicFst gives the linear or
+// log-linear interpolation of the ConstArpaLmDeterministicFsts of two language
+// models, and reproduces the first one when the second has zero weight.
+void UnitTestInterpolatedConstArpaLm() {
+  std::string arpa_filename = "tmp.arpa", carpa_filename1 = "tmp1.carpa",
+      carpa_filename2 = "tmp2.carpa";
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  WriteRandomArpa(arpa_filename);
+  BuildConstArpaLm(options, arpa_filename, carpa_filename1);
+  WriteRandomArpa(arpa_filename);
+  BuildConstArpaLm(options, arpa_filename, carpa_filename2);
+  ConstArpaLm lm1, lm2;
+  ReadKaldiObject(carpa_filename1, &lm1);
+  ReadKaldiObject(carpa_filename2, &lm2);
+  std::vector<const ConstArpaLm*> lms;
+  lms.push_back(&lm1);
+  lms.push_back(&lm2);
+
+  for (int32 config = 0; config < 3; ++config) {
+    bool log_linear = (config == 1);
+    std::vector<BaseFloat> weights(2);
+    weights[0] = (config == 2 ? 1.0 : RandUniform());
+    weights[1] = (config == 2 ? 0.0 : 1.0 - weights[0]);
+    InterpolatedConstArpaLmDeterministicFst interp_fst(lms, weights,
+                                                       log_linear);
+    ConstArpaLmDeterministicFst fst1(lm1), fst2(lm2);
+    for (int32 i = 0; i < 100; ++i) {
+      fst::StdArc::StateId s = interp_fst.Start(), s1 = fst1.Start(),
+          s2 = fst2.Start();
+      for (int32 j = 0; j < 10; ++j) {
+        CheckInterpolatedWeight(interp_fst.Final(s), fst1.Final(s1),
+                                fst2.Final(s2), weights, log_linear);
+        int32 word = RandInt(1, kNumWords - 1);
+        fst::StdArc arc, arc1, arc2;
+        KALDI_ASSERT(interp_fst.GetArc(s, word, &arc) &&
+                     fst1.GetArc(s1, word, &arc1) &&
+                     fst2.GetArc(s2, word, &arc2));
+        CheckInterpolatedWeight(arc.weight, arc1.weight, arc2.weight,
+                                weights, log_linear);
+        s = arc.nextstate;
+        s1 = arc1.nextstate;
+        s2 = arc2.nextstate;
+      }
+    }
+  }
+  std::remove(arpa_filename.c_str());
+  std::remove(carpa_filename1.c_str());
+  std::remove(carpa_filename2.c_str());
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 3; ++i) {
+    UnitTestConstArpaLmQuantized();
+    UnitTestConstArpaLmCache();
+    UnitTestHashArpaLm();
+    UnitTestInterpolatedConstArpaLm();
+  }
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
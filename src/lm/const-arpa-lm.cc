@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -133,8 +134,10 @@ class LmState {
   }
 
   // Computes the size of the memory that the current LmState would take in
-  // <lm_states> array. It's the number of 4-byte chunks.
-  int32 MemSize() const {
+  // <lm_states> array. It's the number of 4-byte chunks. <header_size> is the
+  // number of 4-byte chunks before the children (3, or 2 in the quantized
+  // format).
+  int32 MemSize(const int32 header_size) const {
     if (IsLeaf() && !is_unigram_) {
       // We don't create an entry in this case; the logprob will be stored in
       // the same int32 that we would normally store the pointer in.
@@ -142,7 +145,7 @@ class LmState {
     } else {
       // We store the following information:
       // logprob, backoff_logprob, children.size() and children data.
-      return (3 + 2 * children_.size());
+      return (header_size + 2 * children_.size());
     }
   }
 
@@ -176,8 +179,13 @@ class LmState {
 // auxiliary class LmState above.
 class ConstArpaLmBuilder : public ArpaFileParser {
  public:
-  explicit ConstArpaLmBuilder(ArpaParseOptions options)
+  explicit ConstArpaLmBuilder(ArpaParseOptions options,
+                              int32 quantize_bits = 0)
       : ArpaFileParser(options, NULL) {
+    KALDI_ASSERT(quantize_bits == 0 || quantize_bits == 8 ||
+                 quantize_bits == 16);
+    quantize_bits_ = quantize_bits;
+    header_size_ = (quantize_bits == 0 ? 3 : 2);
     ngram_order_ = 0;
     num_words_ = 0;
     overflow_buffer_size_ = 0;
@@ -218,6 +226,14 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   virtual void ReadComplete();
 
  private:
+  // Computes <codebook_> for the quantized format from the logprobs and
+  // backoffs in <seq_to_state_>.
+  void ComputeCodebooks();
+
+  // Returns the code of <value> in the logprob (<type> == 0) or backoff
+  // (<type> == 1) codebook of n-gram order <order>.
+  int32 Quantize(const int32 order, const int32 type, const float value) const;
+
   struct WordsAndLmStatePairLessThan {
     bool operator()(
         const std::pair<std::vector<int32>*, LmState*>& lhs,
@@ -230,6 +246,15 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Indicating if ConstArpaLm has been built or not.
   bool is_built_;
 
+  // Number of bits of the quantized logprobs and backoffs, or 0.
+  int32 quantize_bits_;
+
+  // Number of int32's in an LmState before the children.
+  int32 header_size_;
+
+  // Codebooks for the quantized format; see ConstArpaLm::codebook_.
+  std::vector<float> codebook_;
+
   // Maximum relative address for the child. We put it here just for testing.
   // The default value is 30-bits and should not be changed except for testing.
   int32 max_address_offset_;
@@ -264,6 +289,75 @@ class ConstArpaLmBuilder : public ArpaFileParser {
                 LmState*, VectorHasher<int32> > seq_to_state_;
 };
 
+// Computes a codebook of <num_codes> values for quantizing <values>. If there
+// are no more distinct values than codes, the codebook contains them exactly;
+// otherwise we split the sorted values into <num_codes> bins with equal numbers
+// of values, and use the mean of each bin. The codebook is sorted, and padded
+// to <num_codes> entries by repeating the last one.
+static void ComputeCodebook(std::vector<float> *values, const int32 num_codes,
+                            std::vector<float> *codebook) {
+  std::sort(values->begin(), values->end());
+  codebook->assign(values->begin(), values->end());
+  codebook->erase(std::unique(codebook->begin(), codebook->end()),
+                  codebook->end());
+  if (codebook->size() > num_codes) {
+    codebook->clear();
+    size_t num_values = values->size();
+    for (int32 c = 0; c < num_codes; ++c) {
+      size_t begin = num_values * c / num_codes,
+          end = num_values * (c + 1) / num_codes;
+      double sum = 0.0;
+      for (size_t i = begin; i < end; ++i) sum += (*values)[i];
+      codebook->push_back(sum / (end - begin));
+    }
+  }
+  if (codebook->empty()) codebook->push_back(0.0);
+  codebook->resize(num_codes, codebook->back());
+}
+
+void ConstArpaLmBuilder::ComputeCodebooks() {
+  int32 num_codes = 1 << quantize_bits_;
+  std::vector<std::vector<float> > logprobs(ngram_order_),
+      backoff_logprobs(ngram_order_);
+  unordered_map<std::vector<int32>,
+                LmState*, VectorHasher<int32> >::iterator iter;
+  for (iter = seq_to_state_.begin(); iter != seq_to_state_.end(); ++iter) {
+    int32 order = iter->first.size();
+    LmState *lm_state = iter->second;
+    logprobs[order - 1].push_back(lm_state->Logprob());
+    if (lm_state->BackoffLogprob() != 0.0)
+      backoff_logprobs[order - 1].push_back(lm_state->BackoffLogprob());
+    if (lm_state->IsChildFinalOrder()) {
+      for (int32 j = 0; j < lm_state->NumChildren(); ++j)
+        logprobs[order].push_back(lm_state->GetChild(j).second.prob);
+    }
+  }
+  codebook_.clear();
+  for (int32 order = 1; order <= ngram_order_; ++order) {
+    std::vector<float> codebook;
+    ComputeCodebook(&(logprobs[order - 1]), num_codes, &codebook);
+    codebook_.insert(codebook_.end(), codebook.begin(), codebook.end());
+    // A backoff of zero is very common (and means there is no backoff), so we
+    // make sure it is represented exactly.
+    ComputeCodebook(&(backoff_logprobs[order - 1]), num_codes - 1, &codebook);
+    codebook.push_back(0.0);
+    std::sort(codebook.begin(), codebook.end());
+    codebook_.insert(codebook_.end(), codebook.begin(), codebook.end());
+  }
+}
+
+int32 ConstArpaLmBuilder::Quantize(const int32 order, const int32 type,
+                                   const float value) const {
+  int32 num_codes = 1 << quantize_bits_;
+  const float *begin = &(codebook_[((order - 1) * 2 + type) * num_codes]),
+      *end = begin + num_codes;
+  // Finds the nearest entry; the codebook is sorted.
+  const float *p = std::lower_bound(begin, end, value);
+  if (p == end) return num_codes - 1;
+  if (p != begin && value - *(p - 1) < *p - value) --p;
+  return p - begin;
+}
+
 void ConstArpaLmBuilder::HeaderAvailable() {
   ngram_order_ = NgramCounts().size();
 }
@@ -360,7 +454,7 @@ void ConstArpaLmBuilder::ReadComplete() {
   unordered_map<std::vector<int32>,
                 LmState*, VectorHasher<int32> >::iterator iter;
   for (iter = seq_to_state_.begin(); iter != seq_to_state_.end(); ++iter) {
-    if (iter->second->MemSize() > 0) {
+    if (iter->second->MemSize(header_size_) > 0) {
       sorted_vec.push_back(
           std::make_pair(const_cast<std::vector<int32>*>(&(iter->first)),
                          iter->second));
@@ -372,15 +466,18 @@ void ConstArpaLmBuilder::ReadComplete() {
 
   // STEP 2: updating <my_address> in LmState.
   for (int32 i = 0; i < sorted_vec.size(); ++i) {
-    lm_states_size_ += sorted_vec[i].second->MemSize();
+    lm_states_size_ += sorted_vec[i].second->MemSize(header_size_);
     if (i == 0) {
       sorted_vec[i].second->SetMyAddress(0);
     } else {
       sorted_vec[i].second->SetMyAddress(sorted_vec[i - 1].second->MyAddress()
-          + sorted_vec[i - 1].second->MemSize());
+          + sorted_vec[i - 1].second->MemSize(header_size_));
     }
   }
 
+  if (quantize_bits_ != 0)
+    ComputeCodebooks();
+
   // STEP 3: creating memory block to store LmStates.
   // Reserves a memory block for LmStates.
   int64 lm_states_index = 0;
@@ -399,14 +496,24 @@ void ConstArpaLmBuilder::ReadComplete() {
   for (int32 i = 0; i < sorted_vec.size(); ++i) {
     // Current address.
     int32* parent_address = lm_states_ + lm_states_index;
+    int32 order = sorted_vec[i].first->size();
 
-    // Adds logprob.
-    Int32AndFloat logprob_f(sorted_vec[i].second->Logprob());
-    lm_states_[lm_states_index++] = logprob_f.i;
+    if (quantize_bits_ == 0) {
+      // Adds logprob.
+      Int32AndFloat logprob_f(sorted_vec[i].second->Logprob());
+      lm_states_[lm_states_index++] = logprob_f.i;
 
-    // Adds backoff_logprob.
-    Int32AndFloat backoff_logprob_f(sorted_vec[i].second->BackoffLogprob());
-    lm_states_[lm_states_index++] = backoff_logprob_f.i;
+      // Adds backoff_logprob.
+      Int32AndFloat backoff_logprob_f(sorted_vec[i].second->BackoffLogprob());
+      lm_states_[lm_states_index++] = backoff_logprob_f.i;
+    } else {
+      // Adds the codes of logprob and backoff_logprob.
+      uint32 logprob_code = Quantize(order, 0, sorted_vec[i].second->Logprob()),
+          backoff_code = Quantize(order, 1,
+                                  sorted_vec[i].second->BackoffLogprob());
+      lm_states_[lm_states_index++] =
+          static_cast<int32>(logprob_code | (backoff_code << 16));
+    }
 
     // Adds num_children.
     lm_states_[lm_states_index++] = sorted_vec[i].second->NumChildren();
@@ -420,7 +527,8 @@ void ConstArpaLmBuilder::ReadComplete() {
     for (int32 j = 0; j < sorted_vec[i].second->NumChildren(); ++j) {
       int32 child_info;
       if (sorted_vec[i].second->IsChildFinalOrder() ||
-          sorted_vec[i].second->GetChild(j).second.state->MemSize() == 0) {
+          sorted_vec[i].second->GetChild(j).second.state->MemSize(
+              header_size_) == 0) {
         // Child is a leaf and not unigram. In this case we will not create an
         // entry in <lm_states_>; instead, we put the logprob in the place where
         // we normally store the poitner.
@@ -431,8 +539,12 @@ void ConstArpaLmBuilder::ReadComplete() {
           child_logprob_f.f =
               sorted_vec[i].second->GetChild(j).second.state->Logprob();
         }
-        child_info = child_logprob_f.i;
-        child_info &= ~1;   // Sets the last bit to 0 so <child_info> is even.
+        if (quantize_bits_ == 0) {
+          child_info = child_logprob_f.i;
+          child_info &= ~1;   // Sets the last bit to 0 so <child_info> is even.
+        } else {
+          child_info = 2 * Quantize(order + 1, 0, child_logprob_f.f);
+        }
       } else {
         // Child is not a leaf or is unigram.
         int64 offset =
@@ -490,10 +602,22 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   ConstArpaLm const_arpa_lm(
       Options().bos_symbol, Options().eos_symbol, Options().unk_symbol,
       ngram_order_, num_words_, overflow_buffer_size_, lm_states_size_,
-      unigram_states_, overflow_buffer_, lm_states_);
+      unigram_states_, overflow_buffer_, lm_states_, quantize_bits_,
+      codebook_);
   const_arpa_lm.Write(os, binary);
 }
 
+ConstArpaLm::~ConstArpaLm() {
+  if (memory_assigned_) {
+    if (lm_states_region_ != NULL)
+      delete lm_states_region_;
+    else
+      delete[] lm_states_;
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+  }
+}
+
 void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
@@ -510,9 +634,32 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, ngram_order_);
   WriteToken(os, binary, "</LmInfo>");
 
+  // Quantization section, only in the quantized format.
+  if (quantize_bits_ != 0) {
+    WriteToken(os, binary, "<LmQuantization>");
+    WriteBasicType(os, binary, quantize_bits_);
+    os.write(reinterpret_cast<const char *>(&(codebook_[0])),
+             sizeof(float) * codebook_.size());
+    WriteToken(os, binary, "</LmQuantization>");
+  }
+
   // LmStates section.
   WriteToken(os, binary, "<LmStates>");
   WriteBasicType(os, binary, lm_states_size_);
+  if (quantize_bits_ != 0) {
+    // If we know the stream position, we pad so that <lm_states_> starts at a
+    // multiple of 64 bytes in the file, which allows ReadInternal() to
+    // memory-map it. The amount of padding is written first.
+    int32 padding = 0;
+    std::streamoff pos = os.tellp();
+    if (pos >= 0) {
+      pos += 1 + sizeof(int32);  // the size of the next WriteBasicType().
+      padding = (64 - pos % 64) % 64;
+    }
+    WriteBasicType(os, binary, padding);
+    for (int32 i = 0; i < padding; ++i)
+      os.put(0);
+  }
   os.write(reinterpret_cast<char *>(lm_states_),
            sizeof(int32) * lm_states_size_);
   if (!os.good()) {
@@ -570,7 +717,8 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   WriteToken(os, binary, "</ConstArpaLm>");
 }
 
-void ConstArpaLm::Read(std::istream &is, bool binary) {
+void ConstArpaLm::Read(std::istream &is, bool binary,
+                       const std::string &source) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
@@ -580,11 +728,12 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   if (first_char == 4) {  // Old on-disk format starts with length of int32.
     ReadInternalOldFormat(is, binary);
   } else {                // New on-disk format starts with token <ConstArpaLm>.
-    ReadInternal(is, binary);
+    ReadInternal(is, binary, source);
   }
 }
 
-void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
+void ConstArpaLm::ReadInternal(std::istream &is, bool binary,
+                               const std::string &source) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
@@ -600,12 +749,58 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   ReadBasicType(is, binary, &ngram_order_);
   ExpectToken(is, binary, "</LmInfo>");
 
+  // Quantization section, only in the quantized format.
+  std::string token;
+  ReadToken(is, binary, &token);
+  if (token == "<LmQuantization>") {
+    ReadBasicType(is, binary, &quantize_bits_);
+    if (quantize_bits_ != 8 && quantize_bits_ != 16) {
+      KALDI_ERR << "ConstArpaLm: unsupported number of quantization bits "
+                << quantize_bits_;
+    }
+    header_size_ = 2;
+    codebook_.resize(2 * ngram_order_ * NumCodes());
+    is.read(reinterpret_cast<char *>(&(codebook_[0])),
+            sizeof(float) * codebook_.size());
+    if (!is.good()) {
+      KALDI_ERR << "ConstArpaLm <LmQuantization> section reading failed.";
+    }
+    ExpectToken(is, binary, "</LmQuantization>");
+    ReadToken(is, binary, &token);
+  }
+
   // LmStates section.
-  ExpectToken(is, binary, "<LmStates>");
+  if (token != "<LmStates>") {
+    KALDI_ERR << "Expected token <LmStates>, got " << token;
+  }
   ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
-  is.read(reinterpret_cast<char *>(lm_states_),
-          sizeof(int32) * lm_states_size_);
+  size_t lm_states_bytes = sizeof(int32) * lm_states_size_;
+  if (quantize_bits_ != 0) {
+    int32 padding;
+    ReadBasicType(is, binary, &padding);
+    is.ignore(padding);
+  }
+  if (quantize_bits_ != 0 && !source.empty()) {
+    // MappedFile::Map() memory-maps the region if it can, and otherwise reads
+    // it into memory.
+    lm_states_region_ = fst::MappedFile::Map(&is, true, source,
+                                             lm_states_bytes);
+    if (lm_states_region_ == NULL) {
+      KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
+    }
+    if (reinterpret_cast<size_t>(lm_states_region_->data()) % sizeof(int32)
+        == 0) {
+      lm_states_ = static_cast<int32 *>(lm_states_region_->mutable_data());
+    } else {
+      lm_states_ = new int32[lm_states_size_];
+      memcpy(lm_states_, lm_states_region_->data(), lm_states_bytes);
+      delete lm_states_region_;
+      lm_states_region_ = NULL;
+    }
+  } else {
+    lm_states_ = new int32[lm_states_size_];
+    is.read(reinterpret_cast<char *>(lm_states_), lm_states_bytes);
+  }
   if (!is.good()) {
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
   }
@@ -734,9 +929,9 @@ bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
     // Note that we always create LmState for unigrams, so even if <lm_state> is
     // not NULL, we still have to check if it has child.
     KALDI_ASSERT(lm_state >= lm_states_);
-    KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
-    // <lm_state + 2> points to <num_children>.
-    if (*(lm_state + 2) > 0) {
+    KALDI_ASSERT(lm_state + header_size_ - 1 <= lm_states_end_);
+    // <lm_state + header_size_ - 1> points to <num_children>.
+    if (*(lm_state + header_size_ - 1) > 0) {
       return true;
     } else {
       return false;
@@ -793,8 +988,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       // defined.
       return std::numeric_limits<float>::min();
     } else {
-      Int32AndFloat logprob_i(*unigram_states_[word]);
-      return logprob_i.f;
+      return StateLogprob(unigram_states_[word], 1);
     }
   }
 
@@ -806,11 +1000,11 @@ float ConstArpaLm::GetNgramLogprobRecurse(
     int32 child_info;
     int32* child_lm_state = NULL;
     if (GetChildInfo(word, state, &child_info)) {
-      DecodeChildInfo(child_info, state, &child_lm_state, &logprob);
+      DecodeChildInfo(child_info, state, hist.size() + 1, &child_lm_state,
+                      &logprob);
       return logprob;
     } else {
-      Int32AndFloat backoff_logprob_i(*(state + 1));
-      backoff_logprob = backoff_logprob_i.f;
+      backoff_logprob = StateBackoffLogprob(state, hist.size());
     }
   }
   std::vector<int32> new_hist(hist);
@@ -836,7 +1030,7 @@ int32* ConstArpaLm::GetLmState(const std::vector<int32>& seq) const {
     if (!GetChildInfo(seq[i], parent, &child_info)) {
       return NULL;
     }
-    DecodeChildInfo(child_info, parent, &child_lm_state, &logprob);
+    DecodeChildInfo(child_info, parent, i + 1, &child_lm_state, &logprob);
     if (child_lm_state == NULL) {
       return NULL;
     } else {
@@ -854,20 +1048,22 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
   KALDI_ASSERT(parent >= lm_states_);
   KALDI_ASSERT(child_info != NULL);
 
-  KALDI_ASSERT(parent + 2 <= lm_states_end_);
-  int32 num_children = *(parent + 2);
-  KALDI_ASSERT(parent + 2 + 2 * num_children <= lm_states_end_);
+  KALDI_ASSERT(parent + header_size_ - 1 <= lm_states_end_);
+  int32 num_children = *(parent + header_size_ - 1);
+  KALDI_ASSERT(parent + header_size_ - 1 + 2 * num_children <= lm_states_end_);
 
   if (num_children == 0) return false;
 
-  // A binary search into the children memory block.
+  // A binary search into the children memory block. <children> is offset so
+  // that the child with index 1 starts at children[2].
+  const int32* children = parent + header_size_ - 2;
   int32 start_index = 1;
   int32 end_index = num_children;
   while (start_index <= end_index) {
     int32 mid_index = round((start_index + end_index) / 2);
-    int32 mid_word = *(parent + 1 + 2 * mid_index);
+    int32 mid_word = children[2 * mid_index];
     if (mid_word == word) {
-      *child_info = *(parent + 2 + 2 * mid_index);
+      *child_info = children[2 * mid_index + 1];
       return true;
     } else if (mid_word < word) {
       start_index = mid_index + 1;
@@ -881,6 +1077,7 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
 
 void ConstArpaLm::DecodeChildInfo(const int32 child_info,
                                   int32* parent,
+                                  const int32 order,
                                   int32** child_lm_state,
                                   float* logprob) const {
   KALDI_ASSERT(initialized_);
@@ -889,20 +1086,21 @@ void ConstArpaLm::DecodeChildInfo(const int32 child_info,
   if (child_info % 2 == 0) {
     // Child is a leaf, only returns the log probability.
     *child_lm_state = NULL;
-    Int32AndFloat logprob_i(child_info);
-    *logprob = logprob_i.f;
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(child_info);
+      *logprob = logprob_i.f;
+    } else {
+      *logprob = Dequantize(order, 0, child_info / 2);
+    }
   } else {
     int32 child_offset = child_info / 2;
     if (child_offset > 0) {
       *child_lm_state = parent + child_offset;
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     } else {
       KALDI_ASSERT(-child_offset < overflow_buffer_size_);
       *child_lm_state = overflow_buffer_[-child_offset];
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     }
+    *logprob = StateLogprob(*child_lm_state, order);
     KALDI_ASSERT(*child_lm_state >= lm_states_);
     KALDI_ASSERT(*child_lm_state <= lm_states_end_);
   }
@@ -914,27 +1112,28 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
   if (lm_state == NULL) return;
 
   KALDI_ASSERT(lm_state >= lm_states_);
-  KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
+  KALDI_ASSERT(lm_state + header_size_ - 1 <= lm_states_end_);
 
   // Inserts the current LmState to <output>.
+  int32 order = seq.size();
   ArpaLine arpa_line;
   arpa_line.words = seq;
-  Int32AndFloat logprob_i(*lm_state);
-  arpa_line.logprob = logprob_i.f;
-  Int32AndFloat backoff_logprob_i(*(lm_state + 1));
-  arpa_line.backoff_logprob = backoff_logprob_i.f;
+  arpa_line.logprob = StateLogprob(lm_state, order);
+  arpa_line.backoff_logprob = StateBackoffLogprob(lm_state, order);
   output->push_back(arpa_line);
 
   // Scans for possible children, and recursively adds child to <output>.
-  int32 num_children = *(lm_state + 2);
-  KALDI_ASSERT(lm_state + 2 + 2 * num_children <= lm_states_end_);
+  int32 num_children = *(lm_state + header_size_ - 1);
+  KALDI_ASSERT(lm_state + header_size_ - 1 + 2 * num_children
+               <= lm_states_end_);
   for (int32 i = 0; i < num_children; ++i) {
     std::vector<int32> new_seq(seq);
-    new_seq.push_back(*(lm_state + 3 + 2 * i));
-    int32 child_info = *(lm_state + 4 + 2 * i);
+    new_seq.push_back(*(lm_state + header_size_ + 2 * i));
+    int32 child_info = *(lm_state + header_size_ + 1 + 2 * i);
     float logprob;
     int32* child_lm_state = NULL;
-    DecodeChildInfo(child_info, lm_state, &child_lm_state, &logprob);
+    DecodeChildInfo(child_info, lm_state, order + 1, &child_lm_state,
+                    &logprob);
 
     if (child_lm_state == NULL) {
       // Leaf case.
@@ -1010,8 +1209,122 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
   os << std::endl << "\\end\\" << std::endl;
 }
 
+// Computes the logprob of <word> following the history state <wseq>, and
+// changes <wseq> to the next history state. Returns false if there is no such
+// arc, in which case <wseq> is not changed.
+static bool GetConstArpaLmArc(const ConstArpaLm& lm, int32 word,
+                              std::vector<int32>* wseq, float* logprob) {
+  *logprob = lm.GetNgramLogprob(word, *wseq);
+  if (*logprob == std::numeric_limits<float>::min()) {
+    return false;
+  }
+
+  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
+  // taken care of in ConstArpaLm.
+  wseq->push_back(word);
+  while (wseq->size() >= lm.NgramOrder()) {
+    // History state has at most lm.NgramOrder() -1 words in the state.
+    wseq->erase(wseq->begin(), wseq->begin() + 1);
+  }
+  while (!lm.HistoryStateExists(*wseq)) {
+    KALDI_ASSERT(wseq->size() > 0);
+    wseq->erase(wseq->begin(), wseq->begin() + 1);
+  }
+  return true;
+}
+
+ConstArpaLmCache::ConstArpaLmCache(const ConstArpaLm& lm, int64 max_arcs,
+                                   int32 num_shards):
+    lm_(lm), num_shards_(num_shards),
+    max_arcs_per_shard_(std::max<int64>(max_arcs / num_shards, 1)),
+    history_shards_(num_shards), arc_shards_(num_shards) {
+  KALDI_ASSERT(num_shards > 0);
+  for (int32 i = 0; i < num_shards_; ++i) {
+    arc_shards_[i].num_hits = 0;
+    arc_shards_[i].num_misses = 0;
+    arc_shards_[i].num_clears = 0;
+  }
+}
+
+int32 ConstArpaLmCache::HistoryId(const std::vector<int32>& wseq) {
+  VectorHasher<int32> hasher;
+  int32 shard_index = hasher(wseq) % num_shards_;
+  HistoryShard& shard = history_shards_[shard_index];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  std::pair<unordered_map<std::vector<int32>, int32,
+                          VectorHasher<int32> >::iterator, bool> result =
+      shard.wseq_to_id.insert(std::make_pair(
+          wseq, static_cast<int32>(shard_index +
+                                   num_shards_ * shard.id_to_wseq.size())));
+  if (result.second)
+    shard.id_to_wseq.push_back(wseq);
+  return result.first->second;
+}
+
+void ConstArpaLmCache::GetHistory(int32 history_id,
+                                  std::vector<int32>* wseq) {
+  HistoryShard& shard = history_shards_[history_id % num_shards_];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  size_t index = history_id / num_shards_;
+  KALDI_ASSERT(index < shard.id_to_wseq.size());
+  *wseq = shard.id_to_wseq[index];
+}
+
+bool ConstArpaLmCache::GetArc(int32 history_id, int32 word, float* logprob,
+                              int32* next_history_id) {
+  std::pair<int32, int32> key(history_id, word);
+  PairHasher<int32> hasher;
+  ArcShard& shard = arc_shards_[hasher(key) % num_shards_];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    unordered_map<std::pair<int32, int32>, std::pair<float, int32>,
+                  PairHasher<int32> >::const_iterator iter =
+        shard.arcs.find(key);
+    if (iter != shard.arcs.end()) {
+      shard.num_hits++;
+      *logprob = iter->second.first;
+      *next_history_id = iter->second.second;
+      return (*next_history_id != -1);
+    }
+    shard.num_misses++;
+  }
+  // We do the lookup without holding the lock; if another thread looks up the
+  // same arc at the same time, they will compute the same thing.
+  std::vector<int32> wseq;
+  GetHistory(history_id, &wseq);
+  if (GetConstArpaLmArc(lm_, word, &wseq, logprob))
+    *next_history_id = HistoryId(wseq);
+  else
+    *next_history_id = -1;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.arcs.size() >= max_arcs_per_shard_) {
+      shard.arcs.clear();
+      shard.num_clears++;
+    }
+    shard.arcs[key] = std::make_pair(*logprob, *next_history_id);
+  }
+  return (*next_history_id != -1);
+}
+
+void ConstArpaLmCache::PrintStats() const {
+  int64 num_hits = 0, num_misses = 0, num_clears = 0, num_histories = 0;
+  for (int32 i = 0; i < num_shards_; ++i) {
+    // The stats are only approximate if other threads are using the cache.
+    num_hits += arc_shards_[i].num_hits;
+    num_misses += arc_shards_[i].num_misses;
+    num_clears += arc_shards_[i].num_clears;
+    num_histories += history_shards_[i].id_to_wseq.size();
+  }
+  KALDI_LOG << "ConstArpaLm cache: " << num_hits << " hits and " << num_misses
+            << " misses (hit rate "
+            << (num_hits * 100.0 / std::max<int64>(num_hits + num_misses, 1))
+            << "%), " << num_histories << " history states, shards cleared "
+            << num_clears << " times.";
+}
+
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    const ConstArpaLm& lm) : lm_(lm), cache_(NULL) {
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
   state_to_wseq_.push_back(bos_state);
@@ -1019,7 +1332,20 @@ ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
   start_state_ = 0;
 }
 
+ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
+    ConstArpaLmCache* cache) : lm_(cache->Lm()), cache_(cache) {
+  std::vector<Label> bos_state(1, lm_.BosSymbol());
+  start_state_ = cache_->HistoryId(bos_state);
+}
+
 fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
+  if (cache_ != NULL) {
+    // The final-prob is the logprob of </s>, as for an arc.
+    float logprob;
+    StateId next_state;
+    cache_->GetArc(s, lm_.EosSymbol(), &logprob, &next_state);
+    return Weight(-logprob);
+  }
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
   const std::vector<Label>& wseq = state_to_wseq_[s];
@@ -1029,27 +1355,27 @@ fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
 
 bool ConstArpaLmDeterministicFst::GetArc(StateId s,
                                          Label ilabel, fst::StdArc *oarc) {
+  if (cache_ != NULL) {
+    float logprob;
+    StateId next_state;
+    if (!cache_->GetArc(s, ilabel, &logprob, &next_state))
+      return false;
+    oarc->ilabel = ilabel;
+    oarc->olabel = ilabel;
+    oarc->nextstate = next_state;
+    oarc->weight = Weight(-logprob);
+    return true;
+  }
+
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
   std::vector<Label> wseq = state_to_wseq_[s];
 
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
-  if (logprob == std::numeric_limits<float>::min()) {
+  float logprob;
+  if (!GetConstArpaLmArc(lm_, ilabel, &wseq, &logprob)) {
     return false;
   }
 
-  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
-  // taken care of in ConstArpaLm.
-  wseq.push_back(ilabel);
-  while (wseq.size() >= lm_.NgramOrder()) {
-    // History state has at most lm_.NgramOrder() -1 words in the state.
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-  while (!lm_.HistoryStateExists(wseq)) {
-    KALDI_ASSERT(wseq.size() > 0);
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-
   std::pair<const std::vector<Label>, StateId> wseq_state_pair(
       wseq, static_cast<Label>(state_to_wseq_.size()));
 
@@ -1071,10 +1397,127 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
   return true;
 }
 
+InterpolatedConstArpaLmDeterministicFst::
+InterpolatedConstArpaLmDeterministicFst(
+    const std::vector<const ConstArpaLm*>& lms,
+    const std::vector<BaseFloat>& weights,
+    bool log_linear): lms_(lms), weights_(weights), log_linear_(log_linear),
+                      max_order_(0) {
+  KALDI_ASSERT(!lms_.empty() && lms_.size() == weights_.size());
+  for (size_t i = 0; i < lms_.size(); ++i) {
+    if (lms_[i]->BosSymbol() != lms_[0]->BosSymbol() ||
+        lms_[i]->EosSymbol() != lms_[0]->EosSymbol()) {
+      KALDI_ERR << "The language models to interpolate have different <s> "
+                << "or </s> symbols.";
+    }
+    if (!log_linear_ && weights_[i] < 0.0) {
+      KALDI_ERR << "Negative weight " << weights_[i] << " for linear "
+                << "interpolation.";
+    }
+    max_order_ = std::max(max_order_, lms_[i]->NgramOrder());
+  }
+  // Creates the start state, <s>; as in ConstArpaLmDeterministicFst, all the
+  // language models use it as their history.
+  std::vector<Label> bos_state(1, lms_[0]->BosSymbol());
+  state_to_wseq_.push_back(bos_state);
+  wseq_to_state_[bos_state] = 0;
+  state_hist_lengths_.resize(lms_.size(), 1);
+}
+
+InterpolatedConstArpaLmDeterministicFst::StateId
+InterpolatedConstArpaLmDeterministicFst::FindOrAddState(
+    const std::vector<Label>& wseq) {
+  std::pair<MapType::iterator, bool> result = wseq_to_state_.insert(
+      std::make_pair(wseq, static_cast<StateId>(state_to_wseq_.size())));
+  if (result.second) {
+    state_to_wseq_.push_back(wseq);
+    for (size_t i = 0; i < lms_.size(); ++i) {
+      // The longest suffix of <wseq> that is a history state of lms_[i].
+      int32 length = std::min<int32>(wseq.size(),
+                                     lms_[i]->NgramOrder() - 1);
+      while (length > 0) {
+        std::vector<Label> hist(wseq.end() - length, wseq.end());
+        if (lms_[i]->HistoryStateExists(hist))
+          break;
+        length--;
+      }
+      state_hist_lengths_.push_back(length);
+    }
+  }
+  return result.first->second;
+}
+
+bool InterpolatedConstArpaLmDeterministicFst::GetLogprob(StateId s,
+                                                         Label word,
+                                                         float* logprob) {
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  const std::vector<Label>& wseq = state_to_wseq_[s];
+  double tot_logprob = (log_linear_ ? 0.0 : kLogZeroDouble);
+  for (size_t i = 0; i < lms_.size(); ++i) {
+    if (weights_[i] == 0.0)
+      continue;
+    int32 length = state_hist_lengths_[s * lms_.size() + i];
+    std::vector<Label> hist(wseq.end() - length, wseq.end());
+    float this_logprob = lms_[i]->GetNgramLogprob(word, hist);
+    if (this_logprob == std::numeric_limits<float>::min()) {
+      // <word> is not in this language model.
+      if (log_linear_)
+        return false;
+      continue;
+    }
+    if (log_linear_)
+      tot_logprob += weights_[i] * this_logprob;
+    else
+      tot_logprob = LogAdd(tot_logprob, Log(weights_[i]) + this_logprob);
+  }
+  if (tot_logprob == kLogZeroDouble)
+    return false;
+  *logprob = tot_logprob;
+  return true;
+}
+
+fst::StdArc::Weight InterpolatedConstArpaLmDeterministicFst::Final(
+    StateId s) {
+  float logprob;
+  if (!GetLogprob(s, lms_[0]->EosSymbol(), &logprob))
+    return Weight::Zero();
+  return Weight(-logprob);
+}
+
+bool InterpolatedConstArpaLmDeterministicFst::GetArc(StateId s,
+                                                     Label ilabel,
+                                                     fst::StdArc *oarc) {
+  float logprob;
+  if (!GetLogprob(s, ilabel, &logprob))
+    return false;
+
+  // The next state is the longest suffix of the word sequence that is a
+  // history state of at least one of the language models.
+  std::vector<Label> wseq(state_to_wseq_[s]);
+  wseq.push_back(ilabel);
+  while (static_cast<int32>(wseq.size()) >= max_order_)
+    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  while (!wseq.empty()) {
+    size_t i = 0;
+    while (i < lms_.size() && !lms_[i]->HistoryStateExists(wseq))
+      ++i;
+    if (i < lms_.size())
+      break;
+    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  }
+
+  oarc->ilabel = ilabel;
+  oarc->olabel = ilabel;
+  oarc->nextstate = FindOrAddState(wseq);
+  oarc->weight = Weight(-logprob);
+  return true;
+}
+
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename) {
-  ConstArpaLmBuilder lm_builder(options);
+                      const std::string& const_arpa_wxfilename,
+                      int32 quantize_bits) {
+  ConstArpaLmBuilder lm_builder(options, quantize_bits);
   KALDI_LOG << "Reading " << arpa_rxfilename;
   Input ki(arpa_rxfilename);
   lm_builder.Read(ki.Stream());
@@ -1082,4 +1525,27 @@ bool BuildConstArpaLm(const ArpaParseOptions& options,
   return true;
 }
 
+void BuildConstArpaLm(const ArpaParseOptions& options,
+                      const std::string& arpa_rxfilename,
+                      ConstArpaLm* lm) {
+  ConstArpaLmBuilder lm_builder(options);
+  KALDI_LOG << "Reading " << arpa_rxfilename;
+  Input ki(arpa_rxfilename);
+  lm_builder.Read(ki.Stream());
+  // The ConstArpaLm that the builder creates does not own its memory, so we
+  // go through the binary format.
+  std::stringstream ss;
+  lm_builder.Write(ss, true);
+  lm->Read(ss, true);
+}
+
+void ReadConstArpaLm(const std::string& rxfilename, ConstArpaLm* lm) {
+  bool binary;
+  Input ki(rxfilename, &binary);
+  std::string source;
+  if (ClassifyRxfilename(rxfilename) == kFileInput)
+    source = rxfilename;
+  lm->Read(ki.Stream(), binary, source);
+}
+
 }  // namespace kaldi
@@ -20,9 +20,12 @@
 #ifndef KALDI_LM_CONST_ARPA_LM_H_
 #define KALDI_LM_CONST_ARPA_LM_H_
 
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include <fst/mapped-file.h>
+
 #include "base/kaldi-common.h"
 #include "fstext/deterministic-fst.h"
 #include "lm/arpa-file-parser.h"
@@ -194,6 +197,26 @@ namespace kaldi {
        of LmState whose address differs too much from the parent address. See
        above how we handle the leaf case.
     5. With the information in step 4, create the class ConstArpaLm.
+
+    Quantized format: if ConstArpaLm is built with quantize_bits set to 8 or
+    16 (see arpa-to-const-arpa --quantize-bits), the logprobs and backoff
+    logprobs are replaced by indexes into codebooks of 2^quantize_bits values,
+    with one codebook for logprobs and one for backoffs for each n-gram order.
+    An LmState then has the following structure:
+
+    struct LmState {
+      int32 codes;  // logprob code in bits 0-15, backoff code in bits 16-31.
+      int32 num_children;
+      std::pair<int32, int32> [] children;
+    }
+
+    and for leaves, child_info is twice the logprob code.  The codebooks are
+    computed by splitting the sorted values of each order into bins with equal
+    numbers of values and taking the mean of each bin; a backoff of zero is
+    always represented exactly.  The <lm_states_> array is aligned in the file,
+    so that ReadConstArpaLm() can memory-map it instead of reading it, which
+    saves loading time and lets several processes on a machine share the
+    memory.
 */
 
 // Forward declaration of Auxiliary struct ArpaLine.
@@ -217,6 +240,9 @@ class ConstArpaLm {
     lm_states_ = NULL;
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
+    lm_states_region_ = NULL;
+    quantize_bits_ = 0;
+    header_size_ = 3;
     memory_assigned_ = false;
     initialized_ = false;
   }
@@ -227,12 +253,20 @@ class ConstArpaLm {
               const int32 unk_symbol, const int32 ngram_order,
               const int32 num_words, const int32 overflow_buffer_size,
               const int64 lm_states_size, int32** unigram_states,
-              int32** overflow_buffer, int32* lm_states) :
+              int32** overflow_buffer, int32* lm_states,
+              const int32 quantize_bits = 0,
+              const std::vector<float> &codebook = std::vector<float>()) :
       bos_symbol_(bos_symbol), eos_symbol_(eos_symbol),
       unk_symbol_(unk_symbol), ngram_order_(ngram_order),
       num_words_(num_words), overflow_buffer_size_(overflow_buffer_size),
       lm_states_size_(lm_states_size), unigram_states_(unigram_states),
-      overflow_buffer_(overflow_buffer), lm_states_(lm_states) {
+      overflow_buffer_(overflow_buffer), lm_states_(lm_states),
+      lm_states_region_(NULL), quantize_bits_(quantize_bits),
+      header_size_(quantize_bits == 0 ? 3 : 2), codebook_(codebook) {
+    KALDI_ASSERT(quantize_bits_ == 0 || quantize_bits_ == 8 ||
+                 quantize_bits_ == 16);
+    KALDI_ASSERT(codebook_.size() ==
+                 (quantize_bits_ == 0 ? 0 : 2 * ngram_order_ * NumCodes()));
     KALDI_ASSERT(unigram_states_ != NULL);
     KALDI_ASSERT(overflow_buffer_ != NULL);
     KALDI_ASSERT(lm_states_ != NULL);
@@ -246,17 +280,17 @@ class ConstArpaLm {
     initialized_ = true;
   }
 
-  ~ConstArpaLm() {
-    if (memory_assigned_) {
-      delete[] lm_states_;
-      delete[] unigram_states_;
-      delete[] overflow_buffer_;
-    }
-  }
+  ~ConstArpaLm();
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
   // ReadInternalOldFormat() to do the actual reading.
-  void Read(std::istream &is, bool binary);
+  void Read(std::istream &is, bool binary) { Read(is, binary, ""); }
+
+  // As Read(is, binary), but if the model is in the quantized format and
+  // <source> is the name of the file that <is> reads from, the LmStates are
+  // memory-mapped from the file rather than read into memory.  See also
+  // ReadConstArpaLm().
+  void Read(std::istream &is, bool binary, const std::string &source);
 
   // Writes the language model in ConstArpaLm format.
   void Write(std::ostream &os, bool binary) const;
@@ -278,9 +312,13 @@ class ConstArpaLm {
   int32 UnkSymbol() const { return unk_symbol_; }
   int32 NgramOrder() const { return ngram_order_; }
 
+  // Returns the number of bits of the quantized logprobs and backoffs, or 0 if
+  // they are not quantized.
+  int32 QuantizeBits() const { return quantize_bits_; }
+
  private:
   // Function that loads data from stream to the class.
-  void ReadInternal(std::istream &is, bool binary);
+  void ReadInternal(std::istream &is, bool binary, const std::string &source);
 
   // Function that loads data from stream to the class. This is a deprecated one
   // that handles the old on-disk format. We keep this for back-compatibility
@@ -314,8 +352,40 @@ class ConstArpaLm {
 
   // Decodes <child_info> to get log probability and child LmState. In the leaf
   // case, only <logprob> will be returned, and <child_address> will be NULL.
+  // <order> is the n-gram order of the child, which is needed to decode the
+  // quantized format.
   void DecodeChildInfo(const int32 child_info, int32* parent,
-                       int32** child_lm_state, float* logprob) const;
+                       const int32 order, int32** child_lm_state,
+                       float* logprob) const;
+
+  // Number of entries in each codebook of the quantized format.
+  int32 NumCodes() const { return 1 << quantize_bits_; }
+
+  // Returns the value of <code> in the logprob (<type> == 0) or backoff
+  // (<type> == 1) codebook of n-gram order <order>.
+  float Dequantize(const int32 order, const int32 type,
+                   const int32 code) const {
+    return codebook_[((order - 1) * 2 + type) * NumCodes() + code];
+  }
+
+  // Returns the logprob of the LmState <lm_state>, of n-gram order <order>.
+  float StateLogprob(const int32* lm_state, const int32 order) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(*lm_state);
+      return logprob_i.f;
+    }
+    return Dequantize(order, 0, static_cast<uint32>(*lm_state) & 0xFFFF);
+  }
+
+  // Returns the backoff logprob of the LmState <lm_state>, of n-gram order
+  // <order>.
+  float StateBackoffLogprob(const int32* lm_state, const int32 order) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat backoff_logprob_i(*(lm_state + 1));
+      return backoff_logprob_i.f;
+    }
+    return Dequantize(order, 1, static_cast<uint32>(*lm_state) >> 16);
+  }
 
   void WriteArpaRecurse(int32* lm_state,
                         const std::vector<int32>& seq,
@@ -381,7 +451,95 @@ class ConstArpaLm {
   // bytes, therefore one LmState will occupy the following number of bytes:
   //
   // x = 1 + 1 + 1 + 2 * children.size() = 3 + 2 * children.size()
+  //
+  // In the quantized format, logprob and backoff_logprob share one int32 (see
+  // the comment at the top of this file), so x = 2 + 2 * children.size().
   int32* lm_states_;
+
+  // If the LmStates were memory-mapped from the file, the mapped region, which
+  // <lm_states_> points into; otherwise NULL.
+  fst::MappedFile* lm_states_region_;
+
+  // Number of bits of the quantized logprobs and backoffs, or 0 if they are
+  // stored as floats.
+  int32 quantize_bits_;
+
+  // Number of int32's in an LmState before the children: 3, or 2 in the
+  // quantized format.
+  int32 header_size_;
+
+  // The codebooks of the quantized format, for n-gram orders 1, 2, ...; for
+  // each order, NumCodes() logprobs followed by NumCodes() backoff logprobs.
+  std::vector<float> codebook_;
+};
+
+/**
+ This class is a cache of the n-gram lookups of a ConstArpaLm that can be
+ shared by several ConstArpaLmDeterministicFst objects, including ones used in
+ different threads (all the functions are thread-safe). It gives each history
+ state (word sequence) that it sees a history id, and caches, for (history id,
+ word) pairs, the logprob of the word and the id of the next history state. The
+ cache is split into shards with separate locks so that threads rarely wait
+ for each other.
+
+ The arc cache is bounded: when a shard reaches its share of <max_arcs>
+ entries, it is cleared. The history ids are never freed, but there can be
+ no more of them than there are history states in the language model.
+ */
+class ConstArpaLmCache {
+ public:
+  // <lm> must outlive this object.
+  ConstArpaLmCache(const ConstArpaLm& lm, int64 max_arcs,
+                   int32 num_shards = 64);
+
+  // Returns the history id of the word sequence <wseq>, which must be a
+  // history state of the language model (see HistoryStateExists()).
+  int32 HistoryId(const std::vector<int32>& wseq);
+
+  // Sets <logprob> to the logprob of <word> following history <history_id>,
+  // and <next_history_id> to the id of the resulting history state. Returns
+  // false if <word> is not in the language model and there is no <unk> (in
+  // which case <logprob> is std::numeric_limits<float>::min(), as returned by
+  // ConstArpaLm::GetNgramLogprob()).
+  bool GetArc(int32 history_id, int32 word, float* logprob,
+              int32* next_history_id);
+
+  const ConstArpaLm& Lm() const { return lm_; }
+
+  // Logs the number of hits and misses and the number of history states. This
+  // does not lock anything, so call it when no other thread is using the
+  // cache.
+  void PrintStats() const;
+
+ private:
+  // Copies the word sequence of history <history_id> to <wseq>.
+  void GetHistory(int32 history_id, std::vector<int32>* wseq);
+
+  struct HistoryShard {
+    std::mutex mutex;
+    unordered_map<std::vector<int32>, int32, VectorHasher<int32> > wseq_to_id;
+    std::vector<std::vector<int32> > id_to_wseq;
+  };
+
+  struct ArcShard {
+    std::mutex mutex;
+    // Maps (history id, word) to (logprob, next history id); the next history
+    // id is -1 if there is no arc.
+    unordered_map<std::pair<int32, int32>, std::pair<float, int32>,
+                  PairHasher<int32> > arcs;
+    int64 num_hits;
+    int64 num_misses;
+    int64 num_clears;
+  };
+
+  const ConstArpaLm& lm_;
+  int32 num_shards_;
+  // Maximum number of entries in each ArcShard.
+  int64 max_arcs_per_shard_;
+  // The history id of a word sequence in history_shards_[i] is (i + num_shards_
+  // * its index in id_to_wseq).
+  std::vector<HistoryShard> history_shards_;
+  std::vector<ArcShard> arc_shards_;
 };
 
 /**
@@ -397,6 +555,11 @@ class ConstArpaLmDeterministicFst
 
   explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
 
+  // This version looks up the n-grams through <cache>, which may be shared with
+  // other objects and threads, and which must outlive this object. The state
+  // ids are the history ids of the cache.
+  explicit ConstArpaLmDeterministicFst(ConstArpaLmCache* cache);
+
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
   virtual StateId Start() { return start_state_; }
@@ -414,14 +577,90 @@ class ConstArpaLmDeterministicFst
   MapType wseq_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
   const ConstArpaLm& lm_;
+  // If non-NULL, we use this instead of <wseq_to_state_> and
+  // <state_to_wseq_>.
+  ConstArpaLmCache* cache_;
+};
+
+/**
+ This class combines several ConstArpaLm language models into one
+ DeterministicOnDemandFst, without building a merged language model.  With
+ linear interpolation, the probability of a word is the weighted sum of its
+ probabilities in the language models (the weights should be non-negative
+ and normally sum to one); with log-linear interpolation, its logprob is the
+ weighted sum of its logprobs (which is not normalized).
+
+ A state is a word sequence: the longest suffix of the words seen that is a
+ history state in at least one of the language models; for each state, we
+ also keep the length of the suffix that each language model uses, so that
+ the result is the same as combining the arcs of the
+ ConstArpaLmDeterministicFsts of the language models.  The language models
+ must have the same <s> and </s> symbols.
+ */
+class InterpolatedConstArpaLmDeterministicFst
+  : public fst::DeterministicOnDemandFst<fst::StdArc> {
+ public:
+  typedef fst::StdArc::Weight Weight;
+  typedef fst::StdArc::StateId StateId;
+  typedef fst::StdArc::Label Label;
+
+  // The language models in <lms> must outlive this object; <weights> has one
+  // weight per language model.
+  InterpolatedConstArpaLmDeterministicFst(
+      const std::vector<const ConstArpaLm*>& lms,
+      const std::vector<BaseFloat>& weights,
+      bool log_linear);
+
+  virtual StateId Start() { return 0; }
+
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
+
+ private:
+  // Sets <logprob> to the interpolated logprob of <word> following state <s>.
+  // Returns false if there is no such arc: with linear interpolation, if no
+  // language model with a nonzero weight has <word>; with log-linear
+  // interpolation, if any of them does not have it.
+  bool GetLogprob(StateId s, Label word, float* logprob);
+
+  // Returns the state for the word sequence <wseq> (which has already been
+  // reduced to a history state), creating it if necessary.
+  StateId FindOrAddState(const std::vector<Label>& wseq);
+
+  typedef unordered_map<std::vector<Label>,
+                        StateId, VectorHasher<Label> > MapType;
+  std::vector<const ConstArpaLm*> lms_;
+  std::vector<BaseFloat> weights_;
+  bool log_linear_;
+  // The largest n-gram order of the language models.
+  int32 max_order_;
+  MapType wseq_to_state_;
+  std::vector<std::vector<Label> > state_to_wseq_;
+  // state_hist_lengths_[s * lms_.size() + i] is the number of words at the
+  // end of state_to_wseq_[s] that lms_[i] uses as its history.
+  std::vector<int32> state_hist_lengths_;
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
 // format. We assume that the words in the input Arpa format language model have
 // been converted into integers.
+// If <quantize_bits> is 8 or 16, it writes the quantized format (see the
+// comment at the top of this file).
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename);
+                      const std::string& const_arpa_wxfilename,
+                      int32 quantize_bits = 0);
+
+// As above, but builds the language model in memory, in <lm>.
+void BuildConstArpaLm(const ArpaParseOptions& options,
+                      const std::string& arpa_rxfilename,
+                      ConstArpaLm* lm);
+
+// Reads a ConstArpaLm format language model from <rxfilename>. Unlike
+// ReadKaldiObject(), this memory-maps the LmStates of the quantized format if
+// <rxfilename> is an ordinary file.
+void ReadConstArpaLm(const std::string& rxfilename, ConstArpaLm* lm);
 
 }  // namespace kaldi
 
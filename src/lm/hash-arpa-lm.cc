@@ -0,0 +1,440 @@
+// lm/hash-arpa-lm.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include "lm/hash-arpa-lm.h"
+
+namespace kaldi {
+
+// The top bit of HashArpaLmEntry::key is set if the n-gram is the history of
+// some other n-gram, i.e. if it is a history state.
+static const uint64 kHasChildrenBit = static_cast<uint64>(1) << 63;
+
+// The hash of the empty word sequence.
+static const uint64 kHashArpaSeed = 0x2545F4914F6CDD1DULL;
+
+// Returns the hash of the word sequence whose hash is <hash>, with <word>
+// added at the start; this is the finalizer of splitmix64.
+static inline uint64 HashArpaCombine(uint64 hash, int32 word) {
+  uint64 z = hash + (static_cast<uint64>(static_cast<uint32>(word)) + 1) *
+      0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Converts a hash to a key for the n-gram tables, which is nonzero and does
+// not use kHasChildrenBit.
+static inline uint64 HashArpaKey(uint64 hash) {
+  uint64 key = hash & ~kHasChildrenBit;
+  return (key == 0 ? 1 : key);
+}
+
+// Returns the index of the entry of <table> with key <key>, or -1 if there is
+// none.  <table> must have at least one empty entry.
+static inline int64 FindHashArpaEntry(
+    const std::vector<HashArpaLmEntry> &table, uint64 key) {
+  size_t size = table.size(), i = key % size;
+  while (true) {
+    uint64 entry_key = table[i].key;
+    if (entry_key == 0)
+      return -1;
+    if ((entry_key & ~kHasChildrenBit) == key)
+      return i;
+    if (++i == size)
+      i = 0;
+  }
+}
+
+class HashArpaLmBuilder : public ArpaFileParser {
+ public:
+  HashArpaLmBuilder(ArpaParseOptions options, HashArpaLm *lm)
+      : ArpaFileParser(options, NULL), lm_(lm) { }
+
+ protected:
+  // ArpaFileParser overrides.
+  virtual void HeaderAvailable();
+  virtual void ConsumeNGram(const NGram& ngram);
+  virtual void ReadComplete();
+
+ private:
+  // Inserts an entry with key <key> into the table of n-gram order <order>
+  // (>= 2), and returns it.  <ngram> is only used for error messages.
+  HashArpaLmEntry *Insert(int32 order, uint64 key, const NGram &ngram);
+
+  // Returns a string like "[ 1 4 5 ]" for error messages.
+  static std::string NGramString(const NGram &ngram);
+
+  HashArpaLm *lm_;
+  // The number of n-grams of each order inserted so far.
+  std::vector<int64> num_ngrams_;
+};
+
+std::string HashArpaLmBuilder::NGramString(const NGram &ngram) {
+  std::ostringstream os;
+  os << "[ ";
+  for (size_t i = 0; i < ngram.words.size(); i++)
+    os << ngram.words[i] << " ";
+  os << "]";
+  return os.str();
+}
+
+void HashArpaLmBuilder::HeaderAvailable() {
+  const std::vector<int32> &counts = NgramCounts();
+  lm_->ngram_order_ = counts.size();
+  lm_->tables_.clear();
+  lm_->tables_.resize(counts.size());
+  lm_->tables_[0].reserve(counts[0]);
+  // The tables are at most 2/3 full, so that the probes are short.
+  for (size_t i = 1; i < counts.size(); i++)
+    lm_->tables_[i].resize(static_cast<size_t>(counts[i]) * 3 / 2 + 1);
+  num_ngrams_.assign(counts.size(), 0);
+}
+
+HashArpaLmEntry *HashArpaLmBuilder::Insert(int32 order, uint64 key,
+                                           const NGram &ngram) {
+  std::vector<HashArpaLmEntry> &table = lm_->tables_[order - 1];
+  // We always leave one entry empty, so that FindHashArpaEntry() stops.
+  if (num_ngrams_[order - 1] + 1 >= table.size()) {
+    KALDI_ERR << "In line " << LineNumber() << ": there are more "
+              << order << "-grams than the header says.";
+  }
+  size_t size = table.size(), i = key % size;
+  while (table[i].key != 0) {
+    if ((table[i].key & ~kHasChildrenBit) == key) {
+      KALDI_ERR << "N-gram " << NGramString(ngram) << " appears twice in the "
+                << "arpa file (or its hash is the same as that of another "
+                << "n-gram, which is very unlikely).";
+    }
+    if (++i == size)
+      i = 0;
+  }
+  num_ngrams_[order - 1]++;
+  table[i].key = key;
+  return &(table[i]);
+}
+
+void HashArpaLmBuilder::ConsumeNGram(const NGram &ngram) {
+  int32 cur_order = ngram.words.size();
+  const std::vector<int32> &words = ngram.words;
+  HashArpaLmEntry *entry;
+  if (cur_order == 1) {
+    std::vector<HashArpaLmEntry> &unigrams = lm_->tables_[0];
+    int32 word = words[0];
+    if (word >= static_cast<int32>(unigrams.size()))
+      unigrams.resize(word + 1);
+    entry = &(unigrams[word]);
+    if (entry->key != 0) {
+      KALDI_ERR << "N-gram " << NGramString(ngram)
+                << " appears twice in the arpa file";
+    }
+    entry->key = 1;
+  } else {
+    uint64 hash = kHashArpaSeed;
+    for (int32 i = cur_order - 1; i >= 0; i--)
+      hash = HashArpaCombine(hash, words[i]);
+    entry = Insert(cur_order, HashArpaKey(hash), ngram);
+
+    // Marks the history n-gram as having children.  As in ConstArpaLm, we
+    // require that the history n-gram exists and was processed before.
+    HashArpaLmEntry *hist_entry = NULL;
+    if (cur_order == 2) {
+      if (lm_->InVocab(words[0]))
+        hist_entry = &(lm_->tables_[0][words[0]]);
+    } else {
+      uint64 hist_hash = kHashArpaSeed;
+      for (int32 i = cur_order - 2; i >= 0; i--)
+        hist_hash = HashArpaCombine(hist_hash, words[i]);
+      int64 index = FindHashArpaEntry(lm_->tables_[cur_order - 2],
+                                      HashArpaKey(hist_hash));
+      if (index != -1)
+        hist_entry = &(lm_->tables_[cur_order - 2][index]);
+    }
+    if (hist_entry == NULL) {
+      KALDI_ERR << "In line " << LineNumber() << ": "
+                << cur_order << "-gram " << NGramString(ngram)
+                << " does not have a parent model " << (cur_order - 1)
+                << "-gram.";
+    }
+    hist_entry->key |= kHasChildrenBit;
+  }
+  entry->logprob = ngram.logprob;
+  entry->backoff = ngram.backoff;
+}
+
+void HashArpaLmBuilder::ReadComplete() {
+  // ConstArpaLm does not keep the backoff of an n-gram of order >= 2 that is
+  // not a history state, so neither do we (a backoff weight of such an n-gram
+  // should be zero anyway).
+  for (size_t i = 1; i < lm_->tables_.size(); i++) {
+    std::vector<HashArpaLmEntry> &table = lm_->tables_[i];
+    for (size_t j = 0; j < table.size(); j++)
+      if ((table[j].key & kHasChildrenBit) == 0)
+        table[j].backoff = 0.0;
+  }
+  lm_->bos_symbol_ = Options().bos_symbol;
+  lm_->eos_symbol_ = Options().eos_symbol;
+  lm_->unk_symbol_ = Options().unk_symbol;
+  int32 num_words = lm_->tables_[0].size();
+  KALDI_ASSERT(lm_->bos_symbol_ < num_words && lm_->bos_symbol_ > 0);
+  KALDI_ASSERT(lm_->eos_symbol_ < num_words && lm_->eos_symbol_ > 0);
+  KALDI_ASSERT(lm_->unk_symbol_ < num_words &&
+               (lm_->unk_symbol_ > 0 || lm_->unk_symbol_ == -1));
+  lm_->initialized_ = true;
+  KALDI_LOG << "Built HashArpaLm of order " << lm_->ngram_order_ << "; the "
+            << "tables use " << lm_->MemorySize() << " bytes.";
+}
+
+void HashArpaLm::Write(std::ostream &os, bool binary) const {
+  KALDI_ASSERT(initialized_);
+  if (!binary) {
+    KALDI_ERR << "text-mode writing is not implemented for HashArpaLm.";
+  }
+  WriteToken(os, binary, "<HashArpaLm>");
+  WriteToken(os, binary, "<LmInfo>");
+  WriteBasicType(os, binary, bos_symbol_);
+  WriteBasicType(os, binary, eos_symbol_);
+  WriteBasicType(os, binary, unk_symbol_);
+  WriteBasicType(os, binary, ngram_order_);
+  WriteToken(os, binary, "</LmInfo>");
+  WriteToken(os, binary, "<LmTables>");
+  for (int32 i = 0; i < ngram_order_; i++) {
+    int64 size = tables_[i].size();
+    WriteBasicType(os, binary, size);
+    if (size > 0)
+      os.write(reinterpret_cast<const char*>(&(tables_[i][0])),
+               sizeof(HashArpaLmEntry) * size);
+  }
+  if (!os.good()) {
+    KALDI_ERR << "HashArpaLm <LmTables> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmTables>");
+  WriteToken(os, binary, "</HashArpaLm>");
+}
+
+void HashArpaLm::Read(std::istream &is, bool binary) {
+  KALDI_ASSERT(!initialized_);
+  if (!binary) {
+    KALDI_ERR << "text-mode reading is not implemented for HashArpaLm.";
+  }
+  ExpectToken(is, binary, "<HashArpaLm>");
+  ExpectToken(is, binary, "<LmInfo>");
+  ReadBasicType(is, binary, &bos_symbol_);
+  ReadBasicType(is, binary, &eos_symbol_);
+  ReadBasicType(is, binary, &unk_symbol_);
+  ReadBasicType(is, binary, &ngram_order_);
+  ExpectToken(is, binary, "</LmInfo>");
+  KALDI_ASSERT(ngram_order_ > 0);
+  ExpectToken(is, binary, "<LmTables>");
+  tables_.resize(ngram_order_);
+  for (int32 i = 0; i < ngram_order_; i++) {
+    int64 size;
+    ReadBasicType(is, binary, &size);
+    if (size < 0 || (i > 0 && size == 0)) {
+      KALDI_ERR << "HashArpaLm: invalid table size " << size;
+    }
+    tables_[i].resize(size);
+    if (size > 0)
+      is.read(reinterpret_cast<char*>(&(tables_[i][0])),
+              sizeof(HashArpaLmEntry) * size);
+    if (!is.good()) {
+      KALDI_ERR << "HashArpaLm <LmTables> section reading failed.";
+    }
+    if (i > 0) {
+      // Makes sure that the lookups will stop.
+      size_t j = 0;
+      while (j < tables_[i].size() && tables_[i][j].key != 0)
+        j++;
+      if (j == tables_[i].size()) {
+        KALDI_ERR << "HashArpaLm: the table of order " << (i + 1)
+                  << " is full; the file is corrupted.";
+      }
+    }
+  }
+  ExpectToken(is, binary, "</LmTables>");
+  ExpectToken(is, binary, "</HashArpaLm>");
+  initialized_ = true;
+}
+
+float HashArpaLm::GetNgramLogprob(const int32 word,
+                                  const std::vector<int32>& hist) const {
+  KALDI_ASSERT(initialized_);
+  int32 mapped_word = word;
+  if (!InVocab(word)) {
+    if (unk_symbol_ == -1)
+      return std::numeric_limits<float>::min();
+    mapped_word = unk_symbol_;
+  }
+
+  // We use at most the last <ngram_order_> - 1 words of <hist>.
+  int32 hist_size = std::min<int32>(hist.size(), ngram_order_ - 1),
+      hist_offset = static_cast<int32>(hist.size()) - hist_size;
+
+  // We follow ConstArpaLm::GetNgramLogprobRecurse(): the logprob is that of
+  // the longest n-gram "h_k ... h_1 word" that exists, plus the backoffs of
+  // the histories "h_j ... h_1" for j > k.  <hash> is the hash of
+  // "h_n ... h_1 word" and <hist_hash> that of "h_n ... h_1".
+  float logprob = tables_[0][mapped_word].logprob, backoff = 0.0;
+  uint64 hash = HashArpaCombine(kHashArpaSeed, mapped_word),
+      hist_hash = kHashArpaSeed;
+  for (int32 n = 1; n <= hist_size; n++) {
+    int32 hist_word = hist[hist_offset + hist_size - n];
+    if (unk_symbol_ != -1 && !InVocab(hist_word))
+      hist_word = unk_symbol_;
+    hash = HashArpaCombine(hash, hist_word);
+    hist_hash = HashArpaCombine(hist_hash, hist_word);
+    const HashArpaLmEntry *hist_entry = NULL;
+    if (n == 1) {
+      if (InVocab(hist_word))
+        hist_entry = &(tables_[0][hist_word]);
+    } else {
+      int64 index = FindHashArpaEntry(tables_[n - 1], HashArpaKey(hist_hash));
+      if (index != -1)
+        hist_entry = &(tables_[n - 1][index]);
+    }
+    if (hist_entry == NULL)
+      continue;
+    // The n-gram can only exist if its history has children.
+    if ((hist_entry->key & kHasChildrenBit) != 0) {
+      int64 index = FindHashArpaEntry(tables_[n], HashArpaKey(hash));
+      if (index != -1) {
+        logprob = tables_[n][index].logprob;
+        backoff = 0.0;
+        continue;
+      }
+    }
+    backoff += hist_entry->backoff;
+  }
+  return logprob + backoff;
+}
+
+bool HashArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
+  KALDI_ASSERT(initialized_);
+  if (hist.size() == 0)
+    return true;
+  if (static_cast<int32>(hist.size()) >= ngram_order_)
+    return false;
+  const HashArpaLmEntry *entry = NULL;
+  if (hist.size() == 1) {
+    if (InVocab(hist[0]))
+      entry = &(tables_[0][hist[0]]);
+  } else {
+    uint64 hash = kHashArpaSeed;
+    for (int32 i = static_cast<int32>(hist.size()) - 1; i >= 0; i--)
+      hash = HashArpaCombine(hash, hist[i]);
+    const std::vector<HashArpaLmEntry> &table = tables_[hist.size() - 1];
+    int64 index = FindHashArpaEntry(table, HashArpaKey(hash));
+    if (index != -1)
+      entry = &(table[index]);
+  }
+  return (entry != NULL && (entry->key & kHasChildrenBit) != 0);
+}
+
+int64 HashArpaLm::MemorySize() const {
+  int64 ans = 0;
+  for (size_t i = 0; i < tables_.size(); i++)
+    ans += tables_[i].size() * sizeof(HashArpaLmEntry);
+  return ans;
+}
+
+HashArpaLmDeterministicFst::HashArpaLmDeterministicFst(
+    const HashArpaLm& lm) : lm_(lm) {
+  // Creates a history state for <s>.
+  std::vector<Label> bos_state(1, lm_.BosSymbol());
+  state_to_wseq_.push_back(bos_state);
+  wseq_to_state_[bos_state] = 0;
+  start_state_ = 0;
+}
+
+fst::StdArc::Weight HashArpaLmDeterministicFst::Final(StateId s) {
+  // At this point, we should have created the state.
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  const std::vector<Label>& wseq = state_to_wseq_[s];
+  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+  return Weight(-logprob);
+}
+
+bool HashArpaLmDeterministicFst::GetArc(StateId s, Label ilabel,
+                                        fst::StdArc *oarc) {
+  // At this point, we should have created the state.
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  std::vector<Label> wseq = state_to_wseq_[s];
+
+  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
+  if (logprob == std::numeric_limits<float>::min()) {
+    return false;
+  }
+
+  // Locates the next state, as in ConstArpaLmDeterministicFst.
+  wseq.push_back(ilabel);
+  while (wseq.size() >= lm_.NgramOrder()) {
+    // History state has at most lm_.NgramOrder() -1 words in the state.
+    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  }
+  while (!lm_.HistoryStateExists(wseq)) {
+    KALDI_ASSERT(wseq.size() > 0);
+    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  }
+
+  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
+      wseq, static_cast<Label>(state_to_wseq_.size()));
+  std::pair<MapType::iterator, bool> result =
+      wseq_to_state_.insert(wseq_state_pair);
+  if (result.second == true)
+    state_to_wseq_.push_back(wseq);
+
+  oarc->ilabel = ilabel;
+  oarc->olabel = ilabel;
+  oarc->nextstate = result.first->second;
+  oarc->weight = Weight(-logprob);
+  return true;
+}
+
+void BuildHashArpaLm(const ArpaParseOptions& options,
+                     const std::string& arpa_rxfilename,
+                     HashArpaLm* lm) {
+  HashArpaLmBuilder lm_builder(options, lm);
+  KALDI_LOG << "Reading " << arpa_rxfilename;
+  Input ki(arpa_rxfilename);
+  lm_builder.Read(ki.Stream());
+}
+
+void ReadConstOrHashArpaLm(const std::string& rxfilename,
+                           ConstArpaLm** const_arpa,
+                           HashArpaLm** hash_arpa) {
+  bool binary;
+  Input ki(rxfilename, &binary);
+  // "<HashArpaLm>" versus "<ConstArpaLm>" (or the old ConstArpaLm format,
+  // which does not start with a token).
+  if (PeekToken(ki.Stream(), binary) == 'H') {
+    *const_arpa = NULL;
+    *hash_arpa = new HashArpaLm();
+    (*hash_arpa)->Read(ki.Stream(), binary);
+  } else {
+    *hash_arpa = NULL;
+    *const_arpa = new ConstArpaLm();
+    std::string source;
+    if (ClassifyRxfilename(rxfilename) == kFileInput)
+      source = rxfilename;
+    (*const_arpa)->Read(ki.Stream(), binary, source);
+  }
+}
+
+}  // namespace kaldi
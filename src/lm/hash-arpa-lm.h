@@ -0,0 +1,157 @@
+// lm/hash-arpa-lm.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LM_HASH_ARPA_LM_H_
+#define KALDI_LM_HASH_ARPA_LM_H_
+
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fstext/deterministic-fst.h"
+#include "lm/arpa-file-parser.h"
+#include "lm/const-arpa-lm.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+/**
+    HashArpaLm is an alternative to ConstArpaLm that stores the n-grams of each
+    order in an open-addressing hash table with linear probing (the "probing"
+    data structure of KenLM).  It gives the same n-gram logprobs as ConstArpaLm
+    (up to the rounding of the leaf logprobs in ConstArpaLm), but a lookup is a
+    few probes into flat arrays rather than a walk through the children of
+    each history state, so it is faster, at the cost of more memory: about 24
+    bytes per n-gram, against 8 to 12 for ConstArpaLm.  See arpa-lm-benchmark
+    for a comparison on a particular language model.
+
+    The tables are keyed by a 64-bit hash of the word sequence, and the words
+    themselves are not stored, so two n-grams of the same order whose hashes
+    are the same would be confused; with 63-bit keys this is vanishingly
+    unlikely.  The hash of "A B C" is computed starting from "C", so that the
+    keys of "C", "B C", "A B C" are computed incrementally when we back off.
+    The unigrams are stored in an array indexed by the word.
+
+    Like ConstArpaLm, the words of the ARPA file must have been converted to
+    integers, and the model is built with arpa-to-hash-arpa.
+*/
+
+// An entry of the n-gram tables of HashArpaLm.
+struct HashArpaLmEntry {
+  // The hash of the word sequence (the top bit is kHasChildrenBit, see
+  // hash-arpa-lm.cc), or 0 if the entry is empty.
+  uint64 key;
+  float logprob;
+  float backoff;
+};
+
+class HashArpaLm {
+ public:
+  HashArpaLm(): bos_symbol_(-1), eos_symbol_(-1), unk_symbol_(-1),
+                ngram_order_(0), initialized_(false) { }
+
+  // Reads the language model, in the format written by Write().  Only the
+  // binary format is supported.
+  void Read(std::istream &is, bool binary);
+
+  void Write(std::ostream &os, bool binary) const;
+
+  // Returns the logprob of <word> following the word sequence <hist>, backing
+  // off as necessary; it behaves like ConstArpaLm::GetNgramLogprob(), e.g.
+  // out-of-vocabulary words are mapped to <unk> if it is defined.  Returns
+  // std::numeric_limits<float>::min() if <word> is not in the language model
+  // and there is no <unk>.
+  float GetNgramLogprob(const int32 word, const std::vector<int32>& hist) const;
+
+  // Returns true if the history word sequence <hist> has successors, i.e. if
+  // it is a state in the FST format language model.
+  bool HistoryStateExists(const std::vector<int32>& hist) const;
+
+  int32 BosSymbol() const { return bos_symbol_; }
+  int32 EosSymbol() const { return eos_symbol_; }
+  int32 UnkSymbol() const { return unk_symbol_; }
+  int32 NgramOrder() const { return ngram_order_; }
+
+  // Returns the number of bytes used by the n-gram tables.
+  int64 MemorySize() const;
+
+ private:
+  friend class HashArpaLmBuilder;
+
+  // Returns true if <word> is in the language model (as a unigram).
+  bool InVocab(int32 word) const {
+    return word >= 0 && word < static_cast<int32>(tables_[0].size()) &&
+        tables_[0][word].key != 0;
+  }
+
+  int32 bos_symbol_;
+  int32 eos_symbol_;
+  int32 unk_symbol_;
+  int32 ngram_order_;
+  bool initialized_;
+
+  // tables_[0] is the unigram array, indexed by word (its size is the largest
+  // word-id plus one, and absent words have key == 0); tables_[n - 1], for
+  // n >= 2, is the hash table of the n-grams of order n.
+  std::vector<std::vector<HashArpaLmEntry> > tables_;
+};
+
+/**
+ This class wraps a HashArpaLm with the interface defined in
+ DeterministicOnDemandFst, like ConstArpaLmDeterministicFst.
+ */
+class HashArpaLmDeterministicFst
+  : public fst::DeterministicOnDemandFst<fst::StdArc> {
+ public:
+  typedef fst::StdArc::Weight Weight;
+  typedef fst::StdArc::StateId StateId;
+  typedef fst::StdArc::Label Label;
+
+  explicit HashArpaLmDeterministicFst(const HashArpaLm& lm);
+
+  virtual StateId Start() { return start_state_; }
+
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
+
+ private:
+  typedef unordered_map<std::vector<Label>,
+                        StateId, VectorHasher<Label> > MapType;
+  StateId start_state_;
+  MapType wseq_to_state_;
+  std::vector<std::vector<Label> > state_to_wseq_;
+  const HashArpaLm& lm_;
+};
+
+// Reads in an Arpa format language model, whose words have been converted to
+// integers, and builds a HashArpaLm from it.
+void BuildHashArpaLm(const ArpaParseOptions& options,
+                     const std::string& arpa_rxfilename,
+                     HashArpaLm* lm);
+
+// Reads a language model in either the ConstArpaLm or the HashArpaLm format
+// from <rxfilename>: it sets one of *const_arpa and *hash_arpa to a newly
+// allocated language model, and the other to NULL.  ConstArpaLm is read as by
+// ReadConstArpaLm().
+void ReadConstOrHashArpaLm(const std::string& rxfilename,
+                           ConstArpaLm** const_arpa,
+                           HashArpaLm** hash_arpa);
+
+}  // namespace kaldi
+
+#endif  // KALDI_LM_HASH_ARPA_LM_H_
@@ -0,0 +1,234 @@
+// lmbin/arpa-lm-benchmark.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABILITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/hash-arpa-lm.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+// Collects a uniformly random sample of the n-grams of an ARPA file
+// (reservoir sampling), which we use as queries, and the vocabulary.
+class NGramSampler : public ArpaFileParser {
+ public:
+  NGramSampler(ArpaParseOptions options, int32 num_samples)
+      : ArpaFileParser(options, NULL), num_samples_(num_samples),
+        num_seen_(0) { }
+
+  const std::vector<std::vector<int32> > &Samples() const { return samples_; }
+  const std::vector<int32> &Vocab() const { return vocab_; }
+
+ protected:
+  virtual void ConsumeNGram(const NGram &ngram) {
+    if (ngram.words.size() == 1)
+      vocab_.push_back(ngram.words[0]);
+    num_seen_++;
+    if (samples_.size() < num_samples_) {
+      samples_.push_back(ngram.words);
+    } else {
+      int64 i = static_cast<int64>(RandUniform() * num_seen_);
+      if (i < num_samples_)
+        samples_[i] = ngram.words;
+    }
+  }
+
+ private:
+  int32 num_samples_;
+  int64 num_seen_;
+  std::vector<std::vector<int32> > samples_;
+  std::vector<int32> vocab_;
+};
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Benchmark the HashArpaLm language model format (see\n"
+        "lm/hash-arpa-lm.h) against ConstArpaLm.  Both are built in memory\n"
+        "from the same Arpa language model (with integer words, as for\n"
+        "arpa-to-const-arpa), and we print their sizes and the number of\n"
+        "n-gram queries per second of each, for queries sampled from the\n"
+        "n-grams of the language model; with --backoff-proportion, some of\n"
+        "the queries have their oldest history word replaced by a random\n"
+        "word of the vocabulary, so that they usually back off.  We also\n"
+        "time the arcs of the DeterministicOnDemandFst wrappers, following\n"
+        "the sampled n-grams as sentences, and check that both give the same\n"
+        "logprobs.\n"
+        "\n"
+        "Usage: arpa-lm-benchmark [options] <arpa-in>\n"
+        " e.g.: arpa-lm-benchmark --bos-symbol=1 --eos-symbol=2 arpa.txt\n";
+
+    ParseOptions po(usage);
+    ArpaParseOptions options;
+    int32 num_queries = 1000000, num_repeats = 3;
+    BaseFloat backoff_proportion = 0.5;
+    options.Register(&po);
+    po.Register("unk-symbol", &options.unk_symbol,
+                "Integer corresponds to unknown-word in language model. -1 if "
+                "no such word is provided.");
+    po.Register("bos-symbol", &options.bos_symbol,
+                "Integer corresponds to <s>. You must set this to your actual "
+                "BOS integer.");
+    po.Register("eos-symbol", &options.eos_symbol,
+                "Integer corresponds to </s>. You must set this to your actual "
+                "EOS integer.");
+    po.Register("num-queries", &num_queries, "Number of n-gram queries.");
+    po.Register("num-repeats", &num_repeats, "Number of times to run the "
+                "queries for each format (the fastest time is reported).");
+    po.Register("backoff-proportion", &backoff_proportion, "Proportion of "
+                "the queries whose oldest history word is replaced by a "
+                "random word of the vocabulary.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 1 || num_queries < 1 || num_repeats < 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (options.bos_symbol == -1 || options.eos_symbol == -1) {
+      KALDI_ERR << "Please set --bos-symbol and --eos-symbol.";
+    }
+
+    std::string arpa_rxfilename = po.GetArg(1);
+
+    Timer timer;
+    ConstArpaLm const_arpa;
+    BuildConstArpaLm(options, arpa_rxfilename, &const_arpa);
+    double const_build_time = timer.Elapsed();
+    timer.Reset();
+    HashArpaLm hash_arpa;
+    BuildHashArpaLm(options, arpa_rxfilename, &hash_arpa);
+    double hash_build_time = timer.Elapsed();
+
+    // ConstArpaLm keeps its arrays in memory as they are written, so the
+    // size of the written model is its size in memory.
+    std::ostringstream const_arpa_os;
+    const_arpa.Write(const_arpa_os, true);
+    int64 const_size = const_arpa_os.str().size(),
+        hash_size = hash_arpa.MemorySize();
+
+    // The queries: "words" is the word and "hists" the history.
+    std::vector<int32> words;
+    std::vector<std::vector<int32> > hists;
+    {
+      NGramSampler sampler(options, num_queries);
+      Input ki(arpa_rxfilename);
+      sampler.Read(ki.Stream());
+      const std::vector<std::vector<int32> > &samples = sampler.Samples();
+      const std::vector<int32> &vocab = sampler.Vocab();
+      if (samples.empty())
+        KALDI_ERR << "No n-grams in " << arpa_rxfilename;
+      for (int32 i = 0; i < num_queries; i++) {
+        std::vector<int32> hist(samples[i % samples.size()]);
+        words.push_back(hist.back());
+        hist.pop_back();
+        if (!hist.empty() && RandUniform() < backoff_proportion)
+          hist[0] = vocab[RandInt(0, vocab.size() - 1)];
+        hists.push_back(hist);
+      }
+    }
+
+    const char *format_names[] = { "ConstArpaLm", "HashArpaLm" };
+    double query_time[2], arc_time[2], tot_logprob[2];
+    std::vector<float> logprobs[2];
+    int64 num_arcs = 0;
+    for (int32 format = 0; format < 2; format++) {
+      logprobs[format].resize(num_queries);
+      for (int32 r = 0; r < num_repeats; r++) {
+        timer.Reset();
+        if (format == 0) {
+          for (int32 i = 0; i < num_queries; i++)
+            logprobs[format][i] = const_arpa.GetNgramLogprob(words[i],
+                                                             hists[i]);
+        } else {
+          for (int32 i = 0; i < num_queries; i++)
+            logprobs[format][i] = hash_arpa.GetNgramLogprob(words[i],
+                                                            hists[i]);
+        }
+        double this_query_time = timer.Elapsed();
+
+        // Follows the queries, as sentences, through the FST wrapper.
+        timer.Reset();
+        fst::DeterministicOnDemandFst<fst::StdArc> *lm_fst = (format == 0 ?
+            static_cast<fst::DeterministicOnDemandFst<fst::StdArc>*>(
+                new ConstArpaLmDeterministicFst(const_arpa)) :
+            new HashArpaLmDeterministicFst(hash_arpa));
+        double this_tot_logprob = 0.0;
+        num_arcs = 0;
+        for (int32 i = 0; i < num_queries; i++) {
+          fst::StdArc::StateId s = lm_fst->Start();
+          for (size_t j = 0; j <= hists[i].size(); j++) {
+            int32 word = (j < hists[i].size() ? hists[i][j] : words[i]);
+            fst::StdArc arc;
+            if (lm_fst->GetArc(s, word, &arc)) {
+              this_tot_logprob -= arc.weight.Value();
+              s = arc.nextstate;
+              num_arcs++;
+            }
+          }
+          this_tot_logprob -= lm_fst->Final(s).Value();
+        }
+        delete lm_fst;
+        double this_arc_time = timer.Elapsed();
+        if (r == 0 || this_query_time < query_time[format])
+          query_time[format] = this_query_time;
+        if (r == 0 || this_arc_time < arc_time[format])
+          arc_time[format] = this_arc_time;
+        tot_logprob[format] = this_tot_logprob;
+      }
+      KALDI_LOG << "Format " << format_names[format] << ": size is "
+                << (format == 0 ? const_size : hash_size) << " bytes, "
+                << "building took "
+                << (format == 0 ? const_build_time : hash_build_time)
+                << "s; " << (num_queries / query_time[format])
+                << " n-gram queries per second, "
+                << (num_arcs / arc_time[format])
+                << " FST arcs per second.";
+    }
+    KALDI_LOG << "HashArpaLm is " << (hash_size * 1.0 / const_size)
+              << " times larger; n-gram queries are "
+              << (query_time[0] / query_time[1]) << " times faster, and FST "
+              << "arcs " << (arc_time[0] / arc_time[1]) << " times faster.";
+
+    // The logprobs differ slightly because ConstArpaLm drops the last bit of
+    // some of them.
+    int32 num_mismatch = 0;
+    for (int32 i = 0; i < num_queries; i++)
+      if (!ApproxEqual(logprobs[0][i], logprobs[1][i], 1.0e-04))
+        num_mismatch++;
+    if (num_mismatch != 0 ||
+        !ApproxEqual(tot_logprob[0], tot_logprob[1], 1.0e-04))
+      KALDI_WARN << num_mismatch << " n-gram queries gave different logprobs "
+                 << "in the two formats; total logprobs of the sentences "
+                 << "were " << tot_logprob[0] << " and " << tot_logprob[1];
+    return (num_mismatch == 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -37,6 +37,10 @@ int main(int argc, char *argv[]) {
         "ConstArpaLm format language model. We first map the words in an Arpa\n"
         "format language model to integers using utils/map_arpa_m.pl, and\n"
         "then use this program to build a ConstArpaLm format language model.\n"
+        "With --quantize-bits=8 or 16, the logprobs and backoffs are quantized\n"
+        "(with a codebook per n-gram order), which makes the model smaller,\n"
+        "and programs that read it from a file memory-map it instead of\n"
+        "reading it into memory.\n"
         "\n"
         "Usage: arpa-to-const-arpa [opts] <input-arpa> <const-arpa>\n"
         " e.g.: arpa-to-const-arpa --bos-symbol=1 --eos-symbol=2 \\\n"
@@ -45,7 +49,12 @@ int main(int argc, char *argv[]) {
     kaldi::ParseOptions po(usage);
 
     ArpaParseOptions options;
+    int32 quantize_bits = 0;
     options.Register(&po);
+    po.Register("quantize-bits", &quantize_bits,
+                "If 8 or 16, quantize the logprobs and backoffs to this many "
+                "bits and write the quantized, memory-mappable format; if 0, "
+                "store them as floats.");
 
     // Ideally, these registrations would be in ArpaParseOptions, but some
     // programs want integers and other want symbols, so we register them
@@ -72,11 +81,15 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
+    if (quantize_bits != 0 && quantize_bits != 8 && quantize_bits != 16) {
+      KALDI_ERR << "--quantize-bits must be 0, 8 or 16.";
+    }
+
     std::string arpa_rxfilename = po.GetArg(1),
         const_arpa_wxfilename = po.GetOptArg(2);
 
     bool ans = BuildConstArpaLm(options, arpa_rxfilename,
-                                const_arpa_wxfilename);
+                                const_arpa_wxfilename, quantize_bits);
     if (ans)
       return 0;
     else
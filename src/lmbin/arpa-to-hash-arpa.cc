@@ -0,0 +1,77 @@
+// lmbin/arpa-to-hash-arpa.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABILITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "lm/hash-arpa-lm.h"
+#include "util/parse-options.h"
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  typedef kaldi::int32 int32;
+  try {
+    const char *usage  =
+        "Converts an Arpa format language model into HashArpaLm format, which\n"
+        "stores the n-grams in hash tables (see lm/hash-arpa-lm.h).  It can be\n"
+        "used instead of the ConstArpaLm format (see arpa-to-const-arpa) by\n"
+        "lattice-lmrescore-const-arpa and lattice-lmrescore-pruned; it is\n"
+        "faster to query but larger.  As for arpa-to-const-arpa, the words in\n"
+        "the input Arpa language model must have been converted to integers,\n"
+        "e.g. with utils/map_arpa_lm.pl.\n"
+        "\n"
+        "Usage: arpa-to-hash-arpa [opts] <input-arpa> <hash-arpa>\n"
+        " e.g.: arpa-to-hash-arpa --bos-symbol=1 --eos-symbol=2 \\\n"
+        "                         arpa.txt hash_arpa";
+
+    kaldi::ParseOptions po(usage);
+
+    ArpaParseOptions options;
+    options.Register(&po);
+
+    po.Register("unk-symbol", &options.unk_symbol,
+                "Integer corresponds to unknown-word in language model. -1 if "
+                "no such word is provided.");
+    po.Register("bos-symbol", &options.bos_symbol,
+                "Integer corresponds to <s>. You must set this to your actual "
+                "BOS integer.");
+    po.Register("eos-symbol", &options.eos_symbol,
+                "Integer corresponds to </s>. You must set this to your actual "
+                "EOS integer.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    if (options.bos_symbol == -1 || options.eos_symbol == -1) {
+      KALDI_ERR << "Please set --bos-symbol and --eos-symbol.";
+    }
+
+    std::string arpa_rxfilename = po.GetArg(1),
+        hash_arpa_wxfilename = po.GetArg(2);
+
+    HashArpaLm lm;
+    BuildHashArpaLm(options, arpa_rxfilename, &lm);
+    WriteKaldiObject(lm, hash_arpa_wxfilename, true);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
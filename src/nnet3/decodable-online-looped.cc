@@ -238,6 +238,13 @@ BaseFloat DecodableNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
       index - 1);
 }
 
+const BaseFloat *DecodableNnetLoopedOnline::LogLikelihoodRow(
+    int32 subsampled_frame) {
+  EnsureFrameIsComputed(subsampled_frame);
+  return current_log_post_.RowData(
+      subsampled_frame - current_log_post_subsampled_offset_);
+}
+
 
 BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
                                                     int32 index) {
@@ -247,6 +254,20 @@ BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
       trans_model_.TransitionIdToPdf(index));
 }
 
+const BaseFloat *DecodableAmNnetLoopedOnline::LogLikelihoodRow(
+    int32 subsampled_frame) {
+  if (subsampled_frame != row_frame_) {
+    EnsureFrameIsComputed(subsampled_frame);
+    row_.Resize(trans_model_.NumTransitionIds(), kUndefined);
+    trans_model_.MapPdfsToTransitionIds(
+        current_log_post_.Row(
+            subsampled_frame - current_log_post_subsampled_offset_),
+        1.0, &row_);
+    row_frame_ = subsampled_frame;
+  }
+  return row_.Data();
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -151,6 +151,8 @@ class DecodableNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   // represents the pdf-id (or other output of the network) PLUS ONE.
   virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 index);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 subsampled_frame);
+
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetLoopedOnline);
 
@@ -172,7 +174,7 @@ class DecodableAmNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
       OnlineFeatureInterface *input_features,
       OnlineFeatureInterface *ivector_features):
       DecodableNnetLoopedOnlineBase(info, input_features, ivector_features),
-      trans_model_(trans_model) { }
+      trans_model_(trans_model), row_frame_(-1) { }
 
 
   // returns the output-dim of the neural net.
@@ -183,8 +185,14 @@ class DecodableAmNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   virtual BaseFloat LogLikelihood(int32 subsampled_frame,
                                   int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 subsampled_frame);
+
  private:
   const TransitionModel &trans_model_;
+  // row_ is the log-likelihoods of frame row_frame_, indexed by
+  // transition-id minus one; it is used by LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetLoopedOnline);
 
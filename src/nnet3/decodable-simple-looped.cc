@@ -83,8 +83,9 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
+  if (opts.computation_cache.empty() || !ReadComputationCache(opts, *nnet))
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
   computation.ComputeCudaIndexes();
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
@@ -92,6 +93,47 @@ void DecodableNnetSimpleLoopedInfo::Init(
   }
 }
 
+void DecodableNnetSimpleLoopedInfo::WriteComputationCache(
+    std::ostream &os, bool binary) const {
+  WriteComputationCacheHeader(nnet, true, os, binary);
+  opts.optimize_config.Write(os, binary);
+  request1.Write(os, binary);
+  request2.Write(os, binary);
+  request3.Write(os, binary);
+  computation.Write(os, binary);
+}
+
+bool DecodableNnetSimpleLoopedInfo::ReadComputationCache(
+    const NnetSimpleLoopedComputationOptions &opts,
+    const Nnet &nnet) {
+  bool binary;
+  Input ki(opts.computation_cache, &binary);
+  std::istream &is = ki.Stream();
+  if (!ReadComputationCacheHeader(nnet, true, is, binary))
+    return false;
+  NnetOptimizeOptions optimize_config;
+  optimize_config.Read(is, binary);
+  if (!(optimize_config == opts.optimize_config)) {
+    KALDI_WARN << "Not using the precompiled computation, as it was "
+               << "compiled with different optimization options.";
+    return false;
+  }
+  ComputationRequest cached_request1, cached_request2, cached_request3;
+  cached_request1.Read(is, binary);
+  cached_request2.Read(is, binary);
+  cached_request3.Read(is, binary);
+  if (!(cached_request1 == request1 && cached_request2 == request2 &&
+        cached_request3 == request3)) {
+    KALDI_WARN << "Not using the precompiled computation, as it was "
+               << "compiled with different options (e.g. --frames-per-chunk).";
+    return false;
+  }
+  computation.Read(is, binary);
+  KALDI_LOG << "Read precompiled looped computation from "
+            << opts.computation_cache;
+  return true;
+}
+
 
 DecodableNnetSimpleLooped::DecodableNnetSimpleLooped(
     const DecodableNnetSimpleLoopedInfo &info,
@@ -253,7 +295,7 @@ DecodableAmNnetSimpleLooped::DecodableAmNnetSimpleLooped(
     const MatrixBase<BaseFloat> *online_ivectors,
     int32 online_ivector_period):
     decodable_nnet_(info, feats, ivector, online_ivectors, online_ivector_period),
-    trans_model_(trans_model) { }
+    trans_model_(trans_model), row_frame_(-1) { }
 
 BaseFloat DecodableAmNnetSimpleLooped::LogLikelihood(int32 frame,
                                                      int32 transition_id) {
@@ -261,6 +303,16 @@ BaseFloat DecodableAmNnetSimpleLooped::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimpleLooped::LogLikelihoodRow(int32 frame) {
+  if (frame != row_frame_) {
+    row_.Resize(trans_model_.NumTransitionIds(), kUndefined);
+    trans_model_.MapPdfsToTransitionIds(decodable_nnet_.GetOutputRow(frame),
+                                        1.0, &row_);
+    row_frame_ = frame;
+  }
+  return row_.Data();
+}
+
 
 
 } // namespace nnet3
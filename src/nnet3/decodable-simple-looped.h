@@ -49,6 +49,7 @@ struct NnetSimpleLoopedComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  std::string computation_cache;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   NnetSimpleLoopedComputationOptions():
@@ -83,6 +84,12 @@ struct NnetSimpleLoopedComputationOptions {
                    "if needed.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("computation-cache", &computation_cache, "If set, "
+                   "rxfilename of the looped computation precompiled for this "
+                   "model by 'nnet3-compile-cache --looped', to save "
+                   "compilation time at startup.  It is ignored (with a "
+                   "warning) if it was compiled for a different model or "
+                   "options.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -119,6 +126,12 @@ class DecodableNnetSimpleLoopedInfo  {
   void Init(const NnetSimpleLoopedComputationOptions &opts,
             Nnet *nnet);
 
+  // Writes the looped computation (with the requests it was compiled from and
+  // a header identifying the network), so that it can be read back by Init()
+  // via the --computation-cache option instead of being compiled.  This is
+  // used by nnet3-compile-cache.
+  void WriteComputationCache(std::ostream &os, bool binary) const;
+
   const NnetSimpleLoopedComputationOptions &opts;
 
   const Nnet &nnet;
@@ -151,6 +164,14 @@ class DecodableNnetSimpleLoopedInfo  {
 
   // The compiled, 'looped' computation.
   NnetComputation computation;
+
+ private:
+  // Called from Init(); tries to read 'computation' from
+  // opts.computation_cache, and returns true on success.  It returns false
+  // (with a warning) if the cached computation was compiled for a different
+  // network, different optimization options or different requests.
+  bool ReadComputationCache(const NnetSimpleLoopedComputationOptions &opts,
+                            const Nnet &nnet);
 };
 
 /*
@@ -215,6 +236,19 @@ class DecodableNnetSimpleLooped {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns the output for a particular frame as a reference to internal
+  // data; it is only valid until the next call to a non-const function of
+  // this object.  The same ordering requirement applies as for GetOutput().
+  inline SubVector<BaseFloat> GetOutputRow(int32 subsampled_frame) {
+    KALDI_ASSERT(subsampled_frame >= current_log_post_subsampled_offset_ &&
+                 "Frames must be accessed in order.");
+    while (subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      AdvanceChunk();
+    return current_log_post_.Row(subsampled_frame -
+                                 current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimpleLooped);
 
@@ -304,6 +338,8 @@ class DecodableAmNnetSimpleLooped: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -319,6 +355,10 @@ class DecodableAmNnetSimpleLooped: public DecodableInterface {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetSimpleLooped);
   DecodableNnetSimpleLooped decodable_nnet_;
   const TransitionModel &trans_model_;
+  // row_ is the log-likelihoods of frame row_frame_, indexed by
+  // transition-id minus one; it is used by LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
 };
 
 
@@ -32,7 +32,9 @@ DecodableNnetSimple::DecodableNnetSimple(
     CachingOptimizingCompiler *compiler,
     const VectorBase<BaseFloat> *ivector,
     const MatrixBase<BaseFloat> *online_ivectors,
-    int32 online_ivector_period):
+    int32 online_ivector_period,
+    NnetComputeArena *arena,
+    ThreadTeam *team):
     opts_(opts),
     nnet_(nnet),
     output_dim_(nnet_.OutputDim("output")),
@@ -41,6 +43,8 @@ DecodableNnetSimple::DecodableNnetSimple(
     ivector_(ivector), online_ivector_feats_(online_ivectors),
     online_ivector_period_(online_ivector_period),
     compiler_(*compiler),
+    arena_(arena != NULL ? arena : &own_arena_),
+    team_(NULL), own_team_(NULL),
     current_log_post_subsampled_offset_(0) {
   num_subsampled_frames_ =
       (feats_.NumRows() + opts_.frame_subsampling_factor - 1) /
@@ -52,6 +56,11 @@ DecodableNnetSimple::DecodableNnetSimple(
                  "You need to set the --online-ivector-period option!"));
   log_priors_.ApplyLog();
   CheckAndFixConfigs();
+  if (opts_.compute_config.num_threads > 1) {
+    if (team == NULL)
+      team = own_team_ = new ThreadTeam(opts_.compute_config.num_threads);
+    team_ = team;
+  }
 }
 
 
@@ -63,13 +72,15 @@ DecodableAmNnetSimple::DecodableAmNnetSimple(
     const VectorBase<BaseFloat> *ivector,
     const MatrixBase<BaseFloat> *online_ivectors,
     int32 online_ivector_period,
-    CachingOptimizingCompiler *compiler):
+    CachingOptimizingCompiler *compiler,
+    NnetComputeArena *arena,
+    ThreadTeam *team):
     compiler_(am_nnet.GetNnet(), opts.optimize_config, opts.compiler_config),
     decodable_nnet_(opts, am_nnet.GetNnet(), am_nnet.Priors(),
                     feats, compiler != NULL ? compiler : &compiler_,
                     ivector, online_ivectors,
-                    online_ivector_period),
-    trans_model_(trans_model) {
+                    online_ivector_period, arena, team),
+    trans_model_(trans_model), row_frame_(-1) {
   // note: we only use compiler_ if the passed-in 'compiler' is NULL.
 }
 
@@ -81,6 +92,16 @@ BaseFloat DecodableAmNnetSimple::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimple::LogLikelihoodRow(int32 frame) {
+  if (frame != row_frame_) {
+    row_.Resize(trans_model_.NumTransitionIds(), kUndefined);
+    trans_model_.MapPdfsToTransitionIds(decodable_nnet_.GetOutputRow(frame),
+                                        1.0, &row_);
+    row_frame_ = frame;
+  }
+  return row_.Data();
+}
+
 int32 DecodableNnetSimple::GetIvectorDim() const {
   if (ivector_ != NULL)
     return ivector_->Dim();
@@ -125,16 +146,10 @@ void DecodableNnetSimple::EnsureFrameIsComputed(int32 subsampled_frame) {
   int32 first_output_frame = start_subsampled_frame * subsampling_factor,
       last_output_frame = last_subsampled_frame * subsampling_factor;
 
-  KALDI_ASSERT(opts_.extra_left_context >= 0 && opts_.extra_right_context >= 0);
-  int32 extra_left_context = opts_.extra_left_context,
-      extra_right_context = opts_.extra_right_context;
-  if (first_output_frame == 0 && opts_.extra_left_context_initial >= 0)
-    extra_left_context = opts_.extra_left_context_initial;
-  if (last_subsampled_frame == num_subsampled_frames_ - 1 &&
-      opts_.extra_right_context_final >= 0)
-    extra_right_context = opts_.extra_right_context_final;
-  int32 left_context = nnet_left_context_ + extra_left_context,
-      right_context = nnet_right_context_ + extra_right_context;
+  int32 left_context, right_context;
+  GetChunkContext(first_output_frame == 0,
+                  last_subsampled_frame == num_subsampled_frames_ - 1,
+                  &left_context, &right_context);
   int32 first_input_frame = first_output_frame - left_context,
       last_input_frame = last_output_frame + right_context,
       num_input_frames = last_input_frame + 1 - first_input_frame;
@@ -219,39 +234,15 @@ void DecodableNnetSimple::DoNnetComputation(
     int32 output_t_start,
     int32 num_subsampled_frames) {
   ComputationRequest request;
-  request.need_model_derivative = false;
-  request.store_component_stats = false;
-
-  bool shift_time = true; // shift the 'input' and 'output' to a consistent
-  // time, to take advantage of caching in the compiler.
-  // An optimization.
-  int32 time_offset = (shift_time ? -output_t_start : 0);
-
-  // First add the regular features-- named "input".
-  request.inputs.reserve(2);
-  request.inputs.push_back(
-      IoSpecification("input", time_offset + input_t_start,
-                      time_offset + input_t_start + input_feats.NumRows()));
-  if (ivector.Dim() != 0) {
-    std::vector<Index> indexes;
-    indexes.push_back(Index(0, 0, 0));
-    request.inputs.push_back(IoSpecification("ivector", indexes));
-  }
-  IoSpecification output_spec;
-  output_spec.name = "output";
-  output_spec.has_deriv = false;
+  GetComputationRequest(input_t_start, input_feats.NumRows(),
+                        ivector.Dim() != 0, output_t_start,
+                        num_subsampled_frames, &request);
   int32 subsample = opts_.frame_subsampling_factor;
-  output_spec.indexes.resize(num_subsampled_frames);
-  // leave n and x values at 0 (the constructor sets these).
-  for (int32 i = 0; i < num_subsampled_frames; i++)
-    output_spec.indexes[i].t = time_offset + output_t_start + i * subsample;
-  request.outputs.resize(1);
-  request.outputs[0].Swap(&output_spec);
 
   std::shared_ptr<const NnetComputation> computation = compiler_.Compile(request);
   Nnet *nnet_to_update = NULL;  // we're not doing any update.
   NnetComputer computer(opts_.compute_config, *computation,
-                        nnet_, nnet_to_update);
+                        nnet_, nnet_to_update, arena_, team_);
 
   CuMatrix<BaseFloat> input_feats_cu(input_feats);
   computer.AcceptInput("input", &input_feats_cu);
@@ -275,6 +266,102 @@ void DecodableNnetSimple::DoNnetComputation(
   current_log_post_subsampled_offset_ = output_t_start / subsample;
 }
 
+void DecodableNnetSimple::GetChunkContext(bool is_first_chunk,
+                                          bool is_last_chunk,
+                                          int32 *left_context,
+                                          int32 *right_context) const {
+  KALDI_ASSERT(opts_.extra_left_context >= 0 && opts_.extra_right_context >= 0);
+  int32 extra_left_context = opts_.extra_left_context,
+      extra_right_context = opts_.extra_right_context;
+  if (is_first_chunk && opts_.extra_left_context_initial >= 0)
+    extra_left_context = opts_.extra_left_context_initial;
+  if (is_last_chunk && opts_.extra_right_context_final >= 0)
+    extra_right_context = opts_.extra_right_context_final;
+  *left_context = nnet_left_context_ + extra_left_context;
+  *right_context = nnet_right_context_ + extra_right_context;
+}
+
+void DecodableNnetSimple::GetComputationRequest(
+    int32 input_t_start,
+    int32 num_input_frames,
+    bool has_ivector,
+    int32 output_t_start,
+    int32 num_subsampled_frames,
+    ComputationRequest *request) const {
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+
+  bool shift_time = true; // shift the 'input' and 'output' to a consistent
+  // time, to take advantage of caching in the compiler.
+  // An optimization.
+  int32 time_offset = (shift_time ? -output_t_start : 0);
+
+  // First add the regular features-- named "input".
+  request->inputs.clear();
+  request->inputs.reserve(2);
+  request->inputs.push_back(
+      IoSpecification("input", time_offset + input_t_start,
+                      time_offset + input_t_start + num_input_frames));
+  if (has_ivector) {
+    std::vector<Index> indexes;
+    indexes.push_back(Index(0, 0, 0));
+    request->inputs.push_back(IoSpecification("ivector", indexes));
+  }
+  IoSpecification output_spec;
+  output_spec.name = "output";
+  output_spec.has_deriv = false;
+  int32 subsample = opts_.frame_subsampling_factor;
+  output_spec.indexes.resize(num_subsampled_frames);
+  // leave n and x values at 0 (the constructor sets these).
+  for (int32 i = 0; i < num_subsampled_frames; i++)
+    output_spec.indexes[i].t = time_offset + output_t_start + i * subsample;
+  request->outputs.resize(1);
+  request->outputs[0].Swap(&output_spec);
+}
+
+void DecodableNnetSimple::CompileAllComputations() {
+  int32 subsampling_factor = opts_.frame_subsampling_factor,
+      subsampled_frames_per_chunk = opts_.frames_per_chunk / subsampling_factor;
+  bool has_ivector = (GetIvectorDim() > 0);
+  // The first and middle chunks of an utterance are always of the full size;
+  // the last chunk (which may also be the first) may be smaller.
+  for (int32 first = 0; first < 2; first++) {
+    for (int32 last = 0; last < 2; last++) {
+      int32 min_num_frames = (last ? 1 : subsampled_frames_per_chunk);
+      for (int32 num_subsampled_frames = min_num_frames;
+           num_subsampled_frames <= subsampled_frames_per_chunk;
+           num_subsampled_frames++) {
+        int32 left_context, right_context;
+        GetChunkContext(first != 0, last != 0, &left_context, &right_context);
+        int32 last_output_frame = (num_subsampled_frames - 1) *
+            subsampling_factor,
+            num_input_frames = left_context + last_output_frame + 1 +
+            right_context;
+        ComputationRequest request;
+        GetComputationRequest(-left_context, num_input_frames, has_ivector,
+                              0, num_subsampled_frames, &request);
+        compiler_.Compile(request);
+      }
+    }
+  }
+}
+
+bool ReadComputationCache(const NnetSimpleComputationOptions &opts,
+                          const Nnet &nnet,
+                          CachingOptimizingCompiler *compiler) {
+  if (opts.computation_cache.empty())
+    return false;
+  bool binary;
+  Input ki(opts.computation_cache, &binary);
+  if (!ReadComputationCacheHeader(nnet, false, ki.Stream(), binary))
+    return false;
+  if (!compiler->ReadCache(ki.Stream(), binary))
+    return false;
+  KALDI_LOG << "Read precompiled computations from "
+            << opts.computation_cache;
+  return true;
+}
+
 void DecodableNnetSimple::CheckAndFixConfigs() {
   static bool warned_frames_per_chunk = false;
   int32 nnet_modulus = nnet_.Modulus();
@@ -317,13 +404,15 @@ DecodableAmNnetSimpleParallel::DecodableAmNnetSimpleParallel(
     const MatrixBase<BaseFloat> &feats,
     const VectorBase<BaseFloat> *ivector,
     const MatrixBase<BaseFloat> *online_ivectors,
-    int32 online_ivector_period):
+    int32 online_ivector_period,
+    CachingOptimizingCompiler *compiler):
     compiler_(am_nnet.GetNnet(), opts.optimize_config, opts.compiler_config),
     trans_model_(trans_model),
     feats_copy_(NULL),
     ivector_copy_(NULL),
     online_ivectors_copy_(NULL),
-    decodable_nnet_(NULL) {
+    decodable_nnet_(NULL),
+    row_frame_(-1) {
   try {
     feats_copy_ = new Matrix<BaseFloat>(feats);
     if (ivector != NULL)
@@ -332,7 +421,8 @@ DecodableAmNnetSimpleParallel::DecodableAmNnetSimpleParallel(
       online_ivectors_copy_ = new Matrix<BaseFloat>(*online_ivectors);
     decodable_nnet_ = new DecodableNnetSimple(opts, am_nnet.GetNnet(),
                                               am_nnet.Priors(), *feats_copy_,
-                                              &compiler_, ivector_copy_,
+                                              (compiler != NULL ? compiler :
+                                               &compiler_), ivector_copy_,
                                               online_ivectors_copy_,
                                               online_ivector_period);
 
@@ -361,6 +451,16 @@ BaseFloat DecodableAmNnetSimpleParallel::LogLikelihood(int32 frame,
   return decodable_nnet_->GetOutput(frame, pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimpleParallel::LogLikelihoodRow(int32 frame) {
+  if (frame != row_frame_) {
+    row_.Resize(trans_model_.NumTransitionIds(), kUndefined);
+    trans_model_.MapPdfsToTransitionIds(decodable_nnet_->GetOutputRow(frame),
+                                        1.0, &row_);
+    row_frame_ = frame;
+  }
+  return row_.Data();
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -49,6 +49,7 @@ struct NnetSimpleComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  std::string computation_cache;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   CachingOptimizingCompilerOptions compiler_config;
@@ -94,6 +95,12 @@ struct NnetSimpleComputationOptions {
                    "input frames");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("computation-cache", &computation_cache, "If set, "
+                   "rxfilename of computations precompiled for this model by "
+                   "nnet3-compile-cache, to save compilation time at startup.  "
+                   "They are ignored (with a warning) if they were compiled "
+                   "for a different model or optimization options, and only "
+                   "used for chunks whose sizes match.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -105,6 +112,16 @@ struct NnetSimpleComputationOptions {
   }
 };
 
+/// If opts.computation_cache is set, reads the precompiled computations from
+/// it into 'compiler', which should have been initialized with 'nnet' and
+/// opts.optimize_config; see nnet3-compile-cache.  Programs that keep a
+/// compiler across utterances should call this after creating it.  Returns
+/// true if the computations were read, and false if opts.computation_cache is
+/// not set or the computations are not for 'nnet'.
+bool ReadComputationCache(const NnetSimpleComputationOptions &opts,
+                          const Nnet &nnet,
+                          CachingOptimizingCompiler *compiler);
+
 /*
   This class handles the neural net computation; it's mostly accessed
   via other wrapper classes.
@@ -144,6 +161,18 @@ class DecodableNnetSimple {
      @param [in] online_ivector_period If you are using iVectors estimated 'online'
                         (i.e. if online_ivectors != NULL) gives the periodicity
                         (in frames) with which the iVectors are estimated.
+     @param [in,out] arena  Optional memory arena for the computations (see
+                        class NnetComputeArena); like 'compiler', it may be
+                        kept in the calling code and shared by consecutive
+                        decodes (in the same thread).  If NULL, this object
+                        uses its own arena, which is shared by its chunks.
+     @param [in] team   Optional team of threads with which the computations
+                        execute commands in parallel if
+                        opts.compute_config.num_threads > 1; like 'arena', it
+                        may be kept in the calling code and shared by
+                        consecutive decodes (in the same thread).  If NULL and
+                        opts.compute_config.num_threads > 1, this object
+                        creates its own team, which is shared by its chunks.
   */
   DecodableNnetSimple(const NnetSimpleComputationOptions &opts,
                       const Nnet &nnet,
@@ -152,7 +181,9 @@ class DecodableNnetSimple {
                       CachingOptimizingCompiler *compiler,
                       const VectorBase<BaseFloat> *ivector = NULL,
                       const MatrixBase<BaseFloat> *online_ivectors = NULL,
-                      int32 online_ivector_period = 1);
+                      int32 online_ivector_period = 1,
+                      NnetComputeArena *arena = NULL,
+                      ThreadTeam *team = NULL);
 
 
   // returns the number of frames of likelihoods.  The same as feats_.NumRows()
@@ -166,6 +197,12 @@ class DecodableNnetSimple {
   // 'output' must be correctly sized (with dimension OutputDim()).
   void GetOutputForFrame(int32 frame, VectorBase<BaseFloat> *output);
 
+  // Compiles all the computations this class could need for utterances of any
+  // length (with its options and iVector setup), so that they are in the
+  // compiler's cache.  This is used by nnet3-compile-cache, which writes them
+  // to disk; the features given to the constructor are not used.
+  void CompileAllComputations();
+
   // Gets the output for a particular frame and pdf_id, with
   // 0 <= subsampled_frame < NumFrames(),
   // and 0 <= pdf_id < OutputDim().
@@ -178,6 +215,20 @@ class DecodableNnetSimple {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns the output for a particular frame, with 0 <= frame < NumFrames(),
+  // as a reference to internal data; it is only valid until the next call to
+  // a non-const function of this object.
+  inline SubVector<BaseFloat> GetOutputRow(int32 subsampled_frame) {
+    if (subsampled_frame < current_log_post_subsampled_offset_ ||
+        subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      EnsureFrameIsComputed(subsampled_frame);
+    return current_log_post_.Row(subsampled_frame -
+                                 current_log_post_subsampled_offset_);
+  }
+
+  ~DecodableNnetSimple() { delete own_team_; }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimple);
 
@@ -185,6 +236,22 @@ class DecodableNnetSimple {
   // cached in current_log_post_.
   void EnsureFrameIsComputed(int32 subsampled_frame);
 
+  // Outputs the left and right context (including the extra context from the
+  // options) for a chunk, depending on whether it is the first and/or the
+  // last chunk of the utterance.
+  void GetChunkContext(bool is_first_chunk, bool is_last_chunk,
+                       int32 *left_context, int32 *right_context) const;
+
+  // Creates the computation request for a chunk; the 't' values are shifted so
+  // that the first output frame is at t = 0, which lets the compiler reuse
+  // computations.  The arguments are as for DoNnetComputation().
+  void GetComputationRequest(int32 input_t_start,
+                             int32 num_input_frames,
+                             bool has_ivector,
+                             int32 output_t_start,
+                             int32 num_subsampled_frames,
+                             ComputationRequest *request) const;
+
   // This function does the actual nnet computation; it is called from
   // EnsureFrameIsComputed.  Any padding at file start/end is done by
   // the caller of this function (so the input should exceed the output
@@ -237,6 +304,17 @@ class DecodableNnetSimple {
   // computations each time.
   CachingOptimizingCompiler &compiler_;
 
+  // The arena given to the constructor, or &own_arena_.
+  NnetComputeArena *arena_;
+  NnetComputeArena own_arena_;
+
+  // If opts_.compute_config.num_threads > 1, the threads with which the
+  // computations of all chunks execute commands in parallel (the team given
+  // to the constructor, or own_team_); else NULL.
+  ThreadTeam *team_;
+  // The team that we created ourselves, if any.
+  ThreadTeam *own_team_;
+
   // The current log-posteriors that we got from the last time we
   // ran the computation.
   Matrix<BaseFloat> current_log_post_;
@@ -280,7 +358,16 @@ class DecodableAmNnetSimple: public DecodableInterface {
                         supply pointers to it, which allows for caching of computations
                         across consecutive decodes.  You'd want to have initialized
                         the compiler object with as
-                        compiler(am_nnet.GetNnet(), opts.optimize_config).
+                        compiler(am_nnet.GetNnet(), opts.optimize_config),
+                        and called ReadComputationCache() on it once.  If
+                        NULL, this object uses its own compiler, which does not
+                        read opts.computation_cache.
+     @param [in,out] arena  A pointer to a memory arena [optional], which
+                        like 'compiler' can be shared by consecutive decodes;
+                        see class NnetComputeArena.
+     @param [in] team   A pointer to a team of threads [optional], which like
+                        'arena' can be shared by consecutive decodes; it is
+                        only used if opts.compute_config.num_threads > 1.
   */
   DecodableAmNnetSimple(const NnetSimpleComputationOptions &opts,
                         const TransitionModel &trans_model,
@@ -289,11 +376,15 @@ class DecodableAmNnetSimple: public DecodableInterface {
                         const VectorBase<BaseFloat> *ivector = NULL,
                         const MatrixBase<BaseFloat> *online_ivectors = NULL,
                         int32 online_ivector_period = 1,
-                        CachingOptimizingCompiler *compiler = NULL);
+                        CachingOptimizingCompiler *compiler = NULL,
+                        NnetComputeArena *arena = NULL,
+                        ThreadTeam *team = NULL);
 
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -312,6 +403,10 @@ class DecodableAmNnetSimple: public DecodableInterface {
   CachingOptimizingCompiler compiler_;
   DecodableNnetSimple decodable_nnet_;
   const TransitionModel &trans_model_;
+  // row_ is the log-likelihoods of frame row_frame_, indexed by
+  // transition-id minus one; it is used by LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
 };
 
 
@@ -323,11 +418,9 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
         (1) It doesn't keep around pointers to the features and iVectors;
             instead, it creates copies of them (so the caller can
             delete the originals).
-        (2) It doesn't support the user passing in a pointer to the
-            CachingOptimizingCompiler-- because making that thread safe
-            would be quite complicated, and in any case multi-threaded
-            decoding probably makes the most sense when using CPU, and
-            in that case we don't expect the compilation phase to dominate.
+        (2) The compiler passed in (if any) will be used from several
+            threads at once; this is OK since
+            CachingOptimizingCompiler::Compile() is thread-safe.
 
      This constructor takes features as input, and you can either supply a
      single iVector input, estimated in batch-mode ('ivector'), or 'online'
@@ -352,6 +445,11 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
      @param [in] online_ivector_period If you are using iVectors estimated 'online'
                         (i.e. if online_ivectors != NULL) gives the periodicity
                         (in frames) with which the iVectors are estimated.
+     @param [in,out] compiler  A pointer to a compiler [optional], which may be
+                        shared by all the decodable objects of the program, as
+                        for DecodableAmNnetSimple.  If NULL, this object uses
+                        its own compiler, which does not read
+                        opts.computation_cache.
   */
   DecodableAmNnetSimpleParallel(
       const NnetSimpleComputationOptions &opts,
@@ -360,11 +458,14 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
       const MatrixBase<BaseFloat> &feats,
       const VectorBase<BaseFloat> *ivector = NULL,
       const MatrixBase<BaseFloat> *online_ivectors = NULL,
-      int32 online_ivector_period = 1);
+      int32 online_ivector_period = 1,
+      CachingOptimizingCompiler *compiler = NULL);
 
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_->NumFrames();
   }
@@ -381,6 +482,8 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetSimpleParallel);
   void DeletePointers();
 
+  // This compiler object is only used if the 'compiler'
+  // argument to the constructor is NULL.
   CachingOptimizingCompiler compiler_;
   const TransitionModel &trans_model_;
 
@@ -389,6 +492,10 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
   Matrix<BaseFloat> *online_ivectors_copy_;
 
   DecodableNnetSimple *decodable_nnet_;
+  // row_ is the log-likelihoods of frame row_frame_, indexed by
+  // transition-id minus one; it is used by LogLikelihoodRow().
+  int32 row_frame_;
+  Vector<BaseFloat> row_;
 };
 
 
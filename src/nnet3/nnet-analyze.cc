@@ -281,8 +281,18 @@ static void IndexesMultiToSubmatrixIndexes(
 
 
 
-void ComputeCommandAttributes(
-    const Nnet &nnet,
+// Returns the properties of component 'c' of 'nnet'.  If nnet == NULL,
+// returns the properties that give the most conservative analysis.
+static int32 ComponentProperties(const Nnet *nnet, int32 c) {
+  if (nnet == NULL)
+    return kPropagateAdds | kBackpropAdds | kUpdatableComponent;
+  return nnet->GetComponent(c)->Properties();
+}
+
+// This is ComputeCommandAttributes(), except that 'nnet' may be NULL; see
+// ComponentProperties().
+static void ComputeCommandAttributesInternal(
+    const Nnet *nnet,
     const NnetComputation &computation,
     const ComputationVariables &vars,
     std::vector<CommandAttributes> *attributes) {
@@ -302,7 +312,9 @@ void ComputeCommandAttributes(
         break;
       case kPropagate:
         vars.RecordAccessForSubmatrix(c.arg3, kReadAccess, &attr);
-        if (nnet.GetComponent(c.arg1)->Properties() & kPropagateAdds)
+        // note: a fused component (c.arg7 >= 0) only modifies the output
+        // in-place, so it doesn't change the accesses.
+        if (ComponentProperties(nnet, c.arg1) & kPropagateAdds)
           vars.RecordAccessForSubmatrix(c.arg4, kReadWriteAccess, &attr);
         else
           vars.RecordAccessForSubmatrix(c.arg4, kWriteAccess, &attr);
@@ -312,12 +324,12 @@ void ComputeCommandAttributes(
         vars.RecordAccessForSubmatrix(c.arg3, kReadAccess, &attr);
         vars.RecordAccessForSubmatrix(c.arg4, kReadAccess, &attr);
         vars.RecordAccessForSubmatrix(c.arg5, kReadAccess, &attr);
-        if (nnet.GetComponent(c.arg1)->Properties() & kBackpropAdds)
+        if (ComponentProperties(nnet, c.arg1) & kBackpropAdds)
           vars.RecordAccessForSubmatrix(c.arg6, kReadWriteAccess, &attr);
         else
           vars.RecordAccessForSubmatrix(c.arg6, kWriteAccess, &attr);
         if (c.command_type == kBackprop &&
-            nnet.GetComponent(c.arg1)->Properties() & kUpdatableComponent)
+            ComponentProperties(nnet, c.arg1) & kUpdatableComponent)
           attr.has_side_effects = true;
         break;
       case kMatrixCopy:
@@ -418,6 +430,14 @@ void ComputeCommandAttributes(
   }
 }
 
+void ComputeCommandAttributes(
+    const Nnet &nnet,
+    const NnetComputation &computation,
+    const ComputationVariables &vars,
+    std::vector<CommandAttributes> *attributes) {
+  ComputeCommandAttributesInternal(&nnet, computation, vars, attributes);
+}
+
 void ComputeVariableAccesses(
     const ComputationVariables &variables,
     const std::vector<CommandAttributes> &command_attributes,
@@ -464,8 +484,8 @@ void ComputeVariableAccesses(
   }
 }
 
-void ComputeMatrixAccesses(
-    const Nnet &nnet,
+// This is ComputeMatrixAccesses(), which does not actually need the nnet.
+static void ComputeMatrixAccessesInternal(
     const NnetComputation &computation,
     const ComputationVariables &variables,
     const std::vector<CommandAttributes> &command_attributes,
@@ -567,6 +587,16 @@ void ComputeMatrixAccesses(
   }
 }
 
+void ComputeMatrixAccesses(
+    const Nnet &nnet,
+    const NnetComputation &computation,
+    const ComputationVariables &variables,
+    const std::vector<CommandAttributes> &command_attributes,
+    std::vector<MatrixAccesses> *matrix_accesses) {
+  ComputeMatrixAccessesInternal(computation, variables, command_attributes,
+                                matrix_accesses);
+}
+
 
 ComputationChecker::ComputationChecker(
     const CheckComputationOptions &config,
@@ -857,6 +887,21 @@ void ComputationChecker::CheckComputationIndexes() const {
           memo_to_command[c.arg5] = command_index;
         }
         KALDI_ASSERT(c.arg6 == 0 || c.arg6 == 1);
+        if (c.arg7 >= 0) {
+          if (c.arg7 >= nnet_.NumComponents())
+            KALDI_ERR << "Fused component index out of range";
+          const Component *fused_component = nnet_.GetComponent(c.arg7);
+          int32 fused_properties = fused_component->Properties();
+          if (!(fused_properties & kSimpleComponent) ||
+              !(fused_properties & kPropagateInPlace) ||
+              fused_component->InputDim() != component->OutputDim() ||
+              fused_component->OutputDim() != component->OutputDim())
+            KALDI_ERR << "Invalid fused component "
+                      << nnet_.GetComponentName(c.arg7);
+          if (c.arg5 != 0 || c.arg6 != 0)
+            KALDI_ERR << "Fused propagate commands may not have memos or "
+                      << "store stats.";
+        }
         break;
       }
       case kBackprop:
@@ -1495,5 +1540,154 @@ int64 GetMaxMemoryUse(const NnetComputation &computation) {
   return max_memory_use;
 }
 
+
+void ComputeCommandDependencies(
+    const NnetComputation &computation,
+    const Analyzer &analyzer,
+    std::vector<std::vector<int32> > *dependencies) {
+  int32 num_commands = computation.commands.size();
+  KALDI_ASSERT(analyzer.command_attributes.size() ==
+               static_cast<size_t>(num_commands));
+  dependencies->clear();
+  dependencies->resize(num_commands);
+
+  // Dependencies via variables: a read depends on the last write, and a write
+  // (or read-write) on the last write and on the reads since then.
+  int32 num_variables = analyzer.variable_accesses.size();
+  for (int32 v = 0; v < num_variables; v++) {
+    const std::vector<Access> &accesses = analyzer.variable_accesses[v];
+    int32 last_write = -1;
+    std::vector<int32> reads_since_write;
+    for (size_t i = 0; i < accesses.size(); i++) {
+      int32 c = accesses[i].command_index;
+      std::vector<int32> &deps = (*dependencies)[c];
+      if (last_write >= 0)
+        deps.push_back(last_write);
+      if (accesses[i].access_type == kReadAccess) {
+        reads_since_write.push_back(c);
+      } else {
+        deps.insert(deps.end(), reads_since_write.begin(),
+                    reads_since_write.end());
+        reads_since_write.clear();
+        last_write = c;
+      }
+    }
+  }
+
+  // Allocation and deallocation, which the variable accesses don't include.
+  // (For inputs, the allocation command is the first kAcceptInput command,
+  // which is also an access.)
+  int32 num_matrices = analyzer.matrix_accesses.size();
+  for (int32 m = 1; m < num_matrices; m++) {
+    const MatrixAccesses &accesses = analyzer.matrix_accesses[m];
+    int32 alloc = accesses.allocate_command,
+        dealloc = accesses.deallocate_command;
+    for (size_t i = 0; i < accesses.accesses.size(); i++) {
+      int32 c = accesses.accesses[i].command_index;
+      if (alloc >= 0 && alloc < c)
+        (*dependencies)[c].push_back(alloc);
+      if (dealloc > c)
+        (*dependencies)[dealloc].push_back(c);
+    }
+    if (alloc >= 0 && dealloc > alloc)
+      (*dependencies)[dealloc].push_back(alloc);
+  }
+
+  // Matrices that share memory in the memory plan.
+  if (computation.matrix_arena_offsets.size() == computation.matrices.size()) {
+    // pairs (offset, matrix-index), sorted by offset.
+    std::vector<std::pair<int64, int32> > arena_matrices;
+    for (int32 m = 1; m < num_matrices; m++)
+      if (computation.matrix_arena_offsets[m] >= 0)
+        arena_matrices.push_back(std::pair<int64, int32>(
+            computation.matrix_arena_offsets[m], m));
+    std::sort(arena_matrices.begin(), arena_matrices.end());
+    size_t num_arena_matrices = arena_matrices.size();
+    for (size_t i = 0; i < num_arena_matrices; i++) {
+      int32 m1 = arena_matrices[i].second;
+      int64 end = arena_matrices[i].first +
+          static_cast<int64>(computation.matrices[m1].num_rows) *
+          computation.ArenaStride(m1);
+      const MatrixAccesses &accesses1 = analyzer.matrix_accesses[m1];
+      for (size_t j = i + 1; j < num_arena_matrices &&
+               arena_matrices[j].first < end; j++) {
+        int32 m2 = arena_matrices[j].second;
+        const MatrixAccesses &accesses2 = analyzer.matrix_accesses[m2];
+        if (accesses1.allocate_command < 0 || accesses2.allocate_command < 0)
+          continue;
+        if (accesses1.deallocate_command >= 0 &&
+            accesses1.deallocate_command < accesses2.allocate_command)
+          (*dependencies)[accesses2.allocate_command].push_back(
+              accesses1.deallocate_command);
+        else if (accesses2.deallocate_command >= 0 &&
+                 accesses2.deallocate_command < accesses1.allocate_command)
+          (*dependencies)[accesses1.allocate_command].push_back(
+              accesses2.deallocate_command);
+      }
+    }
+  }
+
+  // Propagate commands on the same component, and barriers.
+  std::vector<int32> last_propagate;  // indexed by component.
+  std::vector<int32> since_barrier;
+  int32 last_barrier = -1;
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = computation.commands[c];
+    std::vector<int32> &deps = (*dependencies)[c];
+    bool is_barrier = analyzer.command_attributes[c].has_side_effects;
+    switch (command.command_type) {
+      case kPropagate:
+        for (int32 i = 0; i < 2; i++) {
+          int32 component = (i == 0 ? command.arg1 : command.arg7);
+          if (component < 0)
+            continue;
+          if (static_cast<size_t>(component) >= last_propagate.size())
+            last_propagate.resize(component + 1, -1);
+          if (last_propagate[component] >= 0)
+            deps.push_back(last_propagate[component]);
+          last_propagate[component] = c;
+        }
+        break;
+      case kAcceptInput: case kProvideOutput: case kNoOperationMarker:
+      case kNoOperationLabel: case kGotoLabel:
+      case kCompressMatrix: case kDecompressMatrix:
+        is_barrier = true;
+        break;
+      default:
+        break;
+    }
+    if (last_barrier >= 0)
+      deps.push_back(last_barrier);
+    if (is_barrier) {
+      deps.insert(deps.end(), since_barrier.begin(), since_barrier.end());
+      since_barrier.clear();
+      last_barrier = c;
+    } else {
+      since_barrier.push_back(c);
+    }
+  }
+
+  for (int32 c = 0; c < num_commands; c++) {
+    std::vector<int32> &deps = (*dependencies)[c];
+    SortAndUniq(&deps);
+    KALDI_ASSERT(deps.empty() || deps.back() < c);
+  }
+}
+
+void ComputeCommandDependencies(
+    const NnetComputation &computation,
+    std::vector<std::vector<int32> > *dependencies) {
+  Analyzer analyzer;
+  analyzer.variables.Init(computation);
+  ComputeCommandAttributesInternal(NULL, computation, analyzer.variables,
+                                   &analyzer.command_attributes);
+  ComputeVariableAccesses(analyzer.variables, analyzer.command_attributes,
+                          &analyzer.variable_accesses);
+  ComputeMatrixAccessesInternal(computation, analyzer.variables,
+                                analyzer.command_attributes,
+                                &analyzer.matrix_accesses);
+  ComputeCommandDependencies(computation, analyzer, dependencies);
+}
+
 } // namespace nnet3
 } // namespace kaldi
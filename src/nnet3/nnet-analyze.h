@@ -460,6 +460,49 @@ void CheckComputation(const Nnet &nnet,
 int64 GetMaxMemoryUse(const NnetComputation &computation);
 
 
+/**
+   This function works out, for each command in the computation, which earlier
+   commands must have finished before it can be executed; the result is
+   stored in NnetComputation::command_dependencies, which class NnetComputer
+   uses to execute independent commands in parallel (see
+   NnetComputeOptions::num_threads).  A command depends on the last earlier
+   command that writes any variable it reads, and, if it writes a variable, on
+   all earlier commands that access that variable since the last write.
+   Allocation and deallocation of a matrix are treated like writes to all of
+   it; and if the computation has a memory plan (see
+   NnetComputation::matrix_arena_offsets), the allocation of a matrix also
+   depends on the deallocation of earlier matrices that used the same memory.
+   kPropagate commands that use the same component (which may have internal
+   state such as a random generator) are executed in order.  Input and output
+   commands, commands with side effects, goto, label and compression commands
+   act as barriers: they depend on all earlier commands, and all later
+   commands depend on them.
+
+     @param [in] computation  The computation.  Matrices must be allocated
+                        and deallocated at most once (i.e. it must not be
+                        a looped computation).
+     @param [in] analyzer  The analyzer, on which Init() must have been called
+                        with this computation.
+     @param [out] dependencies  Indexed by command index c, a sorted list of
+                        the indexes c' < c of the commands that must be
+                        finished before command c starts.  Dependencies that
+                        are implied by others are not necessarily
+                        omitted.
+*/
+void ComputeCommandDependencies(
+    const NnetComputation &computation,
+    const Analyzer &analyzer,
+    std::vector<std::vector<int32> > *dependencies);
+
+/// This version of ComputeCommandDependencies() does not need the nnet: not
+/// knowing the properties of the components, it treats every kBackprop
+/// command as having side effects (the other properties do not affect the
+/// dependencies).  It is called by NnetComputation::ComputeCudaIndexes().
+void ComputeCommandDependencies(
+    const NnetComputation &computation,
+    std::vector<std::vector<int32> > *dependencies);
+
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -0,0 +1,141 @@
+// nnet3/nnet-batch-compute-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Checks that NnetBatchComputer gives the same output as DecodableNnetSimple,
+// for a number of utterances of different lengths that are decoded at the
+// same time.
+void TestNnetBatchComputer(Nnet *nnet) {
+  int32 input_dim = nnet->InputDim("input"),
+      output_dim = nnet->OutputDim("output"),
+      ivector_dim = std::max<int32>(0, nnet->InputDim("ivector"));
+
+  SetBatchnormTestMode(true, nnet);
+  SetDropoutTestMode(true, nnet);
+
+  Vector<BaseFloat> priors(RandInt(0, 1) == 0 ? output_dim : 0);
+  if (priors.Dim() != 0) {
+    priors.SetRandn();
+    priors.ApplyExp();
+  }
+
+  NnetBatchComputerOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  opts.minibatch_size = RandInt(1, 4);
+  NnetBatchComputer computer(opts, *nnet, priors);
+
+  int32 num_utts = RandInt(1, 6);
+  std::vector<Matrix<BaseFloat> > inputs(num_utts), outputs(num_utts);
+  std::vector<Vector<BaseFloat> > ivectors(num_utts);
+  std::vector<int32> streams(num_utts);
+  for (int32 u = 0; u < num_utts; u++) {
+    int32 num_frames = 5 + RandInt(1, 100);
+    inputs[u].Resize(num_frames, input_dim);
+    inputs[u].SetRandn();
+    ivectors[u].Resize(ivector_dim);
+    ivectors[u].SetRandn();
+    streams[u] = computer.AddStream(inputs[u],
+                                    (ivector_dim != 0 ? &ivectors[u] : NULL));
+  }
+  KALDI_ASSERT(computer.NumStreams() == num_utts);
+
+  int32 num_finished = 0;
+  while (num_finished < num_utts) {
+    KALDI_ASSERT(computer.ComputeNextChunks() > 0);
+    for (int32 u = 0; u < num_utts; u++) {
+      int32 s = streams[u];
+      if (s < 0)
+        continue;
+      Matrix<BaseFloat> output;
+      computer.GetOutputDestructive(s, &output);
+      if (output.NumRows() != 0) {
+        int32 offset = outputs[u].NumRows();
+        outputs[u].Resize(offset + output.NumRows(), output_dim,
+                          kCopyData);
+        outputs[u].RowRange(offset, output.NumRows()).CopyFromMat(output);
+      }
+      KALDI_ASSERT(outputs[u].NumRows() == computer.NumFramesComputed(s));
+      if (computer.IsFinished(s)) {
+        computer.RemoveStream(s);
+        streams[u] = -1;
+        num_finished++;
+      }
+    }
+  }
+  KALDI_ASSERT(computer.NumStreams() == 0 &&
+               computer.ComputeNextChunks() == 0);
+
+  CachingOptimizingCompiler compiler(*nnet);
+  for (int32 u = 0; u < num_utts; u++) {
+    DecodableNnetSimple decodable(opts, *nnet, priors, inputs[u], &compiler,
+                                  (ivector_dim != 0 ? &ivectors[u] : NULL));
+    KALDI_ASSERT(decodable.NumFrames() == outputs[u].NumRows());
+    for (int32 t = 0; t < decodable.NumFrames(); t++) {
+      Vector<BaseFloat> row(output_dim);
+      decodable.GetOutputForFrame(t, &row);
+      SubVector<BaseFloat> batch_row(outputs[u], t);
+      KALDI_ASSERT(row.ApproxEqual(batch_row));
+    }
+  }
+}
+
+void UnitTestNnetBatchComputer() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      KALDI_LOG << "Input config[" << j << "] is: " << configs[j];
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    // Models with statistics-pooling or recurrence would give different
+    // output for chunks of different sizes, so the equivalence doesn't hold.
+    if (NnetIsRecurrent(nnet) ||
+        nnet.Info().find("statistics-extraction") != std::string::npos)
+      continue;
+    TestNnetBatchComputer(&nnet);
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (kaldi::int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestNnetBatchComputer();
+  }
+  KALDI_LOG << "Nnet batch-compute tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,341 @@
+// nnet3/nnet-batch-compute.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+NnetBatchComputer::NnetBatchComputer(
+    const NnetBatchComputerOptions &opts,
+    const Nnet &nnet,
+    const VectorBase<BaseFloat> &priors):
+    opts_(opts),
+    nnet_(nnet),
+    output_dim_(nnet.OutputDim("output")),
+    log_priors_(priors),
+    compiler_(nnet, opts.optimize_config, opts.compiler_config),
+    num_computations_(0) {
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  compiler_.GetSimpleNnetContext(&nnet_left_context_, &nnet_right_context_);
+  // The precompiled computations are for one chunk, so they are only used
+  // for minibatches of one chunk.
+  ReadComputationCache(opts_, nnet_, &compiler_);
+  log_priors_.ApplyLog();
+  if (opts_.frame_subsampling_factor < 1 ||
+      opts_.frames_per_chunk < 1 || opts_.minibatch_size < 1)
+    KALDI_ERR << "--frame-subsampling-factor, --frames-per-chunk and "
+              << "--minibatch-size must be > 0";
+  int32 nnet_modulus = nnet_.Modulus(),
+      n = Lcm(opts_.frame_subsampling_factor, nnet_modulus);
+  if (opts_.frames_per_chunk % n != 0) {
+    // round up to the nearest multiple of n.
+    int32 frames_per_chunk = n * ((opts_.frames_per_chunk + n - 1) / n);
+    KALDI_LOG << "Increasing --frames-per-chunk from "
+              << opts_.frames_per_chunk << " to " << frames_per_chunk
+              << " due to --frame-subsampling-factor="
+              << opts_.frame_subsampling_factor << " and "
+              << "nnet shift-invariance modulus = " << nnet_modulus;
+    opts_.frames_per_chunk = frames_per_chunk;
+  }
+}
+
+int32 NnetBatchComputer::AddStream(
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period) {
+  KALDI_ASSERT(feats.NumRows() > 0);
+  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
+  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
+                 "You need to set the --online-ivector-period option!"));
+  int32 feature_dim = feats.NumCols(),
+      ivector_dim = (ivector != NULL ? ivector->Dim() :
+                     (online_ivectors != NULL ? online_ivectors->NumCols() : 0)),
+      nnet_input_dim = nnet_.InputDim("input"),
+      nnet_ivector_dim = std::max<int32>(0, nnet_.InputDim("ivector"));
+  if (feature_dim != nnet_input_dim)
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << nnet_input_dim << " but you provided "
+              << feature_dim;
+  if (ivector_dim != nnet_ivector_dim)
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << nnet_ivector_dim << " but you provided " << ivector_dim;
+
+  int32 stream = 0;
+  for (; stream < static_cast<int32>(streams_.size()); stream++)
+    if (!streams_[stream].in_use)
+      break;
+  if (stream == static_cast<int32>(streams_.size()))
+    streams_.resize(stream + 1);
+
+  StreamInfo &info = streams_[stream];
+  info.in_use = true;
+  info.feats = feats;
+  if (ivector != NULL)
+    info.ivector = *ivector;
+  if (online_ivectors != NULL) {
+    info.online_ivectors = *online_ivectors;
+    info.online_ivector_period = online_ivector_period;
+  }
+  info.num_subsampled_frames =
+      (feats.NumRows() + opts_.frame_subsampling_factor - 1) /
+      opts_.frame_subsampling_factor;
+  info.num_subsampled_frames_computed = 0;
+  return stream;
+}
+
+void NnetBatchComputer::RemoveStream(int32 stream) {
+  KALDI_ASSERT(static_cast<size_t>(stream) < streams_.size() &&
+               streams_[stream].in_use);
+  // Assigning a default-constructed StreamInfo frees the memory.
+  streams_[stream] = StreamInfo();
+}
+
+int32 NnetBatchComputer::NumStreams() const {
+  int32 ans = 0;
+  for (size_t i = 0; i < streams_.size(); i++)
+    if (streams_[i].in_use)
+      ans++;
+  return ans;
+}
+
+int32 NnetBatchComputer::NumFrames(int32 stream) const {
+  KALDI_ASSERT(static_cast<size_t>(stream) < streams_.size() &&
+               streams_[stream].in_use);
+  return streams_[stream].num_subsampled_frames;
+}
+
+int32 NnetBatchComputer::NumFramesComputed(int32 stream) const {
+  KALDI_ASSERT(static_cast<size_t>(stream) < streams_.size() &&
+               streams_[stream].in_use);
+  return streams_[stream].num_subsampled_frames_computed;
+}
+
+void NnetBatchComputer::GetOutputDestructive(int32 stream,
+                                             Matrix<BaseFloat> *output) {
+  KALDI_ASSERT(static_cast<size_t>(stream) < streams_.size() &&
+               streams_[stream].in_use);
+  output->Resize(0, 0);
+  output->Swap(&(streams_[stream].output));
+}
+
+void NnetBatchComputer::GetCurrentIvector(const StreamInfo &info,
+                                          int32 output_t_start,
+                                          int32 num_output_frames,
+                                          Vector<BaseFloat> *ivector) {
+  if (info.ivector.Dim() != 0) {
+    *ivector = info.ivector;
+    return;
+  } else if (info.online_ivectors.NumRows() == 0) {
+    ivector->Resize(0);
+    return;
+  }
+  KALDI_ASSERT(info.online_ivector_period > 0);
+  // See the comment in DecodableNnetSimple::GetCurrentIvector() about why we
+  // choose a point near the middle of the chunk.
+  int32 frame_to_search = output_t_start + num_output_frames / 2;
+  int32 ivector_frame = frame_to_search / info.online_ivector_period;
+  KALDI_ASSERT(ivector_frame >= 0);
+  if (ivector_frame >= info.online_ivectors.NumRows()) {
+    int32 margin = ivector_frame - (info.online_ivectors.NumRows() - 1);
+    if (margin * info.online_ivector_period > 50) {
+      // Half a second seems like too long to be explainable as edge effects.
+      KALDI_ERR << "Could not get iVector for frame " << frame_to_search
+                << ", only available till frame "
+                << info.online_ivectors.NumRows()
+                << " * ivector-period=" << info.online_ivector_period
+                << " (mismatched --ivector-period?)";
+    }
+    ivector_frame = info.online_ivectors.NumRows() - 1;
+  }
+  *ivector = info.online_ivectors.Row(ivector_frame);
+}
+
+void NnetBatchComputer::GetNextChunk(int32 stream, ChunkInfo *chunk) {
+  const StreamInfo &info = streams_[stream];
+  KALDI_ASSERT(info.in_use &&
+               info.num_subsampled_frames_computed < info.num_subsampled_frames);
+  int32 subsampling_factor = opts_.frame_subsampling_factor,
+      subsampled_frames_per_chunk = opts_.frames_per_chunk / subsampling_factor,
+      start_subsampled_frame = info.num_subsampled_frames_computed,
+      num_subsampled_frames = std::min<int32>(info.num_subsampled_frames -
+                                              start_subsampled_frame,
+                                              subsampled_frames_per_chunk),
+      last_subsampled_frame = start_subsampled_frame + num_subsampled_frames - 1;
+  int32 first_output_frame = start_subsampled_frame * subsampling_factor,
+      last_output_frame = last_subsampled_frame * subsampling_factor;
+
+  KALDI_ASSERT(opts_.extra_left_context >= 0 && opts_.extra_right_context >= 0);
+  int32 extra_left_context = opts_.extra_left_context,
+      extra_right_context = opts_.extra_right_context;
+  if (first_output_frame == 0 && opts_.extra_left_context_initial >= 0)
+    extra_left_context = opts_.extra_left_context_initial;
+  if (last_subsampled_frame == info.num_subsampled_frames - 1 &&
+      opts_.extra_right_context_final >= 0)
+    extra_right_context = opts_.extra_right_context_final;
+  int32 left_context = nnet_left_context_ + extra_left_context,
+      right_context = nnet_right_context_ + extra_right_context;
+  int32 first_input_frame = first_output_frame - left_context,
+      last_input_frame = last_output_frame + right_context,
+      num_input_frames = last_input_frame + 1 - first_input_frame;
+
+  chunk->stream = stream;
+  chunk->left_context = left_context;
+  chunk->num_subsampled_frames = num_subsampled_frames;
+  GetCurrentIvector(info, first_output_frame,
+                    last_output_frame - first_output_frame,
+                    &(chunk->ivector));
+  const Matrix<BaseFloat> &feats = info.feats;
+  chunk->input.Resize(num_input_frames, feats.NumCols(), kUndefined);
+  int32 tot_input_feats = feats.NumRows();
+  for (int32 i = 0; i < num_input_frames; i++) {
+    SubVector<BaseFloat> dest(chunk->input, i);
+    int32 t = i + first_input_frame;
+    if (t < 0) t = 0;
+    if (t >= tot_input_feats) t = tot_input_feats - 1;
+    dest.CopyFromVec(feats.Row(t));
+  }
+}
+
+int32 NnetBatchComputer::ComputeNextChunks() {
+  // Chunks are grouped by their structure: (number of input frames, left
+  // context, number of output frames, iVector dimension).  All chunks in a
+  // group can be computed with the same ComputationRequest.
+  typedef std::map<std::vector<int32>, std::vector<ChunkInfo*> > MapType;
+  MapType groups;
+  std::vector<ChunkInfo> chunks(streams_.size());
+  int32 num_chunks = 0;
+  for (size_t s = 0; s < streams_.size(); s++) {
+    StreamInfo &info = streams_[s];
+    info.output.Resize(0, 0);
+    if (!info.in_use ||
+        info.num_subsampled_frames_computed == info.num_subsampled_frames)
+      continue;
+    ChunkInfo &chunk = chunks[s];
+    GetNextChunk(s, &chunk);
+    std::vector<int32> key(4);
+    key[0] = chunk.input.NumRows();
+    key[1] = chunk.left_context;
+    key[2] = chunk.num_subsampled_frames;
+    key[3] = chunk.ivector.Dim();
+    groups[key].push_back(&chunk);
+    num_chunks++;
+  }
+  for (MapType::iterator iter = groups.begin(); iter != groups.end(); ++iter) {
+    const std::vector<ChunkInfo*> &group = iter->second;
+    for (size_t start = 0; start < group.size(); start += opts_.minibatch_size) {
+      size_t end = std::min<size_t>(group.size(), start + opts_.minibatch_size);
+      std::vector<ChunkInfo*> batch(group.begin() + start, group.begin() + end);
+      ComputeBatch(batch);
+    }
+  }
+  return num_chunks;
+}
+
+void NnetBatchComputer::ComputeBatch(const std::vector<ChunkInfo*> &chunks) {
+  KALDI_ASSERT(!chunks.empty());
+  int32 num_n = chunks.size(),
+      num_input_frames = chunks[0]->input.NumRows(),
+      input_dim = chunks[0]->input.NumCols(),
+      left_context = chunks[0]->left_context,
+      num_subsampled_frames = chunks[0]->num_subsampled_frames,
+      ivector_dim = chunks[0]->ivector.Dim(),
+      subsample = opts_.frame_subsampling_factor;
+
+  ComputationRequest request;
+  request.need_model_derivative = false;
+  request.store_component_stats = false;
+  // As in DecodableNnetSimple, the times are shifted so that the first output
+  // frame is t = 0, to take advantage of caching in the compiler.  The
+  // indexes are ordered with 'n' varying slowest, as in MergeExamples(), so
+  // the rows for each stream are contiguous.
+  request.inputs.resize(ivector_dim != 0 ? 2 : 1);
+  IoSpecification &input_spec = request.inputs[0];
+  input_spec.name = "input";
+  input_spec.indexes.resize(num_n * num_input_frames);
+  for (int32 n = 0; n < num_n; n++) {
+    for (int32 i = 0; i < num_input_frames; i++) {
+      Index &index = input_spec.indexes[n * num_input_frames + i];
+      index.n = n;
+      index.t = i - left_context;
+    }
+  }
+  if (ivector_dim != 0) {
+    IoSpecification &ivector_spec = request.inputs[1];
+    ivector_spec.name = "ivector";
+    ivector_spec.indexes.resize(num_n);
+    for (int32 n = 0; n < num_n; n++)
+      ivector_spec.indexes[n].n = n;
+  }
+  request.outputs.resize(1);
+  IoSpecification &output_spec = request.outputs[0];
+  output_spec.name = "output";
+  output_spec.has_deriv = false;
+  output_spec.indexes.resize(num_n * num_subsampled_frames);
+  for (int32 n = 0; n < num_n; n++) {
+    for (int32 i = 0; i < num_subsampled_frames; i++) {
+      Index &index = output_spec.indexes[n * num_subsampled_frames + i];
+      index.n = n;
+      index.t = i * subsample;
+    }
+  }
+
+  std::shared_ptr<const NnetComputation> computation =
+      compiler_.Compile(request);
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(opts_.compute_config, *computation,
+                        nnet_, nnet_to_update);
+
+  CuMatrix<BaseFloat> input_feats_cu(num_n * num_input_frames, input_dim,
+                                     kUndefined);
+  for (int32 n = 0; n < num_n; n++)
+    input_feats_cu.RowRange(n * num_input_frames,
+                            num_input_frames).CopyFromMat(chunks[n]->input);
+  computer.AcceptInput("input", &input_feats_cu);
+  CuMatrix<BaseFloat> ivector_feats_cu;
+  if (ivector_dim != 0) {
+    ivector_feats_cu.Resize(num_n, ivector_dim, kUndefined);
+    for (int32 n = 0; n < num_n; n++)
+      ivector_feats_cu.Row(n).CopyFromVec(chunks[n]->ivector);
+    computer.AcceptInput("ivector", &ivector_feats_cu);
+  }
+  computer.Run();
+  num_computations_++;
+  CuMatrix<BaseFloat> cu_output;
+  computer.GetOutputDestructive("output", &cu_output);
+  KALDI_ASSERT(cu_output.NumCols() == output_dim_);
+  // subtract log-prior (divide by prior)
+  if (log_priors_.Dim() != 0)
+    cu_output.AddVecToRows(-1.0, log_priors_);
+  // apply the acoustic scale
+  cu_output.Scale(opts_.acoustic_scale);
+
+  for (int32 n = 0; n < num_n; n++) {
+    StreamInfo &info = streams_[chunks[n]->stream];
+    info.output.Resize(num_subsampled_frames, output_dim_, kUndefined);
+    cu_output.RowRange(n * num_subsampled_frames,
+                       num_subsampled_frames).CopyToMat(&(info.output));
+    info.num_subsampled_frames_computed += num_subsampled_frames;
+  }
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,189 @@
+// nnet3/nnet-batch-compute.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+#define KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+
+#include <vector>
+#include <map>
+#include "base/kaldi-common.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+struct NnetBatchComputerOptions: public NnetSimpleComputationOptions {
+  int32 minibatch_size;
+
+  NnetBatchComputerOptions(): minibatch_size(64) { }
+
+  void Register(OptionsItf *opts) {
+    NnetSimpleComputationOptions::Register(opts);
+    opts->Register("minibatch-size", &minibatch_size, "Maximum number of "
+                   "chunks (each from a different utterance) that we put "
+                   "together in a single neural net computation.");
+  }
+};
+
+
+/**
+   NnetBatchComputer does the same computation as class DecodableNnetSimple,
+   but for many utterances at once.  Each utterance is a "stream"; every call
+   to ComputeNextChunks() computes the next chunk of output (of
+   --frames-per-chunk frames) for every stream that has output left to compute,
+   and chunks from different streams that have the same structure are put
+   together in one ComputationRequest, with a different 'n' index for each
+   stream.  The point is that the resulting matrix multiplications have many
+   more rows, which uses BLAS (or the GPU) much more efficiently than many
+   small, separate computations.
+
+   The output is the same as DecodableNnetSimple would give for each
+   utterance: the log-posteriors divided by the priors (if supplied), times the
+   acoustic scale, with one row per (subsampled) frame.
+
+   Typical usage is: call AddStream() for a number of utterances; then loop
+   calling ComputeNextChunks() and GetOutputDestructive() for each stream
+   until IsFinished() is true for the stream, at which point you call
+   RemoveStream() and may add another stream in its place.
+*/
+class NnetBatchComputer {
+ public:
+  /**
+     @param [in] opts   The options class.  Warning: it includes an acoustic
+                        weight, whose default is 0.1; you may sometimes want to
+                        change this to 1.0.
+     @param [in] nnet   The neural net that we're going to do the computation
+                        with.  It is stored as a reference.
+     @param [in] priors Vector of priors-- if supplied and nonempty, we subtract
+                        the log of these priors from the nnet output.
+  */
+  NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                    const Nnet &nnet,
+                    const VectorBase<BaseFloat> &priors);
+
+  /// Adds a new stream (utterance) and returns its index, which may be the
+  /// index of a stream that was previously removed.  The features and iVectors
+  /// are copied, so the caller may delete them after this call.  The meaning
+  /// of the iVector-related arguments is the same as for DecodableNnetSimple.
+  int32 AddStream(const MatrixBase<BaseFloat> &feats,
+                  const VectorBase<BaseFloat> *ivector = NULL,
+                  const MatrixBase<BaseFloat> *online_ivectors = NULL,
+                  int32 online_ivector_period = 1);
+
+  /// Frees the memory associated with this stream; after this, the index
+  /// may be returned again by AddStream().
+  void RemoveStream(int32 stream);
+
+  /// Returns the number of streams that have been added and not removed.
+  int32 NumStreams() const;
+
+  /// Returns the total number of (subsampled) output frames for this stream.
+  int32 NumFrames(int32 stream) const;
+
+  /// Returns the number of (subsampled) output frames we have computed so far
+  /// for this stream.
+  int32 NumFramesComputed(int32 stream) const;
+
+  /// Returns true if all the output for this stream has been computed.
+  bool IsFinished(int32 stream) const {
+    return NumFramesComputed(stream) == NumFrames(stream);
+  }
+
+  /// Computes the next chunk of output for every stream that is not finished.
+  /// Returns the number of chunks computed (zero if all streams were
+  /// finished).
+  int32 ComputeNextChunks();
+
+  /// Outputs the output that was computed for this stream by the most recent
+  /// call to ComputeNextChunks(), and clears it.  The number of rows of the
+  /// output may be zero if no output was computed for this stream.
+  void GetOutputDestructive(int32 stream, Matrix<BaseFloat> *output);
+
+  /// Returns the number of ComputationRequests we have run so far, which is
+  /// useful for diagnostics (compare with the number of chunks computed).
+  int64 NumComputations() const { return num_computations_; }
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchComputer);
+
+  struct StreamInfo {
+    bool in_use;
+    Matrix<BaseFloat> feats;
+    // 'ivector' is nonempty if we're using iVectors estimated in batch mode.
+    Vector<BaseFloat> ivector;
+    // 'online_ivectors' is nonempty if we're using online-estimated iVectors.
+    Matrix<BaseFloat> online_ivectors;
+    int32 online_ivector_period;
+    int32 num_subsampled_frames;
+    int32 num_subsampled_frames_computed;
+    // The output from the most recent chunk.
+    Matrix<BaseFloat> output;
+    StreamInfo(): in_use(false), online_ivector_period(0),
+                  num_subsampled_frames(0),
+                  num_subsampled_frames_computed(0) { }
+  };
+
+  // Represents the input for one chunk of one stream.
+  struct ChunkInfo {
+    int32 stream;
+    // The input features, including left and right context (padded at the
+    // utterance boundaries by repeating the first or last frame).
+    Matrix<BaseFloat> input;
+    // The iVector for this chunk, or empty if we're not using iVectors.
+    Vector<BaseFloat> ivector;
+    // The number of frames of left context in 'input'.
+    int32 left_context;
+    // The number of (subsampled) frames of output we want from this chunk.
+    int32 num_subsampled_frames;
+  };
+
+  // Sets up 'chunk' for the next chunk of the stream with index 'stream'
+  // (it's a copy of the logic in DecodableNnetSimple::EnsureFrameIsComputed()).
+  void GetNextChunk(int32 stream, ChunkInfo *chunk);
+
+  // Gets the iVector for a chunk; this is a copy of the logic in
+  // DecodableNnetSimple::GetCurrentIvector().
+  void GetCurrentIvector(const StreamInfo &info,
+                         int32 output_t_start,
+                         int32 num_output_frames,
+                         Vector<BaseFloat> *ivector);
+
+  // Does the computation for a list of chunks that must all have the same
+  // structure (number of input frames, left context, number of output frames
+  // and iVector dimension), and puts the output in the corresponding streams.
+  void ComputeBatch(const std::vector<ChunkInfo*> &chunks);
+
+  NnetBatchComputerOptions opts_;
+  const Nnet &nnet_;
+  int32 nnet_left_context_;
+  int32 nnet_right_context_;
+  int32 output_dim_;
+  // the log priors (or the empty vector if the priors are not set in the model)
+  CuVector<BaseFloat> log_priors_;
+  CachingOptimizingCompiler compiler_;
+  std::vector<StreamInfo> streams_;
+  int64 num_computations_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_BATCH_COMPUTE_H_
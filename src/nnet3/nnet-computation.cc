@@ -18,9 +18,12 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <functional>
 #include <iterator>
 #include <sstream>
 #include "nnet3/nnet-computation.h"
+#include "nnet3/nnet-analyze.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -97,6 +100,136 @@ void NnetComputation::ComputeCudaIndexes() {
     // the interface of CUDA being plain C.
     indexes_ranges_cuda[i].CopyFromVec(*input_cast);
   }
+  ComputeMemoryPlan();
+  ComputeCommandDependencies();
+}
+
+int32 NnetComputation::ArenaStride(int32 matrix_index) const {
+  const MatrixInfo &info = matrices[matrix_index];
+  if (info.stride_type == kStrideEqualNumCols)
+    return info.num_cols;
+  // This is the same as in Matrix::Init(): round up to a multiple of 16 bytes.
+  int32 multiple = 16 / sizeof(BaseFloat);
+  return (info.num_cols + multiple - 1) / multiple * multiple;
+}
+
+void NnetComputation::ComputeMemoryPlan() {
+  int32 num_matrices = matrices.size(),
+      num_commands = commands.size();
+  // alloc_command[m] and dealloc_command[m] are the indexes of the commands
+  // that allocate and deallocate matrix m; -1 if there is no such command, and
+  // -2 if there is more than one, or if the matrix cannot be in the arena for
+  // other reasons.
+  std::vector<int32> alloc_command(num_matrices, -1),
+      dealloc_command(num_matrices, -1);
+  int32 label_command = -1, goto_command = -1;
+  for (int32 c = 0; c < num_commands; c++) {
+    const Command &command = commands[c];
+    switch (command.command_type) {
+      case kAllocMatrix: case kDeallocMatrix: {
+        int32 m = submatrices[command.arg1].matrix_index;
+        std::vector<int32> &this_command =
+            (command.command_type == kAllocMatrix ? alloc_command :
+             dealloc_command);
+        this_command[m] = (this_command[m] == -1 ? c : -2);
+        break;
+      }
+      case kSwapMatrix:
+        alloc_command[submatrices[command.arg2].matrix_index] = -2;
+        // fall through
+      case kAcceptInput: case kProvideOutput:
+      case kCompressMatrix: case kDecompressMatrix:
+        alloc_command[submatrices[command.arg1].matrix_index] = -2;
+        break;
+      case kNoOperationLabel:
+        label_command = c;
+        break;
+      case kGotoLabel:
+        goto_command = c;
+        break;
+      default:
+        break;
+    }
+  }
+
+  // 'lifetimes' contains, for each matrix in the arena, its lifetime as the
+  // range of commands (first, last); 'sizes' contains pairs
+  // (size, matrix-index) for those matrices.
+  std::vector<std::pair<int32, int32> > &lifetimes = matrix_arena_lifetimes;
+  lifetimes.clear();
+  lifetimes.resize(num_matrices, std::pair<int32, int32>(0, 0));
+  std::vector<std::pair<int64, int32> > sizes;
+  matrix_arena_offsets.clear();
+  matrix_arena_offsets.resize(num_matrices, -1);
+  for (int32 m = 1; m < num_matrices; m++) {
+    int32 first = alloc_command[m], last = dealloc_command[m];
+    if (first < 0 || last < first)
+      continue;
+    if (goto_command >= 0) {
+      // In looped computations, a matrix whose lifetime is not within one
+      // iteration of the loop (or entirely before it) is live throughout.
+      bool before_loop = (last < label_command),
+          inside_loop = (first > label_command && last < goto_command);
+      if (!before_loop && !inside_loop) {
+        first = 0;
+        last = num_commands;
+      }
+    }
+    lifetimes[m] = std::pair<int32, int32>(first, last);
+    int64 size = static_cast<int64>(matrices[m].num_rows) * ArenaStride(m);
+    sizes.push_back(std::pair<int64, int32>(size, m));
+  }
+
+  // We place the largest matrices first, each at the lowest offset where it
+  // does not overlap with any already-placed matrix whose lifetime overlaps
+  // with its own.  Offsets are rounded up to a multiple of 64 bytes.
+  std::sort(sizes.begin(), sizes.end(),
+            std::greater<std::pair<int64, int32> >());
+  int64 alignment = 64 / sizeof(BaseFloat);
+  arena_size = 0;
+  std::vector<std::pair<int32, int64> > placed;  // (matrix-index, size).
+  std::vector<std::pair<int64, int64> > occupied;  // (begin, end) offsets.
+  for (size_t i = 0; i < sizes.size(); i++) {
+    int64 size = sizes[i].first;
+    int32 m = sizes[i].second;
+    occupied.clear();
+    for (size_t j = 0; j < placed.size(); j++) {
+      int32 m2 = placed[j].first;
+      if (lifetimes[m2].first <= lifetimes[m].second &&
+          lifetimes[m].first <= lifetimes[m2].second)
+        occupied.push_back(std::pair<int64, int64>(
+            matrix_arena_offsets[m2],
+            matrix_arena_offsets[m2] + placed[j].second));
+    }
+    std::sort(occupied.begin(), occupied.end());
+    int64 offset = 0;
+    for (size_t j = 0; j < occupied.size(); j++) {
+      if (occupied[j].first >= offset + size)
+        break;  // it fits before this block.
+      if (occupied[j].second > offset)
+        offset = (occupied[j].second + alignment - 1) / alignment * alignment;
+    }
+    matrix_arena_offsets[m] = offset;
+    placed.push_back(std::pair<int32, int64>(m, size));
+    arena_size = std::max(arena_size, offset + size);
+  }
+}
+
+void NnetComputation::ComputeCommandDependencies() {
+  command_dependencies.clear();
+  command_successors.clear();
+  int32 num_commands = commands.size();
+  for (int32 c = 0; c < num_commands; c++) {
+    CommandType command_type = commands[c].command_type;
+    if (command_type == kBackprop || command_type == kBackpropNoModelUpdate ||
+        command_type == kGotoLabel)
+      return;
+  }
+  nnet3::ComputeCommandDependencies(*this, &command_dependencies);
+  command_successors.resize(num_commands);
+  for (int32 c = 0; c < num_commands; c++)
+    for (size_t i = 0; i < command_dependencies[c].size(); i++)
+      command_successors[command_dependencies[c][i]].push_back(c);
 }
 
 int32 NnetComputation::NewSubMatrix(int32 base_submatrix,
@@ -549,7 +682,10 @@ static void PrintCommand(std::ostream &os_out,
       if (c.arg2 == 0) os << "NULL, ";
       else os << "precomputed_indexes[" << c.arg2 << "], ";
       os << submatrix_strings[c.arg3] << ", &" << submatrix_strings[c.arg4]
-         << ")\n";
+         << ")";
+      if (c.arg7 >= 0)
+        os << " [fused with " << nnet.GetComponentName(c.arg7) << "]";
+      os << "\n";
       break;
     case kBackprop:
     case kBackpropNoModelUpdate: {
@@ -698,6 +834,15 @@ static void PrintComputationPreamble(
       os << ", ";
   }
   os << "\n";
+  if (!c.matrix_arena_offsets.empty()) {
+    int32 num_in_arena = 0;
+    for (size_t i = 1; i < c.matrix_arena_offsets.size(); i++)
+      if (c.matrix_arena_offsets[i] >= 0)
+        num_in_arena++;
+    os << "# memory arena: " << (c.arena_size * sizeof(BaseFloat))
+       << " bytes for " << num_in_arena << " of "
+       << (c.matrices.size() - 1) << " matrices\n";
+  }
   if (!c.matrix_debug_info.empty()) {
     os << "# The following show how matrices correspond to network-nodes and\n"
        << "# cindex-ids.  Format is: matrix = <node-id>.[value|deriv][ <list-of-cindex-ids> ]\n"
@@ -1142,7 +1287,12 @@ NnetComputation::NnetComputation(const NnetComputation &other):
     commands(other.commands),
     need_model_derivative(other.need_model_derivative),
     indexes_cuda(other.indexes_cuda),
-    indexes_ranges_cuda(other.indexes_ranges_cuda) {
+    indexes_ranges_cuda(other.indexes_ranges_cuda),
+    matrix_arena_offsets(other.matrix_arena_offsets),
+    matrix_arena_lifetimes(other.matrix_arena_lifetimes),
+    arena_size(other.arena_size),
+    command_dependencies(other.command_dependencies),
+    command_successors(other.command_successors) {
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     component_precomputed_indexes[i].data =
         component_precomputed_indexes[i].data->Copy();
@@ -1159,6 +1309,11 @@ NnetComputation& NnetComputation::operator = (const NnetComputation &other) {
   need_model_derivative = other.need_model_derivative;
   indexes_cuda = other.indexes_cuda;
   indexes_ranges_cuda = other.indexes_ranges_cuda;
+  matrix_arena_offsets = other.matrix_arena_offsets;
+  matrix_arena_lifetimes = other.matrix_arena_lifetimes;
+  arena_size = other.arena_size;
+  command_dependencies = other.command_dependencies;
+  command_successors = other.command_successors;
 
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     delete component_precomputed_indexes[i].data;
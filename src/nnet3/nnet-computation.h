@@ -205,6 +205,11 @@ struct ComputationRequestPtrEqual {
      - arg6 is 1 if we need to call StoreStats() after the Propagate, or 0
        if we don't.  We used to have a separate command for storing the
        stats, but that has been removed.
+     - arg7 is normally -1; if it is >= 0, it is the index of a simple
+       component that supports in-place propagation (e.g. a nonlinearity),
+       which is propagated in-place on the output straight after this
+       component.  This is only set by FuseInferenceCommands(), see
+       --optimization.fuse-inference.
    - kBackprop: Do the back-propagation operation, see Component::Backprop()
      - arg1 is index of component in neural net
      - arg2 is index into ComponentPrecomputedIndexes (0 if NULL; always 0
@@ -447,6 +452,37 @@ struct NnetComputation {
   // computed from "indexes_ranges" by ComputeCudaIndexes().
   std::vector<CuArray<Int32Pair> > indexes_ranges_cuda;
 
+  // The static memory plan used by class NnetComputer on CPU, computed by
+  // ComputeMemoryPlan().  Indexed by matrix-index, this is the offset (in
+  // BaseFloats) of the matrix within a single block of memory (the 'arena',
+  // see class NnetComputeArena), or -1 if the matrix is allocated separately.
+  // Matrices whose lifetimes do not overlap may share memory.  Only matrices
+  // that are allocated by exactly one kAllocMatrix and deallocated by exactly
+  // one kDeallocMatrix command, and that are not inputs, outputs, swapped or
+  // compressed, are put in the arena.
+  std::vector<int64> matrix_arena_offsets;
+
+  // Indexed by matrix-index, the lifetime of each matrix in the arena as the
+  // range (first, last) of command indexes: it is live while a computation
+  // is about to execute command c with first < c <= last.  (0, 0) for
+  // matrices not in the arena.  Matrices whose lifetimes overlap never share
+  // memory.
+  std::vector<std::pair<int32, int32> > matrix_arena_lifetimes;
+
+  // The size of the arena in BaseFloats, i.e. the peak memory used by the
+  // matrices in it.
+  int64 arena_size;
+
+  // Indexed by command index c, the sorted list of the earlier commands that
+  // must be finished before command c starts (see ComputeCommandDependencies()
+  // in nnet-analyze.h), and its reverse: command_successors[c] is the sorted
+  // list of the commands that depend on command c.  Computed by
+  // ComputeCommandDependencies(); used by class NnetComputer to execute
+  // commands in parallel.  Both are empty if the computation cannot be
+  // executed in parallel (if it has backprop or is looped).
+  std::vector<std::vector<int32> > command_dependencies;
+  std::vector<std::vector<int32> > command_successors;
+
 
   /// Convenience function used when adding new matrices.  Writes to
   /// 'this->matrices' and 'this->submatrices'; and if 'this->matrix_debug_info'
@@ -470,9 +506,27 @@ struct NnetComputation {
 
   // This must be called after setting up the computation but prior to actually
   // using the Computation object in a computation, to compute CUDA versions of
-  // the indexes.
+  // the indexes.  It also calls ComputeMemoryPlan() and
+  // ComputeCommandDependencies().
   void ComputeCudaIndexes();
 
+  // Works out the lifetime of each matrix from the kAllocMatrix and
+  // kDeallocMatrix commands and sets up 'matrix_arena_offsets',
+  // 'matrix_arena_lifetimes' and 'arena_size'.  It is called by ComputeCudaIndexes(), so you won't normally
+  // have to call it yourself.
+  void ComputeMemoryPlan();
+
+  // Sets up 'command_dependencies' and 'command_successors', or clears them
+  // if the computation has backprop or is looped.  It is called by
+  // ComputeCudaIndexes() (after ComputeMemoryPlan(), since the dependencies
+  // depend on the memory plan).
+  void ComputeCommandDependencies();
+
+  // Returns the stride that matrix 'matrix_index' has when it is located in
+  // the arena (see matrix_arena_offsets): the same as CPU-based class Matrix
+  // would give it.
+  int32 ArenaStride(int32 matrix_index) const;
+
   // This function produces pretty-print ouput intended to allow a human to
   // interpret the computation.
   void Print(std::ostream &os, const Nnet &nnet) const;
@@ -511,7 +565,7 @@ struct NnetComputation {
   // Assignment operator.
   NnetComputation &operator = (const NnetComputation &other);
   // Default constructor
-  NnetComputation(): need_model_derivative(false) { }
+  NnetComputation(): need_model_derivative(false), arena_size(0) { }
 };
 
 
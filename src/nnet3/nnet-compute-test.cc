@@ -75,6 +75,137 @@ void UnitTestComputationRequestIo(ComputationRequest *request) {
   }
 }
 
+// Checks that matrices which share memory in the arena of the memory plan
+// (see NnetComputation::ComputeMemoryPlan()) are never alive at the same time.
+void UnitTestMemoryPlan(const NnetComputation &computation) {
+  int32 num_matrices = computation.matrices.size();
+  KALDI_ASSERT(computation.matrix_arena_offsets.size() == num_matrices);
+  std::vector<int32> alloc_command(num_matrices, -1),
+      dealloc_command(num_matrices, -1);
+  for (int32 c = 0; c < computation.commands.size(); c++) {
+    const NnetComputation::Command &command = computation.commands[c];
+    if (command.command_type == kAllocMatrix)
+      alloc_command[computation.submatrices[command.arg1].matrix_index] = c;
+    if (command.command_type == kDeallocMatrix)
+      dealloc_command[computation.submatrices[command.arg1].matrix_index] = c;
+  }
+  for (int32 m = 1; m < num_matrices; m++) {
+    int64 offset = computation.matrix_arena_offsets[m];
+    if (offset < 0)
+      continue;
+    // The lifetime is that given by the commands, or the whole computation
+    // (for matrices that live across iterations of a loop).
+    const std::pair<int32, int32> &lifetime =
+        computation.matrix_arena_lifetimes[m];
+    KALDI_ASSERT(lifetime == std::make_pair(alloc_command[m],
+                                            dealloc_command[m]) ||
+                 lifetime == std::make_pair(
+                     0, static_cast<int32>(computation.commands.size())));
+    int64 end = offset + computation.matrices[m].num_rows *
+        computation.ArenaStride(m);
+    KALDI_ASSERT(computation.ArenaStride(m) >= computation.matrices[m].num_cols &&
+                 end <= computation.arena_size);
+    for (int32 m2 = 1; m2 < m; m2++) {
+      int64 offset2 = computation.matrix_arena_offsets[m2];
+      if (offset2 < 0)
+        continue;
+      int64 end2 = offset2 + computation.matrices[m2].num_rows *
+          computation.ArenaStride(m2);
+      if (offset < end2 && offset2 < end) {
+        // They share memory, so their lifetimes must not overlap.
+        KALDI_ASSERT(dealloc_command[m] < alloc_command[m2] ||
+                     dealloc_command[m2] < alloc_command[m]);
+      }
+    }
+  }
+}
+
+// Checks that the command dependencies (see ComputeCommandDependencies()) order
+// all pairs of commands that access the same variable, if one of them writes to
+// it.
+void UnitTestCommandDependencies(const Nnet &nnet,
+                                 const NnetComputation &computation) {
+  Analyzer analyzer;
+  analyzer.Init(nnet, computation);
+  std::vector<std::vector<int32> > dependencies;
+  ComputeCommandDependencies(computation, analyzer, &dependencies);
+  // The dependencies cached in the computation by ComputeCudaIndexes() do not
+  // use the nnet, but should be the same.
+  KALDI_ASSERT(computation.command_dependencies == dependencies);
+  int32 num_commands = computation.commands.size();
+  // must_precede[c][c2] is true if command c2 must be finished before c
+  // starts, directly or indirectly.
+  std::vector<std::vector<bool> > must_precede(num_commands);
+  for (int32 c = 0; c < num_commands; c++) {
+    must_precede[c].resize(num_commands, false);
+    for (size_t i = 0; i < dependencies[c].size(); i++) {
+      int32 c2 = dependencies[c][i];
+      KALDI_ASSERT(c2 < c);
+      must_precede[c][c2] = true;
+      for (int32 c3 = 0; c3 < c2; c3++)
+        if (must_precede[c2][c3])
+          must_precede[c][c3] = true;
+    }
+  }
+  for (size_t v = 0; v < analyzer.variable_accesses.size(); v++) {
+    const std::vector<Access> &accesses = analyzer.variable_accesses[v];
+    for (size_t i = 0; i < accesses.size(); i++) {
+      for (size_t j = i + 1; j < accesses.size(); j++) {
+        if (accesses[i].access_type != kReadAccess ||
+            accesses[j].access_type != kReadAccess)
+          KALDI_ASSERT(must_precede[accesses[j].command_index][
+              accesses[i].command_index]);
+      }
+    }
+  }
+}
+
+// Checks that executing the commands of a forward-only computation in parallel
+// gives the same output as executing them in sequence.  'nnet' must be in test
+// mode (no dropout).
+void UnitTestNnetComputeParallel(const Nnet &nnet,
+                                 const ComputationRequest &request,
+                                 const std::vector<Matrix<BaseFloat> > &inputs) {
+  ComputationRequest forward_request(request);
+  forward_request.need_model_derivative = false;
+  forward_request.store_component_stats = false;
+  for (size_t i = 0; i < forward_request.inputs.size(); i++)
+    forward_request.inputs[i].has_deriv = false;
+  for (size_t i = 0; i < forward_request.outputs.size(); i++)
+    forward_request.outputs[i].has_deriv = false;
+
+  NnetComputation computation;
+  Compiler compiler(forward_request, nnet);
+  CompilerOptions opts;
+  compiler.CreateComputation(opts, &computation);
+  if (RandInt(0, 1) == 0) {
+    NnetOptimizeOptions opt_config;
+    Optimize(opt_config, nnet, MaxOutputTimeInRequest(forward_request),
+             &computation);
+  }
+  computation.ComputeCudaIndexes();
+  UnitTestCommandDependencies(nnet, computation);
+
+  NnetComputeOptions compute_opts, parallel_compute_opts;
+  parallel_compute_opts.num_threads = RandInt(2, 4);
+  ThreadTeam team(parallel_compute_opts.num_threads);
+  NnetComputer computer(compute_opts, computation, nnet, NULL),
+      parallel_computer(parallel_compute_opts, computation, nnet, NULL, NULL,
+                        RandInt(0, 1) == 0 ? &team : NULL);
+  for (size_t i = 0; i < forward_request.inputs.size(); i++) {
+    CuMatrix<BaseFloat> temp(inputs[i]), temp2(inputs[i]);
+    computer.AcceptInput(forward_request.inputs[i].name, &temp);
+    parallel_computer.AcceptInput(forward_request.inputs[i].name, &temp2);
+  }
+  computer.Run();
+  parallel_computer.Run();
+  const CuMatrixBase<BaseFloat> &output(computer.GetOutput("output")),
+      &parallel_output(parallel_computer.GetOutput("output"));
+  KALDI_LOG << "Output sum [parallel] is " << parallel_output.Sum();
+  if (!ApproxEqual(output, parallel_output))
+    KALDI_ERR << "Sequential and parallel computations' outputs differ";
+}
+
 // this checks that a couple of different decodable objects give the same
 // answer.
 void TestNnetDecodable(Nnet *nnet) {
@@ -110,10 +241,62 @@ void TestNnetDecodable(Nnet *nnet) {
       SubVector<BaseFloat> row(output1, t);
       decodable.GetOutputForFrame(t, &row);
     }
+
+    // Check that the precompiled computations written by
+    // CompileAllComputations() give the same output.
+    CachingOptimizingCompilerOptions compiler_opts;
+    compiler_opts.cache_capacity = 1000;
+    CachingOptimizingCompiler cache_compiler(*nnet, opts.optimize_config,
+                                             compiler_opts);
+    DecodableNnetSimple cache_decodable(opts, *nnet, priors, input,
+                                        &cache_compiler,
+                                        (ivector_dim != 0 ? &ivector : NULL));
+    cache_decodable.CompileAllComputations();
+    bool binary = (RandInt(0, 1) == 0);
+    opts.computation_cache = "tmp.cache";
+    {
+      Output ko(opts.computation_cache, binary);
+      WriteComputationCacheHeader(*nnet, false, ko.Stream(), binary);
+      cache_compiler.WriteCache(ko.Stream(), binary);
+    }
+    CachingOptimizingCompiler compiler2(*nnet, opts.optimize_config);
+    KALDI_ASSERT(ReadComputationCache(opts, *nnet, &compiler2));
+    DecodableNnetSimple decodable2(opts, *nnet, priors, input, &compiler2,
+                                   (ivector_dim != 0 ? &ivector : NULL));
+    for (int32 t = 0; t < num_frames; t++) {
+      Vector<BaseFloat> row(output_dim);
+      decodable2.GetOutputForFrame(t, &row);
+      KALDI_ASSERT(row.ApproxEqual(output1.Row(t)));
+    }
+    // All the computations should have come from the cache.
+    KALDI_ASSERT(compiler2.NumComputationsCompiled() == 0);
+    // The cache is not used if the optimization options differ.
+    NnetOptimizeOptions other_optimize_config(opts.optimize_config);
+    other_optimize_config.propagate_in_place =
+        !other_optimize_config.propagate_in_place;
+    CachingOptimizingCompiler compiler3(*nnet, other_optimize_config);
+    KALDI_ASSERT(!ReadComputationCache(opts, *nnet, &compiler3));
+
+    // Check that executing the commands in parallel, with a team of threads
+    // given by the caller, gives the same output.
+    NnetSimpleComputationOptions parallel_opts(opts);
+    parallel_opts.compute_config.num_threads = RandInt(2, 4);
+    ThreadTeam team(parallel_opts.compute_config.num_threads);
+    NnetComputeArena arena;
+    DecodableNnetSimple decodable3(parallel_opts, *nnet, priors, input,
+                                   &compiler,
+                                   (ivector_dim != 0 ? &ivector : NULL),
+                                   NULL, 1, &arena, &team);
+    for (int32 t = 0; t < num_frames; t++) {
+      Vector<BaseFloat> row(output_dim);
+      decodable3.GetOutputForFrame(t, &row);
+      KALDI_ASSERT(row.ApproxEqual(output1.Row(t)));
+    }
   }
 
   {
     NnetSimpleLoopedComputationOptions opts;
+    Nnet nnet_copy(*nnet);
     // caution: this may modify nnet, by changing how it consumes iVectors.
     DecodableNnetSimpleLoopedInfo info(opts, priors, nnet);
     DecodableNnetSimpleLooped decodable(info, input,
@@ -122,6 +305,25 @@ void TestNnetDecodable(Nnet *nnet) {
       SubVector<BaseFloat> row(output2, t);
       decodable.GetOutputForFrame(t, &row);
     }
+
+    // Check that the looped computation gives the same output when it is
+    // read from a cache instead of being compiled.
+    bool binary = (RandInt(0, 1) == 0);
+    {
+      Output ko("tmp.cache", binary);
+      info.WriteComputationCache(ko.Stream(), binary);
+    }
+    NnetSimpleLoopedComputationOptions opts2(opts);
+    opts2.computation_cache = "tmp.cache";
+    DecodableNnetSimpleLoopedInfo info2(opts2, priors, &nnet_copy);
+    DecodableNnetSimpleLooped decodable2(info2, input,
+                                         (ivector_dim != 0 ? &ivector : NULL));
+    for (int32 t = 0; t < num_frames; t++) {
+      Vector<BaseFloat> row(output_dim);
+      decodable2.GetOutputForFrame(t, &row);
+      KALDI_ASSERT(row.ApproxEqual(output2.Row(t)));
+    }
+    std::remove("tmp.cache");
   }
 
 
@@ -220,6 +422,7 @@ void UnitTestNnetCompute() {
       compute_opts.debug = true;
 
     computation.ComputeCudaIndexes();
+    UnitTestMemoryPlan(computation);
     NnetComputer computer(compute_opts,
                           computation,
                           nnet,
@@ -255,6 +458,7 @@ void UnitTestNnetCompute() {
       if (!ApproxEqual(output, output_collapsed)) {
         KALDI_ERR << "Regular and collapsed computations' outputs differ";
       }
+      UnitTestNnetComputeParallel(nnet, request, inputs);
     }
 
     CuMatrix<BaseFloat> output_deriv(output.NumRows(), output.NumCols());
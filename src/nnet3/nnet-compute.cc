@@ -17,7 +17,13 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
 #include <sstream>
 #include "nnet3/nnet-compute.h"
 
@@ -28,23 +34,38 @@ namespace nnet3 {
 NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
                            const Nnet &nnet,
-                           Nnet *nnet_to_update):
+                           Nnet *nnet_to_update,
+                           NnetComputeArena *arena,
+                           ThreadTeam *team):
     options_(options), computation_(computation), nnet_(nnet),
     program_counter_(0), nnet_to_store_stats_(nnet_to_update),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update),
+    arena_(arena != NULL ? arena : &own_arena_), arena_data_(NULL),
+    team_(team), own_team_(NULL) {
   Init();
 }
 
 NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
                            Nnet *nnet,
-                           Nnet *nnet_to_update):
+                           Nnet *nnet_to_update,
+                           NnetComputeArena *arena,
+                           ThreadTeam *team):
     options_(options), computation_(computation), nnet_(*nnet),
     program_counter_(0), nnet_to_store_stats_(nnet),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update),
+    arena_(arena != NULL ? arena : &own_arena_), arena_data_(NULL),
+    team_(team), own_team_(NULL) {
   Init();
 }
 
+BaseFloat *NnetComputeArena::GetMemory(int64 size) {
+  KALDI_ASSERT(size >= 0 && size < std::numeric_limits<MatrixIndexT>::max());
+  if (size > data_.Dim())
+    data_.Resize(size, kUndefined);
+  return data_.Data();
+}
+
 void NnetComputer::Init() {
   KALDI_ASSERT(computation_.indexes_cuda.size() == computation_.indexes.size() &&
  computation_.indexes_ranges_cuda.size() == computation_.indexes_ranges.size() &&
@@ -62,6 +83,35 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  // On GPU, class CuAllocator already caches memory.  In debug mode we don't
+  // use the arena, so that unallocated matrices are empty.
+  bool use_arena = !debug_ && computation_.arena_size > 0 &&
+      computation_.matrix_arena_offsets.size() == computation_.matrices.size();
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    use_arena = false;
+#endif
+  if (use_arena)
+    arena_data_ = arena_->GetMemory(computation_.arena_size);
+
+  // Work out whether we can execute commands in parallel.  Backprop is
+  // excluded because of the memos and the model update, and looped
+  // computations because a matrix may be allocated more than once; for those
+  // computations, computation_.command_dependencies is empty.
+  bool parallel = !debug_ && options_.num_threads > 1 &&
+      !computation_.command_dependencies.empty();
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    parallel = false;
+#endif
+  if (!parallel) {
+    team_ = NULL;
+    return;
+  }
+  if (team_ == NULL) {
+    own_team_ = new ThreadTeam(options_.num_threads);
+    team_ = own_team_;
+  }
 }
 
 //static
@@ -173,6 +223,47 @@ void NnetComputer::SaveMemo(int32 memo_index,
   }
 }
 
+void NnetComputer::PropagateFused(const NnetComputation::Command &c) {
+  const Component *component = nnet_.GetComponent(c.arg1),
+      *fused_component = nnet_.GetComponent(c.arg7);
+  ComponentPrecomputedIndexes *indexes =
+      computation_.component_precomputed_indexes[c.arg2].data;
+  const CuSubMatrix<BaseFloat> input(GetSubMatrix(c.arg3));
+  CuSubMatrix<BaseFloat> output(GetSubMatrix(c.arg4));
+  // We only split the rows into blocks if the output rows only depend on the
+  // corresponding input rows (see IsFusableCommand() in
+  // nnet-optimize-utils.cc).
+  int32 properties = component->Properties(),
+      fused_properties = fused_component->Properties();
+  bool use_blocks = (properties & kSimpleComponent) &&
+      !((properties | fused_properties) & (kUsesMemo | kStoresStats));
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    use_blocks = false;
+#endif
+  // Memos are never needed here: FuseInferenceCommands() only fuses commands
+  // that don't save memos.  We don't expect StoreStats() to be needed either.
+  KALDI_ASSERT(c.arg5 == 0 && c.arg6 == 0);
+  if (!use_blocks) {
+    SaveMemo(0, *component, component->Propagate(indexes, input, &output));
+    SaveMemo(0, *fused_component,
+             fused_component->Propagate(NULL, output, &output));
+    return;
+  }
+  // The blocks are about 256KB of output, which should fit in the L2 cache.
+  int32 num_rows = output.NumRows(),
+      block_size = std::max<int32>(16, 65536 / output.NumCols());
+  for (int32 r = 0; r < num_rows; r += block_size) {
+    int32 this_num_rows = std::min<int32>(block_size, num_rows - r);
+    const CuSubMatrix<BaseFloat> input_part(input.RowRange(r, this_num_rows));
+    CuSubMatrix<BaseFloat> output_part(output.RowRange(r, this_num_rows));
+    SaveMemo(0, *component,
+             component->Propagate(indexes, input_part, &output_part));
+    SaveMemo(0, *fused_component,
+             fused_component->Propagate(NULL, output_part, &output_part));
+  }
+}
+
 void* NnetComputer::GetMemo(int32 memo_index) {
   if (memo_index == 0) {
     return NULL;
@@ -199,29 +290,56 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
-  // Note: this is the same as the default copy constructor, except for the check below.
+    arena_(&own_arena_),
+    arena_data_(NULL),
+    memos_(other.memos_),
+    team_(NULL),
+    own_team_(NULL) {
+  // Note: this is the same as the default copy constructor, except for the
+  // check below and for the arena and the ThreadTeam.  The copy does not use
+  // the arena: the matrices that are live in the arena of 'other' are copied
+  // to matrices_, so that copies (e.g. one per RNNLM state) only store what
+  // is needed to continue the computation, not its peak memory.
   if (!memos_.empty()) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
         "memos are used.";
   }
+  if (other.arena_data_ != NULL) {
+    int32 num_matrices = computation_.matrices.size();
+    for (int32 m = 1; m < num_matrices; m++) {
+      if (!other.IsLiveInArena(m))
+        continue;
+      const NnetComputation::MatrixInfo &info = computation_.matrices[m];
+      matrices_[m].Resize(info.num_rows, info.num_cols, kUndefined,
+                          info.stride_type);
+      matrices_[m].CopyFromMat(CuSubMatrix<BaseFloat>(
+          other.arena_data_ + computation_.matrix_arena_offsets[m],
+          info.num_rows, info.num_cols, computation_.ArenaStride(m)));
+    }
+  }
+  if (other.team_ != NULL) {
+    own_team_ = new ThreadTeam(other.team_->NumThreads());
+    team_ = own_team_;
+  }
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command) {
+  const NnetComputation::Command &c = computation_.commands[command];
   int32 m1, m2;
   try {
     switch (c.command_type) {
       case kAllocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
-        matrices_[m1].Resize(computation_.matrices[m1].num_rows,
-                             computation_.matrices[m1].num_cols,
-                             kUndefined,
-                             computation_.matrices[m1].stride_type);
+        if (arena_data_ == NULL || computation_.matrix_arena_offsets[m1] < 0)
+          matrices_[m1].Resize(computation_.matrices[m1].num_rows,
+                               computation_.matrices[m1].num_cols,
+                               kUndefined,
+                               computation_.matrices[m1].stride_type);
         break;
       case kDeallocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
-        matrices_[m1].Resize(0, 0);
+        if (arena_data_ == NULL || computation_.matrix_arena_offsets[m1] < 0)
+          matrices_[m1].Resize(0, 0);
         break;
       case kSwapMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
@@ -235,6 +353,10 @@ void NnetComputer::ExecuteCommand() {
         break;
       }
       case kPropagate: {
+        if (c.arg7 >= 0) {
+          PropagateFused(c);
+          break;
+        }
         const Component *component = nnet_.GetComponent(c.arg1);
         ComponentPrecomputedIndexes *indexes =
             computation_.component_precomputed_indexes[c.arg2].data;
@@ -430,18 +552,25 @@ void NnetComputer::ExecuteCommand() {
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
-    if (!debug_) {
-      std::string preamble;
-      computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
-      KALDI_WARN << "Printing some background info since error was detected";
-      KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
-        KALDI_LOG << command_strings_[prev_c];
-    }
-    // the following will re-throw the error, but now we've printed more info
-    // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    // In RunParallel() the error is reported by the calling thread.
+    if (team_ != NULL)
+      throw;
+    ReportCommandError(command);
+  }
+}
+
+void NnetComputer::ReportCommandError(int32 command) {
+  if (!debug_) {
+    std::string preamble;
+    computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
+    KALDI_WARN << "Printing some background info since error was detected";
+    KALDI_LOG << preamble;
+    for (int32 prev_c = 0; prev_c < command; prev_c++)
+      KALDI_LOG << command_strings_[prev_c];
   }
+  // the following will re-throw the error, but now we've printed more info
+  // about what went wrong.
+  KALDI_ERR << "Error running command " << command_strings_[command];
 }
 
 CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
@@ -449,11 +578,29 @@ CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
                         computation_.submatrices.size());
   const NnetComputation::SubMatrixInfo &info =
       computation_.submatrices[submatrix_index];
+  if (arena_data_ != NULL) {
+    int64 offset = computation_.matrix_arena_offsets[info.matrix_index];
+    if (offset >= 0) {
+      int32 stride = computation_.ArenaStride(info.matrix_index);
+      return CuSubMatrix<BaseFloat>(
+          arena_data_ + offset + static_cast<int64>(info.row_offset) * stride +
+          info.col_offset, info.num_rows, info.num_cols, stride);
+    }
+  }
   const CuMatrix<BaseFloat> &mat = matrices_[info.matrix_index];
   return CuSubMatrix<BaseFloat>(
       mat, info.row_offset, info.num_rows, info.col_offset, info.num_cols);
 }
 
+bool NnetComputer::IsLiveInArena(int32 m) const {
+  if (arena_data_ == NULL || computation_.matrix_arena_offsets[m] < 0)
+    return false;
+  const std::pair<int32, int32> &lifetime =
+      computation_.matrix_arena_lifetimes[m];
+  return lifetime.first < program_counter_ &&
+      program_counter_ <= lifetime.second;
+}
+
 void NnetComputer::GetPointers(int32 indexes_multi_index,
                                int32 num_cols,
                                CuArray<BaseFloat*> *pointers) {
@@ -516,6 +663,16 @@ void NnetComputer::Run() {
   }
   CheckNoPendingIo();
 
+  if (team_ != NULL) {
+    int32 end_command = program_counter_;
+    while (end_command < num_commands &&
+           c[end_command].command_type != kAcceptInput &&
+           c[end_command].command_type != kProvideOutput)
+      end_command++;
+    RunParallel(end_command);
+    return;
+  }
+
   CommandDebugInfo info;
   Timer timer;
   double total_elapsed_previous = 0.0;
@@ -529,7 +686,7 @@ void NnetComputer::Run() {
     }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    ExecuteCommand(program_counter_);
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -539,6 +696,74 @@ void NnetComputer::Run() {
   }
 }
 
+void NnetComputer::RunParallel(int32 end_command) {
+  int32 begin_command = program_counter_,
+      num_commands = end_command - begin_command;
+  // num_pending[c - begin_command] is the number of commands that command c
+  // is still waiting for.  Commands before begin_command have already been
+  // executed.
+  std::vector<int32> num_pending(num_commands);
+  // The commands that are ready to be executed; we take the lowest-numbered
+  // first, which keeps roughly to the order of the computation.
+  std::priority_queue<int32, std::vector<int32>, std::greater<int32> > ready;
+  for (int32 c = begin_command; c < end_command; c++) {
+    const std::vector<int32> &deps = computation_.command_dependencies[c];
+    num_pending[c - begin_command] = deps.end() -
+        std::lower_bound(deps.begin(), deps.end(), begin_command);
+    if (num_pending[c - begin_command] == 0)
+      ready.push(c);
+  }
+  std::mutex mutex;
+  std::condition_variable condition;
+  int32 num_done = 0, failed_command = -1;
+
+  team_->Run([&](int32 thread_id) {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        while (ready.empty() && num_done < num_commands && failed_command < 0)
+          condition.wait(lock);
+        if (num_done == num_commands || failed_command >= 0)
+          break;
+        int32 command = ready.top();
+        ready.pop();
+        lock.unlock();
+        bool ok = true;
+        try {
+          ExecuteCommand(command);
+        } catch (...) {
+          // Errors are reported by the calling thread, below.
+          ok = false;
+        }
+        lock.lock();
+        if (!ok) {
+          if (failed_command < 0 || command < failed_command)
+            failed_command = command;
+          condition.notify_all();
+          break;
+        }
+        num_done++;
+        int32 num_new_ready = 0;
+        const std::vector<int32> &successors =
+            computation_.command_successors[command];
+        for (size_t i = 0; i < successors.size(); i++) {
+          int32 s = successors[i];
+          if (s < end_command && --num_pending[s - begin_command] == 0) {
+            ready.push(s);
+            num_new_ready++;
+          }
+        }
+        // This thread takes one of the new commands itself.
+        if (num_done == num_commands || num_new_ready > 1)
+          condition.notify_all();
+      }
+    });
+
+  if (failed_command >= 0)
+    ReportCommandError(failed_command);
+  KALDI_ASSERT(num_done == num_commands);
+  program_counter_ = end_command;
+}
+
 void NnetComputer::AcceptInput(const std::string &node_name,
                                CuMatrix<BaseFloat> *input) {
   bool is_output = false;
@@ -679,6 +904,165 @@ NnetComputer::~NnetComputer() {
   // the forward propagation but not the backprop.
   for (size_t i = 0; i < compressed_matrices_.size(); i++)
     delete compressed_matrices_[i];
+  delete own_team_;
+}
+
+
+NnetComputerBatcher::NnetComputerBatcher(
+    const NnetComputation &computation,
+    const NnetComputation &batch_computation,
+    int32 num_sequences):
+    num_sequences_(num_sequences) {
+  KALDI_ASSERT(num_sequences > 0);
+  compatible_ = ComputeRowMaps(computation, batch_computation);
+}
+
+bool NnetComputerBatcher::ComputeRowMaps(
+    const NnetComputation &computation,
+    const NnetComputation &batch_computation) {
+  int32 num_commands = computation.commands.size(),
+      num_matrices = computation.matrices.size();
+  // The program counters and the pending commands are copied between the
+  // computers, so the commands must correspond.
+  if (static_cast<int32>(batch_computation.commands.size()) != num_commands)
+    return false;
+  for (int32 c = 0; c < num_commands; c++)
+    if (computation.commands[c].command_type !=
+        batch_computation.commands[c].command_type)
+      return false;
+  if (batch_computation.matrices.size() != computation.matrices.size() ||
+      computation.matrix_debug_info.size() != computation.matrices.size() ||
+      batch_computation.matrix_debug_info.size() != computation.matrices.size())
+    return false;
+
+  num_rows_.resize(num_matrices, 0);
+  batch_rows_.resize(num_matrices);
+  sequence_rows_.resize(num_matrices);
+  for (int32 m = 1; m < num_matrices; m++) {
+    const NnetComputation::MatrixInfo &info = computation.matrices[m],
+        &batch_info = batch_computation.matrices[m];
+    const std::vector<Cindex> &cindexes =
+        computation.matrix_debug_info[m].cindexes,
+        &batch_cindexes = batch_computation.matrix_debug_info[m].cindexes;
+    int32 num_rows = info.num_rows;
+    if (batch_info.num_rows != num_sequences_ * num_rows ||
+        batch_info.num_cols != info.num_cols ||
+        static_cast<int32>(cindexes.size()) != num_rows ||
+        static_cast<int32>(batch_cindexes.size()) != batch_info.num_rows)
+      return false;
+    num_rows_[m] = num_rows;
+    // row_of_cindex maps each cindex of the matrix (all with n == 0) to its
+    // row.
+    unordered_map<Cindex, int32, CindexHasher> row_of_cindex;
+    for (int32 r = 0; r < num_rows; r++)
+      if (cindexes[r].second.n != 0 ||
+          !row_of_cindex.insert(std::make_pair(cindexes[r], r)).second)
+        return false;
+    std::vector<MatrixIndexT> batch_rows(batch_info.num_rows),
+        sequence_rows(batch_info.num_rows, -1);
+    for (int32 i = 0; i < batch_info.num_rows; i++) {
+      Cindex cindex = batch_cindexes[i];
+      int32 n = cindex.second.n;
+      cindex.second.n = 0;
+      unordered_map<Cindex, int32, CindexHasher>::const_iterator iter =
+          row_of_cindex.find(cindex);
+      if (n < 0 || n >= num_sequences_ || iter == row_of_cindex.end())
+        return false;
+      int32 row = n * num_rows + iter->second;
+      if (sequence_rows[row] != -1)
+        return false;
+      batch_rows[i] = row;
+      sequence_rows[row] = i;
+    }
+    batch_rows_[m] = batch_rows;
+    sequence_rows_[m] = sequence_rows;
+  }
+  return true;
+}
+
+bool NnetComputerBatcher::IsAllocated(const NnetComputer &computer, int32 m) {
+  if (computer.arena_data_ != NULL &&
+      computer.computation_.matrix_arena_offsets[m] >= 0)
+    return computer.IsLiveInArena(m);
+  return computer.matrices_[m].NumRows() != 0;
+}
+
+CuSubMatrix<BaseFloat> NnetComputerBatcher::GetMatrix(NnetComputer *computer,
+                                                      int32 m) {
+  const NnetComputation &computation = computer->computation_;
+  const NnetComputation::MatrixInfo &info = computation.matrices[m];
+  if (computer->arena_data_ != NULL &&
+      computation.matrix_arena_offsets[m] >= 0)
+    return CuSubMatrix<BaseFloat>(
+        computer->arena_data_ + computation.matrix_arena_offsets[m],
+        info.num_rows, info.num_cols, computation.ArenaStride(m));
+  CuMatrix<BaseFloat> &mat = computer->matrices_[m];
+  if (mat.NumRows() == 0)
+    mat.Resize(info.num_rows, info.num_cols, kUndefined, info.stride_type);
+  return CuSubMatrix<BaseFloat>(mat, 0, mat.NumRows(), 0, mat.NumCols());
+}
+
+void NnetComputerBatcher::FreeMatrix(NnetComputer *computer, int32 m) {
+  if (computer->arena_data_ == NULL ||
+      computer->computation_.matrix_arena_offsets[m] < 0)
+    computer->matrices_[m].Resize(0, 0);
+}
+
+void NnetComputerBatcher::Run(const std::vector<NnetComputer*> &computers,
+                              NnetComputer *batch_computer) const {
+  KALDI_ASSERT(compatible_ && !computers.empty() &&
+               computers.size() <= static_cast<size_t>(num_sequences_));
+  int32 num_computers = computers.size(),
+      num_matrices = num_rows_.size();
+  const NnetComputer &first = *(computers[0]);
+  for (int32 i = 0; i < num_computers; i++) {
+    const NnetComputer &computer = *(computers[i]);
+    KALDI_ASSERT(AtSamePoint(computer, first) && computer.memos_.empty() &&
+                 computer.compressed_matrices_.empty());
+  }
+
+  // Copy the matrices of the computers to the batch computer.  They are all at
+  // the same point of the computation, so the same matrices are allocated.
+  for (int32 m = 1; m < num_matrices; m++) {
+    if (!IsAllocated(first, m)) {
+      FreeMatrix(batch_computer, m);
+      continue;
+    }
+    int32 num_rows = num_rows_[m];
+    CuMatrix<BaseFloat> stacked(num_sequences_ * num_rows,
+                                first.computation_.matrices[m].num_cols,
+                                kUndefined);
+    for (int32 n = 0; n < num_sequences_; n++) {
+      NnetComputer *computer = computers[n < num_computers ? n : 0];
+      stacked.RowRange(n * num_rows, num_rows).CopyFromMat(
+          GetMatrix(computer, m));
+    }
+    GetMatrix(batch_computer, m).CopyRows(stacked, batch_rows_[m]);
+  }
+  batch_computer->program_counter_ = first.program_counter_;
+  batch_computer->pending_commands_ = first.pending_commands_;
+
+  batch_computer->Run();
+
+  for (int32 m = 1; m < num_matrices; m++) {
+    if (!IsAllocated(*batch_computer, m)) {
+      for (int32 i = 0; i < num_computers; i++)
+        FreeMatrix(computers[i], m);
+      continue;
+    }
+    int32 num_rows = num_rows_[m];
+    CuSubMatrix<BaseFloat> batch_mat(GetMatrix(batch_computer, m));
+    CuMatrix<BaseFloat> stacked(num_sequences_ * num_rows,
+                                batch_mat.NumCols(), kUndefined);
+    stacked.CopyRows(batch_mat, sequence_rows_[m]);
+    for (int32 i = 0; i < num_computers; i++)
+      GetMatrix(computers[i], m).CopyFromMat(
+          stacked.RowRange(i * num_rows, num_rows));
+  }
+  for (int32 i = 0; i < num_computers; i++) {
+    computers[i]->program_counter_ = batch_computer->program_counter_;
+    computers[i]->pending_commands_ = batch_computer->pending_commands_;
+  }
 }
 
 } // namespace nnet3
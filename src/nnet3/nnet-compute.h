@@ -25,6 +25,7 @@
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-example.h"
+#include "util/kaldi-thread.h"
 
 #include <iostream>
 #include <sstream>
@@ -38,16 +39,49 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  NnetComputeOptions(): debug(false), num_threads(1) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "If >1, the number of threads "
+                   "with which to execute independent commands of the "
+                   "computation (e.g. different branches of the network) in "
+                   "parallel.  Only applies to computations without backprop "
+                   "when running on CPU.  Best used with a single-threaded "
+                   "BLAS.");
   }
 
 };
 
 
+/**
+   class NnetComputeArena holds the block of memory in which class NnetComputer,
+   on CPU, puts the matrices that the memory plan of the computation places
+   there (see NnetComputation::matrix_arena_offsets).  It only ever grows, so
+   that if the same arena is given to successive NnetComputer objects (e.g. one
+   per chunk and utterance when decoding), the system allocator is not called
+   for those matrices once it has reached the largest
+   NnetComputation::arena_size.  An arena may only be used by one NnetComputer
+   object at a time.
+ */
+class NnetComputeArena {
+ public:
+  NnetComputeArena() { }
+
+  /// Returns a pointer to memory for at least 'size' BaseFloats (which is not
+  /// initialized).  This invalidates pointers returned by earlier calls.
+  BaseFloat *GetMemory(int64 size);
+
+  /// Returns the current size of the arena, in BaseFloats.
+  int64 Size() const { return data_.Dim(); }
+ private:
+  Vector<BaseFloat> data_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetComputeArena);
+};
+
+
 /**
   class NnetComputer is responsible for executing the computation described in the
   "computation" object.
@@ -65,10 +99,22 @@ class NnetComputer {
   ///
   /// Caution: there is another constructor that takes a pointer for
   /// 'nnet', be careful not to mix these up.
+  ///
+  /// If 'arena' is non-NULL, it is used for the matrices in the memory plan of
+  /// the computation when running on CPU (see class NnetComputeArena);
+  /// otherwise this object allocates its own arena.
+  ///
+  /// If options.num_threads > 1 and the computation can be run in parallel
+  /// (see Run()), the threads of 'team' are used if it is non-NULL; otherwise
+  /// this object creates its own ThreadTeam with options.num_threads threads.
+  /// Giving the team avoids creating threads for each computation, but the
+  /// same team may only be used by one NnetComputer at a time.
   NnetComputer(const NnetComputeOptions &options,
                const NnetComputation &computation,
                const Nnet &nnet,
-               Nnet *nnet_to_update);
+               Nnet *nnet_to_update,
+               NnetComputeArena *arena = NULL,
+               ThreadTeam *team = NULL);
 
   /// This version of the constructor accepts a pointer to 'nnet' instead
   /// of a const reference.  The difference is that this version will,
@@ -77,14 +123,18 @@ class NnetComputer {
   NnetComputer(const NnetComputeOptions &options,
                const NnetComputation &computation,
                Nnet *nnet,
-               Nnet *nnet_to_update);
+               Nnet *nnet_to_update,
+               NnetComputeArena *arena = NULL,
+               ThreadTeam *team = NULL);
 
 
   /// Copy constructor.  May not be used if memos are stored with this object
   /// (which is only a possibility if backprop will take place, and in these
   /// situations you won't normally be wanting to use the copy constructor
   /// anyway; the copy constructor is more useful for things like RNNLM lattice
-  /// rescoring).
+  /// rescoring).  The copy does not use an arena: it stores only the matrices
+  /// that are live at this point of the computation.  It has its own
+  /// ThreadTeam if 'other' runs commands in parallel.
   NnetComputer(const NnetComputer &other);
 
   /// e.g. AcceptInput ("input", &input_mat), or for derivatives w.r.t. the
@@ -110,6 +160,11 @@ class NnetComputer {
   /// and provide derivatives; and the second time you call it, it will do
   /// the backward computation.  There used to be two separate functions
   /// Forward() and Backward().
+  ///
+  /// If options.num_threads > 1, and the computation has no backprop and no
+  /// loop (i.e. is not a looped computation) and we are on CPU and not in
+  /// debug mode, commands that do not depend on each other (see
+  /// ComputeCommandDependencies()) may be executed at the same time.
   void Run();
 
   // e.g. GetOutput("output").  This function can also be used to get
@@ -127,6 +182,8 @@ class NnetComputer {
 
   ~NnetComputer();
  private:
+  friend class NnetComputerBatcher;
+
   void Init(); // called from constructors.
 
   const NnetComputeOptions &options_;
@@ -156,9 +213,19 @@ class NnetComputer {
   // command_strings_ is only used if debug_=true, or in case of error.
   std::vector<std::string> command_strings_;
 
-  // The matrices used in the computation.
+  // The matrices used in the computation (except for those in the arena, if
+  // arena_data_ is non-NULL).
   std::vector<CuMatrix<BaseFloat> > matrices_;
 
+  // The arena we were given in the constructor, or &own_arena_.
+  NnetComputeArena *arena_;
+  NnetComputeArena own_arena_;
+  // The start of the memory of the arena, if we are using the memory plan of
+  // the computation (on CPU, and not in debug mode), or NULL.  If non-NULL,
+  // matrices m with computation_.matrix_arena_offsets[m] >= 0 are in the
+  // arena, and the corresponding elements of matrices_ are not used.
+  BaseFloat *arena_data_;
+
   // Memos returned by Propagate() that must be passed to the corresponding
   // Backprop() routines, indexed by memo-index (zeroth element always
   // NULL).
@@ -172,9 +239,27 @@ class NnetComputer {
   // happens.
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
+  // The team of threads with which commands are executed in parallel, or NULL
+  // if they are executed in sequence.  It is the team we were given in the
+  // constructor, or own_team_.
+  ThreadTeam *team_;
+  // The team that we created ourselves, if any (deleted in the destructor).
+  ThreadTeam *own_team_;
+
 
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // executes the command computation_.commands[command].  A kGotoLabel
+  // command sets program_counter_.  On error it calls ReportCommandError(),
+  // except when executing commands in parallel.
+  void ExecuteCommand(int32 command);
+
+  // Called when executing command 'command' failed; prints the commands
+  // before it to help with debugging, and throws an error.
+  void ReportCommandError(int32 command);
+
+  // Called from Run() if team_ != NULL: executes the commands from
+  // program_counter_ to end_command - 1, in parallel as their dependencies
+  // allow, and sets program_counter_ to end_command.
+  void RunParallel(int32 end_command);
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -195,6 +280,11 @@ class NnetComputer {
 
   CuSubMatrix<BaseFloat> GetSubMatrix(int32 submatrix_index);
 
+  // Returns true if matrix m is in the arena (see arena_data_) and is live
+  // at program_counter_, according to computation_.matrix_arena_lifetimes.
+  // Matrices in the arena that are not live may share memory with live ones.
+  bool IsLiveInArena(int32 m) const;
+
   void GetPointers(int32 indexes_multi_index,
                    int32 num_cols,
                    CuArray<BaseFloat*> *pointers);
@@ -234,6 +324,12 @@ class NnetComputer {
   // is non-NULL and memo_index is 0, it is an error.
   inline void SaveMemo(int32 memo_index, const Component &c, void *memo);
 
+  // Used in executing a kPropagate command that has a fused in-place
+  // component (c.arg7 >= 0, see FuseInferenceCommands()).  On CPU, if the
+  // first component is simple, the two propagations are done on blocks of
+  // rows, so that the output is still in cache for the second one.
+  void PropagateFused(const NnetComputation::Command &c);
+
   // simple helper function used in executing Backprop().
   // Retrieves memo from 'memo_index' (or returns NULL if
   // memo_index = 0), and sets that value to NULL as
@@ -244,6 +340,84 @@ class NnetComputer {
 };
 
 
+/**
+   class NnetComputerBatcher runs several NnetComputer objects that are
+   executing the same looped computation, each for one sequence, together as
+   one computation for several sequences; this is faster because the matrix
+   multiplications are bigger.  It is used for the RNNLM states in lattice
+   rescoring (see RnnlmComputeState::GetSuccessorStates()).
+
+   The computation for several sequences ('batch_computation') must be
+   compiled from the same requests as the computation for one sequence
+   ('computation'), except for the number of sequences (the 'n' index).  The
+   two computations then normally have the same commands and matrices, the
+   matrices of the batch computation having the rows for all the sequences.
+   The constructor checks this using the debug info of the matrices; if an
+   optimization treated the two computations differently, IsCompatible()
+   returns false and Run() may not be called.
+ */
+class NnetComputerBatcher {
+ public:
+  /// Both computations must have their debug info (see
+  /// CompilerOptions::output_debug_info, which is true by default).
+  NnetComputerBatcher(const NnetComputation &computation,
+                      const NnetComputation &batch_computation,
+                      int32 num_sequences);
+
+  /// Returns true if Run() may be called.
+  bool IsCompatible() const { return compatible_; }
+
+  int32 NumSequences() const { return num_sequences_; }
+
+  /// Returns true if 'a' and 'b' are at the same point of their computation,
+  /// so that they may be given to the same call to Run().
+  static bool AtSamePoint(const NnetComputer &a, const NnetComputer &b) {
+    return a.program_counter_ == b.program_counter_ &&
+        a.pending_commands_ == b.pending_commands_;
+  }
+
+  /// Does the same as calling Run() on each of 'computers', of which there
+  /// must be between one and NumSequences().  They must all be executing
+  /// 'computation', be at the same point in it, and have been given their
+  /// inputs.  'batch_computer' must be executing 'batch_computation'; its
+  /// state is overwritten.  If there are fewer than NumSequences() computers,
+  /// the remaining sequences are computed for a copy of the first one, and
+  /// discarded.
+  void Run(const std::vector<NnetComputer*> &computers,
+           NnetComputer *batch_computer) const;
+
+ private:
+  // Works out batch_rows_ and sequence_rows_; returns false if the
+  // computations are not compatible.
+  bool ComputeRowMaps(const NnetComputation &computation,
+                      const NnetComputation &batch_computation);
+
+  // Returns true if matrix m of 'computer' is allocated; for matrices in the
+  // arena, if it is live at the computer's program counter.
+  static bool IsAllocated(const NnetComputer &computer, int32 m);
+
+  // Returns matrix m of 'computer', allocating it first if needed.
+  static CuSubMatrix<BaseFloat> GetMatrix(NnetComputer *computer, int32 m);
+
+  // Makes sure that matrix m of 'computer' is not allocated, if it is not in
+  // the arena.
+  static void FreeMatrix(NnetComputer *computer, int32 m);
+
+  bool compatible_;
+  int32 num_sequences_;
+  // The number of rows of each matrix of 'computation' (the same for all
+  // sequences).
+  std::vector<int32> num_rows_;
+  // Consider the matrix formed by stacking the versions of matrix m of
+  // 'computation' for each sequence, so that row r of sequence n is row
+  // n * num_rows_[m] + r.  Then batch_rows_[m] gives, for each row of
+  // matrix m of 'batch_computation', the corresponding row of the stacked
+  // matrix, and sequence_rows_[m] is the inverse mapping.
+  std::vector<CuArray<MatrixIndexT> > batch_rows_;
+  std::vector<CuArray<MatrixIndexT> > sequence_rows_;
+};
+
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -557,6 +557,7 @@ class TdnnComponent: public UpdatableComponent {
 
   BaseFloat OrthonormalConstraint() const { return orthonormal_constraint_; }
  private:
+  friend class QuantizedTdnnComponent;
 
   // This static function is a utility function that extracts a CuSubMatrix
   // representing a subset of rows of 'input_matrix'.
@@ -571,6 +572,15 @@ class TdnnComponent: public UpdatableComponent {
   // see the definition for more explanation.
   static void ModifyComputationIo(time_height_convolution::ConvolutionComputationIo *io);
 
+  // These static functions do the work of ReorderIndexes() and
+  // PrecomputeIndexes(); they are shared with QuantizedTdnnComponent.
+  static void ReorderIndexesInternal(std::vector<Index> *input_indexes,
+                                     std::vector<Index> *output_indexes);
+  static PrecomputedIndexes* PrecomputeIndexesInternal(
+      const std::vector<int32> &time_offsets,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes);
+
   void Check() const;
 
   // Function that updates linear_params_, and bias_params_ if present, which
@@ -265,6 +265,11 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
                                                               compiler);
   optimize = optimize_all;
 
+  optimize.fuse_inference = false;
+  bool succ_no_fuse_inference = UnitTestNnetOptimizeWithOptions(srand_seed, optimize,
+                                                                compiler);
+  optimize = optimize_all;
+
 
   optimize.min_deriv_time = std::numeric_limits<int32>::min();
   optimize.max_deriv_time = std::numeric_limits<int32>::max();
@@ -288,10 +293,64 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
     << "\n  allocate_from_other  ... " << KALDI_SUCCFAIL(succ_no_allocate_from_other)
     << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands)
     << "\n  snip_row_ops         ... " << KALDI_SUCCFAIL(succ_no_snip_row_ops)
+    << "\n  fuse_inference       ... " << KALDI_SUCCFAIL(succ_no_fuse_inference)
     << "\n  no_deriv_time        ... " << KALDI_SUCCFAIL(succ_no_deriv_time);
 #undef KALDI_SUCCFAIL
 }
 
+// Checks that FuseInferenceCommands() does not fuse a BatchNormComponent that
+// is not in test mode, whose output depends on all the rows: it would then be
+// computed on blocks of rows.
+static void UnitTestFuseInferenceBatchNorm() {
+  int32 input_dim = RandInt(10, 30), hidden_dim = RandInt(200, 600),
+      num_frames = RandInt(300, 1000);
+  std::ostringstream config_os;
+  config_os << "input-node name=input dim=" << input_dim << std::endl;
+  config_os << "component name=affine type=AffineComponent input-dim="
+            << input_dim << " output-dim=" << hidden_dim << std::endl;
+  config_os << "component name=batchnorm type=BatchNormComponent dim="
+            << hidden_dim << std::endl;
+  config_os << "component name=relu type=RectifiedLinearComponent dim="
+            << hidden_dim << std::endl;
+  config_os << "component-node name=affine component=affine input=input\n";
+  config_os << "component-node name=batchnorm component=batchnorm "
+            << "input=affine\n";
+  config_os << "component-node name=relu component=relu input=batchnorm\n";
+  config_os << "output-node name=output input=relu\n";
+  std::istringstream config_is(config_os.str());
+  Nnet nnet;
+  nnet.ReadConfig(config_is);
+
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", 0, num_frames));
+  request.outputs.push_back(IoSpecification("output", 0, num_frames));
+  request.need_model_derivative = false;
+  request.store_component_stats = false;
+
+  NnetComputation computation;
+  Compiler compiler(request, nnet);
+  CompilerOptions opts;
+  compiler.CreateComputation(opts, &computation);
+  computation.ComputeCudaIndexes();
+  NnetOptimizeOptions opt_config;
+  opt_config.fuse_inference = true;
+  CachingOptimizingCompiler opt_compiler(nnet, opt_config);
+  const NnetComputation &computation_opt = *opt_compiler.Compile(request);
+
+  Matrix<BaseFloat> input(num_frames, input_dim);
+  input.SetRandn();
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, NULL),
+      computer_opt(compute_opts, computation_opt, nnet, NULL);
+  CuMatrix<BaseFloat> temp(input), temp2(input);
+  computer.AcceptInput("input", &temp);
+  computer_opt.AcceptInput("input", &temp2);
+  computer.Run();
+  computer_opt.Run();
+  KALDI_ASSERT(ApproxEqual(computer.GetOutput("output"),
+                           computer_opt.GetOutput("output")));
+}
+
 static void UnitTestNnetOptimize() {
   for (int32 srand_seed = 0; srand_seed < 40; srand_seed++) {
     KALDI_LOG << "About to run UnitTestNnetOptimizeInternal with srand_seed = "
@@ -314,9 +373,11 @@ int main() {
   CuDevice::Instantiate().SetDebugStrideMode(true);
   CuDevice::Instantiate().SelectGpuId("no");
   UnitTestNnetOptimize();
+  UnitTestFuseInferenceBatchNorm();
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  UnitTestFuseInferenceBatchNorm();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
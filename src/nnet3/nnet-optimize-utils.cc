@@ -4579,6 +4579,92 @@ void FixGotoLabel(NnetComputation *computation) {
   }
 }
 
+
+// Returns true if the kPropagate command 'c' is one whose output we could
+// fuse a following in-place propagation into, or (if 'fused' is true) if it
+// is one that could be fused into the previous propagation.  NnetComputer
+// runs fused propagations of simple components on blocks of rows, so we
+// exclude components whose output rows depend on other rows, which are the
+// ones that use memos or store stats (e.g. BatchNormComponent when not in
+// test mode; even if the memo is not needed here, its statistics would be
+// computed per block).
+static bool IsFusableCommand(const Nnet &nnet,
+                             const NnetComputation::Command &c,
+                             bool fused) {
+  if (c.command_type != kPropagate || c.arg5 != 0 || c.arg6 != 0 ||
+      c.arg7 >= 0)
+    return false;
+  const Component *component = nnet.GetComponent(c.arg1);
+  int32 properties = component->Properties();
+  if (properties & (kUsesMemo | kStoresStats))
+    return false;
+  if (!fused)
+    return true;
+  return (c.arg3 == c.arg4 && (properties & kSimpleComponent) &&
+          (properties & kPropagateInPlace) &&
+          !(properties & kPropagateAdds) &&
+          component->InputDim() == component->OutputDim());
+}
+
+void FuseInferenceCommands(const Nnet &nnet,
+                           NnetComputation *computation) {
+  int32 num_commands = computation->commands.size();
+  for (int32 c = 0; c < num_commands; c++) {
+    CommandType command_type = computation->commands[c].command_type;
+    if (command_type == kBackprop || command_type == kBackpropNoModelUpdate)
+      return;  // This optimization is only for test-time computations.
+  }
+  Analyzer analyzer;
+  analyzer.Init(nnet, *computation);
+  int32 num_fused = 0;
+  std::vector<int32> variables;
+  for (int32 c1 = 0; c1 < num_commands; c1++) {
+    NnetComputation::Command &command1 = computation->commands[c1];
+    if (!IsFusableCommand(nnet, command1, false))
+      continue;
+    // Find the first command after c1 that accesses the output of c1.
+    variables.clear();
+    analyzer.variables.AppendVariablesForSubmatrix(command1.arg4, &variables);
+    int32 c2 = num_commands;
+    for (size_t i = 0; i < variables.size(); i++) {
+      const std::vector<Access> &accesses =
+          analyzer.variable_accesses[variables[i]];
+      std::vector<Access>::const_iterator iter = accesses.begin(),
+          end = accesses.end();
+      for (; iter != end; ++iter) {
+        if (iter->command_index > c1) {
+          c2 = std::min(c2, iter->command_index);
+          break;
+        }
+      }
+    }
+    if (c2 == num_commands)
+      continue;
+    NnetComputation::Command &command2 = computation->commands[c2];
+    if (!IsFusableCommand(nnet, command2, true) ||
+        command2.arg3 != command1.arg4)
+      continue;
+    // We'll be moving the propagation in c2 up to c1, so there must be no
+    // labels or markers in between (e.g. for looped computations).
+    bool ok = true;
+    for (int32 c = c1 + 1; c < c2; c++) {
+      CommandType command_type = computation->commands[c].command_type;
+      if (command_type == kNoOperationMarker ||
+          command_type == kNoOperationLabel ||
+          command_type == kNoOperationPermanent ||
+          command_type == kGotoLabel)
+        ok = false;
+    }
+    if (!ok)
+      continue;
+    command1.arg7 = command2.arg1;
+    command2.command_type = kNoOperation;
+    num_fused++;
+  }
+  if (num_fused > 0)
+    RemoveNoOps(computation);
+}
+
 bool MatrixIsUnused(const Analyzer &analyzer,
                     const NnetComputation &computation,
                     int32 m) {
@@ -5023,6 +5109,9 @@ void ComputationCache::Read(std::istream &is, bool binary) {
   KALDI_ASSERT(computation_cache_size >= 0);
   computation_cache_.clear();
   access_queue_.clear();
+  // Keep all the computations we read, even if there are more than the
+  // capacity (e.g. precompiled computations for decoding).
+  cache_capacity_ = std::max(cache_capacity_, computation_cache_size);
   ExpectToken(is, binary, "<ComputationCache>");
   for (size_t c = 0; c < computation_cache_size; c++) {
     ComputationRequest request;
@@ -616,6 +616,22 @@ void OptimizeLoopedComputation(const Nnet &nnet,
 void FixGotoLabel(NnetComputation *computation);
 
 
+/// This optimization, which only does something for computations without
+/// backprop (i.e. at test time), looks for a kPropagate command followed by a
+/// propagation that operates in-place on its output, of a simple component
+/// such as a nonlinearity (e.g. AffineComponent followed by
+/// RectifiedLinearComponent), where nothing else accesses that output in
+/// between.  It fuses the second into the first command by setting its
+/// arg7 to the second component, which lets NnetComputer do both on blocks
+/// of rows while they are still in cache.  Components whose output rows
+/// depend on other rows (those that use memos or store stats, such as
+/// BatchNormComponent when not in test mode) are never fused.  Batch-norm and
+/// scale-and-offset components should be folded into the affine parameters
+/// beforehand by CollapseModel().
+void FuseInferenceCommands(const Nnet &nnet,
+                           NnetComputation *computation);
+
+
 /// Class ComputationCache is used inside class CachingOptimizingCompiler to
 /// cache previously computed computations.  The code was moved from class
 /// CachingOptimizingCompiler to this separate class for clarity when adding
@@ -79,6 +79,10 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FuseInference>");
+    ReadBasicType(is, binary, &fuse_inference);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -122,6 +126,8 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FuseInference>");
+  WriteBasicType(os, binary, fuse_inference);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -143,7 +149,8 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_inference == fuse_inference);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -579,6 +586,14 @@ void Optimize(const NnetOptimizeOptions &config,
       CheckComputation(nnet, *computation, false);
   }
 
+  if (config.optimize && config.fuse_inference) {
+    // this only does something for computations without backprop; it has to
+    // go before OptimizeLoopedComputation(), as it renumbers the commands.
+    FuseInferenceCommands(nnet, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
 
   if ((config.optimize && config.move_sizing_commands) ||
       config.optimize_looped_computation) {
@@ -639,7 +654,8 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
-    seconds_taken_io_(0.0), cache_(config.cache_capacity),
+    seconds_taken_io_(0.0), num_computations_compiled_(0),
+    cache_(config.cache_capacity),
     nnet_left_context_(-1), nnet_right_context_(-1) { }
 
 CachingOptimizingCompiler::CachingOptimizingCompiler(
@@ -650,7 +666,8 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
-    seconds_taken_io_(0.0), cache_(config.cache_capacity),
+    seconds_taken_io_(0.0), num_computations_compiled_(0),
+    cache_(config.cache_capacity),
     nnet_left_context_(-1), nnet_right_context_(-1) { }
 
 void CachingOptimizingCompiler::GetSimpleNnetContext(
@@ -663,14 +680,17 @@ void CachingOptimizingCompiler::GetSimpleNnetContext(
   *nnet_right_context = nnet_right_context_;
 }
 
-void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
+bool CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
   {
     Timer timer;
     NnetOptimizeOptions opt_config_cached;
     opt_config_cached.Read(is, binary);
     // we won't read cached computations if any optimize option has been changed.
-    if (!(opt_config_ == opt_config_cached))
-      return;
+    if (!(opt_config_ == opt_config_cached)) {
+      KALDI_WARN << "Not using the cached computations, as they were "
+                 << "compiled with different optimization options.";
+      return false;
+    }
     cache_.Read(is, binary);
     seconds_taken_io_ += timer.Elapsed();
   }
@@ -682,7 +702,7 @@ void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
     // arbitrary but it only affects printed times-taken.
     seconds_taken_total_ += timer.Elapsed();
   }
-
+  return true;
 }
 
 void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
@@ -692,6 +712,55 @@ void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
   seconds_taken_io_ += timer.Elapsed();
 }
 
+// Returns a hash of the output of nnet.Info(), which describes the structure
+// of the network (and summarizes its parameters).  This is used to make sure
+// that precompiled computations are only used with the network they were
+// compiled for.
+static uint64 GetNnetInfoHash(const Nnet &nnet) {
+  std::string info = nnet.Info();
+  // This is the 64-bit FNV-1a hash.
+  uint64 ans = 14695981039346656037ULL;
+  for (size_t i = 0; i < info.size(); i++) {
+    ans ^= static_cast<unsigned char>(info[i]);
+    ans *= 1099511628211ULL;
+  }
+  return ans;
+}
+
+void WriteComputationCacheHeader(const Nnet &nnet, bool looped,
+                                 std::ostream &os, bool binary) {
+  WriteToken(os, binary, "<ComputationCacheHeader>");
+  WriteToken(os, binary, "<NnetHash>");
+  WriteBasicType(os, binary, GetNnetInfoHash(nnet));
+  WriteToken(os, binary, "<Looped>");
+  WriteBasicType(os, binary, looped);
+  WriteToken(os, binary, "</ComputationCacheHeader>");
+}
+
+bool ReadComputationCacheHeader(const Nnet &nnet, bool looped,
+                                std::istream &is, bool binary) {
+  uint64 nnet_hash;
+  bool looped_in;
+  ExpectToken(is, binary, "<ComputationCacheHeader>");
+  ExpectToken(is, binary, "<NnetHash>");
+  ReadBasicType(is, binary, &nnet_hash);
+  ExpectToken(is, binary, "<Looped>");
+  ReadBasicType(is, binary, &looped_in);
+  ExpectToken(is, binary, "</ComputationCacheHeader>");
+  if (nnet_hash != GetNnetInfoHash(nnet)) {
+    KALDI_WARN << "Not using the precompiled computations, as they were "
+               << "compiled for a different neural network.";
+    return false;
+  }
+  if (looped_in != looped) {
+    KALDI_WARN << "Not using the precompiled computations, as they were "
+               << "compiled for " << (looped_in ? "looped" : "non-looped")
+               << " decoding.";
+    return false;
+  }
+  return true;
+}
+
 CachingOptimizingCompiler::~CachingOptimizingCompiler() {
   if (seconds_taken_total_ > 0.0 || seconds_taken_io_ > 0.0) {
     std::ostringstream os;
@@ -733,6 +802,7 @@ std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileInterna
     if (computation == NULL)
       computation = CompileNoShortcut(request);
     KALDI_ASSERT(computation != NULL);
+    num_computations_compiled_++;
     return cache_.Insert(request, computation);
   }
 }
@@ -21,6 +21,7 @@
 #ifndef KALDI_NNET3_NNET_OPTIMIZE_H_
 #define KALDI_NNET3_NNET_OPTIMIZE_H_
 
+#include <atomic>
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-optimize-utils.h"
@@ -54,6 +55,7 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_inference;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +81,7 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_inference(true),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +148,11 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-inference", &fuse_inference, "Set this to false to "
+                   "disable an optimization, only applied to computations "
+                   "without backprop, that fuses the propagation of in-place "
+                   "components such as nonlinearities into the propagation "
+                   "of the preceding component (e.g. an affine component).");
 
   }
   void Read(std::istream &is, bool binary);
@@ -239,9 +247,16 @@ class CachingOptimizingCompiler {
   /// 'std::shared_ptr<const NnetComputation>' in the calling code.
   std::shared_ptr<const NnetComputation> Compile(
       const ComputationRequest &request);
-  void ReadCache(std::istream &is, bool binary);
+  /// Reads computations written by WriteCache() into the cache.  Returns
+  /// false (with a warning) if they were not read because they were compiled
+  /// with different optimization options.
+  bool ReadCache(std::istream &is, bool binary);
   void WriteCache(std::ostream &os, bool binary);
 
+  /// Returns the number of computations this object has compiled, i.e. that
+  /// it did not find in its cache.
+  int32 NumComputationsCompiled() const { return num_computations_compiled_; }
+
 
   // GetSimpleNnetContext() is equivalent to calling:
   // ComputeSimpleNnetContext(nnet_, &nnet_left_context,
@@ -299,6 +314,10 @@ class CachingOptimizingCompiler {
   double seconds_taken_indexes_;
   double seconds_taken_io_;
 
+  // The number of computations compiled (see NumComputationsCompiled()); it is
+  // atomic because Compile() may be called from multiple threads.
+  std::atomic<int32> num_computations_compiled_;
+
   ComputationCache cache_;
 
   // These following two variables are only used by the function GetSimpleNnetContext().
@@ -391,6 +410,22 @@ void ConsolidateIoOperations(const Nnet &nnet,
                              NnetComputation *computation);
 
 
+/// Writes the header of a file of precompiled computations for decoding with
+/// 'nnet' (see nnet3-compile-cache), which identifies the network and whether
+/// the computations are for looped decoding.  The computations themselves
+/// follow (see CachingOptimizingCompiler::WriteCache() and
+/// DecodableNnetSimpleLoopedInfo::WriteComputationCache()).
+void WriteComputationCacheHeader(const Nnet &nnet, bool looped,
+                                 std::ostream &os, bool binary);
+
+/// Reads the header written by WriteComputationCacheHeader().  Returns true if
+/// the computations that follow are for 'nnet' and of the type given by
+/// 'looped'; otherwise it prints a warning and returns false, and the
+/// computations should not be read.
+bool ReadComputationCacheHeader(const Nnet &nnet, bool looped,
+                                std::istream &is, bool binary);
+
+
 
 } // namespace nnet3
 } // namespace kaldi
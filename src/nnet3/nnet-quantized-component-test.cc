@@ -0,0 +1,178 @@
+// nnet3/nnet-quantized-component-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns the norm of (a - b) divided by the norm of b.
+static BaseFloat RelativeDifference(const MatrixBase<BaseFloat> &a,
+                                    const MatrixBase<BaseFloat> &b) {
+  Matrix<BaseFloat> diff(a);
+  diff.AddMat(-1.0, b);
+  return diff.FrobeniusNorm() / b.FrobeniusNorm();
+}
+
+void UnitTestQuantizedMatrix() {
+  int32 num_rows = RandInt(1, 50), num_cols = RandInt(1, 200);
+  Matrix<BaseFloat> mat(num_rows, num_cols);
+  mat.SetRandn();
+  if (RandInt(0, 1) == 0)
+    mat.Row(0).SetZero();
+  QuantizedMatrix qmat(mat);
+  KALDI_ASSERT(qmat.NumRows() == num_rows && qmat.NumCols() == num_cols &&
+               qmat.Stride() % 64 == 0 && qmat.Stride() >= num_cols);
+  Matrix<BaseFloat> mat2;
+  qmat.Dequantize(&mat2);
+  for (int32 i = 0; i < num_rows; i++) {
+    // The error is at most half a quantization step.
+    BaseFloat max_error = 0.5 * qmat.RowScale(i) + 1.0e-06;
+    for (int32 j = 0; j < num_cols; j++)
+      KALDI_ASSERT(std::abs(mat(i, j) - mat2(i, j)) <= max_error);
+  }
+
+  for (int32 binary = 0; binary < 2; binary++) {
+    std::ostringstream os;
+    qmat.Write(os, binary != 0);
+    std::istringstream is(os.str());
+    QuantizedMatrix qmat2;
+    qmat2.Read(is, binary != 0);
+    Matrix<BaseFloat> mat3;
+    qmat2.Dequantize(&mat3);
+    KALDI_ASSERT(mat3.ApproxEqual(mat2, 1.0e-05));
+    for (int32 i = 0; i < num_rows; i++)
+      KALDI_ASSERT(qmat2.RowSum(i) == qmat.RowSum(i));
+  }
+}
+
+void UnitTestAddMatQuantizedMat() {
+  int32 num_frames = RandInt(1, 30), input_dim = RandInt(1, 300),
+      output_dim = RandInt(1, 30);
+  Matrix<BaseFloat> in(num_frames, input_dim), params(output_dim, input_dim),
+      out(num_frames, output_dim), ref_out(num_frames, output_dim);
+  in.SetRandn();
+  params.SetRandn();
+  if (num_frames > 1)
+    in.Row(1).SetZero();
+  out.SetRandn();
+  ref_out.CopyFromMat(out);
+  ref_out.AddMatMat(1.0, in, kNoTrans, params, kTrans, 1.0);
+  AddMatQuantizedMat(in, QuantizedMatrix(params), &out);
+  BaseFloat diff = RelativeDifference(out, ref_out);
+  KALDI_ASSERT(diff < 0.05);
+}
+
+// Checks that a network gives about the same output after the 'quantize'
+// edit, which converts all its components except the nonlinearity.
+void UnitTestQuantizeNnet() {
+  int32 input_dim = RandInt(10, 50);
+  std::ostringstream config;
+  config << "component name=tdnn1 type=TdnnComponent input-dim=" << input_dim
+         << " output-dim=200 time-offsets=-1,0,1 use-bias="
+         << (RandInt(0, 1) == 0 ? "true" : "false") << "\n"
+         << "component name=relu1 type=RectifiedLinearComponent dim=200\n"
+         << "component name=linear2 type=LinearComponent input-dim=200 "
+         << "output-dim=64\n"
+         << "component name=affine2 type=NaturalGradientAffineComponent "
+         << "input-dim=64 output-dim=100\n"
+         << "component name=affine3 type=FixedAffineComponent "
+         << "input-dim=100 output-dim=80\n"
+         << "input-node name=input dim=" << input_dim << "\n"
+         << "component-node name=tdnn1 component=tdnn1 input=input\n"
+         << "component-node name=relu1 component=relu1 input=tdnn1\n"
+         << "component-node name=linear2 component=linear2 input=relu1\n"
+         << "component-node name=affine2 component=affine2 input=linear2\n"
+         << "component-node name=affine3 component=affine3 input=affine2\n"
+         << "output-node name=output input=affine3\n";
+  Nnet nnet;
+  {
+    std::istringstream is(config.str());
+    nnet.ReadConfig(is);
+  }
+  Nnet quantized_nnet(nnet);
+  {
+    std::istringstream is("quantize");
+    ReadEditConfig(is, &quantized_nnet);
+  }
+  int32 num_quantized = 0;
+  for (int32 c = 0; c < quantized_nnet.NumComponents(); c++) {
+    std::string type = quantized_nnet.GetComponent(c)->Type();
+    if (type == "QuantizedAffineComponent" || type == "QuantizedTdnnComponent")
+      num_quantized++;
+  }
+  KALDI_ASSERT(num_quantized == 4);
+
+  // Writing and reading the quantized network gives the same network.
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  quantized_nnet.Write(os, binary);
+  std::istringstream is(os.str());
+  Nnet quantized_nnet2;
+  quantized_nnet2.Read(is, binary);
+  std::ostringstream os2;
+  quantized_nnet2.Write(os2, binary);
+  KALDI_ASSERT(os.str() == os2.str());
+
+  int32 num_frames = RandInt(5, 50);
+  Matrix<BaseFloat> input(num_frames, input_dim);
+  input.SetRandn();
+  Vector<BaseFloat> priors;
+  Matrix<BaseFloat> output(num_frames, 80), quantized_output(num_frames, 80);
+  NnetSimpleComputationOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  {
+    CachingOptimizingCompiler compiler(nnet);
+    DecodableNnetSimple decodable(opts, nnet, priors, input, &compiler);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+  {
+    CachingOptimizingCompiler compiler(quantized_nnet2);
+    DecodableNnetSimple decodable(opts, quantized_nnet2, priors, input,
+                                  &compiler);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(quantized_output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+  BaseFloat diff = RelativeDifference(quantized_output, output);
+  KALDI_LOG << "Relative difference of the outputs after quantization is "
+            << diff;
+  KALDI_ASSERT(diff < 0.1);
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (int32 i = 0; i < 10; i++) {
+    UnitTestQuantizedMatrix();
+    UnitTestAddMatQuantizedMat();
+  }
+  for (int32 i = 0; i < 3; i++)
+    UnitTestQuantizeNnet();
+  KALDI_LOG << "Quantized component tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,591 @@
+// nnet3/nnet-quantized-component.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#if defined(__AVX2__) || defined(__AVX512VNNI__)
+#include <immintrin.h>
+#endif
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-computation-graph.h"
+#include "nnet3/nnet-parse.h"
+#include "cudamatrix/cu-device.h"
+
+// With AVX-512 VNNI, the inner products are computed with the instruction
+// vpdpbusd, which multiplies unsigned by signed bytes; so we store the
+// quantized inputs with an offset of 128, and subtract 128 times the sum of
+// each row of the parameters afterwards.  Otherwise the inputs are signed
+// like the parameters.
+#if defined(__AVX512VNNI__) && defined(__AVX512F__)
+#define KALDI_QUANTIZED_USE_VNNI 1
+#elif defined(__AVX2__)
+#define KALDI_QUANTIZED_USE_AVX2 1
+#endif
+
+namespace kaldi {
+namespace nnet3 {
+
+namespace {
+
+// The rows of quantized matrices are padded to a multiple of this many bytes,
+// which is the size of an AVX-512 register.
+const int32 kQuantizedRowAlignment = 64;
+
+// The number of rows of the parameters that we multiply each input row by at
+// a time, in AddMatQuantizedMat(); this saves loading the input row again.
+const int32 kQuantizedRowBlock = 4;
+
+int32 QuantizedStride(int32 num_cols) {
+  return (num_cols + kQuantizedRowAlignment - 1) / kQuantizedRowAlignment *
+      kQuantizedRowAlignment;
+}
+
+// Quantizes "row", of dimension "dim", to "dest", which has "stride" elements
+// (the ones after "dim" are set to zero); "offset" is added to each integer
+// (this is 0 or 128).  Returns the scale.
+BaseFloat QuantizeRow(const BaseFloat *row, int32 dim, int32 stride,
+                      int32 offset, int8 *dest) {
+  BaseFloat max_abs = 0.0;
+  for (int32 j = 0; j < dim; j++)
+    max_abs = std::max(max_abs, std::abs(row[j]));
+  std::memset(dest + dim, offset, stride - dim);
+  if (max_abs == 0.0) {
+    std::memset(dest, offset, dim);
+    return 0.0;
+  }
+  BaseFloat inv_scale = 127.0 / max_abs;
+  for (int32 j = 0; j < dim; j++) {
+    int32 q = static_cast<int32>(std::floor(row[j] * inv_scale + 0.5));
+    q = std::max(-127, std::min(127, q));
+    // For offset == 128, this is the unsigned value q + 128 stored in a
+    // signed byte.
+    dest[j] = static_cast<int8>(static_cast<uint8>(q + offset));
+  }
+  return max_abs / 127.0;
+}
+
+#if defined(KALDI_QUANTIZED_USE_VNNI)
+
+inline int32 HorizontalSum(__m512i v) {
+  return _mm512_reduce_add_epi32(v);
+}
+
+// Sets dots[r] to the inner product of "x" (unsigned, with the offset of 128)
+// and w[r], for 0 <= r < num_rows (num_rows <= kQuantizedRowBlock).
+inline void DotProducts(const int8 *x, const int8 *const *w, int32 num_rows,
+                        int32 stride, int32 *dots) {
+  __m512i acc[kQuantizedRowBlock];
+  for (int32 r = 0; r < num_rows; r++)
+    acc[r] = _mm512_setzero_si512();
+  for (int32 k = 0; k < stride; k += 64) {
+    __m512i vx = _mm512_loadu_si512(x + k);
+    for (int32 r = 0; r < num_rows; r++)
+      acc[r] = _mm512_dpbusd_epi32(acc[r], vx,
+                                   _mm512_loadu_si512(w[r] + k));
+  }
+  for (int32 r = 0; r < num_rows; r++)
+    dots[r] = HorizontalSum(acc[r]);
+}
+
+#elif defined(KALDI_QUANTIZED_USE_AVX2)
+
+inline int32 HorizontalSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+  sum = _mm_hadd_epi32(sum, sum);
+  sum = _mm_hadd_epi32(sum, sum);
+  return _mm_cvtsi128_si32(sum);
+}
+
+// Sets dots[r] to the inner product of "x" and w[r], for 0 <= r < num_rows
+// (num_rows <= kQuantizedRowBlock).  The bytes are sign-extended to 16 bits
+// so that vpmaddwd can multiply and add pairs of them without saturation.
+inline void DotProducts(const int8 *x, const int8 *const *w, int32 num_rows,
+                        int32 stride, int32 *dots) {
+  __m256i acc[kQuantizedRowBlock];
+  for (int32 r = 0; r < num_rows; r++)
+    acc[r] = _mm256_setzero_si256();
+  for (int32 k = 0; k < stride; k += 16) {
+    __m256i vx = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + k)));
+    for (int32 r = 0; r < num_rows; r++) {
+      __m256i vw = _mm256_cvtepi8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(w[r] + k)));
+      acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(vx, vw));
+    }
+  }
+  for (int32 r = 0; r < num_rows; r++)
+    dots[r] = HorizontalSum(acc[r]);
+}
+
+#else
+
+// Sets dots[r] to the inner product of "x" and w[r], for 0 <= r < num_rows.
+inline void DotProducts(const int8 *x, const int8 *const *w, int32 num_rows,
+                        int32 stride, int32 *dots) {
+  for (int32 r = 0; r < num_rows; r++) {
+    const int8 *w_row = w[r];
+    int32 sum = 0;
+    for (int32 k = 0; k < stride; k++)
+      sum += static_cast<int32>(x[k]) * static_cast<int32>(w_row[k]);
+    dots[r] = sum;
+  }
+}
+
+#endif
+
+}  // namespace
+
+
+QuantizedMatrix::QuantizedMatrix(const MatrixBase<BaseFloat> &mat) {
+  Resize(mat.NumRows(), mat.NumCols());
+  for (int32 i = 0; i < num_rows_; i++)
+    row_scales_(i) = QuantizeRow(mat.RowData(i), num_cols_, stride_, 0,
+                                 &(data_[i * stride_]));
+  ComputeRowSums();
+}
+
+void QuantizedMatrix::Resize(int32 num_rows, int32 num_cols) {
+  KALDI_ASSERT(num_rows >= 0 && num_cols >= 0);
+  num_rows_ = num_rows;
+  num_cols_ = num_cols;
+  stride_ = QuantizedStride(num_cols);
+  data_.clear();
+  data_.resize(static_cast<size_t>(num_rows) * stride_, 0);
+  row_scales_.Resize(num_rows);
+  row_sums_.clear();
+}
+
+void QuantizedMatrix::ComputeRowSums() {
+  row_sums_.resize(num_rows_);
+  for (int32 i = 0; i < num_rows_; i++) {
+    const int8 *row = RowData(i);
+    int32 sum = 0;
+    for (int32 j = 0; j < num_cols_; j++)
+      sum += row[j];
+    row_sums_[i] = sum;
+  }
+}
+
+void QuantizedMatrix::Dequantize(Matrix<BaseFloat> *mat) const {
+  mat->Resize(num_rows_, num_cols_, kUndefined);
+  for (int32 i = 0; i < num_rows_; i++) {
+    const int8 *row = RowData(i);
+    BaseFloat scale = row_scales_(i);
+    BaseFloat *dest = mat->RowData(i);
+    for (int32 j = 0; j < num_cols_; j++)
+      dest[j] = scale * row[j];
+  }
+}
+
+int64 QuantizedMatrix::MemorySize() const {
+  return static_cast<int64>(data_.size()) +
+      num_rows_ * (sizeof(BaseFloat) + sizeof(int32));
+}
+
+void QuantizedMatrix::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedMatrix>");
+  WriteBasicType(os, binary, num_rows_);
+  WriteBasicType(os, binary, num_cols_);
+  row_scales_.Write(os, binary);
+  // The padding is not written.
+  std::vector<int8> data(static_cast<size_t>(num_rows_) * num_cols_);
+  for (int32 i = 0; i < num_rows_; i++)
+    std::copy(RowData(i), RowData(i) + num_cols_, data.begin() + i * num_cols_);
+  WriteIntegerVector(os, binary, data);
+  WriteToken(os, binary, "</QuantizedMatrix>");
+}
+
+void QuantizedMatrix::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<QuantizedMatrix>");
+  int32 num_rows, num_cols;
+  ReadBasicType(is, binary, &num_rows);
+  ReadBasicType(is, binary, &num_cols);
+  Resize(num_rows, num_cols);
+  row_scales_.Read(is, binary);
+  std::vector<int8> data;
+  ReadIntegerVector(is, binary, &data);
+  if (row_scales_.Dim() != num_rows ||
+      data.size() != static_cast<size_t>(num_rows) * num_cols)
+    KALDI_ERR << "Reading QuantizedMatrix: dimension mismatch.";
+  for (int32 i = 0; i < num_rows; i++)
+    std::copy(data.begin() + i * num_cols, data.begin() + (i + 1) * num_cols,
+              data_.begin() + i * stride_);
+  ComputeRowSums();
+  ExpectToken(is, binary, "</QuantizedMatrix>");
+}
+
+
+void AddMatQuantizedMat(const MatrixBase<BaseFloat> &in,
+                        const QuantizedMatrix &params,
+                        MatrixBase<BaseFloat> *out) {
+  KALDI_ASSERT(in.NumCols() == params.NumCols() &&
+               out->NumRows() == in.NumRows() &&
+               out->NumCols() == params.NumRows());
+  int32 num_frames = in.NumRows(), num_cols = in.NumCols(),
+      num_params = params.NumRows(), stride = params.Stride();
+#if defined(KALDI_QUANTIZED_USE_VNNI)
+  const int32 offset = 128;
+#else
+  const int32 offset = 0;
+#endif
+  // First quantize all the rows of the input, so that in the loop below we
+  // can go through the parameters just once, a block of rows at a time, while
+  // they are in cache.
+  std::vector<int8> in_data(static_cast<size_t>(num_frames) * stride);
+  std::vector<BaseFloat> in_scales(num_frames);
+  for (int32 t = 0; t < num_frames; t++)
+    in_scales[t] = QuantizeRow(in.RowData(t), num_cols, stride, offset,
+                               &(in_data[t * stride]));
+
+  const int8 *w[kQuantizedRowBlock];
+  int32 dots[kQuantizedRowBlock];
+  BaseFloat w_scales[kQuantizedRowBlock];
+  for (int32 j = 0; j < num_params; j += kQuantizedRowBlock) {
+    int32 num_rows = std::min(kQuantizedRowBlock, num_params - j);
+    for (int32 r = 0; r < num_rows; r++) {
+      w[r] = params.RowData(j + r);
+      w_scales[r] = params.RowScale(j + r);
+    }
+    for (int32 t = 0; t < num_frames; t++) {
+      if (in_scales[t] == 0.0)
+        continue;  // This input row is zero.
+      DotProducts(&(in_data[t * stride]), w, num_rows, stride, dots);
+      BaseFloat *out_row = out->RowData(t) + j;
+      for (int32 r = 0; r < num_rows; r++) {
+        int32 dot = dots[r] - offset * params.RowSum(j + r);
+        out_row[r] += in_scales[t] * w_scales[r] * dot;
+      }
+    }
+  }
+}
+
+
+QuantizedAffineComponent::QuantizedAffineComponent(const AffineComponent &c) {
+  Init(c.LinearParams(), c.BiasParams());
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const FixedAffineComponent &c) {
+  Init(c.LinearParams(), c.BiasParams());
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(const LinearComponent &c) {
+  // A LinearComponent is an affine component with zero bias.
+  CuVector<BaseFloat> bias(c.OutputDim());
+  Init(c.Params(), bias);
+}
+
+void QuantizedAffineComponent::Init(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(linear_params.NumRows() == bias_params.Dim() &&
+               linear_params.NumRows() != 0);
+  Matrix<BaseFloat> linear_params_cpu(linear_params);
+  linear_params_ = QuantizedMatrix(linear_params_cpu);
+  bias_params_ = bias_params;
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  std::string filename;
+  CuMatrix<BaseFloat> mat;
+  // Two forms allowed: "matrix=<rxfilename>", or "input-dim=x output-dim=y"
+  // (for testing purposes only).
+  if (cfl->GetValue("matrix", &filename)) {
+    if (cfl->HasUnusedValues())
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    bool binary;
+    Input ki(filename, &binary);
+    mat.Read(ki.Stream(), binary);
+    KALDI_ASSERT(mat.NumRows() != 0 && mat.NumCols() > 1);
+  } else {
+    int32 input_dim = -1, output_dim = -1;
+    if (!cfl->GetValue("input-dim", &input_dim) ||
+        !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues()) {
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    }
+    mat.Resize(output_dim, input_dim + 1);
+    mat.SetRandn();
+  }
+  CuVector<BaseFloat> bias(mat.NumRows());
+  bias.CopyColFromMat(mat, mat.NumCols() - 1);
+  Init(mat.ColRange(0, mat.NumCols() - 1), bias);
+}
+
+std::string QuantizedAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  Matrix<BaseFloat> linear_params;
+  linear_params_.Dequantize(&linear_params);
+  CuMatrix<BaseFloat> linear_params_cu(linear_params);
+  PrintParameterStats(stream, "linear-params", linear_params_cu);
+  PrintParameterStats(stream, "bias", bias_params_, true);
+  stream << ", quantized-size=" << linear_params_.MemorySize();
+  return stream.str();
+}
+
+void* QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  out->CopyRowsFromVec(bias_params_);  // Adds the bias term first.
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    Matrix<BaseFloat> linear_params;
+    linear_params_.Dequantize(&linear_params);
+    CuMatrix<BaseFloat> linear_params_gpu(linear_params);
+    out->AddMatMat(1.0, in, kNoTrans, linear_params_gpu, kTrans, 1.0);
+    return NULL;
+  }
+#endif
+  AddMatQuantizedMat(in.Mat(), linear_params_, &(out->Mat()));
+  return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  // kBackpropAdds is true. It's the user's responsibility to zero out
+  // <in_deriv> if they need it to be so.
+  if (in_deriv) {
+    Matrix<BaseFloat> linear_params;
+    linear_params_.Dequantize(&linear_params);
+    CuMatrix<BaseFloat> linear_params_cu(linear_params);
+    in_deriv->AddMatMat(1.0, out_deriv, kNoTrans,
+                        linear_params_cu, kNoTrans, 1.0);
+  }
+}
+
+Component* QuantizedAffineComponent::Copy() const {
+  QuantizedAffineComponent *ans = new QuantizedAffineComponent();
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<LinearParams>");
+  linear_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>",
+                       "<LinearParams>");
+  linear_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+}
+
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(const TdnnComponent &c):
+    time_offsets_(c.time_offsets_), bias_params_(c.bias_params_) {
+  int32 num_offsets = time_offsets_.size(),
+      input_dim = c.InputDim();
+  Matrix<BaseFloat> linear_params(c.linear_params_);
+  for (int32 i = 0; i < num_offsets; i++)
+    linear_params_.push_back(QuantizedMatrix(
+        linear_params.ColRange(i * input_dim, input_dim)));
+}
+
+void QuantizedTdnnComponent::InitFromConfig(ConfigLine *cfl) {
+  KALDI_ERR << "QuantizedTdnnComponent cannot be initialized from a config "
+            << "line; use the 'quantize' edit directive on a TdnnComponent.";
+}
+
+std::string QuantizedTdnnComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  stream << ", time-offsets=";
+  for (size_t i = 0; i < time_offsets_.size(); i++) {
+    if (i != 0) stream << ',';
+    stream << time_offsets_[i];
+  }
+  int64 quantized_size = 0;
+  for (size_t i = 0; i < linear_params_.size(); i++)
+    quantized_size += linear_params_[i].MemorySize();
+  if (bias_params_.Dim() != 0)
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  stream << ", quantized-size=" << quantized_size;
+  return stream.str();
+}
+
+void* QuantizedTdnnComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+
+  // As in TdnnComponent::Propagate(), if there is no bias we have the flag
+  // kPropagateAdds, so we add to "out".
+  if (bias_params_.Dim() != 0)
+    out->CopyRowsFromVec(bias_params_);
+
+  int32 num_offsets = time_offsets_.size();
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_part = TdnnComponent::GetInputPart(
+        in, out->NumRows(), indexes->row_stride, indexes->row_offsets[i]);
+#if HAVE_CUDA == 1
+    if (CuDevice::Instantiate().Enabled()) {
+      Matrix<BaseFloat> linear_params;
+      linear_params_[i].Dequantize(&linear_params);
+      CuMatrix<BaseFloat> linear_params_gpu(linear_params);
+      out->AddMatMat(1.0, in_part, kNoTrans, linear_params_gpu, kTrans, 1.0);
+      continue;
+    }
+#endif
+    AddMatQuantizedMat(in_part.Mat(), linear_params_[i], &(out->Mat()));
+  }
+  return NULL;
+}
+
+void QuantizedTdnnComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  const TdnnComponent::PrecomputedIndexes *indexes =
+      dynamic_cast<const TdnnComponent::PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL &&
+               indexes->row_offsets.size() == time_offsets_.size());
+  if (in_deriv == NULL)
+    return;
+  int32 num_offsets = time_offsets_.size();
+  for (int32 i = 0; i < num_offsets; i++) {
+    CuSubMatrix<BaseFloat> in_deriv_part = TdnnComponent::GetInputPart(
+        *in_deriv, out_deriv.NumRows(), indexes->row_stride,
+        indexes->row_offsets[i]);
+    Matrix<BaseFloat> linear_params;
+    linear_params_[i].Dequantize(&linear_params);
+    CuMatrix<BaseFloat> linear_params_cu(linear_params);
+    in_deriv_part.AddMatMat(1.0, out_deriv, kNoTrans,
+                            linear_params_cu, kNoTrans, 1.0);
+  }
+}
+
+Component* QuantizedTdnnComponent::Copy() const {
+  QuantizedTdnnComponent *ans = new QuantizedTdnnComponent();
+  ans->time_offsets_ = time_offsets_;
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedTdnnComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedTdnnComponent>");
+  WriteToken(os, binary, "<TimeOffsets>");
+  WriteIntegerVector(os, binary, time_offsets_);
+  WriteToken(os, binary, "<LinearParams>");
+  for (size_t i = 0; i < linear_params_.size(); i++)
+    linear_params_[i].Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedTdnnComponent>");
+}
+
+void QuantizedTdnnComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedTdnnComponent>",
+                       "<TimeOffsets>");
+  ReadIntegerVector(is, binary, &time_offsets_);
+  ExpectToken(is, binary, "<LinearParams>");
+  linear_params_.resize(time_offsets_.size());
+  for (size_t i = 0; i < linear_params_.size(); i++)
+    linear_params_[i].Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedTdnnComponent>");
+  KALDI_ASSERT(!linear_params_.empty() &&
+               (bias_params_.Dim() == 0 ||
+                bias_params_.Dim() == linear_params_[0].NumRows()));
+}
+
+void QuantizedTdnnComponent::ReorderIndexes(
+    std::vector<Index> *input_indexes,
+    std::vector<Index> *output_indexes) const {
+  TdnnComponent::ReorderIndexesInternal(input_indexes, output_indexes);
+}
+
+void QuantizedTdnnComponent::GetInputIndexes(
+    const MiscComputationInfo &misc_info,
+    const Index &output_index,
+    std::vector<Index> *desired_indexes) const {
+  KALDI_ASSERT(output_index.t != kNoTime);
+  size_t size = time_offsets_.size();
+  desired_indexes->resize(size);
+  for (size_t i = 0; i < size; i++) {
+    (*desired_indexes)[i].n = output_index.n;
+    (*desired_indexes)[i].t = output_index.t + time_offsets_[i];
+    (*desired_indexes)[i].x = output_index.x;
+  }
+}
+
+bool QuantizedTdnnComponent::IsComputable(
+    const MiscComputationInfo &misc_info,
+    const Index &output_index,
+    const IndexSet &input_index_set,
+    std::vector<Index> *used_inputs) const {
+  KALDI_ASSERT(output_index.t != kNoTime);
+  size_t size = time_offsets_.size();
+  Index index(output_index);
+  if (used_inputs != NULL) {
+    used_inputs->clear();
+    used_inputs->reserve(size);
+  }
+  for (size_t i = 0; i < size; i++) {
+    index.t = output_index.t + time_offsets_[i];
+    if (!input_index_set(index))
+      return false;
+    if (used_inputs != NULL)
+      used_inputs->push_back(index);
+  }
+  return true;
+}
+
+ComponentPrecomputedIndexes* QuantizedTdnnComponent::PrecomputeIndexes(
+    const MiscComputationInfo &misc_info,
+    const std::vector<Index> &input_indexes,
+    const std::vector<Index> &output_indexes,
+    bool need_backprop) const {
+  return TdnnComponent::PrecomputeIndexesInternal(
+      time_offsets_, input_indexes, output_indexes);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,238 @@
+// nnet3/nnet-quantized-component.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+#define KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-convolutional-component.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-quantized-component.h
+///
+///   This file contains declarations of components whose parameters are
+///   quantized to 8-bit integers, for faster inference on CPU and smaller
+///   models: QuantizedAffineComponent and QuantizedTdnnComponent.  They are
+///   not trainable; they are created from trained models with the 'quantize'
+///   directive of the edits-config (see ReadEditConfig() in nnet-utils.h),
+///   e.g.
+///     nnet3-am-copy --edits='quantize' final.mdl final_quantized.mdl
+
+
+/**
+   QuantizedMatrix stores a matrix as 8-bit integers with one scale per row:
+   element (i, j) of the matrix is approximately RowScale(i) * RowData(i)[j],
+   where the integers are in the range [-127, 127].  The rows are padded with
+   zeros to a multiple of 64 bytes, so that the SIMD code in
+   AddMatQuantizedMat() does not need to deal with partial vectors.
+ */
+class QuantizedMatrix {
+ public:
+  QuantizedMatrix(): num_rows_(0), num_cols_(0), stride_(0) { }
+
+  /// Quantizes "mat", using the largest absolute value of each row to set its
+  /// scale.
+  explicit QuantizedMatrix(const MatrixBase<BaseFloat> &mat);
+
+  int32 NumRows() const { return num_rows_; }
+  int32 NumCols() const { return num_cols_; }
+
+  /// The number of bytes per row, including the padding.
+  int32 Stride() const { return stride_; }
+
+  const int8 *RowData(int32 i) const { return &(data_[i * stride_]); }
+  BaseFloat RowScale(int32 i) const { return row_scales_(i); }
+  /// The sum of the integers of row i; it is needed by the kernels that
+  /// multiply unsigned by signed 8-bit integers (see the .cc file).
+  int32 RowSum(int32 i) const { return row_sums_[i]; }
+
+  /// Sets "mat" (which is resized) to the approximation of the original
+  /// matrix.
+  void Dequantize(Matrix<BaseFloat> *mat) const;
+
+  /// The number of bytes used by the parameters.
+  int64 MemorySize() const;
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  void Resize(int32 num_rows, int32 num_cols);
+  void ComputeRowSums();
+
+  int32 num_rows_;
+  int32 num_cols_;
+  int32 stride_;
+  std::vector<int8> data_;
+  Vector<BaseFloat> row_scales_;
+  std::vector<int32> row_sums_;
+};
+
+/// Does out += in * params^T, like
+///   out->AddMatMat(1.0, in, kNoTrans, params_float, kTrans, 1.0)
+/// but using integer arithmetic: each row of "in" is quantized to 8 bits on
+/// the fly, with its own scale.  Depending on the instruction sets that the
+/// code was compiled for (e.g. -mavx2 or -mavx512vnni in CXXFLAGS), this uses
+/// AVX-512 VNNI, AVX2 or plain C++.  "in" and "out" must be in CPU memory.
+void AddMatQuantizedMat(const MatrixBase<BaseFloat> &in,
+                        const QuantizedMatrix &params,
+                        MatrixBase<BaseFloat> *out);
+
+
+/**
+   QuantizedAffineComponent is the inference-only counterpart of
+   AffineComponent (and its child classes such as
+   NaturalGradientAffineComponent), FixedAffineComponent and LinearComponent,
+   with the linear parameters quantized to 8 bits (see class QuantizedMatrix).
+   It uses about a quarter of the memory, and on CPU its Propagate() is done
+   with integer arithmetic.  With a GPU, and in Backprop() (which is only
+   provided for testing), the parameters are converted back to floating point
+   each time, which is slow.
+
+   It is normally created from a trained model with the 'quantize' directive
+   of the edits-config.  For testing purposes it can also be initialized from
+   a config line, as for FixedAffineComponent:
+     matrix=<rxfilename>   A matrix of dimension output-dim by input-dim + 1,
+                           whose last column is the bias, or
+     input-dim=x output-dim=y  Random parameters.
+ */
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent() { }
+  explicit QuantizedAffineComponent(const AffineComponent &c);
+  explicit QuantizedAffineComponent(const FixedAffineComponent &c);
+  explicit QuantizedAffineComponent(const LinearComponent &c);
+
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const { return kSimpleComponent|kBackpropAdds; }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                          const CuMatrixBase<BaseFloat> &in,
+                          CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &, // in_value
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *, // to_update
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  const QuantizedMatrix &LinearParams() const { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  void Init(const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params);
+
+  QuantizedMatrix linear_params_;
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedAffineComponent);
+};
+
+
+/**
+   QuantizedTdnnComponent is the inference-only counterpart of TdnnComponent,
+   with the linear parameters quantized to 8 bits; it is to TdnnComponent what
+   QuantizedAffineComponent is to AffineComponent.  The parameters of each
+   time offset are stored as a separate QuantizedMatrix (with their own
+   scales).  It can only be created from a TdnnComponent, with the 'quantize'
+   directive of the edits-config.
+ */
+class QuantizedTdnnComponent: public Component {
+ public:
+  QuantizedTdnnComponent() { }
+  explicit QuantizedTdnnComponent(const TdnnComponent &c);
+
+  virtual int32 InputDim() const { return linear_params_[0].NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_[0].NumRows(); }
+
+  virtual std::string Type() const { return "QuantizedTdnnComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual int32 Properties() const {
+    return kReordersIndexes|kBackpropAdds|
+        (bias_params_.Dim() == 0 ? kPropagateAdds : 0);
+  }
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                          const CuMatrixBase<BaseFloat> &in,
+                          CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &out_value,
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  // The index-related functions behave as in TdnnComponent, and use its
+  // PrecomputedIndexes.
+  virtual void ReorderIndexes(std::vector<Index> *input_indexes,
+                              std::vector<Index> *output_indexes) const;
+  virtual void GetInputIndexes(const MiscComputationInfo &misc_info,
+                               const Index &output_index,
+                               std::vector<Index> *desired_indexes) const;
+  virtual bool IsComputable(const MiscComputationInfo &misc_info,
+                            const Index &output_index,
+                            const IndexSet &input_index_set,
+                            std::vector<Index> *used_inputs) const;
+  virtual ComponentPrecomputedIndexes* PrecomputeIndexes(
+      const MiscComputationInfo &misc_info,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes,
+      bool need_backprop) const;
+
+ private:
+  // The time offsets, as in TdnnComponent.
+  std::vector<int32> time_offsets_;
+  // linear_params_[i] is the part of the linear parameters of TdnnComponent
+  // that multiplies the input at time offset time_offsets_[i]; each is of
+  // dimension output-dim by input-dim.
+  std::vector<QuantizedMatrix> linear_params_;
+  // The bias parameters, or the empty vector if there is no bias.
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedTdnnComponent);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
@@ -1892,6 +1892,12 @@ class ScaleAndOffsetComponent: public UpdatableComponent {
 
   // copy constructor
   explicit ScaleAndOffsetComponent(const ScaleAndOffsetComponent &other);
+
+  // Outputs the scales and offsets that the propagation actually uses, i.e.
+  // with any scales that are very close to zero floored; their dimension is
+  // the block-dim.  Used in CollapseModel().
+  void GetScalesAndOffsets(CuVector<BaseFloat> *scales,
+                           CuVector<BaseFloat> *offsets) const;
  private:
   // Internal version of propagate, requires in.NumCols() equal to scales_.Dim()
   // (if batch-dim was set, this may require the caller to reshape the input and
@@ -348,6 +348,13 @@ void TdnnComponent::UpdateNaturalGradient(
 void TdnnComponent::ReorderIndexes(
     std::vector<Index> *input_indexes,
     std::vector<Index> *output_indexes) const {
+  ReorderIndexesInternal(input_indexes, output_indexes);
+}
+
+// static
+void TdnnComponent::ReorderIndexesInternal(
+    std::vector<Index> *input_indexes,
+    std::vector<Index> *output_indexes) {
   using namespace time_height_convolution;
 
   // The following figures out a regular structure for the input and
@@ -539,6 +546,15 @@ ComponentPrecomputedIndexes* TdnnComponent::PrecomputeIndexes(
       const std::vector<Index> &input_indexes,
       const std::vector<Index> &output_indexes,
       bool need_backprop) const {
+  return PrecomputeIndexesInternal(time_offsets_, input_indexes,
+                                   output_indexes);
+}
+
+// static
+TdnnComponent::PrecomputedIndexes* TdnnComponent::PrecomputeIndexesInternal(
+      const std::vector<int32> &time_offsets,
+      const std::vector<Index> &input_indexes,
+      const std::vector<Index> &output_indexes) {
   using namespace time_height_convolution;
   // The following figures out a regular structure for the input and
   // output indexes, in case there were gaps (which is unlikely in typical
@@ -563,13 +579,13 @@ ComponentPrecomputedIndexes* TdnnComponent::PrecomputeIndexes(
 
   PrecomputedIndexes *ans = new PrecomputedIndexes();
   ans->row_stride = io.reorder_t_in;
-  int32 num_offsets = time_offsets_.size();
+  int32 num_offsets = time_offsets.size();
   ans->row_offsets.resize(num_offsets);
   for (int32 i = 0; i < num_offsets; i++) {
     // For each offset, work out which row of the input has the same t value as
     // the first t value in the output plus that offset.  That becomes the start
     // row of the corresponding sub-part of the input.
-    int32 time_offset = time_offsets_[i],
+    int32 time_offset = time_offsets[i],
         required_input_t = io.start_t_out + time_offset,
         input_t = (required_input_t - io.start_t_in) / io.t_step_in;
 
@@ -21,6 +21,7 @@
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-am-decodable-simple.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -100,6 +101,78 @@ void UnitTestConvertRepeatedToBlockAffineComposite() {
   }
 }
 
+// Tests that CollapseModel() folds batch-norm and scale-and-offset components
+// that follow affine and linear components into them, without changing the
+// output.
+void UnitTestCollapseModelPostTransform() {
+  int32 input_dim = RandInt(10, 30), hidden_dim = 2 * RandInt(10, 30);
+  std::ostringstream config;
+  config << "component name=affine1 type=NaturalGradientAffineComponent "
+         << "input-dim=" << input_dim << " output-dim=" << hidden_dim << "\n"
+         << "component name=bn1 type=BatchNormComponent dim=" << hidden_dim
+         << " block-dim=" << (hidden_dim / 2) << "\n"
+         << "component name=so1 type=ScaleAndOffsetComponent dim="
+         << hidden_dim << "\n"
+         << "component name=relu1 type=RectifiedLinearComponent dim="
+         << hidden_dim << "\n"
+         << "component name=linear2 type=LinearComponent input-dim="
+         << hidden_dim << " output-dim=" << hidden_dim << "\n"
+         << "component name=so2 type=ScaleAndOffsetComponent dim="
+         << hidden_dim << " block-dim=" << (hidden_dim / 2) << "\n"
+         << "input-node name=input dim=" << input_dim << "\n"
+         << "component-node name=affine1 component=affine1 input=input\n"
+         << "component-node name=bn1 component=bn1 input=affine1\n"
+         << "component-node name=so1 component=so1 input=bn1\n"
+         << "component-node name=relu1 component=relu1 input=so1\n"
+         << "component-node name=linear2 component=linear2 input=relu1\n"
+         << "component-node name=so2 component=so2 input=linear2\n"
+         << "output-node name=output input=so2\n";
+  Nnet nnet;
+  std::istringstream is(config.str());
+  nnet.ReadConfig(is);
+  // make the scales and offsets nontrivial.
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    UpdatableComponent *uc =
+        dynamic_cast<UpdatableComponent*>(nnet.GetComponent(c));
+    if (uc != NULL && uc->Type() == "ScaleAndOffsetComponent")
+      uc->PerturbParams(0.5);
+  }
+  SetBatchnormTestMode(true, &nnet);
+  Nnet nnet_collapsed(nnet);
+  CollapseModel(CollapseModelConfig(), &nnet_collapsed);
+  for (int32 c = 0; c < nnet_collapsed.NumComponents(); c++) {
+    std::string type = nnet_collapsed.GetComponent(c)->Type();
+    KALDI_ASSERT(type != "BatchNormComponent" &&
+                 type != "ScaleAndOffsetComponent");
+  }
+
+  int32 num_frames = RandInt(5, 20);
+  Matrix<BaseFloat> input(num_frames, input_dim);
+  input.SetRandn();
+  Vector<BaseFloat> priors;
+  NnetSimpleComputationOptions opts;
+  Matrix<BaseFloat> output(num_frames, hidden_dim),
+      output_collapsed(num_frames, hidden_dim);
+  {
+    CachingOptimizingCompiler compiler(nnet);
+    DecodableNnetSimple decodable(opts, nnet, priors, input, &compiler);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+  {
+    CachingOptimizingCompiler compiler(nnet_collapsed);
+    DecodableNnetSimple decodable(opts, nnet_collapsed, priors, input,
+                                  &compiler);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(output_collapsed, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+  KALDI_ASSERT(output.ApproxEqual(output_collapsed, 1.0e-04));
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -111,6 +184,8 @@ int main() {
   UnitTestNnetContext();
   UnitTestConvertRepeatedToBlockAffine();
   UnitTestConvertRepeatedToBlockAffineComposite();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestCollapseModelPostTransform();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -25,6 +25,7 @@
 #include "nnet3/nnet-normalize-component.h"
 #include "nnet3/nnet-general-component.h"
 #include "nnet3/nnet-convolutional-component.h"
+#include "nnet3/nnet-quantized-component.h"
 #include "nnet3/nnet-parse.h"
 #include "nnet3/nnet-computation-graph.h"
 #include "nnet3/nnet-diagnostics.h"
@@ -1151,6 +1152,53 @@ void ReadEditConfig(std::istream &edit_config_is, Nnet *nnet) {
       }
       KALDI_LOG << "Converted " << num_components_changed
                 << " components to FixedAffineComponent.";
+    } else if (directive == "quantize") {
+      std::string name_pattern = "*";
+      // name_pattern defaults to '*' if none is given.  This pattern
+      // matches names of components, not nodes.
+      config_line.GetValue("name", &name_pattern);
+      int32 num_components_changed = 0;
+      int64 size_before = 0, size_after = 0;
+      for (int32 c = 0; c < nnet->NumComponents(); c++) {
+        if (!NameMatchesPattern(nnet->GetComponentName(c).c_str(),
+                                name_pattern.c_str()))
+          continue;
+        Component *component = nnet->GetComponent(c);
+        AffineComponent *affine = NULL;
+        FixedAffineComponent *fixed_affine = NULL;
+        LinearComponent *linear = NULL;
+        TdnnComponent *tdnn = NULL;
+        Component *quantized = NULL;
+        int64 num_params = 0;
+        if ((affine = dynamic_cast<AffineComponent*>(component))) {
+          quantized = new QuantizedAffineComponent(*affine);
+          num_params = affine->LinearParams().NumRows() *
+              static_cast<int64>(affine->LinearParams().NumCols());
+        } else if ((fixed_affine =
+                    dynamic_cast<FixedAffineComponent*>(component))) {
+          quantized = new QuantizedAffineComponent(*fixed_affine);
+          num_params = fixed_affine->LinearParams().NumRows() *
+              static_cast<int64>(fixed_affine->LinearParams().NumCols());
+        } else if ((linear = dynamic_cast<LinearComponent*>(component))) {
+          quantized = new QuantizedAffineComponent(*linear);
+          num_params = linear->Params().NumRows() *
+              static_cast<int64>(linear->Params().NumCols());
+        } else if ((tdnn = dynamic_cast<TdnnComponent*>(component))) {
+          quantized = new QuantizedTdnnComponent(*tdnn);
+          num_params = tdnn->LinearParams().NumRows() *
+              static_cast<int64>(tdnn->LinearParams().NumCols());
+        } else {
+          continue;
+        }
+        size_before += num_params * sizeof(BaseFloat);
+        size_after += num_params;
+        nnet->SetComponent(c, quantized);
+        num_components_changed++;
+      }
+      KALDI_LOG << "Quantized " << num_components_changed
+                << " components; the size of their linear parameters went "
+                << "from " << size_before << " to about " << size_after
+                << " bytes.";
     } else if (directive == "remove-orphan-nodes") {
       bool remove_orphan_inputs = false;
       config_line.GetValue("remove-orphan-inputs", &remove_orphan_inputs);
@@ -1608,30 +1656,63 @@ class ModelCollapser {
   /**
      Tries to produce a component that's equivalent to running the component
      'component_index2' with input given by 'component_index1'.  This handles
-     the case where 'component_index1' is of type BatchnormComponent, and where
-     'component_index2' is of type AffineComponent or
-     NaturalGradientAffineComponent.
+     the case where 'component_index1' is of type BatchnormComponent or
+     ScaleAndOffsetComponent, and where 'component_index2' is of type
+     AffineComponent, NaturalGradientAffineComponent, LinearComponent or
+     TdnnComponent; and also the case where it's the other way round, i.e.
+     the batch-norm or scale-and-offset comes after the affine component (for
+     this case, the dimensions must match).
 
      Returns -1 if this code can't produce a combined component (normally
      because the components have the wrong types).
    */
   int32 CollapseComponentsBatchnorm(int32 component_index1,
                                     int32 component_index2) {
-    const BatchNormComponent *batchnorm_component =
-        dynamic_cast<const BatchNormComponent*>(
-            nnet_->GetComponent(component_index1));
-    if (batchnorm_component == NULL)
-      return -1;
+    CuVector<BaseFloat> offset, scale;
+    if (GetDiagonalTransform(component_index1, &offset, &scale)) {
+      std::string component_name1 = nnet_->GetComponentName(component_index1);
+      return GetDiagonallyPreModifiedComponentIndex(offset, scale,
+                                                    component_name1,
+                                                    component_index2);
+    }
+    if (nnet_->GetComponent(component_index1)->OutputDim() ==
+        nnet_->GetComponent(component_index2)->InputDim() &&
+        GetDiagonalTransform(component_index2, &offset, &scale)) {
+      std::string component_name2 = nnet_->GetComponentName(component_index2);
+      return GetDiagonallyPostModifiedComponentIndex(offset, scale,
+                                                     component_name2,
+                                                     component_index1);
+    }
+    return -1;
+  }
 
-    if (batchnorm_component->Offset().Dim() == 0) {
-      KALDI_ERR << "Expected batch-norm components to have test-mode set.";
+  /**
+     If the component 'component_index' is of type BatchNormComponent or
+     ScaleAndOffsetComponent, this function outputs the diagonal transform
+     y = scale * x + offset that it does (of dimension equal to its block-dim)
+     and returns true; otherwise it returns false.
+   */
+  bool GetDiagonalTransform(int32 component_index,
+                            CuVector<BaseFloat> *offset,
+                            CuVector<BaseFloat> *scale) {
+    const Component *component = nnet_->GetComponent(component_index);
+    const BatchNormComponent *batchnorm_component =
+        dynamic_cast<const BatchNormComponent*>(component);
+    const ScaleAndOffsetComponent *scale_offset_component =
+        dynamic_cast<const ScaleAndOffsetComponent*>(component);
+    if (batchnorm_component != NULL) {
+      if (batchnorm_component->Offset().Dim() == 0) {
+        KALDI_ERR << "Expected batch-norm components to have test-mode set.";
+      }
+      *offset = batchnorm_component->Offset();
+      *scale = batchnorm_component->Scale();
+      return true;
+    } else if (scale_offset_component != NULL) {
+      scale_offset_component->GetScalesAndOffsets(scale, offset);
+      return true;
+    } else {
+      return false;
     }
-    std::string batchnorm_component_name = nnet_->GetComponentName(
-        component_index1);
-    return GetDiagonallyPreModifiedComponentIndex(batchnorm_component->Offset(),
-                                                  batchnorm_component->Scale(),
-                                                  batchnorm_component_name,
-                                                  component_index2);
   }
 
 
@@ -1922,6 +2003,107 @@ class ModelCollapser {
   }
 
 
+  /**
+     This function finds, or creates, a component which is like
+     'component_index' but is followed by a diagonal offset-and-scale
+     transform; it's like GetDiagonallyPreModifiedComponentIndex() except the
+     transform is applied *after* the component.  The component must be
+     AffineComponent, NaturalGradientAffineComponent, LinearComponent or
+     TdnnComponent, and the dimension of 'offset'/'scale' must divide its
+     output dimension.  Returns -1 if the component is not of one of those
+     types.
+   */
+  int32 GetDiagonallyPostModifiedComponentIndex(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      const std::string &src_identifier,
+      int32 component_index) {
+    KALDI_ASSERT(offset.Dim() > 0 && offset.Dim() == scale.Dim());
+    std::ostringstream new_component_name_os;
+    new_component_name_os << nnet_->GetComponentName(component_index)
+                          << "."
+                          << src_identifier;
+    std::string new_component_name = new_component_name_os.str();
+    int32 new_component_index = nnet_->GetComponentIndex(new_component_name);
+    if (new_component_index >= 0)
+      return new_component_index;  // we previously created this.
+
+    const Component *component = nnet_->GetComponent(component_index);
+    const AffineComponent *affine_component =
+        dynamic_cast<const AffineComponent*>(component);
+    const LinearComponent *linear_component =
+        dynamic_cast<const LinearComponent*>(component);
+    const TdnnComponent *tdnn_component =
+        dynamic_cast<const TdnnComponent*>(component);
+
+    Component *new_component = NULL;
+    if (affine_component != NULL) {
+      new_component = component->Copy();
+      AffineComponent *new_affine_component =
+          dynamic_cast<AffineComponent*>(new_component);
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_affine_component->BiasParams()),
+                                   &(new_affine_component->LinearParams()));
+    } else if (linear_component != NULL) {
+      CuVector<BaseFloat> bias_params(linear_component->OutputDim());
+      AffineComponent *new_affine_component =
+          new AffineComponent(linear_component->Params(),
+                              bias_params,
+                              linear_component->LearningRate());
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_affine_component->BiasParams()),
+                                   &(new_affine_component->LinearParams()));
+      new_component = new_affine_component;
+    } else if (tdnn_component != NULL) {
+      new_component = tdnn_component->Copy();
+      TdnnComponent *new_tdnn_component =
+          dynamic_cast<TdnnComponent*>(new_component);
+      if (new_tdnn_component->BiasParams().Dim() == 0) {
+        // make sure it has a bias even if it had none before.
+        new_tdnn_component->BiasParams().Resize(
+            new_tdnn_component->OutputDim());
+      }
+      PostMultiplyAffineParameters(offset, scale,
+                                   &(new_tdnn_component->BiasParams()),
+                                   &(new_tdnn_component->LinearParams()));
+    } else {
+      return -1;  // we can't do this: this component isn't of the right type.
+    }
+    return nnet_->AddComponent(new_component_name, new_component);
+  }
+
+  /**
+     This helper function, used in GetDiagonallyPostModifiedComponentIndex,
+     modifies the linear and bias parameters of an affine transform to capture
+     the effect of following that affine transform by a diagonal affine
+     transform with parameters 'offset' and 'scale'.  The dimension of
+     'offset' and 'scale' must be the same and must divide the output dim of
+     the affine transform, i.e. must divide linear_params->NumRows().
+   */
+  static void PostMultiplyAffineParameters(
+      const CuVectorBase<BaseFloat> &offset,
+      const CuVectorBase<BaseFloat> &scale,
+      CuVectorBase<BaseFloat> *bias_params,
+      CuMatrixBase<BaseFloat> *linear_params) {
+    int32 output_dim = linear_params->NumRows(),
+        transform_dim = offset.Dim();
+    KALDI_ASSERT(bias_params->Dim() == output_dim &&
+                 offset.Dim() == scale.Dim() &&
+                 output_dim % transform_dim == 0);
+    CuVector<BaseFloat> full_offset(output_dim),
+        full_scale(output_dim);
+    for (int32 d = 0; d < output_dim; d += transform_dim) {
+      full_offset.Range(d, transform_dim).CopyFromVec(offset);
+      full_scale.Range(d, transform_dim).CopyFromVec(scale);
+    }
+    // The affine component does y = a x + b, and the post-transform replaces
+    // y with s y + o, so we get:  y = s a x + (s b + o).
+    bias_params->MulElements(full_scale);
+    bias_params->AddVec(1.0, full_offset);
+    linear_params->MulRowsVec(full_scale);
+  }
+
+
   /**
       Given a component 'component_index', returns a component which
       will give the same output as the current component gives when its input
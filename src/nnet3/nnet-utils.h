@@ -222,7 +222,8 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
    is reponsible for collapsing together sequential components where
    doing so could make the test-time operation more efficient.
    For example, dropout components and batch-norm components that
-   are in test mode can be combined with the next layer; and if there
+   are in test mode can be combined with the next layer (or batch-norm and
+   ScaleAndOffsetComponent with the previous one); and if there
    are successive affine components it may also be possible to
    combine these under some circumstances.
 
@@ -231,7 +232,8 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
  */
 struct CollapseModelConfig {
   bool collapse_dropout;  // dropout then affine/conv.
-  bool collapse_batchnorm;  // batchnorm then affine.
+  bool collapse_batchnorm;  // batchnorm or scale-and-offset, then affine
+                            // or (if dims match) the other way round.
   bool collapse_affine;  // affine or fixed-affine then affine.
   bool collapse_scale;  // affine then fixed-scale.
   CollapseModelConfig(): collapse_dropout(true),
@@ -266,6 +268,14 @@ void CollapseModel(const CollapseModelConfig &config,
     convert-to-fixed-affine [name=<name-pattern>]
       Converts the given affine components to FixedAffineComponent which is not updatable.
 
+    quantize [name=<name-pattern>]
+      Converts the given components of type AffineComponent (or child classes
+      thereof), FixedAffineComponent, LinearComponent or TdnnComponent to
+      QuantizedAffineComponent or QuantizedTdnnComponent, whose linear
+      parameters are stored as 8-bit integers with per-row scales.  They are
+      not updatable, and are about 4 times smaller; on CPU their Propagate()
+      uses integer arithmetic (see nnet-quantized-component.h).
+
     remove-orphan-nodes [remove-orphan-inputs=(true|false)]
       Removes orphan nodes (that are never used to compute anything).  Note:
       remove-orphan-inputs defaults to false.
@@ -123,6 +123,14 @@ int main(int argc, char *argv[]) {
       // different utterances.
       CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
                                          decodable_opts.optimize_config);
+      ReadComputationCache(decodable_opts, am_nnet.GetNnet(), &compiler);
+      // the arena holds the memory for the computations, also across utterances.
+      NnetComputeArena arena;
+      // the team of threads, if any, with which the computations execute
+      // commands in parallel; it is shared by all utterances.
+      ThreadTeam *team = NULL;
+      if (decodable_opts.compute_config.num_threads > 1)
+        team = new ThreadTeam(decodable_opts.compute_config.num_threads);
 
       RandomAccessBaseFloatMatrixReader online_ivector_reader(
           online_ivector_rspecifier);
@@ -186,7 +194,7 @@ int main(int argc, char *argv[]) {
         DecodableAmNnetSimple nnet_decodable(
             decodable_opts, trans_model, am_nnet,
             features, ivector, online_ivectors,
-            online_ivector_period, &compiler);
+            online_ivector_period, &compiler, &arena, team);
 
         AlignUtteranceWrapper(align_config, utt,
                               decodable_opts.acoustic_scale,
@@ -201,6 +209,7 @@ int main(int argc, char *argv[]) {
       KALDI_LOG << "Retried " << num_retry << " out of "
                 << (num_done + num_err) << " utterances.";
       KALDI_LOG << "Done " << num_done << ", errors on " << num_err;
+      delete team;
     }
 
 #if HAVE_CUDA==1
@@ -0,0 +1,127 @@
+// nnet3bin/nnet3-compile-cache.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Compile, ahead of time, the nnet3 computations that decoding with the\n"
+        "given model will need, and write them to a file that can be given to\n"
+        "the decoding programs with the --computation-cache option, to save\n"
+        "compilation time at startup.  The decoding options that affect the\n"
+        "computations (e.g. --frames-per-chunk, --extra-left-context,\n"
+        "--frame-subsampling-factor and the --optimization.* options) must be\n"
+        "the same as when decoding, otherwise the cached computations are not\n"
+        "used.  With --looped=true, the looped computation used by\n"
+        "nnet3-latgen-faster-looped and the online decoders is written instead\n"
+        "(using the options --frames-per-chunk, --frame-subsampling-factor,\n"
+        "--extra-left-context-initial and --optimization.*).\n"
+        "\n"
+        "Usage: nnet3-compile-cache [options] <model-in> <cache-out>\n"
+        " e.g.: nnet3-compile-cache --frames-per-chunk=50 final.mdl final.cache\n"
+        "  nnet3-latgen-faster --frames-per-chunk=50 \\\n"
+        "     --computation-cache=final.cache final.mdl ...\n";
+
+    ParseOptions po(usage);
+    Timer timer;
+
+    bool binary_write = true, looped = false;
+    NnetSimpleComputationOptions decodable_opts;
+
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("looped", &looped, "If true, write the computation for looped "
+                "decoding; otherwise the computations for nnet3-latgen-faster "
+                "and similar programs.");
+    decodable_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_rxfilename = po.GetArg(1),
+        cache_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    // This must match what the decoding programs do after reading the model,
+    // as the computations are only used with the same network.
+    Nnet &nnet = am_nnet.GetNnet();
+    SetBatchnormTestMode(true, &nnet);
+    SetDropoutTestMode(true, &nnet);
+    CollapseModel(CollapseModelConfig(), &nnet);
+
+    Output ko(cache_wxfilename, binary_write);
+    if (looped) {
+      // The looped decoders have a subset of the options.
+      NnetSimpleLoopedComputationOptions looped_opts;
+      looped_opts.frames_per_chunk = decodable_opts.frames_per_chunk;
+      looped_opts.frame_subsampling_factor =
+          decodable_opts.frame_subsampling_factor;
+      looped_opts.extra_left_context_initial =
+          std::max<int32>(0, decodable_opts.extra_left_context_initial);
+      looped_opts.optimize_config = decodable_opts.optimize_config;
+      DecodableNnetSimpleLoopedInfo info(looped_opts, &am_nnet);
+      info.WriteComputationCache(ko.Stream(), binary_write);
+    } else {
+      CachingOptimizingCompilerOptions compiler_opts;
+      // Make sure that none of the computations is evicted from the cache.
+      compiler_opts.cache_capacity = std::numeric_limits<int32>::max();
+      CachingOptimizingCompiler compiler(nnet, decodable_opts.optimize_config,
+                                         compiler_opts);
+      // The features and iVector are not used; only their dimensions matter.
+      Matrix<BaseFloat> feats(1, nnet.InputDim("input"));
+      Vector<BaseFloat> ivector(std::max<int32>(0, nnet.InputDim("ivector")));
+      DecodableNnetSimple decodable(decodable_opts, nnet, am_nnet.Priors(),
+                                    feats, &compiler,
+                                    ivector.Dim() > 0 ? &ivector : NULL);
+      decodable.CompileAllComputations();
+      WriteComputationCacheHeader(nnet, false, ko.Stream(), binary_write);
+      compiler.WriteCache(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Wrote precompiled " << (looped ? "looped " : "")
+              << "computations for " << model_rxfilename << " to "
+              << cache_wxfilename << "; took " << timer.Elapsed()
+              << " seconds.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -119,6 +119,13 @@ int main(int argc, char *argv[]) {
         ivector_rspecifier, utt2spk_rspecifier);
 
     CachingOptimizingCompiler compiler(nnet, opts.optimize_config);
+    ReadComputationCache(opts, nnet, &compiler);
+    NnetComputeArena arena;
+    // the team of threads, if any, with which the computations execute
+    // commands in parallel; it is shared by all utterances.
+    ThreadTeam *team = NULL;
+    if (opts.compute_config.num_threads > 1)
+      team = new ThreadTeam(opts.compute_config.num_threads);
 
     BaseFloatMatrixWriter matrix_writer(matrix_wspecifier);
 
@@ -160,7 +167,7 @@ int main(int argc, char *argv[]) {
           opts, nnet, priors,
           features, &compiler,
           ivector, online_ivectors,
-          online_ivector_period);
+          online_ivector_period, &arena, team);
 
       Matrix<BaseFloat> matrix(nnet_computer.NumFrames(),
                                nnet_computer.OutputDim());
@@ -177,6 +184,7 @@ int main(int argc, char *argv[]) {
       frame_count += features.NumRows();
       num_success++;
     }
+    delete team;
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
@@ -0,0 +1,282 @@
+// nnet3bin/nnet3-latgen-faster-batch.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/timer.h"
+#include "base/kaldi-common.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-matrix.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/transition-model.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "cudamatrix/cu-device.h"
+#include "util/common-utils.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model.  This version decodes\n"
+        "many utterances at the same time: it advances them chunk by chunk, and\n"
+        "the neural net computation for a chunk of each utterance is done as a\n"
+        "single minibatch (see --minibatch-size), which is more efficient\n"
+        "than separate computations, particularly on GPU or with multi-threaded\n"
+        "BLAS.  Only a single decoding graph (not a table of them) is supported.\n"
+        "See also: nnet3-latgen-faster-parallel\n"
+        "\n"
+        "Usage: nnet3-latgen-faster-batch [options] <nnet-in> <fst-in> <features-rspecifier>"
+        " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n";
+    ParseOptions po(usage);
+
+    Timer timer;
+    bool allow_partial = false;
+    LatticeFasterDecoderConfig config;
+    NnetBatchComputerOptions decodable_opts;
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    std::string use_gpu = "no";
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    if (ClassifyRspecifier(fst_in_str, NULL, NULL) != kNoRspecifier)
+      KALDI_ERR << "nnet3-latgen-faster-batch does not support a table of "
+                << "FSTs; use nnet3-latgen-faster-parallel.";
+    if (config.flush_interval > 0)
+      KALDI_ERR << "nnet3-latgen-faster-batch does not support "
+                << "--flush-interval; use nnet3-latgen-faster.";
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+    timer.Reset();
+
+    NnetBatchComputer computer(decodable_opts, am_nnet.GetNnet(),
+                               am_nnet.Priors());
+
+    // The following are indexed by the stream index returned by
+    // computer.AddStream().  We keep the decoders across utterances, so that
+    // their memory gets reused.
+    std::vector<LatticeFasterDecoder*> decoders;
+    std::vector<DecodableMatrixMappedOffset*> decodables;
+    std::vector<std::string> utts;
+    int32 num_active = 0, num_chunks = 0;
+
+    while (true) {
+      // Start decoding new utterances, until we have --minibatch-size
+      // utterances in progress.
+      for (; num_active < decodable_opts.minibatch_size && !feature_reader.Done();
+           feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        const Matrix<BaseFloat> &features (feature_reader.Value());
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+        const Matrix<BaseFloat> *online_ivectors = NULL;
+        const Vector<BaseFloat> *ivector = NULL;
+        if (!ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No iVector available for utterance " << utt;
+            num_fail++;
+            continue;
+          } else {
+            ivector = &ivector_reader.Value(utt);
+          }
+        }
+        if (!online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No online iVector available for utterance " << utt;
+            num_fail++;
+            continue;
+          } else {
+            online_ivectors = &online_ivector_reader.Value(utt);
+          }
+        }
+        int32 stream = computer.AddStream(features, ivector, online_ivectors,
+                                          online_ivector_period);
+        if (stream >= static_cast<int32>(decoders.size())) {
+          decoders.resize(stream + 1, NULL);
+          decodables.resize(stream + 1, NULL);
+          utts.resize(stream + 1);
+        }
+        if (decoders[stream] == NULL)
+          decoders[stream] = new LatticeFasterDecoder(*decode_fst, config);
+        KALDI_ASSERT(decodables[stream] == NULL);
+        decodables[stream] = new DecodableMatrixMappedOffset(trans_model);
+        utts[stream] = utt;
+        decoders[stream]->InitDecoding();
+        num_active++;
+      }
+      if (num_active == 0)
+        break;
+
+      num_chunks += computer.ComputeNextChunks();
+
+      for (size_t s = 0; s < decodables.size(); s++) {
+        if (decodables[s] == NULL)
+          continue;
+        DecodableMatrixMappedOffset *decodable = decodables[s];
+        LatticeFasterDecoder *decoder = decoders[s];
+        Matrix<BaseFloat> loglikes;
+        computer.GetOutputDestructive(s, &loglikes);
+        // The decoder has already consumed all frames we previously gave it,
+        // so we can discard them.
+        int32 frames_to_discard = decodable->NumFramesReady() -
+            decodable->FirstAvailableFrame();
+        decodable->AcceptLoglikes(&loglikes, frames_to_discard);
+        bool finished = computer.IsFinished(s);
+        if (finished)
+          decodable->InputIsFinished();
+        decoder->AdvanceDecoding(decodable);
+        if (!finished)
+          continue;
+
+        decoder->FinalizeDecoding();
+        double like;
+        if (decoder->NumFramesDecoded() > 0 &&
+            OutputDecodedUtteranceLatticeFaster(
+                *decoder, trans_model, word_syms, utts[s],
+                decodable_opts.acoustic_scale, determinize, allow_partial,
+                &alignment_writer, &words_writer, &compact_lattice_writer,
+                &lattice_writer, &like)) {
+          tot_like += like;
+          frame_count += decoder->NumFramesDecoded();
+          num_success++;
+        } else {
+          num_fail++;
+        }
+        delete decodable;
+        decodables[s] = NULL;
+        computer.RemoveStream(s);
+        num_active--;
+      }
+    }
+    DeletePointers(&decoders);
+    delete decode_fst;
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken " << elapsed
+              << "s: real-time factor assuming 100 feature frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    KALDI_LOG << "Computed " << num_chunks << " chunks in "
+              << computer.NumComputations() << " neural net computations.";
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
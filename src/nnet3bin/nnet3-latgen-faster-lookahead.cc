@@ -0,0 +1,239 @@
+// nnet3bin/nnet3-latgen-faster-lookahead.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::StdArc;
+    using fst::VectorFst;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model, composing the graph\n"
+        "HCL with the grammar G on the fly (with label lookahead and weight\n"
+        "pushing) instead of using a static HCLG.  HCL should have the\n"
+        "self-loops added and no disambiguation symbols on its input side;\n"
+        "use the --disambig-symbols option to remove the disambiguation\n"
+        "symbols (e.g. #0) from the input side of G.  See\n"
+        "fstext/lookahead-compose.h for more information.\n"
+        "Usage: nnet3-latgen-faster-lookahead [options] <nnet-in> <hcl-fst-in> "
+        "<g-fst-in> <features-rspecifier> <lattice-wspecifier> "
+        "[ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "e.g.: nnet3-latgen-faster-lookahead --disambig-symbols=disambig.int \\\n"
+        "   final.mdl HCL.fst G.fst scp:feats.scp ark:lat.ark\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    int32 cache_size_mb = 1024;
+    LatticeFasterDecoderConfig config;
+    NnetSimpleComputationOptions decodable_opts;
+
+    std::string word_syms_filename, disambig_rxfilename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("disambig-symbols", &disambig_rxfilename, "List of "
+                "disambiguation symbols (as integers) to be removed from the "
+                "input side of G.");
+    po.Register("cache-size-mb", &cache_size_mb, "Size in megabytes of the "
+                "cache of composed states, which is kept for all utterances.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        hcl_in_filename = po.GetArg(2),
+        g_in_filename = po.GetArg(3),
+        feature_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    Fst<StdArc> *hcl_fst = fst::ReadFstKaldiGeneric(hcl_in_filename);
+    VectorFst<StdArc> *g_fst = fst::ReadFstKaldi(g_in_filename);
+    if (disambig_rxfilename != "") {
+      std::vector<int32> disambig_syms;
+      if (!ReadIntegerVectorSimple(disambig_rxfilename, &disambig_syms))
+        KALDI_ERR << "Could not read disambiguation symbols from "
+                  << PrintableRxfilename(disambig_rxfilename);
+      fst::RemoveSomeInputSymbols(disambig_syms, g_fst);
+    }
+    // decode_fst takes ownership of g_fst.
+    fst::LookaheadComposeFst decode_fst(
+        *hcl_fst, g_fst, static_cast<size_t>(cache_size_mb) << 20);
+    delete hcl_fst;  // decode_fst has its own copy.
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+    // this compiler object allows caching of computations across
+    // different utterances.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config);
+    ReadComputationCache(decodable_opts, am_nnet.GetNnet(), &compiler);
+    // the arena holds the memory for the computations, also across utterances.
+    NnetComputeArena arena;
+    // the team of threads, if any, with which the computations execute
+    // commands in parallel; it is shared by all utterances.
+    ThreadTeam *team = NULL;
+    if (decodable_opts.compute_config.num_threads > 1)
+      team = new ThreadTeam(decodable_opts.compute_config.num_threads);
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    timer.Reset();
+
+    // The decoder, and decode_fst with its cache of composed states, are
+    // shared between utterances.
+    LatticeFasterDecoder decoder(decode_fst.GetFst(), config);
+
+    for (; !feature_reader.Done(); feature_reader.Next()) {
+      std::string utt = feature_reader.Key();
+      const Matrix<BaseFloat> &features (feature_reader.Value());
+      if (features.NumRows() == 0) {
+        KALDI_WARN << "Zero-length utterance: " << utt;
+        num_fail++;
+        continue;
+      }
+      const Matrix<BaseFloat> *online_ivectors = NULL;
+      const Vector<BaseFloat> *ivector = NULL;
+      if (!ivector_rspecifier.empty()) {
+        if (!ivector_reader.HasKey(utt)) {
+          KALDI_WARN << "No iVector available for utterance " << utt;
+          num_fail++;
+          continue;
+        } else {
+          ivector = &ivector_reader.Value(utt);
+        }
+      }
+      if (!online_ivector_rspecifier.empty()) {
+        if (!online_ivector_reader.HasKey(utt)) {
+          KALDI_WARN << "No online iVector available for utterance " << utt;
+          num_fail++;
+          continue;
+        } else {
+          online_ivectors = &online_ivector_reader.Value(utt);
+        }
+      }
+
+      DecodableAmNnetSimple nnet_decodable(
+          decodable_opts, trans_model, am_nnet,
+          features, ivector, online_ivectors,
+          online_ivector_period, &compiler, &arena, team);
+
+      double like;
+      if (DecodeUtteranceLatticeFaster(
+              decoder, nnet_decodable, trans_model, word_syms, utt,
+              decodable_opts.acoustic_scale, determinize, allow_partial,
+              &alignment_writer, &words_writer, &compact_lattice_writer,
+              &lattice_writer, &like)) {
+        tot_like += like;
+        frame_count += nnet_decodable.NumFramesReady();
+        num_success++;
+      } else num_fail++;
+    }
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+    delete word_syms;
+    delete team;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
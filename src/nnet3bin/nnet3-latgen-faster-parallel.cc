@@ -104,6 +104,12 @@ int main(int argc, char *argv[]) {
       SetDropoutTestMode(true, &(am_nnet.GetNnet()));
       CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
     }
+    // The compiler is shared by the decoding threads (its Compile() function
+    // is thread-safe), so the computations are cached across utterances.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config,
+                                       decodable_opts.compiler_config);
+    ReadComputationCache(decodable_opts, am_nnet.GetNnet(), &compiler);
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -175,7 +181,7 @@ int main(int argc, char *argv[]) {
               DecodableAmNnetSimpleParallel(
                   decodable_opts, trans_model, am_nnet,
                   features, ivector, online_ivectors,
-                  online_ivector_period);
+                  online_ivector_period, &compiler);
 
           DecodeUtteranceLatticeFasterClass *task =
               new DecodeUtteranceLatticeFasterClass(
@@ -239,7 +245,7 @@ int main(int argc, char *argv[]) {
             DecodableAmNnetSimpleParallel(
                 decodable_opts, trans_model, am_nnet,
                 features, ivector, online_ivectors,
-                online_ivector_period);
+                online_ivector_period, &compiler);
 
         DecodeUtteranceLatticeFasterClass *task =
             new DecodeUtteranceLatticeFasterClass(
@@ -52,7 +52,7 @@ int main(int argc, char *argv[]) {
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wspecifier;
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
@@ -74,6 +74,10 @@ int main(int argc, char *argv[]) {
     po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
                 "between iVectors in matrices supplied to the --online-ivectors "
                 "option");
+    po.Register("search-stats-wspecifier", &search_stats_wspecifier,
+                "If supplied, write per-frame statistics of the decoder's "
+                "search (see SearchStatsToMatrix() in "
+                "decoder/lattice-faster-decoder.h) to here, as matrices.");
 
     po.Read(argc, argv);
 
@@ -116,6 +120,7 @@ int main(int argc, char *argv[]) {
 
     Int32VectorWriter words_writer(words_wspecifier);
     Int32VectorWriter alignment_writer(alignment_wspecifier);
+    BaseFloatMatrixWriter search_stats_writer(search_stats_wspecifier);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_filename != "")
@@ -130,6 +135,14 @@ int main(int argc, char *argv[]) {
     // different utterances.
     CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
                                        decodable_opts.optimize_config);
+    ReadComputationCache(decodable_opts, am_nnet.GetNnet(), &compiler);
+    // the arena holds the memory for the computations, also across utterances.
+    NnetComputeArena arena;
+    // the team of threads, if any, with which the computations execute
+    // commands in parallel; it is shared by all utterances.
+    ThreadTeam *team = NULL;
+    if (decodable_opts.compute_config.num_threads > 1)
+      team = new ThreadTeam(decodable_opts.compute_config.num_threads);
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
@@ -140,6 +153,7 @@ int main(int argc, char *argv[]) {
 
       {
         LatticeFasterDecoder decoder(*decode_fst, config);
+        decoder.SetRecordSearchStats(search_stats_writer.IsOpen());
 
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -173,7 +187,7 @@ int main(int argc, char *argv[]) {
           DecodableAmNnetSimple nnet_decodable(
               decodable_opts, trans_model, am_nnet,
               features, ivector, online_ivectors,
-              online_ivector_period, &compiler);
+              online_ivector_period, &compiler, &arena, team);
 
           double like;
           if (DecodeUtteranceLatticeFaster(
@@ -186,6 +200,11 @@ int main(int argc, char *argv[]) {
             frame_count += nnet_decodable.NumFramesReady();
             num_success++;
           } else num_fail++;
+          if (search_stats_writer.IsOpen()) {
+            Matrix<BaseFloat> search_stats;
+            SearchStatsToMatrix(decoder.SearchStats(), &search_stats);
+            search_stats_writer.Write(utt, search_stats);
+          }
         }
       }
       delete decode_fst; // delete this only after decoder goes out of scope.
@@ -208,6 +227,7 @@ int main(int argc, char *argv[]) {
         }
 
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
+        decoder.SetRecordSearchStats(search_stats_writer.IsOpen());
 
         const Matrix<BaseFloat> *online_ivectors = NULL;
         const Vector<BaseFloat> *ivector = NULL;
@@ -233,7 +253,7 @@ int main(int argc, char *argv[]) {
         DecodableAmNnetSimple nnet_decodable(
             decodable_opts, trans_model, am_nnet,
             features, ivector, online_ivectors,
-            online_ivector_period, &compiler);
+            online_ivector_period, &compiler, &arena, team);
 
         double like;
         if (DecodeUtteranceLatticeFaster(
@@ -245,6 +265,11 @@ int main(int argc, char *argv[]) {
           frame_count += nnet_decodable.NumFramesReady();
           num_success++;
         } else num_fail++;
+        if (search_stats_writer.IsOpen()) {
+          Matrix<BaseFloat> search_stats;
+          SearchStatsToMatrix(decoder.SearchStats(), &search_stats);
+          search_stats_writer.Write(utt, search_stats);
+        }
       }
     }
 
@@ -262,6 +287,7 @@ int main(int argc, char *argv[]) {
               << frame_count << " frames.";
 
     delete word_syms;
+    delete team;
     if (num_success != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
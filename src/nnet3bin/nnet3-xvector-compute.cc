@@ -134,6 +134,10 @@ int main(int argc, char *argv[]) {
     SetDropoutTestMode(true, &nnet);
     CollapseModel(CollapseModelConfig(), &nnet);
 
+    // The computations precompiled by nnet3-compile-cache are for decoding
+    // chunks, not for the xvector computations.
+    if (!opts.computation_cache.empty())
+      KALDI_WARN << "--computation-cache is not used by this program.";
     CachingOptimizingCompiler compiler(nnet, opts.optimize_config, compiler_config);
 
     BaseFloatVectorWriter vector_writer(vector_wspecifier);
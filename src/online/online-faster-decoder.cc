@@ -29,6 +29,7 @@ namespace kaldi {
 
 void OnlineFasterDecoder::ResetDecoder(bool full) {
   ClearToks(toks_.Clear());
+  SetHashType();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   Arc dummy_arc(0, 0, Weight::One(), start_state);
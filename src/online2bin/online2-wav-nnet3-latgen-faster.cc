@@ -130,6 +130,11 @@ int main(int argc, char *argv[]) {
     feature_opts.Register(&po);
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
+    po.Register("num-decoder-threads", &decoder_opts.num_decoder_threads,
+                "Number of threads used to propagate the tokens on each frame "
+                "of an utterance (requires a graph in the const or vector FST "
+                "format); useful for low-latency decoding of a single stream "
+                "with a large beam.");
     endpoint_opts.Register(&po);
 
 
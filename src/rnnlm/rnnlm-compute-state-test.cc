@@ -0,0 +1,189 @@
+// rnnlm/rnnlm-compute-state-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "rnnlm/rnnlm-compute-state.h"
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace rnnlm {
+
+
+// Gets a recurrent neural net with no dependency on t greater than the
+// current t, like the nnet part of an RNNLM.
+nnet3::Nnet *GetRecurrentNnet(int32 embedding_dim) {
+  int32 hidden_dim = RandInt(10, 30),
+      recurrent_offset = -RandInt(1, 3);
+  std::ostringstream config_os;
+  config_os << "input-node name=input dim=" << embedding_dim << std::endl;
+  config_os << "component name=affine1 type=NaturalGradientAffineComponent "
+            << "input-dim=" << embedding_dim << " output-dim=" << hidden_dim
+            << std::endl;
+  config_os << "component name=recurrent type=NaturalGradientAffineComponent "
+            << "input-dim=" << hidden_dim << " output-dim=" << hidden_dim
+            << std::endl;
+  config_os << "component name=tanh1 type=TanhComponent dim=" << hidden_dim
+            << std::endl;
+  config_os << "component name=affine2 type=NaturalGradientAffineComponent "
+            << "input-dim=" << hidden_dim << " output-dim=" << embedding_dim
+            << std::endl;
+  config_os << "component-node name=affine1 component=affine1 input=input\n";
+  config_os << "component-node name=recurrent component=recurrent "
+            << "input=Offset(tanh1, " << recurrent_offset << ")\n";
+  config_os << "component-node name=tanh1 component=tanh1 "
+            << "input=Sum(affine1, IfDefined(recurrent))\n";
+  config_os << "component-node name=affine2 component=affine2 input=tanh1\n";
+  config_os << "output-node input=affine2 name=output\n";
+  std::istringstream config_is(config_os.str());
+  nnet3::Nnet *ans = new nnet3::Nnet();
+  ans->ReadConfig(config_is);
+  return ans;
+}
+
+// Checks that the two states predict the same log-probs.
+void CheckSameLogProbs(int32 vocab_size, const RnnlmComputeState &state1,
+                       const RnnlmComputeState &state2) {
+  for (int32 w = 1; w < vocab_size; w++) {
+    BaseFloat log_prob1 = state1.LogProbOfWord(w),
+        log_prob2 = state2.LogProbOfWord(w);
+    if (!(std::abs(log_prob1 - log_prob2) < 1.0e-03))
+      KALDI_ERR << "Log-probs differ for word " << w << ": " << log_prob1
+                << " vs. " << log_prob2;
+  }
+}
+
+// Checks that GetSuccessorStates() gives the same states as calling
+// GetSuccessorState() for each state.
+void TestGetSuccessorStates() {
+  int32 embedding_dim = RandInt(5, 20),
+      vocab_size = RandInt(10, 50);
+  nnet3::Nnet *nnet = GetRecurrentNnet(embedding_dim);
+  CuMatrix<BaseFloat> word_embedding_mat(vocab_size, embedding_dim);
+  word_embedding_mat.SetRandn();
+  word_embedding_mat.Scale(0.5);
+
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  opts.normalize_probs = (RandInt(0, 1) == 0);
+  opts.batch_size = RandInt(2, 8);
+  RnnlmComputeStateInfo info(opts, *nnet, word_embedding_mat);
+  // The computation for several states should have the same structure as
+  // for one state, or we would not be testing the batched computation.
+  KALDI_ASSERT(info.batcher != NULL);
+
+  // Make some states with histories of different lengths, since only the
+  // states at the same point of the looped computation are computed together.
+  std::vector<RnnlmComputeState*> states;
+  states.push_back(new RnnlmComputeState(info, opts.bos_index));
+  for (int32 i = 0; i < 20; i++) {
+    const RnnlmComputeState *state = states[RandInt(0, states.size() - 1)];
+    states.push_back(state->GetSuccessorState(RandInt(1, vocab_size - 1)));
+  }
+
+  int32 num_successors = RandInt(0, 30);
+  std::vector<const RnnlmComputeState*> predecessors(num_successors);
+  std::vector<int32> next_words(num_successors);
+  for (int32 i = 0; i < num_successors; i++) {
+    predecessors[i] = states[RandInt(0, states.size() - 1)];
+    next_words[i] = RandInt(1, vocab_size - 1);
+  }
+  std::vector<RnnlmComputeState*> successors;
+  RnnlmComputeState::GetSuccessorStates(predecessors, next_words,
+                                        &successors);
+  KALDI_ASSERT(static_cast<int32>(successors.size()) == num_successors);
+
+  for (int32 i = 0; i < num_successors; i++) {
+    RnnlmComputeState *successor =
+        predecessors[i]->GetSuccessorState(next_words[i]);
+    CheckSameLogProbs(vocab_size, *successor, *(successors[i]));
+    // Also check that the recurrent part of the state was computed
+    // correctly, by adding another word.
+    int32 word = RandInt(1, vocab_size - 1);
+    successor->AddWord(word);
+    successors[i]->AddWord(word);
+    CheckSameLogProbs(vocab_size, *successor, *(successors[i]));
+    delete successor;
+  }
+  DeletePointers(&successors);
+  DeletePointers(&states);
+  delete nnet;
+}
+
+
+// Checks that states obtained by copying (GetSuccessorState()) predict the
+// same log-probs as a state to which the words are added directly, i.e. that
+// the copy constructor of NnetComputer keeps the recurrent part of the state.
+void TestCopiedStates() {
+  int32 embedding_dim = RandInt(5, 20),
+      vocab_size = RandInt(10, 50);
+  nnet3::Nnet *nnet = GetRecurrentNnet(embedding_dim);
+  CuMatrix<BaseFloat> word_embedding_mat(vocab_size, embedding_dim);
+  word_embedding_mat.SetRandn();
+  word_embedding_mat.Scale(0.5);
+
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  RnnlmComputeStateInfo info(opts, *nnet, word_embedding_mat);
+
+  RnnlmComputeState direct_state(info, opts.bos_index);
+  RnnlmComputeState *copied_state = new RnnlmComputeState(info,
+                                                          opts.bos_index);
+  int32 num_words = RandInt(1, 10);
+  for (int32 i = 0; i < num_words; i++) {
+    int32 word = RandInt(1, vocab_size - 1);
+    direct_state.AddWord(word);
+    RnnlmComputeState *successor = copied_state->GetSuccessorState(word);
+    delete copied_state;
+    copied_state = successor;
+    CheckSameLogProbs(vocab_size, direct_state, *copied_state);
+  }
+  delete copied_state;
+  delete nnet;
+}
+
+}  // namespace rnnlm
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  int32 loop = 0;
+#if HAVE_CUDA == 1
+  for (loop = 0; loop < 2; loop++) {
+    CuDevice::Instantiate().SetDebugStrideMode(true);
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 10; i++) {
+      kaldi::rnnlm::TestGetSuccessorStates();
+      kaldi::rnnlm::TestCopiedStates();
+    }
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+#if HAVE_CUDA == 1
+  }
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
@@ -68,6 +68,30 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
     KALDI_VLOG(3) << "Computation is:";
     computation.Print(std::cerr, rnnlm);
   }
+
+  batcher = NULL;
+  if (opts.batch_size > 1) {
+    CreateLoopedComputationRequestSimple(rnnlm,
+                                         1, // num_frames
+                                         frame_subsampling_factor,
+                                         1, // ivector_period = 1
+                                         0, // extra_left_context_initial == 0
+                                         0, // extra_right_context == 0
+                                         opts.batch_size, // num_sequences
+                                         &request1, &request2, &request3);
+    CompileLooped(rnnlm, opts.optimize_config, request1, request2,
+                  request3, &batch_computation);
+    batch_computation.ComputeCudaIndexes();
+    batcher = new nnet3::NnetComputerBatcher(computation, batch_computation,
+                                             opts.batch_size);
+    if (!batcher->IsCompatible()) {
+      KALDI_WARN << "The computations for one and for " << opts.batch_size
+                 << " states have a different structure; the RNNLM states "
+                 << "will be computed one by one.";
+      delete batcher;
+      batcher = NULL;
+    }
+  }
 }
 
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
@@ -92,6 +116,95 @@ RnnlmComputeState* RnnlmComputeState::GetSuccessorState(int32 next_word) const {
   return ans;
 }
 
+void RnnlmComputeState::GetSuccessorStates(
+    const std::vector<const RnnlmComputeState*> &states,
+    const std::vector<int32> &next_words,
+    std::vector<RnnlmComputeState*> *successors) {
+  KALDI_ASSERT(states.size() == next_words.size());
+  int32 num_states = states.size();
+  successors->resize(num_states);
+  if (num_states == 0)
+    return;
+  const RnnlmComputeStateInfo &info = states[0]->info_;
+  const CuMatrix<BaseFloat> &word_embedding_mat = info.word_embedding_mat;
+  int32 num_words = word_embedding_mat.NumRows(),
+      embedding_dim = word_embedding_mat.NumCols(),
+      batch_size = std::max<int32>(info.opts.batch_size, 1);
+
+  // 'groups' contains lists of the successors that are at the same point of
+  // the looped computation (the states near the start of the sentence are
+  // not), which are the ones we can compute together.
+  std::vector<std::vector<RnnlmComputeState*> > groups;
+  for (int32 i = 0; i < num_states; i++) {
+    KALDI_ASSERT(&(states[i]->info_) == &info);
+    int32 word_index = next_words[i];
+    KALDI_ASSERT(word_index > 0 && word_index < num_words);
+    RnnlmComputeState *successor = new RnnlmComputeState(*(states[i]));
+    successor->previous_word_ = word_index;
+    (*successors)[i] = successor;
+    if (info.batcher == NULL) {
+      successor->AdvanceChunk();
+      continue;
+    }
+    size_t g = 0;
+    for (; g < groups.size(); g++)
+      if (nnet3::NnetComputerBatcher::AtSamePoint(
+              groups[g][0]->computer_, successor->computer_))
+        break;
+    if (g == groups.size())
+      groups.resize(g + 1);
+    groups[g].push_back(successor);
+  }
+
+  if (!groups.empty()) {
+    nnet3::NnetComputer batch_computer(info.opts.compute_config,
+                                       info.batch_computation, info.rnnlm,
+                                       NULL);  // NULL is 'nnet_to_update'
+    std::vector<nnet3::NnetComputer*> computers;
+    for (size_t g = 0; g < groups.size(); g++) {
+      const std::vector<RnnlmComputeState*> &group = groups[g];
+      int32 group_size = group.size();
+      for (int32 begin = 0; begin < group_size; begin += batch_size) {
+        int32 this_batch_size = std::min(batch_size, group_size - begin);
+        if (this_batch_size == 1) {
+          group[begin]->AdvanceChunk();
+          continue;
+        }
+        computers.clear();
+        for (int32 i = begin; i < begin + this_batch_size; i++) {
+          group[i]->AcceptPreviousWord();
+          computers.push_back(&(group[i]->computer_));
+        }
+        info.batcher->Run(computers, &batch_computer);
+        for (int32 i = begin; i < begin + this_batch_size; i++)
+          group[i]->GetPredictedWordEmbedding();
+      }
+    }
+  }
+  if (!info.opts.normalize_probs)
+    return;
+
+  for (int32 begin = 0; begin < num_states; begin += batch_size) {
+    int32 this_batch_size = std::min(batch_size, num_states - begin);
+    CuMatrix<BaseFloat> predicted_word_embeddings(this_batch_size,
+                                                  embedding_dim, kUndefined);
+    for (int32 i = 0; i < this_batch_size; i++)
+      predicted_word_embeddings.Row(i).CopyFromVec(
+          (*successors)[begin + i]->predicted_word_embedding_->Row(0));
+    CuMatrix<BaseFloat> probs(this_batch_size, num_words, kUndefined);
+    probs.AddMatMat(1.0, predicted_word_embeddings, kNoTrans,
+                    word_embedding_mat, kTrans, 0.0);
+    probs.ApplyExp();
+    // We excluding the <eps> symbol which is always 0.
+    CuVector<BaseFloat> log_sums(this_batch_size);
+    log_sums.AddColSumMat(1.0, probs.ColRange(1, num_words - 1), 0.0);
+    log_sums.ApplyLog();
+    Vector<BaseFloat> log_sums_cpu(log_sums);
+    for (int32 i = 0; i < this_batch_size; i++)
+      (*successors)[begin + i]->normalization_factor_ = log_sums_cpu(i);
+  }
+}
+
 void RnnlmComputeState::AddWord(int32 word_index) {
   KALDI_ASSERT(word_index > 0 && word_index < info_.word_embedding_mat.NumRows());
   previous_word_ = word_index;
@@ -143,18 +256,24 @@ void RnnlmComputeState::GetLogProbOfWords(CuMatrixBase<BaseFloat> *output) const
 }
 
 void RnnlmComputeState::AdvanceChunk() {
+  AcceptPreviousWord();
+  computer_.Run();
+  GetPredictedWordEmbedding();
+}
+
+void RnnlmComputeState::AcceptPreviousWord() {
   CuMatrix<BaseFloat> input_embeddings(1, info_.word_embedding_mat.NumCols());
   input_embeddings.Row(0).AddVec(1.0,
                                  info_.word_embedding_mat.Row(previous_word_));
   computer_.AcceptInput("input", &input_embeddings);
-  computer_.Run();
-  {
-    // Note: here GetOutput() is used instead of GetOutputDestructive(), since
-    // here we have recurrence that goes directly from the output, and the call
-    // to GetOutputDestructive() would cause a crash on the next chunk.
-    const CuMatrixBase<BaseFloat> &output(computer_.GetOutput("output"));
-    predicted_word_embedding_ = &output;
-  }
+}
+
+void RnnlmComputeState::GetPredictedWordEmbedding() {
+  // Note: here GetOutput() is used instead of GetOutputDestructive(), since
+  // here we have recurrence that goes directly from the output, and the call
+  // to GetOutputDestructive() would cause a crash on the next chunk.
+  const CuMatrixBase<BaseFloat> &output(computer_.GetOutput("output"));
+  predicted_word_embedding_ = &output;
 }
 
 } // namespace rnnlm
@@ -41,6 +41,8 @@ struct RnnlmComputeStateComputationOptions {
   int32 eos_index;
   // This is not needed for computation; included only for ease of scripting.
   int32 brk_index;
+  // The maximum number of states GetSuccessorStates() computes together.
+  int32 batch_size;
   nnet3::NnetOptimizeOptions optimize_config;
   nnet3::NnetComputeOptions compute_config;
   RnnlmComputeStateComputationOptions():
@@ -48,7 +50,8 @@ struct RnnlmComputeStateComputationOptions {
       normalize_probs(false),
       bos_index(-1),
       eos_index(-1),
-      brk_index(-1)
+      brk_index(-1),
+      batch_size(32)
       { }
 
   void Register(OptionsItf *opts) {
@@ -64,6 +67,11 @@ struct RnnlmComputeStateComputationOptions {
     opts->Register("brk-symbol", &brk_index, "Index in wordlist representing "
                    "the break symbol. It is not needed in the computation "
                    "and we are including it for ease of scripting");
+    opts->Register("batch-size", &batch_size, "The maximum number of RNNLM "
+                   "states that are computed together, in one nnet3 "
+                   "computation (and, if --normalize-probs=true, one matrix "
+                   "multiplication for the normalization factors); larger "
+                   "values are faster but use more memory.");
 
     // Register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -87,12 +95,25 @@ class RnnlmComputeStateInfo  {
       const kaldi::nnet3::Nnet &rnnlm,
       const CuMatrix<BaseFloat> &word_embedding_mat);
 
+  ~RnnlmComputeStateInfo() { delete batcher; }
+
   const RnnlmComputeStateComputationOptions &opts;
   const kaldi::nnet3::Nnet &rnnlm;
   const CuMatrix<BaseFloat> &word_embedding_mat;
 
   // The compiled, 'looped' computation.
   nnet3::NnetComputation computation;
+
+  // The same computation compiled for opts.batch_size sequences, used by
+  // RnnlmComputeState::GetSuccessorStates(); only set up if
+  // opts.batch_size > 1.
+  nnet3::NnetComputation batch_computation;
+  // Runs 'computation' for several states as 'batch_computation'; NULL if
+  // opts.batch_size <= 1 or if the two computations are not compatible.
+  nnet3::NnetComputerBatcher *batcher;
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmComputeStateInfo);
 };
 
 /*
@@ -113,6 +134,20 @@ class RnnlmComputeState {
   /// The pointer is owned by the caller.
   RnnlmComputeState* GetSuccessorState(int32 next_word) const;
 
+  /// Does the same as calling GetSuccessorState(next_words[i]) on states[i]
+  /// for each i, and putting the results in (*successors)[i], but computes
+  /// the new states together, in batches of up to opts.batch_size states:
+  /// the nnet3 computation is run once per batch, for all its states (see
+  /// class NnetComputerBatcher), and if opts.normalize_probs is true we do
+  /// one matrix-matrix multiplication by the word-embedding matrix per batch
+  /// rather than a matrix-vector multiplication per state.  The states must
+  /// all have the same RnnlmComputeStateInfo.  The pointers are owned by the
+  /// caller.
+  static void GetSuccessorStates(
+      const std::vector<const RnnlmComputeState*> &states,
+      const std::vector<int32> &next_words,
+      std::vector<RnnlmComputeState*> *successors);
+
   /// Return the log-prob that the model predicts for the provided word-index,
   /// given the previous history determined by the sequence of calls to AddWord()
   /// (implicitly starting with the BOS symbol).
@@ -129,6 +164,14 @@ class RnnlmComputeState {
   /// This function does the computation for the next chunk.
   void AdvanceChunk();
 
+  /// Gives the embedding of previous_word_ to computer_, as the input for
+  /// the next chunk; called by AdvanceChunk().
+  void AcceptPreviousWord();
+
+  /// Sets predicted_word_embedding_ after the computation for a chunk has
+  /// been run; called by AdvanceChunk().
+  void GetPredictedWordEmbedding();
+
   const RnnlmComputeStateInfo &info_;
   nnet3::NnetComputer computer_;
   int32 previous_word_;
@@ -36,6 +36,7 @@ KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
   state_to_rnnlm_state_.resize(0);
   state_to_wseq_.resize(0);
   wseq_to_state_.clear();
+  pending_states_.clear();
 }
 
 void KaldiRnnlmDeterministicFst::Clear() {
@@ -49,6 +50,39 @@ void KaldiRnnlmDeterministicFst::Clear() {
   state_to_wseq_.resize(1);
   wseq_to_state_.clear();
   wseq_to_state_[state_to_wseq_[0]] = 0;
+  pending_states_.clear();
+}
+
+void KaldiRnnlmDeterministicFst::ComputePendingStates() {
+  // A pending state's predecessor may itself be pending, so we may need more
+  // than one round; each round computes the states whose predecessors have
+  // already been computed.
+  while (!pending_states_.empty()) {
+    std::vector<const RnnlmComputeState*> predecessors;
+    std::vector<int32> words;
+    std::vector<StateId> states;
+    std::vector<PendingState> remaining;
+    for (size_t i = 0; i < pending_states_.size(); i++) {
+      const PendingState &pending = pending_states_[i];
+      const RnnlmComputeState *predecessor =
+          state_to_rnnlm_state_[pending.predecessor];
+      if (predecessor != NULL) {
+        predecessors.push_back(predecessor);
+        words.push_back(pending.word);
+        states.push_back(pending.state);
+      } else {
+        remaining.push_back(pending);
+      }
+    }
+    // Each state was created after its predecessor, so the first one always
+    // has a computed predecessor.
+    KALDI_ASSERT(!states.empty());
+    std::vector<RnnlmComputeState*> successors;
+    RnnlmComputeState::GetSuccessorStates(predecessors, words, &successors);
+    for (size_t i = 0; i < states.size(); i++)
+      state_to_rnnlm_state_[states[i]] = successors[i];
+    pending_states_.swap(remaining);
+  }
 }
 
 KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
@@ -71,6 +105,8 @@ fst::StdArc::Weight KaldiRnnlmDeterministicFst::Final(StateId s) {
   /// At this point, we have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
+  if (state_to_rnnlm_state_[s] == NULL)
+    ComputePendingStates();
   RnnlmComputeState* rnn = state_to_rnnlm_state_[s];
   return Weight(-rnn->LogProbOfWord(eos_index_));
 }
@@ -80,6 +116,8 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   /// At this point, we have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
+  if (state_to_rnnlm_state_[s] == NULL)
+    ComputePendingStates();
   std::vector<Label> word_seq = state_to_wseq_[s];
   const RnnlmComputeState* rnnlm = state_to_rnnlm_state_[s];
 
@@ -101,11 +139,12 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   typedef MapType::iterator IterType;
   std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
 
-  // If the pair was just inserted, then also add it to state_to_* structures.
+  // If the pair was just inserted, then also add it to state_to_* structures;
+  // its RNNLM state will be computed later, by ComputePendingStates().
   if (result.second == true) {
-    RnnlmComputeState *rnnlm2 = rnnlm->GetSuccessorState(ilabel);
+    pending_states_.push_back(PendingState(result.first->second, s, ilabel));
     state_to_wseq_.push_back(word_seq);
-    state_to_rnnlm_state_.push_back(rnnlm2);
+    state_to_rnnlm_state_.push_back(NULL);
   }
 
   // Creates the arc.
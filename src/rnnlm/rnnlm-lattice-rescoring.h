@@ -58,6 +58,20 @@ class KaldiRnnlmDeterministicFst
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
  private:
+  // Computes the RNNLM states of all the states in pending_states_, using
+  // RnnlmComputeState::GetSuccessorStates().
+  void ComputePendingStates();
+
+  // A state whose RNNLM state we have not computed yet; it is the successor
+  // of 'predecessor' with the word 'word'.
+  struct PendingState {
+    StateId state;
+    StateId predecessor;
+    Label word;
+    PendingState(StateId state, StateId predecessor, Label word):
+        state(state), predecessor(predecessor), word(word) { }
+  };
+
   typedef unordered_map
       <std::vector<Label>, StateId, VectorHasher<Label> > MapType;
   StateId start_state_;
@@ -71,9 +85,19 @@ class KaldiRnnlmDeterministicFst
   std::vector<std::vector<Label> > state_to_wseq_;
 
   // Mapping from state-id to RNNLM states.
-  // The pointers are owned in this class
+  // The pointers are owned in this class; they are NULL for the states in
+  // pending_states_.
   std::vector<RnnlmComputeState*> state_to_rnnlm_state_;
 
+  // GetArc() does not compute the RNNLM state of a new destination state
+  // straight away, but adds it to this list.  The first time GetArc() or
+  // Final() is called on one of these states, we compute all of them
+  // together, which is faster than computing them one by one (see
+  // RnnlmComputeState::GetSuccessorStates()).  With the pruned composition
+  // (ComposeCompactLatticePruned()) this list will typically hold all the new
+  // states reached by expanding the arcs of a lattice state.
+  std::vector<PendingState> pending_states_;
+
 };
 
 }  // namespace rnnlm
@@ -0,0 +1,79 @@
+// util/free-list-allocator-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/free-list-allocator.h"
+#include <set>
+
+namespace kaldi {
+
+struct TestObject {
+  float a;
+  int32 b;
+  TestObject *next;
+  TestObject(float a, int32 b, TestObject *next): a(a), b(b), next(next) { }
+};
+
+void TestFreeListAllocator() {
+  size_t block_size = 1 + Rand() % 20;
+  FreeListAllocator<TestObject> allocator(block_size);
+  std::vector<TestObject*> live;
+  std::set<TestObject*> live_set;
+  for (int32 i = 0; i < 2000; i++) {
+    if (live.empty() || Rand() % 3 != 0) {
+      TestObject *obj = new (allocator.New()) TestObject(i * 0.5, i, NULL);
+      // Make sure we never hand out the same memory twice.
+      KALDI_ASSERT(live_set.count(obj) == 0);
+      live_set.insert(obj);
+      live.push_back(obj);
+    } else {
+      size_t index = Rand() % live.size();
+      TestObject *obj = live[index];
+      KALDI_ASSERT(obj->a == obj->b * 0.5);
+      live[index] = live.back();
+      live.pop_back();
+      live_set.erase(obj);
+      allocator.Delete(obj);
+    }
+    KALDI_ASSERT(allocator.NumInUse() == live.size());
+    KALDI_ASSERT(allocator.NumAllocated() >= live.size());
+  }
+  for (size_t i = 0; i < live.size(); i++) {
+    KALDI_ASSERT(live[i]->a == live[i]->b * 0.5);
+    allocator.Delete(live[i]);
+  }
+  KALDI_ASSERT(allocator.NumInUse() == 0);
+
+  // Once the memory has been allocated, re-using the same number of objects
+  // should not need any more.
+  size_t num_allocated = allocator.NumAllocated();
+  live.clear();
+  for (size_t i = 0; i < num_allocated; i++)
+    live.push_back(new (allocator.New()) TestObject(0.0, 0, NULL));
+  KALDI_ASSERT(allocator.NumAllocated() == num_allocated);
+  for (size_t i = 0; i < live.size(); i++)
+    allocator.Delete(live[i]);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestFreeListAllocator();
+  KALDI_LOG << "Test OK.";
+}
@@ -0,0 +1,123 @@
+// util/free-list-allocator.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_FREE_LIST_ALLOCATOR_H_
+#define KALDI_UTIL_FREE_LIST_ALLOCATOR_H_
+#include <vector>
+#include <new>
+#include <type_traits>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a simple slab allocator for small, fixed-size objects
+   that are created and destroyed very frequently, such as the Tokens and
+   ForwardLinks of the lattice decoders.  Memory is obtained from the system
+   allocator in blocks of many objects and is never returned to it until the
+   allocator itself is destroyed; objects that are freed go onto a free list
+   and are reused by subsequent calls to New().  It is the same scheme that
+   HashList (hash-list.h) uses internally for its Elems.
+
+   The objects must be trivially destructible (their destructor is never
+   called).  New() returns uninitialized memory, so the usual idiom is
+   placement new, e.g.:
+     Token *tok = new (token_allocator.New()) Token(cost, 0.0, NULL, NULL);
+     ...
+     token_allocator.Delete(tok);
+
+   This class is not thread-safe; each decoder should have its own instance.
+*/
+
+
+namespace kaldi {
+
+template<class T> class FreeListAllocator {
+ public:
+  /// The block size is the number of objects we allocate at a time from the
+  /// system allocator.
+  explicit FreeListAllocator(size_t block_size = 1024):
+      block_size_(block_size), freed_head_(NULL), num_in_use_(0) {
+    KALDI_ASSERT(block_size > 0);
+  }
+
+  /// Returns uninitialized memory suitable for an object of type T.  Think of
+  /// this as operator new; use placement new to construct the object.
+  inline T *New() {
+    if (freed_head_ == NULL)
+      AllocateBlock();
+    Slot *ans = freed_head_;
+    freed_head_ = freed_head_->next;
+    num_in_use_++;
+    return reinterpret_cast<T*>(ans);
+  }
+
+  /// Returns the memory pointed to by "t" (which must have been obtained from
+  /// New() on this same object) to the free list.  The destructor of T is not
+  /// called.
+  inline void Delete(T *t) {
+    Slot *s = reinterpret_cast<Slot*>(t);
+    s->next = freed_head_;
+    freed_head_ = s;
+    num_in_use_--;
+  }
+
+  /// Returns the number of objects obtained from New() for which Delete() has
+  /// not yet been called.
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the total number of objects we have storage for, including the
+  /// ones on the free list.
+  size_t NumAllocated() const { return allocated_.size() * block_size_; }
+
+  ~FreeListAllocator() {
+    if (num_in_use_ != 0) {
+      KALDI_WARN << "Possible memory leak: " << num_in_use_
+                 << " objects were not returned to FreeListAllocator.";
+    }
+    for (size_t i = 0; i < allocated_.size(); i++)
+      delete [] allocated_[i];
+  }
+
+ private:
+  // A Slot is either a free-list entry or the storage for one object.
+  union Slot {
+    Slot *next;
+    typename std::aligned_storage<sizeof(T),
+                                  std::alignment_of<T>::value>::type data;
+  };
+
+  void AllocateBlock() {
+    Slot *block = new Slot[block_size_];
+    for (size_t i = 0; i + 1 < block_size_; i++)
+      block[i].next = block + i + 1;
+    block[block_size_ - 1].next = freed_head_;
+    freed_head_ = block;
+    allocated_.push_back(block);
+  }
+
+  size_t block_size_;
+  Slot *freed_head_;  // head of list of free slots.
+  size_t num_in_use_;
+  std::vector<Slot*> allocated_;  // list of allocated blocks.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(FreeListAllocator);
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_FREE_LIST_ALLOCATOR_H_
@@ -32,14 +32,36 @@ template<class I, class T> HashList<I, T>::HashList() {
   bucket_list_tail_ = static_cast<size_t>(-1);  // invalid.
   hash_size_ = 0;
   freed_head_ = NULL;
+  index_type_ = kHashListChained;
+  list_tail_ = NULL;
+  stamp_ = 1;
+  probe_shift_ = 64;
+  probe_count_ = 0;
 }
 
 template<class I, class T> void HashList<I, T>::SetSize(size_t size) {
   hash_size_ = size;
   KALDI_ASSERT(list_head_ == NULL &&
       bucket_list_tail_ == static_cast<size_t>(-1));  // make sure empty.
-  if (size > buckets_.size())
-    buckets_.resize(size, HashBucket(0, NULL));
+  if (index_type_ == kHashListChained) {
+    if (size > buckets_.size())
+      buckets_.resize(size, HashBucket(0, NULL));
+  } else if (index_type_ == kHashListProbing) {
+    if (size > index_.size())
+      ResizeProbeTable(size);
+  }
+}
+
+template<class I, class T>
+void HashList<I, T>::SetIndexType(HashListIndexType type) {
+  KALDI_ASSERT(list_head_ == NULL &&
+      bucket_list_tail_ == static_cast<size_t>(-1));  // make sure empty.
+  index_type_ = type;
+  index_.clear();
+  stamp_ = 1;
+  probe_count_ = 0;
+  if (type == kHashListProbing)
+    ResizeProbeTable(std::max<size_t>(hash_size_, 16));
 }
 
 template<class I, class T>
@@ -52,6 +74,16 @@ typename HashList<I, T>::Elem* HashList<I, T>::Clear() {
     buckets_[cur_bucket].last_elem = NULL;  // this is how we indicate "empty".
   }
   bucket_list_tail_ = static_cast<size_t>(-1);
+  if (index_type_ != kHashListChained) {
+    // Invalidate all entries of the index by changing the stamp.
+    if (++stamp_ == 0) {
+      for (size_t i = 0; i < index_.size(); i++)
+        index_[i].stamp = 0;
+      stamp_ = 1;
+    }
+    list_tail_ = NULL;
+    probe_count_ = 0;
+  }
   Elem *ans = list_head_;
   list_head_ = NULL;
   return ans;
@@ -70,6 +102,8 @@ inline void HashList<I, T>::Delete(Elem *e) {
 
 template<class I, class T>
 inline typename HashList<I, T>::Elem* HashList<I, T>::Find(I key) {
+  if (index_type_ != kHashListChained)
+    return FindInIndex(key);
   size_t index = (static_cast<size_t>(key) % hash_size_);
   HashBucket &bucket = buckets_[index];
   if (bucket.last_elem == NULL) {
@@ -124,6 +158,10 @@ HashList<I, T>::~HashList() {
 
 template<class I, class T>
 void HashList<I, T>::Insert(I key, T val) {
+  if (index_type_ != kHashListChained) {
+    InsertIntoIndex(key, val);
+    return;
+  }
   size_t index = (static_cast<size_t>(key) % hash_size_);
   HashBucket &bucket = buckets_[index];
   Elem *elem = New();
@@ -156,6 +194,10 @@ void HashList<I, T>::Insert(I key, T val) {
 
 template<class I, class T>
 void HashList<I, T>::InsertMore(I key, T val) {
+  if (index_type_ != kHashListChained) {
+    InsertMoreIntoIndex(key, val);
+    return;
+  }
   size_t index = (static_cast<size_t>(key) % hash_size_);
   HashBucket &bucket = buckets_[index];
   Elem *elem = New();
@@ -178,6 +220,103 @@ void HashList<I, T>::InsertMore(I key, T val) {
   e->tail = elem;
 }
 
+template<class I, class T>
+inline typename HashList<I, T>::Elem* HashList<I, T>::FindInIndex(I key) {
+  if (index_type_ == kHashListDirect) {
+    size_t k = static_cast<size_t>(key);
+    if (k < index_.size() && index_[k].stamp == stamp_)
+      return index_[k].elem;
+    return NULL;
+  } else {
+    size_t mask = index_.size() - 1;
+    for (size_t i = ProbeStart(key); index_[i].stamp == stamp_;
+         i = (i + 1) & mask)
+      if (index_[i].key == key) return index_[i].elem;
+    return NULL;  // reached an empty entry.
+  }
+}
+
+template<class I, class T>
+inline void HashList<I, T>::AddToIndex(Elem *elem) {
+  if (index_type_ == kHashListDirect) {
+    size_t k = static_cast<size_t>(elem->key);
+    if (k >= index_.size())
+      ResizeDirectIndex(k);
+    IndexEntry &entry = index_[k];
+    if (entry.stamp != stamp_) {
+      entry.elem = elem;
+      entry.stamp = stamp_;
+    }
+  } else {
+    size_t mask = index_.size() - 1, i = ProbeStart(elem->key);
+    for (; index_[i].stamp == stamp_; i = (i + 1) & mask)
+      if (index_[i].key == elem->key) return;  // already present.
+    IndexEntry &entry = index_[i];
+    entry.elem = elem;
+    entry.key = elem->key;
+    entry.stamp = stamp_;
+    probe_count_++;
+  }
+}
+
+template<class I, class T>
+inline void HashList<I, T>::InsertIntoIndex(I key, T val) {
+  // Keep the load factor of the probing hash table at most 1/2.
+  if (index_type_ == kHashListProbing && 2 * (probe_count_ + 1) > index_.size())
+    ResizeProbeTable(2 * index_.size());
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = NULL;
+  if (list_tail_ == NULL) {
+    KALDI_ASSERT(list_head_ == NULL);
+    list_head_ = elem;
+  } else {
+    list_tail_->tail = elem;
+  }
+  list_tail_ = elem;
+  AddToIndex(elem);
+}
+
+template<class I, class T>
+void HashList<I, T>::InsertMoreIntoIndex(I key, T val) {
+  Elem *e = FindInIndex(key);
+  KALDI_ASSERT(e != NULL);  // assume one element is already here
+  // Insert after the last element with this key.
+  while (e->tail != NULL && e->tail->key == key) e = e->tail;
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = e->tail;
+  e->tail = elem;
+  if (list_tail_ == e)
+    list_tail_ = elem;
+}
+
+template<class I, class T>
+void HashList<I, T>::ResizeProbeTable(size_t size) {
+  size_t new_size = 1;
+  int32 log_size = 0;
+  while (new_size < size) {
+    new_size *= 2;
+    log_size++;
+  }
+  index_.clear();
+  index_.resize(new_size);
+  stamp_ = 1;
+  probe_shift_ = 64 - log_size;
+  probe_count_ = 0;
+  for (Elem *e = list_head_; e != NULL; e = e->tail)
+    AddToIndex(e);
+}
+
+template<class I, class T>
+void HashList<I, T>::ResizeDirectIndex(size_t key) {
+  if (key >= static_cast<size_t>(std::numeric_limits<int32>::max()))
+    KALDI_ERR << "Key " << key << " is too large for a direct-indexed "
+              << "HashList (or it is negative).";
+  index_.resize(std::max(key + 1, 2 * index_.size()));
+}
 
 }  // end namespace kaldi
 
@@ -26,10 +26,11 @@
 
 namespace kaldi {
 
-template<class Int, class T> void TestHashList() {
+template<class Int, class T> void TestHashList(HashListIndexType type) {
   typedef typename HashList<Int, T>::Elem Elem;
 
   HashList<Int, T> hash;
+  hash.SetIndexType(type);
   hash.SetSize(200);  // must be called before use.
   std::map<Int, T> m1;
   for (size_t j = 0; j < 50; j++) {
@@ -84,6 +85,40 @@ template<class Int, class T> void TestHashList() {
 
     KALDI_ASSERT(m1.size() == count);
   }
+
+  // Test InsertMore(): all elements with the same key should follow each
+  // other in the list, and Find() should return the first of them.
+  Elem *h = hash.Clear(), *tmp;
+  for (; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
+  std::map<Int, size_t> counts;
+  for (size_t j = 0; j < 100; j++) {
+    Int key = Rand() % 100;
+    Elem *e = hash.Find(key);
+    if (e == NULL) {
+      hash.Insert(key, 0);
+    } else {
+      KALDI_ASSERT(e->val == 0);
+      hash.InsertMore(key, counts[key]);
+    }
+    counts[key]++;
+  }
+  size_t count = 0;
+  for (const Elem *e = hash.GetList(); e != NULL; e = e->tail) {
+    size_t num_same = 1;
+    for (; e->tail != NULL && e->tail->key == e->key; e = e->tail)
+      num_same++;
+    KALDI_ASSERT(num_same == counts[e->key]);
+    count += num_same;
+  }
+  KALDI_ASSERT(count == 100);
+  h = hash.Clear();
+  for (; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
 }
 
 
@@ -96,12 +131,18 @@ template<class Int, class T> void TestHashList() {
 int main() {
   using namespace kaldi;
   for (size_t i = 0;i < 3;i++) {
-    TestHashList<int, unsigned int>();
-    TestHashList<unsigned int, int>();
-    TestHashList<int16, int32>();
-    TestHashList<int16, int32>();
-    TestHashList<char, unsigned char>();
-    TestHashList<unsigned char, int>();
+    HashListIndexType types[] = { kHashListChained, kHashListProbing,
+                                  kHashListDirect };
+    for (size_t j = 0; j < 3; j++) {
+      HashListIndexType type = types[j];
+      TestHashList<int, unsigned int>(type);
+      TestHashList<unsigned int, int>(type);
+      TestHashList<int16, int32>(type);
+      TestHashList<int16, int32>(type);
+      TestHashList<unsigned char, int>(type);
+      if (type != kHashListDirect)  // the keys may be negative.
+        TestHashList<char, unsigned char>(type);
+    }
   }
   std::cout << "Test OK.\n";
 }
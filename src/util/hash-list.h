@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <limits>
 #include <cassert>
+#include <string>
 #include "util/stl-utils.h"
 
 
@@ -42,11 +43,45 @@
    to avoid repeated new's/deletes.
 
    See hash-list-test.cc for an example of how to use this object.
+
+   By default the hash is a chained hash whose buckets point into the list.
+   For decoding graphs whose state-ids are dense, it can be faster to look up
+   the elements in a different type of index; see SetIndexType() and
+   HashListIndexType.
 */
 
 
 namespace kaldi {
 
+/// This enum says how HashList finds the elements in the list.
+enum HashListIndexType {
+  /// A chained hash (the original implementation); the elements in the list
+  /// are grouped by hash bucket.  Uses the least memory.
+  kHashListChained,
+  /// A vector directly indexed by the key, each entry tagged with a stamp
+  /// that tells us whether it belongs to the current list (so that Clear()
+  /// does not have to touch the vector).  Only suitable for non-negative
+  /// integer keys that are not too large, e.g. the state-ids of an expanded
+  /// FST; it uses 16 bytes of memory per possible key.
+  kHashListDirect,
+  /// An open-addressing hash table with linear probing, whose entries are
+  /// tagged with stamps like those of kHashListDirect.  Uses more memory than
+  /// kHashListChained, but has fewer cache misses.
+  kHashListProbing
+};
+
+/// Converts the strings "chained", "direct" and "probing" to the
+/// corresponding HashListIndexType; returns false if the string was not one
+/// of those.
+inline bool HashListIndexTypeFromString(const std::string &str,
+                                        HashListIndexType *type) {
+  if (str == "chained") *type = kHashListChained;
+  else if (str == "direct") *type = kHashListDirect;
+  else if (str == "probing") *type = kHashListProbing;
+  else return false;
+  return true;
+}
+
 template<class I, class T> class HashList {
  public:
   struct Elem {
@@ -114,8 +149,45 @@ template<class I, class T> class HashList {
   /// Returns current number of hash buckets.
   inline size_t Size() { return hash_size_; }
 
+  /// Sets the type of index used to find elements (the default is
+  /// kHashListChained).  Like SetSize(), it must be called while the hash is
+  /// empty.  With kHashListDirect the keys must be non-negative integers and
+  /// SetSize() has no effect; the index grows as needed to cover the largest
+  /// key seen.  Note: except with kHashListChained, elements are kept in the
+  /// list in the order in which they were inserted.
+  void SetIndexType(HashListIndexType type);
+
+  HashListIndexType IndexType() const { return index_type_; }
+
   ~HashList();
  private:
+  // The following are used when index_type_ != kHashListChained.
+  inline Elem *FindInIndex(I key);
+  inline void InsertIntoIndex(I key, T val);
+  void InsertMoreIntoIndex(I key, T val);
+  // Adds 'elem' to the index (but not to the list); if an element with the
+  // same key is already in the index, does nothing.
+  inline void AddToIndex(Elem *elem);
+  // Returns the position in index_ where linear probing for 'key' starts.
+  inline size_t ProbeStart(I key) const {
+    return static_cast<size_t>((static_cast<uint64>(key) *
+                                static_cast<uint64>(11400714819323198485ULL))
+                               >> probe_shift_);
+  }
+  // Sets the size of the probing hash table to a power of two that is at
+  // least 'size', and re-adds the elements in the list to it.
+  void ResizeProbeTable(size_t size);
+  // Grows the direct index so that it covers 'key'.
+  void ResizeDirectIndex(size_t key);
+
+  // An entry of the direct index or the probing hash table.  It is only valid
+  // if stamp == stamp_.  'key' is only used with kHashListProbing.
+  struct IndexEntry {
+    Elem *elem;
+    uint32 stamp;
+    I key;
+    inline IndexEntry(): elem(NULL), stamp(0), key() { }
+  };
 
   struct HashBucket {
     size_t prev_bucket;  // index to next bucket (-1 if list tail).  Note:
@@ -136,6 +208,14 @@ template<class I, class T> class HashList {
 
   std::vector<Elem*> allocated_;  // list of allocated blocks.
 
+  HashListIndexType index_type_;
+  Elem *list_tail_;  // tail of currently stored list; only maintained if
+                     // index_type_ != kHashListChained.
+  std::vector<IndexEntry> index_;  // direct index or probing hash table.
+  uint32 stamp_;  // incremented by Clear(); the stamp of valid entries.
+  int32 probe_shift_;  // 64 - log2(index_.size()), for kHashListProbing.
+  size_t probe_count_;  // number of valid entries, for kHashListProbing.
+
   static const size_t allocate_block_size_ = 1024;  // Number of Elements to
   // allocate in one block.  Must be largish so storing allocated_ doesn't
   // become a problem.
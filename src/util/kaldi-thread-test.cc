@@ -123,6 +123,28 @@ void TestTaskSequencer() {
 }
 
 
+void TestThreadTeam() {
+  int32 num_threads = 1 + Rand() % 8;
+  ThreadTeam team(num_threads);
+  KALDI_ASSERT(team.NumThreads() == num_threads);
+  std::vector<int64> sums(num_threads);
+  for (int32 job = 0; job < 100; job++) {
+    int32 max_to_count = Rand() % 10000;
+    // Each thread sums up its part of the integers from 0 to max_to_count-1.
+    team.Run([&](int32 thread_id) {
+        int64 sum = 0;
+        for (int32 j = thread_id; j < max_to_count; j += num_threads)
+          sum += j;
+        sums[thread_id] = sum;
+      });
+    int64 tot = 0;
+    for (int32 i = 0; i < num_threads; i++)
+      tot += sums[i];
+    KALDI_ASSERT(tot == (static_cast<int64>(max_to_count) *
+                         (max_to_count - 1)) / 2);
+  }
+}
+
 }  // end namespace kaldi.
 
 int main() {
@@ -130,4 +152,6 @@ int main() {
   TestThreads();
   for (int32 i = 0; i < 1000; i++)
     TestTaskSequencer();
+  for (int32 i = 0; i < 10; i++)
+    TestThreadTeam();
 }
@@ -29,5 +29,64 @@ MultiThreadable::~MultiThreadable() {
 }
 
 
+ThreadTeam::ThreadTeam(int32 num_threads):
+    num_threads_(num_threads), func_(NULL), job_index_(0), num_running_(0),
+    exit_(false) {
+  KALDI_ASSERT(num_threads >= 1);
+  for (int32 i = 1; i < num_threads; i++)
+    threads_.push_back(std::thread(&ThreadTeam::ThreadLoop, this, i));
+}
+
+void ThreadTeam::Run(const std::function<void(int32)> &func) {
+  if (num_threads_ > 1) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    KALDI_ASSERT(num_running_ == 0 && "ThreadTeam::Run() is not reentrant.");
+    func_ = &func;
+    num_running_ = num_threads_ - 1;
+    job_index_++;
+    start_condition_.notify_all();
+  }
+  func(0);
+  if (num_threads_ > 1) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_running_ != 0)
+      done_condition_.wait(lock);
+    func_ = NULL;
+  }
+}
+
+void ThreadTeam::ThreadLoop(int32 thread_id) {
+  int64 last_job_index = 0;
+  while (true) {
+    const std::function<void(int32)> *func;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!exit_ && job_index_ == last_job_index)
+        start_condition_.wait(lock);
+      if (exit_)
+        return;
+      last_job_index = job_index_;
+      func = func_;
+    }
+    (*func)(thread_id);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (--num_running_ == 0)
+        done_condition_.notify_one();
+    }
+  }
+}
+
+ThreadTeam::~ThreadTeam() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    exit_ = true;
+    start_condition_.notify_all();
+  }
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+}
+
+
 
 }  // end namespace kaldi
@@ -22,6 +22,9 @@
 #ifndef KALDI_THREAD_KALDI_THREAD_H_
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
@@ -52,6 +55,11 @@
 // destructor to have side effects such as outputting data.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
+//
+// The class ThreadTeam is for code that needs to split up a lot of small jobs
+// between threads, e.g. once for each frame in a decoder, where the time taken
+// to create threads for each job (as MultiThreader does) would be too much.
+// It keeps a fixed set of threads that wait for work between jobs.
 
 
 namespace kaldi {
@@ -152,6 +160,56 @@ template<class C> void RunMultiThreaded(const C &c_in) {
 }
 
 
+/// ThreadTeam runs a function in a fixed number of threads at once, and waits
+/// for them all to finish; it is intended to be called many times per second
+/// (e.g. once per frame in a decoder).  The threads are created by the
+/// constructor, wait for work between calls to Run(), and are joined by the
+/// destructor.  Example:
+/// \code
+///   ThreadTeam team(4);
+///   std::vector<double> sums(team.NumThreads());
+///   team.Run([&](int32 thread_id) { sums[thread_id] = SumOfPart(thread_id); });
+/// \endcode
+class ThreadTeam {
+ public:
+  /// Creates num_threads - 1 threads; the thread that calls Run() makes up the
+  /// rest of the team.  num_threads must be >= 1.
+  explicit ThreadTeam(int32 num_threads);
+
+  int32 NumThreads() const { return num_threads_; }
+
+  /// Calls func(thread_id) for each 0 <= thread_id < NumThreads() in
+  /// parallel, and returns when all of these calls have returned.  The call
+  /// with thread_id == 0 is made in the calling thread.  'func' should not
+  /// throw (an exception in one of the other threads would terminate the
+  /// program).  Run() must not be called from more than one thread at a time.
+  void Run(const std::function<void(int32)> &func);
+
+  /// Waits for the threads to exit.
+  ~ThreadTeam();
+
+ private:
+  // This is what the threads other than the calling thread run.
+  void ThreadLoop(int32 thread_id);
+
+  int32 num_threads_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable start_condition_;  // notified when a job starts.
+  std::condition_variable done_condition_;  // notified when the last thread
+                                            // finishes its part of a job.
+  // The following are protected by mutex_.
+  const std::function<void(int32)> *func_;  // the current job.
+  int64 job_index_;  // incremented for each job.
+  int32 num_running_;  // number of threads still running the current job,
+                       // not counting the calling thread.
+  bool exit_;  // set by the destructor.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadTeam);
+};
+
+
 struct TaskSequencerConfig {
   int32 num_threads;
   int32 num_threads_total;